@@ -26,6 +26,8 @@ GTEST_DEX_DIRECTORIES := \
   AbstractMethod \
   AllFields \
   DefaultMethods \
+  DexDiffA \
+  DexDiffB \
   DexToDexDecompiler \
   ErroneousA \
   ErroneousB \
@@ -54,6 +56,7 @@ GTEST_DEX_DIRECTORIES := \
   MyClassNatives \
   Nested \
   NonStaticLeafMethods \
+  OpaquePredicates \
   Packages \
   ProtoCompare \
   ProtoCompare2 \
@@ -154,9 +157,11 @@ ART_GTEST_atomic_dex_ref_map_test_DEX_DEPS := Interfaces
 ART_GTEST_class_linker_test_DEX_DEPS := AllFields ErroneousA ErroneousB ErroneousInit ForClassLoaderA ForClassLoaderB ForClassLoaderC ForClassLoaderD Interfaces MethodTypes MultiDex MyClass Nested Statics StaticsFromCode
 ART_GTEST_class_loader_context_test_DEX_DEPS := Main MultiDex MyClass ForClassLoaderA ForClassLoaderB ForClassLoaderC ForClassLoaderD
 ART_GTEST_class_table_test_DEX_DEPS := XandY
+ART_GTEST_compiled_method_cache_test_DEX_DEPS := StaticLeafMethods
 ART_GTEST_compiler_driver_test_DEX_DEPS := AbstractMethod StaticLeafMethods ProfileTestMultiDex
 ART_GTEST_dex_cache_test_DEX_DEPS := Main Packages MethodTypes
-ART_GTEST_dexlayout_test_DEX_DEPS := ManyMethods
+ART_GTEST_dexdump_test_DEX_DEPS := DexDiffA DexDiffB
+ART_GTEST_dexlayout_test_DEX_DEPS := ManyMethods MultiDex
 ART_GTEST_dex2oat_test_DEX_DEPS := $(ART_GTEST_dex2oat_environment_tests_DEX_DEPS) ManyMethods Statics VerifierDeps MainUncompressed EmptyUncompressed
 ART_GTEST_dex2oat_image_test_DEX_DEPS := $(ART_GTEST_dex2oat_environment_tests_DEX_DEPS) Statics VerifierDeps
 ART_GTEST_exception_test_DEX_DEPS := ExceptionHandle
@@ -179,6 +184,7 @@ ART_GTEST_proxy_test_DEX_DEPS := Interfaces
 ART_GTEST_reflection_test_DEX_DEPS := Main NonStaticLeafMethods StaticLeafMethods
 ART_GTEST_profile_assistant_test_DEX_DEPS := ProfileTestMultiDex
 ART_GTEST_profile_compilation_info_test_DEX_DEPS := ManyMethods ProfileTestMultiDex
+ART_GTEST_veridex_test_DEX_DEPS := OpaquePredicates
 ART_GTEST_runtime_callbacks_test_DEX_DEPS := XandY
 ART_GTEST_stub_test_DEX_DEPS := AllFields
 ART_GTEST_transaction_test_DEX_DEPS := Transaction
@@ -329,6 +335,11 @@ ART_GTEST_hiddenapi_test_HOST_DEPS := \
   $(HOST_CORE_IMAGE_DEFAULT_32) \
   hiddenapid-host
 
+ART_GTEST_veridex_test_HOST_DEPS := \
+  $(HOST_CORE_IMAGE_DEFAULT_64) \
+  $(HOST_CORE_IMAGE_DEFAULT_32) \
+  veridex-host
+
 # The path for which all the source files are relative, not actually the current directory.
 LOCAL_PATH := art
 
@@ -352,6 +363,7 @@ ART_TEST_MODULES := \
     art_runtime_tests \
     art_runtime_compiler_tests \
     art_sigchain_tests \
+    art_veridex_tests \
 
 ART_TARGET_GTEST_FILES := $(foreach m,$(ART_TEST_MODULES),\
     $(ART_TEST_LIST_device_$(TARGET_ARCH)_$(m)))
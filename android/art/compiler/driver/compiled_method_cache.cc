@@ -0,0 +1,822 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "compiled_method_cache.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <ostream>
+#include <type_traits>
+
+#include "android-base/stringprintf.h"
+#include "android-base/strings.h"
+
+#include "arch/instruction_set_features.h"
+#include "art_method-inl.h"
+#include "base/dumpable.h"
+#include "base/os.h"
+#include "base/unix_file/fd_file.h"
+#include "base/utils.h"
+#include "class_linker.h"
+#include "class_status.h"
+#include "compiled_method.h"
+#include "dex/class_reference.h"
+#include "dex/code_item_accessors-inl.h"
+#include "dex/dex_file-inl.h"
+#include "dex/dex_file_exception_helpers.h"
+#include "dex/dex_instruction-inl.h"
+#include "dex/verified_method.h"
+#include "driver/compiler_driver.h"
+#include "driver/compiler_options.h"
+#include "gc/heap.h"
+#include "gc/space/image_space.h"
+#include "linker/linker_patch.h"
+#include "runtime.h"
+
+namespace art {
+
+namespace {
+
+constexpr uint8_t kMagic[] = { 'c', 'm', 'c', '\n' };
+// Bump when the entry format or the meaning of the key changes.
+constexpr uint32_t kVersion = 2u;
+
+// Two independently mixed 64-bit lanes, so that accidental collisions between the keys of
+// different methods are negligible even for very large caches.
+class KeyHasher {
+ public:
+  KeyHasher() : lo_(UINT64_C(0xcbf29ce484222325)), hi_(UINT64_C(0x84222325cbf29ce4)) {}
+
+  void Update(const void* data, size_t size) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+    for (size_t i = 0; i != size; ++i) {
+      lo_ = (lo_ ^ bytes[i]) * UINT64_C(0x100000001b3);
+      hi_ = RotateLeft64((hi_ ^ bytes[i]) * UINT64_C(0x9e3779b97f4a7c15), 27);
+    }
+  }
+
+  template <typename T>
+  void UpdateValue(T value) {
+    static_assert(std::is_integral<T>::value || std::is_enum<T>::value, "Use Update()");
+    Update(&value, sizeof(value));
+  }
+
+  void UpdateString(const char* str) {
+    size_t length = strlen(str);
+    UpdateValue(length);
+    Update(str, length);
+  }
+
+  void UpdateKey(const CompiledMethodCache::Key& key) {
+    UpdateValue(key.lo);
+    UpdateValue(key.hi);
+  }
+
+  CompiledMethodCache::Key Finish() const {
+    return CompiledMethodCache::Key { Mix(lo_ ^ RotateLeft64(hi_, 32)), Mix(hi_) };
+  }
+
+ private:
+  static uint64_t RotateLeft64(uint64_t value, int shift) {
+    return (value << shift) | (value >> (64 - shift));
+  }
+
+  // Finalizer of MurmurHash3.
+  static uint64_t Mix(uint64_t value) {
+    value ^= value >> 33;
+    value *= UINT64_C(0xff51afd7ed558ccd);
+    value ^= value >> 33;
+    value *= UINT64_C(0xc4ceb9fe1a85ec53);
+    value ^= value >> 33;
+    return value;
+  }
+
+  uint64_t lo_;
+  uint64_t hi_;
+};
+
+uint64_t HashString(const char* str) {
+  KeyHasher hasher;
+  hasher.UpdateString(str);
+  return hasher.Finish().lo;
+}
+
+void HashMethodId(KeyHasher* hasher, const DexFile& dex_file, uint32_t method_idx) {
+  const DexFile::MethodId& method_id = dex_file.GetMethodId(method_idx);
+  hasher->UpdateString(dex_file.GetMethodDeclaringClassDescriptor(method_id));
+  hasher->UpdateString(dex_file.GetMethodName(method_id));
+  hasher->UpdateString(dex_file.GetMethodSignature(method_id).ToString().c_str());
+}
+
+void HashFieldId(KeyHasher* hasher, const DexFile& dex_file, uint32_t field_idx) {
+  const DexFile::FieldId& field_id = dex_file.GetFieldId(field_idx);
+  hasher->UpdateString(dex_file.GetFieldDeclaringClassDescriptor(field_id));
+  hasher->UpdateString(dex_file.GetFieldName(field_id));
+  hasher->UpdateString(dex_file.GetFieldTypeDescriptor(field_id));
+}
+
+// Hash the symbol referenced by the index operand of `inst`, if any. Returns false for
+// references we do not know how to key.
+bool HashInstructionReference(KeyHasher* hasher, const DexFile& dex_file, const Instruction& inst) {
+  Instruction::IndexType index_type = Instruction::IndexTypeOf(inst.Opcode());
+  if (index_type == Instruction::kIndexNone) {
+    return true;
+  }
+  uint32_t index = (Instruction::FormatOf(inst.Opcode()) == Instruction::k22c)
+      ? inst.VRegC()
+      : inst.VRegB();
+  switch (index_type) {
+    case Instruction::kIndexTypeRef:
+      hasher->UpdateString(dex_file.StringByTypeIdx(dex::TypeIndex(index)));
+      return true;
+    case Instruction::kIndexStringRef:
+      hasher->UpdateString(dex_file.StringDataByIdx(dex::StringIndex(index)));
+      return true;
+    case Instruction::kIndexMethodRef:
+      HashMethodId(hasher, dex_file, index);
+      return true;
+    case Instruction::kIndexFieldRef:
+      HashFieldId(hasher, dex_file, index);
+      return true;
+    case Instruction::kIndexMethodAndProtoRef:
+      HashMethodId(hasher, dex_file, index);
+      hasher->UpdateString(
+          dex_file.GetProtoSignature(dex_file.GetProtoId(inst.VRegH())).ToString().c_str());
+      return true;
+    default:
+      // Call sites, method handles, protos and quickened offsets.
+      return false;
+  }
+}
+
+// Digest of a method's code that is independent of where its dex file is loaded.
+bool HashMethod(KeyHasher* hasher,
+                const DexFile& dex_file,
+                uint32_t method_idx,
+                const DexFile::CodeItem* code_item) {
+  hasher->UpdateValue(method_idx);
+  HashMethodId(hasher, dex_file, method_idx);
+  CodeItemDataAccessor accessor(dex_file, code_item);
+  hasher->UpdateValue(accessor.RegistersSize());
+  hasher->UpdateValue(accessor.InsSize());
+  hasher->UpdateValue(accessor.OutsSize());
+  hasher->UpdateValue(accessor.InsnsSizeInCodeUnits());
+  hasher->Update(accessor.Insns(), accessor.InsnsSizeInCodeUnits() * sizeof(uint16_t));
+  hasher->UpdateValue(accessor.TriesSize());
+  for (const DexFile::TryItem& try_item : accessor.TryItems()) {
+    hasher->UpdateValue(try_item.start_addr_);
+    hasher->UpdateValue(try_item.insn_count_);
+    for (CatchHandlerIterator it(accessor, try_item); it.HasNext(); it.Next()) {
+      dex::TypeIndex type_idx = it.GetHandlerTypeIndex();
+      hasher->UpdateValue(type_idx.index_);
+      hasher->UpdateString(type_idx.IsValid() ? dex_file.StringByTypeIdx(type_idx) : "");
+      hasher->UpdateValue(it.GetHandlerAddress());
+    }
+  }
+  for (const DexInstructionPcPair& inst : accessor) {
+    if (!HashInstructionReference(hasher, dex_file, inst.Inst())) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Digest of the class structure of a dex file: everything that determines class layout,
+// vtables and the class hierarchy, but none of the code.
+void HashDexFileStructure(KeyHasher* hasher, const DexFile& dex_file) {
+  hasher->UpdateValue(dex_file.NumClassDefs());
+  for (uint32_t i = 0; i != dex_file.NumClassDefs(); ++i) {
+    const DexFile::ClassDef& class_def = dex_file.GetClassDef(i);
+    hasher->UpdateString(dex_file.GetClassDescriptor(class_def));
+    hasher->UpdateValue(class_def.access_flags_);
+    hasher->UpdateString(class_def.superclass_idx_.IsValid()
+                             ? dex_file.StringByTypeIdx(class_def.superclass_idx_)
+                             : "");
+    const DexFile::TypeList* interfaces = dex_file.GetInterfacesList(class_def);
+    if (interfaces != nullptr) {
+      for (uint32_t j = 0; j != interfaces->Size(); ++j) {
+        hasher->UpdateString(dex_file.StringByTypeIdx(interfaces->GetTypeItem(j).type_idx_));
+      }
+    }
+    const uint8_t* class_data = dex_file.GetClassData(class_def);
+    if (class_data == nullptr) {
+      continue;
+    }
+    for (ClassDataItemIterator it(dex_file, class_data); it.HasNext(); it.Next()) {
+      hasher->UpdateValue(it.GetRawMemberAccessFlags());
+      if (it.IsAtMethod()) {
+        HashMethodId(hasher, dex_file, it.GetMemberIndex());
+      } else {
+        HashFieldId(hasher, dex_file, it.GetMemberIndex());
+      }
+    }
+  }
+}
+
+void HashCompilerOptions(KeyHasher* hasher, const CompilerOptions& options) {
+  hasher->UpdateValue(options.GetCompilerFilter());
+  hasher->UpdateValue(options.GetHugeMethodThreshold());
+  hasher->UpdateValue(options.GetLargeMethodThreshold());
+  hasher->UpdateValue(options.GetSmallMethodThreshold());
+  hasher->UpdateValue(options.GetTinyMethodThreshold());
+  hasher->UpdateValue(options.GetNumDexMethodsThreshold());
+  hasher->UpdateValue(options.GetInlineMaxCodeUnits());
+  hasher->UpdateValue(options.GetDebuggable());
+  hasher->UpdateValue(options.GetNativeDebuggable());
+  hasher->UpdateValue(options.GetGenerateDebugInfo());
+  hasher->UpdateValue(options.GetGenerateMiniDebugInfo());
+  hasher->UpdateValue(options.GetImplicitNullChecks());
+  hasher->UpdateValue(options.GetImplicitStackOverflowChecks());
+  hasher->UpdateValue(options.GetImplicitSuspendChecks());
+  hasher->UpdateValue(options.GetCompilePic());
+  hasher->UpdateValue(options.CountHotnessInCompiledCode());
+  hasher->UpdateValue(options.GetRegisterAllocationStrategy());
+  const std::vector<const DexFile*>* no_inline_from = options.GetNoInlineFromDexFile();
+  hasher->UpdateValue(no_inline_from != nullptr);
+  if (no_inline_from != nullptr) {
+    hasher->UpdateValue(no_inline_from->size());
+    for (const DexFile* dex_file : *no_inline_from) {
+      hasher->UpdateString(dex_file->GetLocation().c_str());
+      hasher->UpdateValue(dex_file->GetLocationChecksum());
+    }
+  }
+  if (options.GetPassesToRun() != nullptr) {
+    for (const std::string& pass : *options.GetPassesToRun()) {
+      hasher->UpdateString(pass.c_str());
+    }
+  }
+}
+
+template <typename T>
+void Append(std::vector<uint8_t>* buffer, const T& value) {
+  static_assert(std::is_trivially_copyable<T>::value, "Not trivially copyable");
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+  buffer->insert(buffer->end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+void AppendArray(std::vector<uint8_t>* buffer, ArrayRef<const T> array) {
+  Append(buffer, static_cast<uint32_t>(array.size()));
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(array.data());
+  buffer->insert(buffer->end(), bytes, bytes + array.size() * sizeof(T));
+}
+
+class EntryReader {
+ public:
+  explicit EntryReader(ArrayRef<const uint8_t> data) : data_(data), pos_(0u) {}
+
+  template <typename T>
+  bool Read(T* value) {
+    if (data_.size() - pos_ < sizeof(T)) {
+      return false;
+    }
+    memcpy(value, data_.data() + pos_, sizeof(T));
+    pos_ += sizeof(T);
+    return true;
+  }
+
+  bool ReadArray(ArrayRef<const uint8_t>* array) {
+    uint32_t size;
+    if (!Read(&size) || data_.size() - pos_ < size) {
+      return false;
+    }
+    *array = data_.SubArray(pos_, size);
+    pos_ += size;
+    return true;
+  }
+
+  bool IsAtEnd() const {
+    return pos_ == data_.size();
+  }
+
+ private:
+  const ArrayRef<const uint8_t> data_;
+  size_t pos_;
+};
+
+struct PatchRecord {
+  uint32_t literal_offset;
+  uint32_t type;
+  uint32_t value1;  // Target index or first Baker custom value.
+  uint32_t value2;  // PC insn offset or second Baker custom value.
+  uint64_t symbol;  // Hash of the symbol referenced by the target index.
+};
+
+struct DependencyRecord {
+  uint32_t dex_file_index;
+  uint32_t method_idx;
+  uint32_t class_status;  // Status of the declaring class as recorded by the driver.
+  uint32_t padding;
+  uint64_t digest;
+};
+
+// Hash of the symbol a patch refers to in `dex_file`, or 0 if the index is out of range.
+uint64_t GetPatchSymbol(const DexFile& dex_file, linker::LinkerPatch::Type type, uint32_t index) {
+  switch (type) {
+    case linker::LinkerPatch::Type::kMethodRelative:
+    case linker::LinkerPatch::Type::kMethodBssEntry:
+    case linker::LinkerPatch::Type::kCall:
+    case linker::LinkerPatch::Type::kCallRelative: {
+      if (index >= dex_file.NumMethodIds()) {
+        return 0u;
+      }
+      KeyHasher hasher;
+      HashMethodId(&hasher, dex_file, index);
+      return hasher.Finish().lo;
+    }
+    case linker::LinkerPatch::Type::kTypeRelative:
+    case linker::LinkerPatch::Type::kTypeClassTable:
+    case linker::LinkerPatch::Type::kTypeBssEntry:
+      return (index < dex_file.NumTypeIds())
+          ? HashString(dex_file.StringByTypeIdx(dex::TypeIndex(index)))
+          : 0u;
+    case linker::LinkerPatch::Type::kStringRelative:
+    case linker::LinkerPatch::Type::kStringInternTable:
+    case linker::LinkerPatch::Type::kStringBssEntry:
+      return (index < dex_file.NumStringIds())
+          ? HashString(dex_file.StringDataByIdx(dex::StringIndex(index)))
+          : 0u;
+    case linker::LinkerPatch::Type::kBakerReadBarrierBranch:
+      return 0u;
+  }
+  LOG(FATAL) << "Unexpected patch type " << static_cast<uint32_t>(type);
+  UNREACHABLE();
+}
+
+bool EncodePatch(const linker::LinkerPatch& patch, const DexFile& dex_file, PatchRecord* record) {
+  using Type = linker::LinkerPatch::Type;
+  record->literal_offset = patch.LiteralOffset();
+  record->type = static_cast<uint32_t>(patch.GetType());
+  const DexFile* target_dex_file;
+  switch (patch.GetType()) {
+    case Type::kMethodRelative:
+    case Type::kMethodBssEntry:
+      record->value2 = patch.PcInsnOffset();
+      FALLTHROUGH_INTENDED;
+    case Type::kCall:
+    case Type::kCallRelative:
+      target_dex_file = patch.TargetMethod().dex_file;
+      record->value1 = patch.TargetMethod().index;
+      break;
+    case Type::kTypeRelative:
+    case Type::kTypeClassTable:
+    case Type::kTypeBssEntry:
+      target_dex_file = patch.TargetTypeDexFile();
+      record->value1 = patch.TargetTypeIndex().index_;
+      record->value2 = patch.PcInsnOffset();
+      break;
+    case Type::kStringRelative:
+    case Type::kStringInternTable:
+    case Type::kStringBssEntry:
+      target_dex_file = patch.TargetStringDexFile();
+      record->value1 = patch.TargetStringIndex().index_;
+      record->value2 = patch.PcInsnOffset();
+      break;
+    case Type::kBakerReadBarrierBranch:
+      record->value1 = patch.GetBakerCustomValue1();
+      record->value2 = patch.GetBakerCustomValue2();
+      record->symbol = 0u;
+      return true;
+  }
+  // Only patches into the method's own dex file can be rebased onto a new compilation.
+  if (target_dex_file != &dex_file) {
+    return false;
+  }
+  record->symbol = GetPatchSymbol(dex_file, patch.GetType(), record->value1);
+  return true;
+}
+
+bool DecodePatch(const PatchRecord& record, const DexFile& dex_file, linker::LinkerPatch* patch) {
+  using Type = linker::LinkerPatch::Type;
+  if (record.type > static_cast<uint32_t>(Type::kBakerReadBarrierBranch)) {
+    return false;
+  }
+  Type type = static_cast<Type>(record.type);
+  if (GetPatchSymbol(dex_file, type, record.value1) != record.symbol) {
+    return false;
+  }
+  switch (type) {
+    case Type::kMethodRelative:
+      *patch = linker::LinkerPatch::RelativeMethodPatch(
+          record.literal_offset, &dex_file, record.value2, record.value1);
+      break;
+    case Type::kMethodBssEntry:
+      *patch = linker::LinkerPatch::MethodBssEntryPatch(
+          record.literal_offset, &dex_file, record.value2, record.value1);
+      break;
+    case Type::kCall:
+      *patch = linker::LinkerPatch::CodePatch(record.literal_offset, &dex_file, record.value1);
+      break;
+    case Type::kCallRelative:
+      *patch = linker::LinkerPatch::RelativeCodePatch(
+          record.literal_offset, &dex_file, record.value1);
+      break;
+    case Type::kTypeRelative:
+      *patch = linker::LinkerPatch::RelativeTypePatch(
+          record.literal_offset, &dex_file, record.value2, record.value1);
+      break;
+    case Type::kTypeClassTable:
+      *patch = linker::LinkerPatch::TypeClassTablePatch(
+          record.literal_offset, &dex_file, record.value2, record.value1);
+      break;
+    case Type::kTypeBssEntry:
+      *patch = linker::LinkerPatch::TypeBssEntryPatch(
+          record.literal_offset, &dex_file, record.value2, record.value1);
+      break;
+    case Type::kStringRelative:
+      *patch = linker::LinkerPatch::RelativeStringPatch(
+          record.literal_offset, &dex_file, record.value2, record.value1);
+      break;
+    case Type::kStringInternTable:
+      *patch = linker::LinkerPatch::StringInternTablePatch(
+          record.literal_offset, &dex_file, record.value2, record.value1);
+      break;
+    case Type::kStringBssEntry:
+      *patch = linker::LinkerPatch::StringBssEntryPatch(
+          record.literal_offset, &dex_file, record.value2, record.value1);
+      break;
+    case Type::kBakerReadBarrierBranch:
+      *patch = linker::LinkerPatch::BakerReadBarrierBranchPatch(
+          record.literal_offset, record.value1, record.value2);
+      break;
+  }
+  return true;
+}
+
+const DexFile::CodeItem* FindCodeItem(const DexFile& dex_file,
+                                     const DexFile::ClassDef& class_def,
+                                     uint32_t method_idx) {
+  const uint8_t* class_data = dex_file.GetClassData(class_def);
+  if (class_data == nullptr) {
+    return nullptr;
+  }
+  ClassDataItemIterator it(dex_file, class_data);
+  it.SkipAllFields();
+  for (; it.HasNextMethod(); it.Next()) {
+    if (it.GetMemberIndex() == method_idx) {
+      return it.GetMethodCodeItem();
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace
+
+std::unique_ptr<CompiledMethodCache> CompiledMethodCache::Create(
+    const std::string& directory,
+    CompilerDriver* driver,
+    const std::vector<const DexFile*>& classpath_dex_files,
+    std::string* error_msg) {
+  const CompilerOptions& options = driver->GetCompilerOptions();
+  if (options.IsBootImage() || options.IsAppImage()) {
+    // Image compilation depends on the classes initialized at compile time.
+    *error_msg = "Compiled method cache not supported when compiling an image";
+    return nullptr;
+  }
+  if (driver->GetProfileCompilationInfo() != nullptr) {
+    // Inlining depends on the inline caches recorded in the profile.
+    *error_msg = "Compiled method cache not supported when compiling with a profile";
+    return nullptr;
+  }
+  if (!OS::DirectoryExists(directory.c_str())) {
+    *error_msg = "Compiled method cache directory does not exist: " + directory;
+    return nullptr;
+  }
+
+  KeyHasher hasher;
+  hasher.Update(kMagic, sizeof(kMagic));
+  hasher.UpdateValue(kVersion);
+  hasher.UpdateValue(driver->GetInstructionSet());
+  hasher.UpdateString(driver->GetInstructionSetFeatures()->GetFeatureString().c_str());
+  HashCompilerOptions(&hasher, options);
+  Runtime* runtime = Runtime::Current();
+  for (gc::space::ImageSpace* space : runtime->GetHeap()->GetBootImageSpaces()) {
+    hasher.UpdateValue(space->GetImageHeader().GetOatChecksum());
+  }
+  for (const DexFile* dex_file : runtime->GetClassLinker()->GetBootClassPath()) {
+    hasher.UpdateValue(dex_file->GetLocationChecksum());
+  }
+  for (const DexFile* dex_file : classpath_dex_files) {
+    hasher.UpdateValue(dex_file->GetLocationChecksum());
+  }
+  for (const DexFile* dex_file : driver->GetDexFilesForOatFile()) {
+    HashDexFileStructure(&hasher, *dex_file);
+  }
+  return std::unique_ptr<CompiledMethodCache>(
+      new CompiledMethodCache(directory, driver, hasher.Finish()));
+}
+
+CompiledMethodCache::CompiledMethodCache(const std::string& directory,
+                                         CompilerDriver* driver,
+                                         Key context_key)
+    : directory_(directory),
+      driver_(driver),
+      context_key_(context_key),
+      num_hits_(0u),
+      num_misses_(0u),
+      num_stores_(0u),
+      num_uncacheable_(0u),
+      num_evictions_(0u) {}
+
+CompiledMethodCache::~CompiledMethodCache() {
+  VLOG(compiler) << "Compiled method cache: " << Dumpable<CompiledMethodCache>(*this);
+}
+
+bool CompiledMethodCache::ComputeKey(const DexFile& dex_file,
+                                     uint32_t method_idx,
+                                     uint16_t class_def_idx,
+                                     const DexFile::CodeItem* code_item,
+                                     uint32_t access_flags,
+                                     InvokeType invoke_type,
+                                     Key* key) {
+  if (code_item == nullptr) {
+    return false;
+  }
+  KeyHasher hasher;
+  hasher.UpdateKey(context_key_);
+  hasher.UpdateValue(access_flags);
+  hasher.UpdateValue(invoke_type);
+  const VerifiedMethod* verified_method = driver_->GetVerifiedMethod(&dex_file, method_idx);
+  hasher.UpdateValue(driver_->IsMethodVerifiedWithoutFailures(method_idx, class_def_idx, dex_file));
+  hasher.UpdateValue(
+      verified_method != nullptr ? verified_method->GetEncounteredVerificationFailures() : 0u);
+  if (!HashMethod(&hasher, dex_file, method_idx, code_item)) {
+    num_uncacheable_.FetchAndAddRelaxed(1u);
+    return false;
+  }
+  *key = hasher.Finish();
+  return true;
+}
+
+std::string CompiledMethodCache::GetEntryPath(const Key& key) const {
+  return android::base::StringPrintf("%s/%016" PRIx64 "%016" PRIx64 ".cm",
+                                     directory_.c_str(),
+                                     key.hi,
+                                     key.lo);
+}
+
+int32_t CompiledMethodCache::FindDexFileIndex(const DexFile* dex_file) const {
+  ArrayRef<const DexFile* const> dex_files = driver_->GetDexFilesForOatFile();
+  auto it = std::find(dex_files.begin(), dex_files.end(), dex_file);
+  return (it != dex_files.end()) ? static_cast<int32_t>(it - dex_files.begin()) : -1;
+}
+
+bool CompiledMethodCache::IsDependencyUnchanged(uint32_t dex_file_index,
+                                                uint32_t method_idx,
+                                                uint32_t class_status,
+                                                uint64_t digest) const {
+  ArrayRef<const DexFile* const> dex_files = driver_->GetDexFilesForOatFile();
+  if (dex_file_index >= dex_files.size() ||
+      method_idx >= dex_files[dex_file_index]->NumMethodIds()) {
+    return false;
+  }
+  const DexFile& dex_file = *dex_files[dex_file_index];
+  const DexFile::ClassDef* class_def =
+      dex_file.FindClassDef(dex_file.GetMethodId(method_idx).class_idx_);
+  if (class_def == nullptr) {
+    return false;
+  }
+  // The inliner only inlines from verified classes, so a callee class that no longer verifies
+  // (or now does) may change the code even if its bytecode did not.
+  ClassReference class_ref(&dex_file, dex_file.GetIndexForClassDef(*class_def));
+  if (static_cast<uint32_t>(driver_->GetClassStatus(class_ref)) != class_status) {
+    return false;
+  }
+  const DexFile::CodeItem* code_item = FindCodeItem(dex_file, *class_def, method_idx);
+  if (code_item == nullptr) {
+    return false;
+  }
+  KeyHasher hasher;
+  return HashMethod(&hasher, dex_file, method_idx, code_item) && hasher.Finish().lo == digest;
+}
+
+CompiledMethod* CompiledMethodCache::Lookup(const DexFile& dex_file, const Key& key) {
+  std::string path = GetEntryPath(key);
+  std::unique_ptr<File> file(OS::OpenFileForReading(path.c_str()));
+  if (file == nullptr) {
+    num_misses_.FetchAndAddRelaxed(1u);
+    return nullptr;
+  }
+  int64_t length = file->GetLength();
+  std::vector<uint8_t> data(length > 0 ? static_cast<size_t>(length) : 0u);
+  if (length <= 0 || !file->ReadFully(data.data(), data.size())) {
+    num_misses_.FetchAndAddRelaxed(1u);
+    return nullptr;
+  }
+
+  ArrayRef<const uint8_t> entry(data);
+  EntryReader reader(entry);
+  uint8_t magic[sizeof(kMagic)];
+  uint32_t version;
+  Key stored_key;
+  uint32_t frame_size_in_bytes;
+  uint32_t core_spill_mask;
+  uint32_t fp_spill_mask;
+  ArrayRef<const uint8_t> code;
+  ArrayRef<const uint8_t> method_info;
+  ArrayRef<const uint8_t> vmap_table;
+  ArrayRef<const uint8_t> cfi_info;
+  uint32_t num_patches;
+  bool valid =
+      reader.Read(&magic) &&
+      memcmp(magic, kMagic, sizeof(kMagic)) == 0 &&
+      reader.Read(&version) &&
+      version == kVersion &&
+      reader.Read(&stored_key) &&
+      stored_key.lo == key.lo &&
+      stored_key.hi == key.hi &&
+      reader.Read(&frame_size_in_bytes) &&
+      reader.Read(&core_spill_mask) &&
+      reader.Read(&fp_spill_mask) &&
+      reader.ReadArray(&code) &&
+      reader.ReadArray(&method_info) &&
+      reader.ReadArray(&vmap_table) &&
+      reader.ReadArray(&cfi_info) &&
+      reader.Read(&num_patches);
+  std::vector<linker::LinkerPatch> patches;
+  for (uint32_t i = 0; valid && i != num_patches; ++i) {
+    PatchRecord record;
+    linker::LinkerPatch patch = linker::LinkerPatch::BakerReadBarrierBranchPatch(0u);
+    valid = reader.Read(&record) && DecodePatch(record, dex_file, &patch);
+    patches.push_back(patch);
+  }
+  uint32_t num_dependencies;
+  valid = valid && reader.Read(&num_dependencies);
+  for (uint32_t i = 0; valid && i != num_dependencies; ++i) {
+    DependencyRecord record;
+    valid = reader.Read(&record) &&
+        IsDependencyUnchanged(
+            record.dex_file_index, record.method_idx, record.class_status, record.digest);
+  }
+  if (!valid || !reader.IsAtEnd()) {
+    num_misses_.FetchAndAddRelaxed(1u);
+    return nullptr;
+  }
+
+  num_hits_.FetchAndAddRelaxed(1u);
+  // Trim() evicts by modification time, record the use. Failing only affects the eviction order.
+  futimens(file->Fd(), nullptr);
+  return CompiledMethod::SwapAllocCompiledMethod(
+      driver_,
+      driver_->GetInstructionSet(),
+      code,
+      frame_size_in_bytes,
+      core_spill_mask,
+      fp_spill_mask,
+      method_info,
+      vmap_table,
+      cfi_info,
+      ArrayRef<const linker::LinkerPatch>(patches));
+}
+
+void CompiledMethodCache::Store(const DexFile& dex_file,
+                                const Key& key,
+                                const CompiledMethod* compiled_method,
+                                const ArenaSet<ArtMethod*>& inlined_methods) {
+  std::vector<uint8_t> buffer;
+  Append(&buffer, kMagic);
+  Append(&buffer, kVersion);
+  Append(&buffer, key);
+  Append(&buffer, static_cast<uint32_t>(compiled_method->GetFrameSizeInBytes()));
+  Append(&buffer, compiled_method->GetCoreSpillMask());
+  Append(&buffer, compiled_method->GetFpSpillMask());
+  AppendArray(&buffer, compiled_method->GetQuickCode());
+  AppendArray(&buffer, compiled_method->GetMethodInfo());
+  AppendArray(&buffer, compiled_method->GetVmapTable());
+  AppendArray(&buffer, compiled_method->GetCFIInfo());
+  ArrayRef<const linker::LinkerPatch> patches = compiled_method->GetPatches();
+  Append(&buffer, static_cast<uint32_t>(patches.size()));
+  for (const linker::LinkerPatch& patch : patches) {
+    PatchRecord record;
+    memset(&record, 0, sizeof(record));
+    if (!EncodePatch(patch, dex_file, &record)) {
+      num_uncacheable_.FetchAndAddRelaxed(1u);
+      return;
+    }
+    Append(&buffer, record);
+  }
+  std::vector<DependencyRecord> dependencies;
+  for (ArtMethod* method : inlined_methods) {
+    int32_t dex_file_index = FindDexFileIndex(method->GetDexFile());
+    if (dex_file_index == -1) {
+      // Boot class path and classpath code is covered by the context key.
+      continue;
+    }
+    KeyHasher hasher;
+    uint32_t method_idx = method->GetDexMethodIndex();
+    if (!HashMethod(&hasher, *method->GetDexFile(), method_idx, method->GetCodeItem())) {
+      num_uncacheable_.FetchAndAddRelaxed(1u);
+      return;
+    }
+    ClassStatus class_status =
+        driver_->GetClassStatus(ClassReference(method->GetDexFile(), method->GetClassDefIndex()));
+    DependencyRecord record;
+    memset(&record, 0, sizeof(record));
+    record.dex_file_index = static_cast<uint32_t>(dex_file_index);
+    record.method_idx = method_idx;
+    record.class_status = static_cast<uint32_t>(class_status);
+    record.digest = hasher.Finish().lo;
+    dependencies.push_back(record);
+  }
+  Append(&buffer, static_cast<uint32_t>(dependencies.size()));
+  for (const DependencyRecord& record : dependencies) {
+    Append(&buffer, record);
+  }
+
+  // Write to a temporary file and rename it, so that concurrent compilations never see a
+  // partially written entry.
+  std::string path = GetEntryPath(key);
+  std::string temp_path = android::base::StringPrintf("%s.%d.tmp", path.c_str(), GetTid());
+  std::unique_ptr<File> file(OS::CreateEmptyFileWriteOnly(temp_path.c_str()));
+  if (file == nullptr) {
+    return;
+  }
+  if (!file->WriteFully(buffer.data(), buffer.size()) || file->FlushCloseOrErase() != 0) {
+    file->Erase(/* unlink */ true);
+    return;
+  }
+  if (rename(temp_path.c_str(), path.c_str()) != 0) {
+    unlink(temp_path.c_str());
+    return;
+  }
+  num_stores_.FetchAndAddRelaxed(1u);
+}
+
+void CompiledMethodCache::Trim(size_t max_size) {
+  struct Entry {
+    std::string path;
+    struct timespec mtime;
+    size_t size;
+  };
+  DIR* dir = opendir(directory_.c_str());
+  if (dir == nullptr) {
+    PLOG(WARNING) << "Failed to open compiled method cache directory " << directory_;
+    return;
+  }
+  std::vector<Entry> entries;
+  size_t total_size = 0u;
+  for (dirent* e = readdir(dir); e != nullptr; e = readdir(dir)) {
+    // Temporary files belong to stores in progress.
+    if (!android::base::EndsWith(e->d_name, ".cm")) {
+      continue;
+    }
+    std::string path = directory_ + "/" + e->d_name;
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+      continue;
+    }
+    entries.push_back(Entry { path, st.st_mtim, static_cast<size_t>(st.st_size) });
+    total_size += static_cast<size_t>(st.st_size);
+  }
+  closedir(dir);
+  if (total_size <= max_size) {
+    return;
+  }
+
+  std::sort(entries.begin(), entries.end(), [](const Entry& lhs, const Entry& rhs) {
+    return (lhs.mtime.tv_sec != rhs.mtime.tv_sec) ? lhs.mtime.tv_sec < rhs.mtime.tv_sec
+                                                  : lhs.mtime.tv_nsec < rhs.mtime.tv_nsec;
+  });
+  for (const Entry& entry : entries) {
+    if (total_size <= max_size) {
+      break;
+    }
+    if (unlink(entry.path.c_str()) == 0) {
+      total_size -= entry.size;
+      num_evictions_.FetchAndAddRelaxed(1u);
+    } else if (errno == ENOENT) {
+      // Evicted by another compilation.
+      total_size -= entry.size;
+    }
+  }
+}
+
+void CompiledMethodCache::Dump(std::ostream& os) const {
+  os << "hits=" << num_hits_.LoadRelaxed()
+     << " misses=" << num_misses_.LoadRelaxed()
+     << " stores=" << num_stores_.LoadRelaxed()
+     << " uncacheable=" << num_uncacheable_.LoadRelaxed()
+     << " evictions=" << num_evictions_.LoadRelaxed();
+}
+
+}  // namespace art
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_COMPILER_DRIVER_COMPILED_METHOD_CACHE_H_
+#define ART_COMPILER_DRIVER_COMPILED_METHOD_CACHE_H_
+
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/arena_containers.h"
+#include "base/atomic.h"
+#include "base/macros.h"
+#include "base/mutex.h"
+#include "dex/dex_file.h"
+#include "dex/invoke_type.h"
+
+namespace art {
+
+class ArtMethod;
+class CompiledMethod;
+class CompilerDriver;
+
+// A persistent cache of compiled methods shared between dex2oat invocations, stored as one
+// file per method in a directory.
+//
+// A method is keyed by its code item together with the symbols referenced by the indices in
+// it, its verification result, the compiler options, the instruction set and a digest of
+// everything outside the method that the compiled code may depend on: the class structure
+// of the dex files being compiled, the classpath and the boot image. Code inlined from other
+// methods being compiled is recorded with the entry, together with the status of the
+// callee's class, and checked on lookup, so editing the body of a method only invalidates
+// the methods that inlined it.
+//
+// Entries are never removed during a compilation. Trim() evicts the least recently used
+// entries once the directory grows over a size limit; a hit counts as a use.
+class CompiledMethodCache {
+ public:
+  // Size limit used by dex2oat unless --compiled-method-cache-max-size is passed.
+  static constexpr size_t kDefaultMaxSizeMb = 256u;
+
+  struct Key {
+    uint64_t lo;
+    uint64_t hi;
+  };
+
+  // Create a cache in `directory` for the compilation set up in `driver`. Returns null and
+  // sets `error_msg` if the cache cannot be used with this compilation.
+  static std::unique_ptr<CompiledMethodCache> Create(
+      const std::string& directory,
+      CompilerDriver* driver,
+      const std::vector<const DexFile*>& classpath_dex_files,
+      std::string* error_msg);
+
+  ~CompiledMethodCache();
+
+  // Compute the key of a method. Returns false if the method cannot be cached.
+  bool ComputeKey(const DexFile& dex_file,
+                  uint32_t method_idx,
+                  uint16_t class_def_idx,
+                  const DexFile::CodeItem* code_item,
+                  uint32_t access_flags,
+                  InvokeType invoke_type,
+                  Key* key);
+
+  // Return the cached compiled method for `key` or null if there is no valid entry.
+  CompiledMethod* Lookup(const DexFile& dex_file, const Key& key);
+
+  // Record `compiled_method` for `key`. `inlined_methods` are the methods whose code
+  // was inlined into it.
+  void Store(const DexFile& dex_file,
+             const Key& key,
+             const CompiledMethod* compiled_method,
+             const ArenaSet<ArtMethod*>& inlined_methods)
+      REQUIRES_SHARED(Locks::mutator_lock_);
+
+  // Delete the least recently used entries of the directory, including entries stored by
+  // other compilations, until the remaining entries take at most `max_size` bytes.
+  void Trim(size_t max_size);
+
+  size_t GetNumHits() const {
+    return num_hits_.LoadRelaxed();
+  }
+
+  size_t GetNumStores() const {
+    return num_stores_.LoadRelaxed();
+  }
+
+  size_t GetNumEvictions() const {
+    return num_evictions_.LoadRelaxed();
+  }
+
+  void Dump(std::ostream& os) const;
+
+ private:
+  CompiledMethodCache(const std::string& directory,
+                      CompilerDriver* driver,
+                      Key context_key);
+
+  std::string GetEntryPath(const Key& key) const;
+  // Index of `dex_file` in the dex files being compiled or -1.
+  int32_t FindDexFileIndex(const DexFile* dex_file) const;
+  bool IsDependencyUnchanged(uint32_t dex_file_index,
+                             uint32_t method_idx,
+                             uint32_t class_status,
+                             uint64_t digest) const;
+
+  const std::string directory_;
+  CompilerDriver* const driver_;
+  // Digest of the compiler options and everything outside of individual methods.
+  const Key context_key_;
+
+  Atomic<size_t> num_hits_;
+  Atomic<size_t> num_misses_;
+  Atomic<size_t> num_stores_;
+  Atomic<size_t> num_uncacheable_;
+  Atomic<size_t> num_evictions_;
+
+  DISALLOW_COPY_AND_ASSIGN(CompiledMethodCache);
+};
+
+}  // namespace art
+
+#endif  // ART_COMPILER_DRIVER_COMPILED_METHOD_CACHE_H_
@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "driver/compiled_method_cache.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <map>
+#include <vector>
+
+#include "android-base/strings.h"
+
+#include "common_compiler_test.h"
+#include "compiled_method-inl.h"
+#include "dex/dex_file.h"
+#include "dex/method_reference.h"
+#include "driver/compiler_driver.h"
+#include "driver/compiler_options.h"
+#include "scoped_thread_state_change-inl.h"
+
+namespace art {
+
+class CompiledMethodCacheTest : public CommonCompilerTest {
+ protected:
+  void SetUp() OVERRIDE {
+    CommonCompilerTest::SetUp();
+    cache_dir_ = android_data_ + "/compiled-method-cache";
+    ASSERT_EQ(0, mkdir(cache_dir_.c_str(), 0700));
+  }
+
+  void TearDown() OVERRIDE {
+    ClearDirectory(cache_dir_.c_str());
+    rmdir(cache_dir_.c_str());
+    CommonCompilerTest::TearDown();
+  }
+
+  // Compile all dex files of `class_loader` with a new driver using the cache and return
+  // the code of every compiled method.
+  std::map<MethodReference, std::vector<uint8_t>> CompileWithCache(jobject class_loader)
+      REQUIRES(!Locks::mutator_lock_) {
+    CreateCompilerDriver(compiler_kind_, kRuntimeISA);
+    compiler_options_->boot_image_ = false;
+    compiler_options_->debuggable_ = debuggable_;
+    compiler_options_->no_inline_from_ = no_inline_from_;
+    std::vector<const DexFile*> dex_files = GetDexFiles(class_loader);
+    compiler_driver_->SetDexFilesForOatFile(dex_files);
+    std::string error_msg;
+    std::unique_ptr<CompiledMethodCache> cache = CompiledMethodCache::Create(
+        cache_dir_, compiler_driver_.get(), std::vector<const DexFile*>(), &error_msg);
+    CHECK(cache != nullptr) << error_msg;
+    compiler_driver_->SetCompiledMethodCache(std::move(cache));
+
+    TimingLogger timings("CompiledMethodCacheTest::CompileWithCache", false, false);
+    compiler_driver_->CompileAll(class_loader, dex_files, &timings);
+
+    std::map<MethodReference, std::vector<uint8_t>> code;
+    for (const DexFile* dex_file : dex_files) {
+      for (uint32_t method_idx = 0; method_idx != dex_file->NumMethodIds(); ++method_idx) {
+        MethodReference ref(dex_file, method_idx);
+        CompiledMethod* compiled_method = compiler_driver_->GetCompiledMethod(ref);
+        if (compiled_method != nullptr) {
+          ArrayRef<const uint8_t> quick_code = compiled_method->GetQuickCode();
+          code.emplace(ref, std::vector<uint8_t>(quick_code.begin(), quick_code.end()));
+        }
+      }
+    }
+    return code;
+  }
+
+  // Return the sizes of the cache entries, by file name.
+  std::map<std::string, size_t> GetEntrySizes() {
+    std::map<std::string, size_t> sizes;
+    DIR* dir = opendir(cache_dir_.c_str());
+    CHECK(dir != nullptr) << cache_dir_;
+    for (dirent* e = readdir(dir); e != nullptr; e = readdir(dir)) {
+      if (android::base::EndsWith(e->d_name, ".cm")) {
+        struct stat st;
+        CHECK_EQ(0, stat((cache_dir_ + "/" + e->d_name).c_str(), &st));
+        sizes.emplace(e->d_name, static_cast<size_t>(st.st_size));
+      }
+    }
+    closedir(dir);
+    return sizes;
+  }
+
+  std::string cache_dir_;
+  // Options applied to the compilations of CompileWithCache().
+  bool debuggable_ = false;
+  const std::vector<const DexFile*>* no_inline_from_ = nullptr;
+};
+
+TEST_F(CompiledMethodCacheTest, ReuseCompiledMethods) {
+  jobject class_loader;
+  {
+    ScopedObjectAccess soa(Thread::Current());
+    class_loader = LoadDex("StaticLeafMethods");
+  }
+
+  std::map<MethodReference, std::vector<uint8_t>> first = CompileWithCache(class_loader);
+  CompiledMethodCache* cache = compiler_driver_->GetCompiledMethodCache();
+  ASSERT_FALSE(first.empty());
+  EXPECT_EQ(0u, cache->GetNumHits());
+  EXPECT_NE(0u, cache->GetNumStores());
+  size_t num_stores = cache->GetNumStores();
+
+  std::map<MethodReference, std::vector<uint8_t>> second = CompileWithCache(class_loader);
+  cache = compiler_driver_->GetCompiledMethodCache();
+  EXPECT_EQ(num_stores, cache->GetNumHits());
+  EXPECT_EQ(0u, cache->GetNumStores());
+  EXPECT_EQ(first, second);
+}
+
+TEST_F(CompiledMethodCacheTest, OptionsAreKeyed) {
+  jobject class_loader;
+  {
+    ScopedObjectAccess soa(Thread::Current());
+    class_loader = LoadDex("StaticLeafMethods");
+  }
+
+  CompileWithCache(class_loader);
+  ASSERT_NE(0u, compiler_driver_->GetCompiledMethodCache()->GetNumStores());
+
+  // A different option must not reuse the entries.
+  debuggable_ = true;
+  CompileWithCache(class_loader);
+  EXPECT_EQ(0u, compiler_driver_->GetCompiledMethodCache()->GetNumHits());
+}
+
+TEST_F(CompiledMethodCacheTest, NoInlineFromDexFilesAreKeyed) {
+  jobject class_loader;
+  {
+    ScopedObjectAccess soa(Thread::Current());
+    class_loader = LoadDex("StaticLeafMethods");
+  }
+  std::vector<const DexFile*> no_inline_from = GetDexFiles(class_loader);
+  std::vector<const DexFile*> empty;
+
+  no_inline_from_ = &no_inline_from;
+  CompileWithCache(class_loader);
+  ASSERT_NE(0u, compiler_driver_->GetCompiledMethodCache()->GetNumStores());
+
+  // Forbidding inlining from a different set of dex files must not reuse the entries.
+  no_inline_from_ = &empty;
+  CompileWithCache(class_loader);
+  EXPECT_EQ(0u, compiler_driver_->GetCompiledMethodCache()->GetNumHits());
+
+  no_inline_from_ = &no_inline_from;
+  CompileWithCache(class_loader);
+  EXPECT_NE(0u, compiler_driver_->GetCompiledMethodCache()->GetNumHits());
+}
+
+TEST_F(CompiledMethodCacheTest, TrimEvictsLeastRecentlyUsed) {
+  jobject class_loader;
+  {
+    ScopedObjectAccess soa(Thread::Current());
+    class_loader = LoadDex("StaticLeafMethods");
+  }
+
+  CompileWithCache(class_loader);
+  CompiledMethodCache* cache = compiler_driver_->GetCompiledMethodCache();
+  std::map<std::string, size_t> sizes = GetEntrySizes();
+  ASSERT_LT(1u, sizes.size());
+  size_t total_size = 0u;
+  for (const auto& entry : sizes) {
+    total_size += entry.second;
+  }
+
+  // Nothing is evicted within the limit.
+  cache->Trim(total_size);
+  EXPECT_EQ(0u, cache->GetNumEvictions());
+  EXPECT_EQ(sizes, GetEntrySizes());
+
+  // Make the first entry the least recently used one. It is the only one evicted when the
+  // limit is one byte smaller.
+  struct timespec times[2];
+  times[0].tv_sec = times[1].tv_sec = 1;
+  times[0].tv_nsec = times[1].tv_nsec = 0;
+  std::string oldest = sizes.begin()->first;
+  ASSERT_EQ(0, utimensat(AT_FDCWD, (cache_dir_ + "/" + oldest).c_str(), times, 0));
+  cache->Trim(total_size - 1u);
+  EXPECT_EQ(1u, cache->GetNumEvictions());
+  std::map<std::string, size_t> remaining = GetEntrySizes();
+  EXPECT_EQ(sizes.size() - 1u, remaining.size());
+  EXPECT_EQ(0u, remaining.count(oldest));
+
+  cache->Trim(0u);
+  EXPECT_TRUE(GetEntrySizes().empty());
+}
+
+TEST_F(CompiledMethodCacheTest, NotUsedForBootImage) {
+  CreateCompilerDriver(compiler_kind_, kRuntimeISA);
+  ASSERT_TRUE(compiler_options_->IsBootImage());
+  std::string error_msg;
+  std::unique_ptr<CompiledMethodCache> cache = CompiledMethodCache::Create(
+      cache_dir_, compiler_driver_.get(), std::vector<const DexFile*>(), &error_msg);
+  EXPECT_TRUE(cache == nullptr);
+  EXPECT_FALSE(error_msg.empty());
+}
+
+}  // namespace art
@@ -46,6 +46,20 @@ class CompiledMethodStorage {
     return dedupe_enabled_;
   }
 
+  // Bound the resident part of the swap space, see SwapSpace::SetResidentBudget(). Has no
+  // effect without swap.
+  void SetSwapResidentBudget(size_t budget) {
+    if (swap_space_ != nullptr) {
+      swap_space_->SetResidentBudget(budget);
+    }
+  }
+
+  void ReleaseSwapResidentPages() {
+    if (swap_space_ != nullptr) {
+      swap_space_->ReleaseResidentPages();
+    }
+  }
+
   SwapAllocator<void> GetSwapSpaceAllocator() {
     return SwapAllocator<void>(swap_space_.get());
   }
@@ -17,6 +17,9 @@
 #include "compiler_driver.h"
 
 #include <unistd.h>
+#include <algorithm>
+#include <limits>
+#include <numeric>
 #include <unordered_set>
 #include <vector>
 
@@ -31,6 +34,7 @@
 #include "base/arena_allocator.h"
 #include "base/array_ref.h"
 #include "base/bit_vector.h"
+#include "base/casts.h"
 #include "base/enums.h"
 #include "base/logging.h"  // For VLOG
 #include "base/stl_util.h"
@@ -50,6 +54,7 @@
 #include "dex/verification_results.h"
 #include "dex/verified_method.h"
 #include "dex_compilation_unit.h"
+#include "driver/compiled_method_cache.h"
 #include "driver/compiler_options.h"
 #include "gc/accounting/card_table-inl.h"
 #include "gc/accounting/heap_bitmap.h"
@@ -288,6 +293,7 @@ CompilerDriver::CompilerDriver(
       compiler_context_(nullptr),
       support_boot_image_fixup_(true),
       compiled_method_storage_(swap_fd),
+      only_verify_changed_classes_(false),
       profile_compilation_info_(profile_compilation_info),
       max_arena_alloc_(0),
       dex_to_dex_compiler_(this) {
@@ -377,7 +383,8 @@ void CompilerDriver::CompileAll(jobject class_loader,
     stats_->Dump();
   }
 
-  FreeThreadPools();
+  // Keep the parallel thread pool for writing the output, see GetThreadPool().
+  single_thread_pool_.reset();
 }
 
 static optimizer::DexToDexCompiler::CompilationLevel GetDexToDexCompilationLevel(
@@ -1513,6 +1520,7 @@ class ParallelCompilationManager {
                              const std::vector<const DexFile*>& dex_files,
                              ThreadPool* thread_pool)
     : index_(0),
+      num_work_deques_(0u),
       class_linker_(class_linker),
       class_loader_(class_loader),
       compiler_(compiler),
@@ -1576,7 +1584,152 @@ class ParallelCompilationManager {
     return index_.FetchAndAddSequentiallyConsistent(1);
   }
 
+  // Visit the work items [0, weights.size()), scheduling the heaviest items first. Items are
+  // distributed over one deque per work unit using the longest-processing-time rule, i.e. each
+  // item goes to the deque with the least total weight so far. `fn` is invoked once per work
+  // unit with a callable `bool next_item(uint32_t* item)` that pops from the front of the work
+  // unit's own deque and, once that is empty, steals from the back of the others. This lets
+  // `fn` set up per-thread state once for all the items it visits.
+  template <typename Fn>
+  void ForAllWeightedLambda(const std::vector<size_t>& weights, Fn fn, size_t work_units)
+      REQUIRES(!*Locks::mutator_lock_) {
+    Thread* self = Thread::Current();
+    self->AssertNoPendingException();
+    CHECK_GT(work_units, 0U);
+    CHECK_LE(weights.size(), std::numeric_limits<uint32_t>::max());
+
+    std::vector<uint32_t> order(weights.size());
+    std::iota(order.begin(), order.end(), 0u);
+    // Stable so that items of equal weight keep their dex order and scheduling is deterministic.
+    std::stable_sort(order.begin(),
+                     order.end(),
+                     [&weights](uint32_t lhs, uint32_t rhs) { return weights[lhs] > weights[rhs]; });
+
+    work_deques_.reset(new WorkDeque[work_units]);
+    num_work_deques_ = work_units;
+    std::vector<size_t> loads(work_units, 0u);
+    for (uint32_t item : order) {
+      size_t target = std::min_element(loads.begin(), loads.end()) - loads.begin();
+      loads[target] += weights[item];
+      work_deques_[target].items.push_back(item);
+    }
+    for (size_t i = 0; i != work_units; ++i) {
+      work_deques_[i].Reset();
+    }
+
+    for (size_t i = 0; i < work_units; ++i) {
+      thread_pool_->AddTask(self, new ForAllWeightedClosureLambda<Fn>(this, i, fn));
+    }
+    thread_pool_->StartWorkers(self);
+
+    // Ensure we're suspended while we're blocked waiting for the other threads to finish (worker
+    // thread destructor's called below perform join).
+    CHECK_NE(self->GetState(), kRunnable);
+
+    // Wait for all the worker threads to finish.
+    thread_pool_->Wait(self, true, false);
+
+    // And stop the workers accepting jobs.
+    thread_pool_->StopWorkers(self);
+
+    work_deques_.reset();
+    num_work_deques_ = 0u;
+  }
+
+  // Take the next item for `worker`: its own heaviest remaining item, or failing that the
+  // lightest remaining item of another worker. Returns false when no work is left anywhere.
+  bool NextWeightedItem(size_t worker, uint32_t* item) {
+    DCHECK_LT(worker, num_work_deques_);
+    if (work_deques_[worker].PopFront(item)) {
+      return true;
+    }
+    for (size_t i = 1; i != num_work_deques_; ++i) {
+      if (work_deques_[(worker + i) % num_work_deques_].PopBack(item)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
  private:
+  // A deque over a fixed list of items. The owner pops from the front and thieves pop from the
+  // back; both ends are packed into a single word so either side claims an item with one CAS.
+  struct WorkDeque {
+    std::vector<uint32_t> items;
+    Atomic<uint64_t> bounds;
+
+    void Reset() {
+      bounds.StoreRelaxed(Pack(0u, items.size()));
+    }
+
+    bool PopFront(uint32_t* item) {
+      uint64_t old_bounds = bounds.LoadRelaxed();
+      while (true) {
+        uint32_t front = Front(old_bounds);
+        uint32_t back = Back(old_bounds);
+        if (front == back) {
+          return false;
+        }
+        if (bounds.CompareAndSetWeakRelaxed(old_bounds, Pack(front + 1u, back))) {
+          *item = items[front];
+          return true;
+        }
+        old_bounds = bounds.LoadRelaxed();
+      }
+    }
+
+    bool PopBack(uint32_t* item) {
+      uint64_t old_bounds = bounds.LoadRelaxed();
+      while (true) {
+        uint32_t front = Front(old_bounds);
+        uint32_t back = Back(old_bounds);
+        if (front == back) {
+          return false;
+        }
+        if (bounds.CompareAndSetWeakRelaxed(old_bounds, Pack(front, back - 1u))) {
+          *item = items[back - 1u];
+          return true;
+        }
+        old_bounds = bounds.LoadRelaxed();
+      }
+    }
+
+    static uint64_t Pack(uint32_t front, uint32_t back) {
+      return (static_cast<uint64_t>(back) << 32) | front;
+    }
+    static uint32_t Front(uint64_t value) {
+      return static_cast<uint32_t>(value);
+    }
+    static uint32_t Back(uint64_t value) {
+      return static_cast<uint32_t>(value >> 32);
+    }
+  };
+
+  template <typename Fn>
+  class ForAllWeightedClosureLambda : public Task {
+   public:
+    ForAllWeightedClosureLambda(ParallelCompilationManager* manager, size_t worker, Fn fn)
+        : manager_(manager),
+          worker_(worker),
+          fn_(fn) {}
+
+    void Run(Thread* self) OVERRIDE {
+      ParallelCompilationManager* manager = manager_;
+      size_t worker = worker_;
+      fn_([manager, worker](uint32_t* item) { return manager->NextWeightedItem(worker, item); });
+      self->AssertNoPendingException();
+    }
+
+    void Finalize() OVERRIDE {
+      delete this;
+    }
+
+   private:
+    ParallelCompilationManager* const manager_;
+    const size_t worker_;
+    Fn fn_;
+  };
+
   template <typename Fn>
   class ForAllClosureLambda : public Task {
    public:
@@ -1607,6 +1760,8 @@ class ParallelCompilationManager {
   };
 
   AtomicInteger index_;
+  std::unique_ptr<WorkDeque[]> work_deques_;
+  size_t num_work_deques_;
   ClassLinker* const class_linker_;
   const jobject class_loader_;
   CompilerDriver* const compiler_;
@@ -1937,8 +2092,16 @@ bool CompilerDriver::FastVerify(jobject jclass_loader,
     // Fetch the list of unverified classes.
     const std::set<dex::TypeIndex>& unverified_classes =
         verifier_deps->GetUnverifiedClasses(*dex_file);
+    auto changed_it = changed_class_defs_.find(dex_file);
+    const std::vector<bool>* changed_class_defs =
+        (changed_it != changed_class_defs_.end()) ? &changed_it->second : nullptr;
     for (uint32_t i = 0; i < dex_file->NumClassDefs(); ++i) {
       const DexFile::ClassDef& class_def = dex_file->GetClassDef(i);
+      if (changed_class_defs != nullptr && (*changed_class_defs)[i]) {
+        // Verify() verifies the class again and records its new status.
+        verifier_deps->ClearUnverifiedClass(*dex_file, class_def.class_idx_);
+        continue;
+      }
       if (unverified_classes.find(class_def.class_idx_) == unverified_classes.end()) {
         if (compiler_only_verifies) {
           // Just update the compiled_classes_ map. The compiler doesn't need to resolve
@@ -1980,7 +2143,11 @@ void CompilerDriver::Verify(jobject jclass_loader,
                             const std::vector<const DexFile*>& dex_files,
                             TimingLogger* timings) {
   if (FastVerify(jclass_loader, dex_files, timings)) {
-    return;
+    if (changed_class_defs_.empty()) {
+      return;
+    }
+    // The verification of the unchanged classes was reused, verify the changed ones.
+    only_verify_changed_classes_ = true;
   }
 
   // If there is no existing `verifier_deps` (because of non-existing vdex), or
@@ -2036,8 +2203,11 @@ class VerifyClassVisitor : public CompilationVisitor {
 
   virtual void Visit(size_t class_def_index) REQUIRES(!Locks::mutator_lock_) OVERRIDE {
     ScopedTrace trace(__FUNCTION__);
-    ScopedObjectAccess soa(Thread::Current());
     const DexFile& dex_file = *manager_->GetDexFile();
+    if (manager_->GetCompiler()->IsClassVerificationReused(dex_file, class_def_index)) {
+      return;
+    }
+    ScopedObjectAccess soa(Thread::Current());
     const DexFile::ClassDef& class_def = dex_file.GetClassDef(class_def_index);
     const char* descriptor = dex_file.GetClassDescriptor(class_def);
     ClassLinker* class_linker = manager_->GetClassLinker();
@@ -2683,6 +2853,106 @@ void CompilerDriver::InitializeClasses(jobject class_loader,
   }
 }
 
+// A method visited by CompileDexFile, with the state needed to compile it on its own.
+struct MethodCompilationItem {
+  const DexFile::CodeItem* code_item;
+  uint32_t access_flags;
+  InvokeType invoke_type;
+  uint32_t method_idx;
+  uint16_t class_def_index;
+};
+
+// Per-class state shared by all the methods of a class def.
+struct ClassCompilationState {
+  optimizer::DexToDexCompiler::CompilationLevel dex_to_dex_compilation_level =
+      optimizer::DexToDexCompiler::CompilationLevel::kDontDexToDexCompile;
+  bool compilation_enabled = false;
+};
+
+// Estimated cost of compiling `item`, used to schedule large methods first. Methods without
+// code (native, abstract) still cost something, so they get a weight of one.
+static size_t GetMethodCompilationWeight(const DexFile& dex_file,
+                                         const MethodCompilationItem& item) {
+  if (item.code_item == nullptr) {
+    return 1u;
+  }
+  return 1u + CodeItemInstructionAccessor(dex_file, item.code_item).InsnsSizeInCodeUnits();
+}
+
+// Collect the methods of `class_def_index` to compile into `methods`. Leaves `methods` empty
+// if the whole class is skipped.
+static void CollectClassMethods(const ParallelCompilationManager& context,
+                                size_t class_def_index,
+                                ClassCompilationState* state,
+                                std::vector<MethodCompilationItem>* methods) {
+  ScopedTrace trace(__FUNCTION__);
+  const DexFile& dex_file = *context.GetDexFile();
+  const DexFile::ClassDef& class_def = dex_file.GetClassDef(class_def_index);
+  ClassLinker* class_linker = context.GetClassLinker();
+  jobject jclass_loader = context.GetClassLoader();
+  ClassReference ref(&dex_file, class_def_index);
+  // Skip compiling classes with generic verifier failures since they will still fail at runtime
+  if (context.GetCompiler()->GetVerificationResults()->IsClassRejected(ref)) {
+    return;
+  }
+  // Use a scoped object access to perform to the quick SkipClass check.
+  const char* descriptor = dex_file.GetClassDescriptor(class_def);
+  ScopedObjectAccess soa(Thread::Current());
+  StackHandleScope<2> hs(soa.Self());
+  Handle<mirror::ClassLoader> class_loader(
+      hs.NewHandle(soa.Decode<mirror::ClassLoader>(jclass_loader)));
+  Handle<mirror::Class> klass(
+      hs.NewHandle(class_linker->FindClass(soa.Self(), descriptor, class_loader)));
+  if (klass == nullptr) {
+    soa.Self()->AssertPendingException();
+    soa.Self()->ClearException();
+  } else if (SkipClass(jclass_loader, dex_file, klass.Get())) {
+    return;
+  }
+
+  const uint8_t* class_data = dex_file.GetClassData(class_def);
+  if (class_data == nullptr) {
+    // empty class, probably a marker interface
+    return;
+  }
+
+  // Go to native so that we don't block GC during compilation.
+  ScopedThreadSuspension sts(soa.Self(), kNative);
+
+  CompilerDriver* const driver = context.GetCompiler();
+
+  // Can we run DEX-to-DEX compiler on this class ?
+  state->dex_to_dex_compilation_level =
+      GetDexToDexCompilationLevel(soa.Self(), *driver, jclass_loader, dex_file, class_def);
+
+  ClassDataItemIterator it(dex_file, class_data);
+  it.SkipAllFields();
+
+  state->compilation_enabled = driver->IsClassToCompile(
+      dex_file.StringByTypeIdx(class_def.class_idx_));
+
+  // Collect direct and virtual methods.
+  int64_t previous_method_idx = -1;
+  while (it.HasNextMethod()) {
+    uint32_t method_idx = it.GetMemberIndex();
+    if (method_idx == previous_method_idx) {
+      // smali can create dex files with two encoded_methods sharing the same method_idx
+      // http://code.google.com/p/smali/issues/detail?id=119
+      it.Next();
+      continue;
+    }
+    previous_method_idx = method_idx;
+    methods->push_back(MethodCompilationItem {
+        it.GetMethodCodeItem(),
+        it.GetMethodAccessFlags(),
+        it.GetMethodInvokeType(class_def),
+        method_idx,
+        dchecked_integral_cast<uint16_t>(class_def_index) });
+    it.Next();
+  }
+  DCHECK(!it.HasNext());
+}
+
 template <typename CompileFn>
 static void CompileDexFile(CompilerDriver* driver,
                            jobject class_loader,
@@ -2701,85 +2971,88 @@ static void CompileDexFile(CompilerDriver* driver,
                                      dex_files,
                                      thread_pool);
 
-  auto compile = [&context, &compile_fn](size_t class_def_index) {
+  const size_t num_class_defs = dex_file.NumClassDefs();
+  std::vector<ClassCompilationState> class_states(num_class_defs);
+
+  // Compile the methods handed out by `next_method`. The class loader and dex cache are looked
+  // up once for all of them, not once per method.
+  auto compile_methods = [&context, &class_states, &compile_fn](auto next_method) {
     ScopedTrace trace(__FUNCTION__);
     const DexFile& dex_file = *context.GetDexFile();
-    const DexFile::ClassDef& class_def = dex_file.GetClassDef(class_def_index);
-    ClassLinker* class_linker = context.GetClassLinker();
-    jobject jclass_loader = context.GetClassLoader();
-    ClassReference ref(&dex_file, class_def_index);
-    // Skip compiling classes with generic verifier failures since they will still fail at runtime
-    if (context.GetCompiler()->GetVerificationResults()->IsClassRejected(ref)) {
-      return;
-    }
-    // Use a scoped object access to perform to the quick SkipClass check.
-    const char* descriptor = dex_file.GetClassDescriptor(class_def);
     ScopedObjectAccess soa(Thread::Current());
-    StackHandleScope<3> hs(soa.Self());
+    StackHandleScope<2> hs(soa.Self());
     Handle<mirror::ClassLoader> class_loader(
-        hs.NewHandle(soa.Decode<mirror::ClassLoader>(jclass_loader)));
-    Handle<mirror::Class> klass(
-        hs.NewHandle(class_linker->FindClass(soa.Self(), descriptor, class_loader)));
-    Handle<mirror::DexCache> dex_cache;
-    if (klass == nullptr) {
-      soa.Self()->AssertPendingException();
-      soa.Self()->ClearException();
-      dex_cache = hs.NewHandle(class_linker->FindDexCache(soa.Self(), dex_file));
-    } else if (SkipClass(jclass_loader, dex_file, klass.Get())) {
-      return;
-    } else {
-      dex_cache = hs.NewHandle(klass->GetDexCache());
-    }
-
-    const uint8_t* class_data = dex_file.GetClassData(class_def);
-    if (class_data == nullptr) {
-      // empty class, probably a marker interface
-      return;
-    }
+        hs.NewHandle(soa.Decode<mirror::ClassLoader>(context.GetClassLoader())));
+    Handle<mirror::DexCache> dex_cache(
+        hs.NewHandle(context.GetClassLinker()->FindDexCache(soa.Self(), dex_file)));
 
     // Go to native so that we don't block GC during compilation.
     ScopedThreadSuspension sts(soa.Self(), kNative);
 
-    CompilerDriver* const driver = context.GetCompiler();
-
-    // Can we run DEX-to-DEX compiler on this class ?
-    optimizer::DexToDexCompiler::CompilationLevel dex_to_dex_compilation_level =
-        GetDexToDexCompilationLevel(soa.Self(), *driver, jclass_loader, dex_file, class_def);
-
-    ClassDataItemIterator it(dex_file, class_data);
-    it.SkipAllFields();
-
-    bool compilation_enabled = driver->IsClassToCompile(
-        dex_file.StringByTypeIdx(class_def.class_idx_));
-
-    // Compile direct and virtual methods.
-    int64_t previous_method_idx = -1;
-    while (it.HasNextMethod()) {
-      uint32_t method_idx = it.GetMemberIndex();
-      if (method_idx == previous_method_idx) {
-        // smali can create dex files with two encoded_methods sharing the same method_idx
-        // http://code.google.com/p/smali/issues/detail?id=119
-        it.Next();
-        continue;
-      }
-      previous_method_idx = method_idx;
+    const MethodCompilationItem* item;
+    while ((item = next_method()) != nullptr) {
+      const ClassCompilationState& state = class_states[item->class_def_index];
       compile_fn(soa.Self(),
-                 driver,
-                 it.GetMethodCodeItem(),
-                 it.GetMethodAccessFlags(),
-                 it.GetMethodInvokeType(class_def),
-                 class_def_index,
-                 method_idx,
+                 context.GetCompiler(),
+                 item->code_item,
+                 item->access_flags,
+                 item->invoke_type,
+                 item->class_def_index,
+                 item->method_idx,
                  class_loader,
                  dex_file,
-                 dex_to_dex_compilation_level,
-                 compilation_enabled,
+                 state.dex_to_dex_compilation_level,
+                 state.compilation_enabled,
                  dex_cache);
-      it.Next();
+      soa.Self()->AssertNoPendingException();
     }
-    DCHECK(!it.HasNext());
   };
-  context.ForAllLambda(0, dex_file.NumClassDefs(), compile, thread_count);
+
+  if (thread_count == 1u) {
+    // Nothing to balance, compile each class as soon as its methods are known.
+    std::vector<MethodCompilationItem> methods;
+    auto compile_class = [&](size_t class_def_index) {
+      methods.clear();
+      CollectClassMethods(context, class_def_index, &class_states[class_def_index], &methods);
+      size_t next = 0u;
+      compile_methods([&methods, &next]() {
+        return (next != methods.size()) ? &methods[next++] : nullptr;
+      });
+    };
+    context.ForAllLambda(0, num_class_defs, compile_class, thread_count);
+    return;
+  }
+
+  // Obfuscated apps often have a few classes that are orders of magnitude larger than the rest,
+  // so handing out whole classes leaves one thread compiling a giant class long after the others
+  // are done. Collect the methods of all classes first, then schedule them individually by size.
+  std::vector<std::vector<MethodCompilationItem>> class_methods(num_class_defs);
+  auto collect = [&context, &class_states, &class_methods](size_t class_def_index) {
+    CollectClassMethods(context,
+                        class_def_index,
+                        &class_states[class_def_index],
+                        &class_methods[class_def_index]);
+  };
+  context.ForAllLambda(0, num_class_defs, collect, thread_count);
+
+  std::vector<MethodCompilationItem> methods;
+  std::vector<size_t> weights;
+  for (std::vector<MethodCompilationItem>& items : class_methods) {
+    for (const MethodCompilationItem& item : items) {
+      methods.push_back(item);
+      weights.push_back(GetMethodCompilationWeight(dex_file, item));
+    }
+    std::vector<MethodCompilationItem>().swap(items);
+  }
+  context.ForAllWeightedLambda(
+      weights,
+      [&methods, &compile_methods](auto next_item) {
+        compile_methods([&methods, &next_item]() -> const MethodCompilationItem* {
+          uint32_t index;
+          return next_item(&index) ? &methods[index] : nullptr;
+        });
+      },
+      thread_count);
 }
 
 void CompilerDriver::Compile(jobject class_loader,
@@ -2807,7 +3080,8 @@ void CompilerDriver::Compile(jobject class_loader,
     const ArenaPool* const arena_pool = Runtime::Current()->GetArenaPool();
     const size_t arena_alloc = arena_pool->GetBytesAllocated();
     max_arena_alloc_ = std::max(arena_alloc, max_arena_alloc_);
-    Runtime::Current()->ReclaimArenaPoolMemory();
+    // Keep the arenas the next dex file is likely to need, free the ones nobody used.
+    Runtime::Current()->GetArenaPool()->TrimToHighWaterMark();
   }
 
   if (dex_to_dex_compiler_.NumCodeItemsToQuicken(Thread::Current()) > 0u) {
@@ -3028,4 +3302,23 @@ void CompilerDriver::SetClasspathDexFiles(const std::vector<const DexFile*>& dex
   classpath_classes_.AddDexFiles(dex_files);
 }
 
+void CompilerDriver::SetCompiledMethodCache(std::unique_ptr<CompiledMethodCache>&& cache) {
+  compiled_method_cache_ = std::move(cache);
+}
+
+void CompilerDriver::SetChangedClassDefs(const DexFile* dex_file,
+                                         std::vector<bool>&& changed_class_defs) {
+  DCHECK_EQ(changed_class_defs.size(), dex_file->NumClassDefs());
+  changed_class_defs_.Overwrite(dex_file, std::move(changed_class_defs));
+}
+
+bool CompilerDriver::IsClassVerificationReused(const DexFile& dex_file,
+                                               uint16_t class_def_index) const {
+  if (!only_verify_changed_classes_) {
+    return false;
+  }
+  auto it = changed_class_defs_.find(&dex_file);
+  return it == changed_class_defs_.end() || !it->second[class_def_index];
+}
+
 }  // namespace art
@@ -60,6 +60,7 @@ class VerifierDepsTest;
 class ArtField;
 class BitVector;
 class CompiledMethod;
+class CompiledMethodCache;
 class CompilerOptions;
 class DexCompilationUnit;
 template<class T> class Handle;
@@ -302,6 +303,12 @@ class CompilerDriver {
     return parallel_thread_count_;
   }
 
+  // Thread pool with GetThreadCount() - 1 workers. It is kept after CompileAll() so that writing
+  // the output can use it, and is null before.
+  ThreadPool* GetThreadPool() const {
+    return parallel_thread_pool_.get();
+  }
+
   void SetDedupeEnabled(bool dedupe_enabled) {
     compiled_method_storage_.SetDedupeEnabled(dedupe_enabled);
   }
@@ -353,6 +360,21 @@ class CompilerDriver {
     return &compiled_method_storage_;
   }
 
+  // Persistent cache of compiled methods shared with other compilations, or null.
+  CompiledMethodCache* GetCompiledMethodCache() const {
+    return compiled_method_cache_.get();
+  }
+  void SetCompiledMethodCache(std::unique_ptr<CompiledMethodCache>&& cache);
+
+  // Mark the class definitions of `dex_file` that changed since the input VerifierDeps were
+  // recorded, e.g. the classes whose code a deobfuscator rewrote. If the VerifierDeps are still
+  // valid, the verification of all other classes is reused and only these are verified again.
+  void SetChangedClassDefs(const DexFile* dex_file, std::vector<bool>&& changed_class_defs);
+
+  // Whether the verification of the class is taken from the input VerifierDeps and the class
+  // does not need to be verified again.
+  bool IsClassVerificationReused(const DexFile& dex_file, uint16_t class_def_index) const;
+
   // Can we assume that the klass is loaded?
   bool CanAssumeClassIsLoaded(mirror::Class* klass)
       REQUIRES_SHARED(Locks::mutator_lock_);
@@ -535,6 +557,14 @@ class CompilerDriver {
 
   CompiledMethodStorage compiled_method_storage_;
 
+  std::unique_ptr<CompiledMethodCache> compiled_method_cache_;
+
+  // Class definitions that changed since the input VerifierDeps were recorded, per dex file.
+  SafeMap<const DexFile*, std::vector<bool>> changed_class_defs_;
+  // Whether FastVerify() validated the input VerifierDeps and only the changed classes are left
+  // to verify.
+  bool only_verify_changed_classes_;
+
   // Info for profile guided compilation.
   const ProfileCompilationInfo* const profile_compilation_info_;
 
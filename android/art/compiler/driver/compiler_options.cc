@@ -37,6 +37,9 @@ CompilerOptions::CompilerOptions()
       tiny_method_threshold_(kDefaultTinyMethodThreshold),
       num_dex_methods_threshold_(kDefaultNumDexMethodsThreshold),
       inline_max_code_units_(kUnsetInlineMaxCodeUnits),
+      method_time_budget_ms_(kDefaultMethodTimeBudgetMs),
+      method_arena_budget_mb_(kDefaultMethodArenaBudgetMb),
+      method_instruction_budget_(kDefaultMethodInstructionBudget),
       no_inline_from_(nullptr),
       boot_image_(false),
       core_image_(false),
@@ -58,6 +61,11 @@ CompilerOptions::CompilerOptions()
       init_failure_output_(nullptr),
       dump_cfg_file_name_(""),
       dump_cfg_append_(false),
+      dump_cfg_per_thread_(false),
+      dump_cfg_format_(DumpCfgFormat::kC1Visualizer),
+      dump_cfg_compression_(DumpCfgCompression::kNone),
+      dump_cfg_methods_(),
+      dump_cfg_passes_(),
       force_determinism_(false),
       deduplicate_code_(true),
       count_hotness_in_compiled_code_(false),
@@ -109,6 +117,30 @@ bool CompilerOptions::ParseRegisterAllocationStrategy(const std::string& option,
   return true;
 }
 
+bool CompilerOptions::ParseDumpCfgFormat(const std::string& option, std::string* error_msg) {
+  if (option == "c1visualizer") {
+    dump_cfg_format_ = DumpCfgFormat::kC1Visualizer;
+  } else if (option == "snapshot") {
+    dump_cfg_format_ = DumpCfgFormat::kSnapshot;
+  } else {
+    *error_msg = "Unrecognized CFG dump format. Try c1visualizer, or snapshot.";
+    return false;
+  }
+  return true;
+}
+
+bool CompilerOptions::ParseDumpCfgCompression(const std::string& option, std::string* error_msg) {
+  if (option == "none") {
+    dump_cfg_compression_ = DumpCfgCompression::kNone;
+  } else if (option == "gzip") {
+    dump_cfg_compression_ = DumpCfgCompression::kGzip;
+  } else {
+    *error_msg = "Unrecognized CFG dump compression. Try none, or gzip.";
+    return false;
+  }
+  return true;
+}
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wframe-larger-than="
 
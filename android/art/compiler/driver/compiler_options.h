@@ -48,6 +48,21 @@ class CompilerOptions FINAL {
   static const bool kDefaultGenerateMiniDebugInfo = false;
   static const size_t kDefaultInlineMaxCodeUnits = 32;
   static constexpr size_t kUnsetInlineMaxCodeUnits = -1;
+  // Per-method compilation budgets, zero means unlimited.
+  static const size_t kDefaultMethodTimeBudgetMs = 0;
+  static const size_t kDefaultMethodArenaBudgetMb = 0;
+  static const size_t kDefaultMethodInstructionBudget = 0;
+
+  // Format of the graphs dumped with --dump-cfg.
+  enum class DumpCfgFormat {
+    kC1Visualizer,  // Text format of the c1visualizer tool.
+    kSnapshot,      // Compact binary snapshot, see graph_visualizer.h.
+  };
+
+  enum class DumpCfgCompression {
+    kNone,
+    kGzip,
+  };
 
   CompilerOptions();
   ~CompilerOptions();
@@ -131,6 +146,18 @@ class CompilerOptions FINAL {
     inline_max_code_units_ = units;
   }
 
+  size_t GetMethodTimeBudgetMs() const {
+    return method_time_budget_ms_;
+  }
+
+  size_t GetMethodArenaBudgetMb() const {
+    return method_arena_budget_mb_;
+  }
+
+  size_t GetMethodInstructionBudget() const {
+    return method_instruction_budget_;
+  }
+
   double GetTopKProfileThreshold() const {
     return top_k_profile_threshold_;
   }
@@ -250,6 +277,28 @@ class CompilerOptions FINAL {
     return dump_cfg_append_;
   }
 
+  bool GetDumpCfgPerThread() const {
+    return dump_cfg_per_thread_;
+  }
+
+  DumpCfgFormat GetDumpCfgFormat() const {
+    return dump_cfg_format_;
+  }
+
+  DumpCfgCompression GetDumpCfgCompression() const {
+    return dump_cfg_compression_;
+  }
+
+  // Patterns of the methods whose graphs are dumped, all methods if empty.
+  const std::vector<std::string>& GetDumpCfgMethods() const {
+    return dump_cfg_methods_;
+  }
+
+  // Patterns of the passes after which graphs are dumped, all passes if empty.
+  const std::vector<std::string>& GetDumpCfgPasses() const {
+    return dump_cfg_passes_;
+  }
+
   bool IsForceDeterminism() const {
     return force_determinism_;
   }
@@ -280,6 +329,8 @@ class CompilerOptions FINAL {
 
  private:
   bool ParseDumpInitFailures(const std::string& option, std::string* error_msg);
+  bool ParseDumpCfgFormat(const std::string& option, std::string* error_msg);
+  bool ParseDumpCfgCompression(const std::string& option, std::string* error_msg);
   void ParseDumpCfgPasses(const StringPiece& option, UsageFn Usage);
   void ParseInlineMaxCodeUnits(const StringPiece& option, UsageFn Usage);
   void ParseNumDexMethods(const StringPiece& option, UsageFn Usage);
@@ -296,6 +347,9 @@ class CompilerOptions FINAL {
   size_t tiny_method_threshold_;
   size_t num_dex_methods_threshold_;
   size_t inline_max_code_units_;
+  size_t method_time_budget_ms_;
+  size_t method_arena_budget_mb_;
+  size_t method_instruction_budget_;
 
   // Dex files from which we should not inline code.
   // This is usually a very short list (i.e. a single dex file), so we
@@ -332,6 +386,11 @@ class CompilerOptions FINAL {
 
   std::string dump_cfg_file_name_;
   bool dump_cfg_append_;
+  bool dump_cfg_per_thread_;
+  DumpCfgFormat dump_cfg_format_;
+  DumpCfgCompression dump_cfg_compression_;
+  std::vector<std::string> dump_cfg_methods_;
+  std::vector<std::string> dump_cfg_passes_;
 
   // Whether the compiler should trade performance for determinism to guarantee exactly reproducible
   // outcomes.
@@ -357,6 +416,7 @@ class CompilerOptions FINAL {
   friend class Dex2Oat;
   friend class DexToDexDecompilerTest;
   friend class CommonCompilerTest;
+  friend class CompiledMethodCacheTest;
   friend class verifier::VerifierDepsTest;
 
   template <class Base>
@@ -52,6 +52,9 @@ inline bool ReadCompilerOptions(Base& map, CompilerOptions* options, std::string
   map.AssignIfExists(Base::TinyMethodMaxThreshold, &options->tiny_method_threshold_);
   map.AssignIfExists(Base::NumDexMethodsThreshold, &options->num_dex_methods_threshold_);
   map.AssignIfExists(Base::InlineMaxCodeUnitsThreshold, &options->inline_max_code_units_);
+  map.AssignIfExists(Base::MethodTimeBudgetMs, &options->method_time_budget_ms_);
+  map.AssignIfExists(Base::MethodArenaBudgetMb, &options->method_arena_budget_mb_);
+  map.AssignIfExists(Base::MethodInstructionBudget, &options->method_instruction_budget_);
   map.AssignIfExists(Base::GenerateDebugInfo, &options->generate_debug_info_);
   map.AssignIfExists(Base::GenerateMiniDebugInfo, &options->generate_mini_debug_info_);
   map.AssignIfExists(Base::GenerateBuildID, &options->generate_build_id_);
@@ -70,6 +73,21 @@ inline bool ReadCompilerOptions(Base& map, CompilerOptions* options, std::string
   if (map.Exists(Base::DumpCFGAppend)) {
     options->dump_cfg_append_ = true;
   }
+  if (map.Exists(Base::DumpCFGPerThread)) {
+    options->dump_cfg_per_thread_ = true;
+  }
+  if (map.Exists(Base::DumpCFGFormat)) {
+    if (!options->ParseDumpCfgFormat(*map.Get(Base::DumpCFGFormat), error_msg)) {
+      return false;
+    }
+  }
+  if (map.Exists(Base::DumpCFGCompression)) {
+    if (!options->ParseDumpCfgCompression(*map.Get(Base::DumpCFGCompression), error_msg)) {
+      return false;
+    }
+  }
+  map.AssignIfExists(Base::DumpCFGMethods, &options->dump_cfg_methods_);
+  map.AssignIfExists(Base::DumpCFGPasses, &options->dump_cfg_passes_);
   if (map.Exists(Base::RegisterAllocationStrategy)) {
     if (!options->ParseRegisterAllocationStrategy(*map.Get(Base::DumpInitFailures), error_msg)) {
       return false;
@@ -124,6 +142,16 @@ inline void AddCompilerOptionsArgumentParserOptions(Builder& b) {
           .template WithType<unsigned int>()
           .IntoKey(Map::InlineMaxCodeUnitsThreshold)
 
+      .Define("--method-time-budget-ms=_")
+          .template WithType<unsigned int>()
+          .IntoKey(Map::MethodTimeBudgetMs)
+      .Define("--method-arena-budget-mb=_")
+          .template WithType<unsigned int>()
+          .IntoKey(Map::MethodArenaBudgetMb)
+      .Define("--method-instruction-budget=_")
+          .template WithType<unsigned int>()
+          .IntoKey(Map::MethodInstructionBudget)
+
       .Define({"--generate-debug-info", "-g", "--no-generate-debug-info"})
           .WithValues({true, true, false})
           .IntoKey(Map::GenerateDebugInfo)
@@ -172,6 +200,20 @@ inline void AddCompilerOptionsArgumentParserOptions(Builder& b) {
           .IntoKey(Map::DumpCFG)
       .Define("--dump-cfg-append")
           .IntoKey(Map::DumpCFGAppend)
+      .Define("--dump-cfg-per-thread")
+          .IntoKey(Map::DumpCFGPerThread)
+      .Define("--dump-cfg-format=_")
+          .template WithType<std::string>()
+          .IntoKey(Map::DumpCFGFormat)
+      .Define("--dump-cfg-compression=_")
+          .template WithType<std::string>()
+          .IntoKey(Map::DumpCFGCompression)
+      .Define("--dump-cfg-methods=_")
+          .template WithType<ParseStringList<','>>()
+          .IntoKey(Map::DumpCFGMethods)
+      .Define("--dump-cfg-passes=_")
+          .template WithType<ParseStringList<','>>()
+          .IntoKey(Map::DumpCFGPasses)
 
       .Define("--register-allocation-strategy=_")
           .template WithType<std::string>()
@@ -1,5 +1,7 @@
 #include <sys/mman.h>
 #include <stdio.h>
+#include <algorithm>
+#include <thread>
 #include <typeinfo> 
 
 #include "arch/instruction_set_features.h"
@@ -10,6 +12,7 @@
 #include "base/array_slice.h"
 #include "base/callee_save_type.h"
 #include "base/stl_util.h"
+#include "base/time_utils.h"
 #include "base/timing_logger.h"
 
 #include "builder.h"
@@ -17,6 +20,7 @@
 #include "class_table.h"
 #include "code_generator.h"
 #include "common_runtime_test.h"
+#include "compilation_budget.h"
 #include "compiler.h"
 #include "constant_folding.h"
 #include "opaque_identification.h"
@@ -25,7 +29,10 @@
 #include "dex/code_item_accessors.h"
 #include "dex/verification_results.h"
 #include "dex/dex_file.h"
+#include "dex/dex_extraction_cache.h"
 #include "dex/dex_file-inl.h"
+#include "dex/dex_file_verifier.h"
+#include "dex/dex_verification_cache.h"
 
 #include "driver/compiler_driver.h"
 #include "driver/compiler_driver.h"
@@ -51,6 +58,12 @@
 
 
 namespace art{
+
+// Per-method budgets for the analysis passes.
+static constexpr uint64_t kMethodTimeBudgetMs = 10000;
+static constexpr size_t kMethodArenaBudgetMb = 512;
+static constexpr size_t kMethodInstructionBudget = 500000;
+
 class Gyoo : public CommonRuntimeTest {
 
 public: 
@@ -86,6 +99,20 @@ public:
   }
   void SetUp() {
     CommonRuntimeTest::SetUp();
+    // Large app dex files are verified on all cores, like dex2oat does with its compiler threads.
+    DexFileVerifier::SetDefaultNumThreads(std::max(1u, std::thread::hardware_concurrency()));
+    // Apps opened again by later runs skip the structural verification of their dex files.
+    const char* verification_cache_dir = getenv("ART_DEX_VERIFICATION_CACHE");
+    if (verification_cache_dir != nullptr) {
+      std::string error_msg;
+      CHECK(DexVerificationCache::Enable(verification_cache_dir, &error_msg)) << error_msg;
+    }
+    // Compressed dex files are inflated once and then mapped by every later run.
+    const char* extraction_cache_dir = getenv("ART_DEX_EXTRACTION_CACHE");
+    if (extraction_cache_dir != nullptr) {
+      std::string error_msg;
+      CHECK(DexExtractionCache::Enable(extraction_cache_dir, &error_msg)) << error_msg;
+    }
     {
       ScopedObjectAccess soa(Thread::Current());
 
@@ -258,42 +285,62 @@ public:
         interpreter_metadata,
         &handles);
 
+    // Bound the time and memory a single pathological method can take, so that one method
+    // does not hold up the whole app. The budget is checked between passes.
+    CompilationBudget budget(MsToNs(kMethodTimeBudgetMs),
+                             kMethodArenaBudgetMb * MB,
+                             kMethodInstructionBudget);
+    ScopedCompilationBudget scoped_budget(&graph, &budget);
+
     //std::cout << class_name << " : " << a << access_flag <<std::endl;
-    if( builder.BuildGraph() != GraphAnalysisResult::kAnalysisSuccess)
+    GraphAnalysisResult result = builder.BuildGraph();
+    if (result == GraphAnalysisResult::kAnalysisOverBudget) {
+      PrintSkippedMethod(a, method_idx, code_item_accessor, budget);
+      return;
+    }
+    if (result != GraphAnalysisResult::kAnalysisSuccess)
       return;
-    std::cout << "\t\t\t{\n";
-    std::cout << "\t\t\t\t\"id\" : \"" << a << "\",\n";
-    std::cout << "\t\t\t\t\"idx\" : " << method_idx << ",\n";
-    std::cout << "\t\t\t\t\"insns\" : " << code_item_accessor.InsnsSizeInCodeUnits() << ",\n";
-    std::cout << "\t\t\t\t\"fields\" : " << "[\n";
 
-    StringPrettyPrinter printer_before(&graph);
-    printer_before.VisitInsertionOrder();
-    std::string actual_before = printer_before.str();
-    
-    //std::cout << "before==\n" << actual_before << std::endl;
-    
     HConstantFolding(&graph, "constant_folding").Run();
     GraphChecker graph_checker_cf(&graph);
     graph_checker_cf.Run();
     ASSERT_TRUE(graph_checker_cf.IsValid());
 
-    StringPrettyPrinter printer_after_cf(&graph);
-    printer_after_cf.VisitInsertionOrder();
-    std::string actual_after_cf = printer_after_cf.str();
-    //std::cout << "after==\n" << actual_after_cf << std::endl;
-    
+    if (IsCompilationBudgetExhausted(&graph)) {
+      PrintSkippedMethod(a, method_idx, code_item_accessor, budget);
+      return;
+    }
+
     HDeadCodeElimination(&graph, nullptr /* stats */, "dead_code_elimination").Run();
     GraphChecker graph_checker_dce(&graph);
     graph_checker_dce.Run();
     ASSERT_TRUE(graph_checker_dce.IsValid());
     RemoveSuspendChecks(&graph);
 
-    //StringPrettyPrinter printer_after_dce(&graph);
-    //printer_after_dce.VisitInsertionOrder();
-    //std::string actual_after_dce = printer_after_dce.str();
+    // The graph is fully built and simplified by now; the identification pass is a single
+    // walk over it, so report the method even if the budget ran out during DCE.
+    std::cout << "\t\t\t{\n";
+    std::cout << "\t\t\t\t\"id\" : \"" << a << "\",\n";
+    std::cout << "\t\t\t\t\"idx\" : " << method_idx << ",\n";
+    std::cout << "\t\t\t\t\"insns\" : " << code_item_accessor.InsnsSizeInCodeUnits() << ",\n";
+    std::cout << "\t\t\t\t\"fields\" : " << "[\n";
     HOpaqueIdentification(&graph, "opaque_identification").Run();
-    //std::cout << "after==\n" << actual_after_dce << std::endl;
+    std::cout << "\t\t\t\t" << "]\n";
+    std::cout << "\t\t\t},\n";
+  }
+
+  // Record a method given up on because of its compilation budget. It has no field tallies,
+  // so the profile step ignores it, but it stays visible in the output.
+  void PrintSkippedMethod(const char* name,
+                          uint32_t method_idx,
+                          const CodeItemDebugInfoAccessor& code_item_accessor,
+                          const CompilationBudget& budget) {
+    std::cout << "\t\t\t{\n";
+    std::cout << "\t\t\t\t\"id\" : \"" << name << "\",\n";
+    std::cout << "\t\t\t\t\"idx\" : " << method_idx << ",\n";
+    std::cout << "\t\t\t\t\"insns\" : " << code_item_accessor.InsnsSizeInCodeUnits() << ",\n";
+    std::cout << "\t\t\t\t\"skipped\" : \"" << budget.GetExhaustedResource() << "\",\n";
+    std::cout << "\t\t\t\t\"fields\" : " << "[\n";
     std::cout << "\t\t\t\t" << "]\n";
     std::cout << "\t\t\t},\n";
   }
@@ -21,6 +21,7 @@
 #include "base/bit_vector-inl.h"
 #include "base/logging.h"
 #include "block_builder.h"
+#include "compilation_budget.h"
 #include "data_type-inl.h"
 #include "dex/verified_method.h"
 #include "driver/compiler_options.h"
@@ -161,6 +162,12 @@ GraphAnalysisResult HGraphBuilder::BuildGraph() {
     return kAnalysisInvalidBytecode;
   }
 
+  // SSA construction is super-linear on some obfuscated methods, do not start it if building
+  // the instructions alone already used up the compilation budget.
+  if (IsCompilationBudgetExhausted(graph_)) {
+    return kAnalysisOverBudget;
+  }
+
   // 5) Type the graph and eliminate dead/redundant phis.
   return ssa_builder.BuildSsa();
 }
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "compilation_budget.h"
+
+#include "base/arena_allocator.h"
+#include "base/time_utils.h"
+#include "nodes.h"
+
+namespace art {
+
+void CompilationBudget::Start() {
+  start_ns_ = (max_time_ns_ != 0u) ? NanoTime() : 0u;
+  exhausted_resource_ = Resource::kNone;
+}
+
+bool CompilationBudget::IsExhausted(const HGraph* graph) {
+  if (exhausted_resource_ != Resource::kNone) {
+    return true;
+  }
+  // Check the cheap counters first.
+  if (max_instructions_ != 0u &&
+      static_cast<size_t>(graph->GetCurrentInstructionId()) > max_instructions_) {
+    exhausted_resource_ = Resource::kInstructions;
+  } else if (max_arena_bytes_ != 0u && graph->GetAllocator()->BytesUsed() > max_arena_bytes_) {
+    exhausted_resource_ = Resource::kArenaMemory;
+  } else if (max_time_ns_ != 0u && NanoTime() - start_ns_ > max_time_ns_) {
+    exhausted_resource_ = Resource::kTime;
+  }
+  return exhausted_resource_ != Resource::kNone;
+}
+
+bool IsCompilationBudgetExhausted(const HGraph* graph) {
+  CompilationBudget* budget = graph->GetCompilationBudget();
+  return budget != nullptr && budget->IsExhausted(graph);
+}
+
+ScopedCompilationBudget::ScopedCompilationBudget(HGraph* graph, CompilationBudget* budget)
+    : graph_(graph) {
+  DCHECK(graph_->GetCompilationBudget() == nullptr);
+  if (!budget->IsUnlimited()) {
+    budget->Start();
+    graph_->SetCompilationBudget(budget);
+  }
+}
+
+ScopedCompilationBudget::~ScopedCompilationBudget() {
+  graph_->SetCompilationBudget(nullptr);
+}
+
+std::ostream& operator<<(std::ostream& os, const CompilationBudget::Resource& rhs) {
+  switch (rhs) {
+    case CompilationBudget::Resource::kNone: return os << "none";
+    case CompilationBudget::Resource::kTime: return os << "time";
+    case CompilationBudget::Resource::kArenaMemory: return os << "arena";
+    case CompilationBudget::Resource::kInstructions: return os << "instructions";
+  }
+  return os << "CompilationBudget::Resource[" << static_cast<int>(rhs) << "]";
+}
+
+}  // namespace art
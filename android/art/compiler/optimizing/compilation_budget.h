@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_COMPILER_OPTIMIZING_COMPILATION_BUDGET_H_
+#define ART_COMPILER_OPTIMIZING_COMPILATION_BUDGET_H_
+
+#include <ostream>
+
+#include "base/macros.h"
+#include "base/value_object.h"
+
+namespace art {
+
+class HGraph;
+
+// Limits on the wall time, arena memory and number of instructions the optimizing
+// compiler may spend on a single method. A limit of zero means unlimited.
+//
+// The budget is not enforced preemptively: the compiler polls it at pass boundaries and
+// degrades (runs a cheaper pass list) or gives up on the method once it is exhausted.
+class CompilationBudget : public ValueObject {
+ public:
+  enum class Resource {
+    kNone,
+    kTime,
+    kArenaMemory,
+    kInstructions,
+  };
+
+  CompilationBudget(uint64_t max_time_ns, size_t max_arena_bytes, size_t max_instructions)
+      : max_time_ns_(max_time_ns),
+        max_arena_bytes_(max_arena_bytes),
+        max_instructions_(max_instructions),
+        start_ns_(0u),
+        exhausted_resource_(Resource::kNone) {}
+
+  static CompilationBudget Unlimited() {
+    return CompilationBudget(0u, 0u, 0u);
+  }
+
+  bool IsUnlimited() const {
+    return max_time_ns_ == 0u && max_arena_bytes_ == 0u && max_instructions_ == 0u;
+  }
+
+  // Start measuring wall time from now and forget about any previous exhaustion.
+  void Start();
+
+  // Check the resources used so far by `graph`. Once a budget is exhausted it stays
+  // exhausted until the next call to Start().
+  bool IsExhausted(const HGraph* graph);
+
+  // The first resource found exhausted, or kNone.
+  Resource GetExhaustedResource() const {
+    return exhausted_resource_;
+  }
+
+ private:
+  const uint64_t max_time_ns_;
+  const size_t max_arena_bytes_;
+  const size_t max_instructions_;
+
+  uint64_t start_ns_;
+  Resource exhausted_resource_;
+};
+
+std::ostream& operator<<(std::ostream& os, const CompilationBudget::Resource& rhs);
+
+// Whether `graph` has a budget and has exhausted it.
+bool IsCompilationBudgetExhausted(const HGraph* graph);
+
+// Attaches a (typically stack allocated) budget to a graph for the lifetime of this object,
+// so that the graph never keeps a dangling pointer on any return path. An unlimited budget
+// is not attached at all.
+class ScopedCompilationBudget : public ValueObject {
+ public:
+  ScopedCompilationBudget(HGraph* graph, CompilationBudget* budget);
+  ~ScopedCompilationBudget();
+
+ private:
+  HGraph* const graph_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedCompilationBudget);
+};
+
+}  // namespace art
+
+#endif  // ART_COMPILER_OPTIMIZING_COMPILATION_BUDGET_H_
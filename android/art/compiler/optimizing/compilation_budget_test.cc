@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "compilation_budget.h"
+
+#include "nodes.h"
+#include "optimizing_unit_test.h"
+
+#include "gtest/gtest.h"
+
+namespace art {
+
+class CompilationBudgetTest : public OptimizingUnitTest {};
+
+TEST_F(CompilationBudgetTest, UnlimitedIsNeverExhausted) {
+  HGraph* graph = CreateGraph();
+  CompilationBudget budget = CompilationBudget::Unlimited();
+  ASSERT_TRUE(budget.IsUnlimited());
+  budget.Start();
+  for (size_t i = 0; i != 100u; ++i) {
+    graph->GetNextInstructionId();
+  }
+  ASSERT_FALSE(budget.IsExhausted(graph));
+  ASSERT_EQ(CompilationBudget::Resource::kNone, budget.GetExhaustedResource());
+}
+
+TEST_F(CompilationBudgetTest, InstructionBudget) {
+  HGraph* graph = CreateGraph();
+  CompilationBudget budget(/* max_time_ns */ 0u,
+                           /* max_arena_bytes */ 0u,
+                           /* max_instructions */ 10u);
+  ASSERT_FALSE(budget.IsUnlimited());
+  budget.Start();
+  graph->SetCompilationBudget(&budget);
+  for (size_t i = 0; i != 10u; ++i) {
+    graph->GetNextInstructionId();
+  }
+  ASSERT_FALSE(IsCompilationBudgetExhausted(graph));
+  graph->GetNextInstructionId();
+  ASSERT_TRUE(IsCompilationBudgetExhausted(graph));
+  ASSERT_EQ(CompilationBudget::Resource::kInstructions, budget.GetExhaustedResource());
+}
+
+TEST_F(CompilationBudgetTest, ExhaustionIsStickyUntilStart) {
+  HGraph* graph = CreateGraph();
+  CompilationBudget budget(/* max_time_ns */ 0u,
+                           /* max_arena_bytes */ 0u,
+                           /* max_instructions */ 1u);
+  budget.Start();
+  graph->GetNextInstructionId();
+  graph->GetNextInstructionId();
+  ASSERT_TRUE(budget.IsExhausted(graph));
+
+  // A fresh graph is within budget, but the previous exhaustion is remembered.
+  HGraph* other_graph = CreateGraph();
+  ASSERT_TRUE(budget.IsExhausted(other_graph));
+  budget.Start();
+  ASSERT_FALSE(budget.IsExhausted(other_graph));
+}
+
+TEST_F(CompilationBudgetTest, ScopedBudget) {
+  HGraph* graph = CreateGraph();
+  {
+    CompilationBudget budget(/* max_time_ns */ 0u,
+                             /* max_arena_bytes */ 0u,
+                             /* max_instructions */ 10u);
+    ScopedCompilationBudget scoped_budget(graph, &budget);
+    ASSERT_EQ(&budget, graph->GetCompilationBudget());
+  }
+  ASSERT_TRUE(graph->GetCompilationBudget() == nullptr);
+
+  // An unlimited budget is not attached at all.
+  CompilationBudget unlimited = CompilationBudget::Unlimited();
+  ScopedCompilationBudget scoped_unlimited(graph, &unlimited);
+  ASSERT_TRUE(graph->GetCompilationBudget() == nullptr);
+}
+
+TEST_F(CompilationBudgetTest, NoBudget) {
+  HGraph* graph = CreateGraph();
+  ASSERT_FALSE(IsCompilationBudgetExhausted(graph));
+}
+
+}  // namespace art
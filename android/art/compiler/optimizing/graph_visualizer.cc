@@ -17,11 +17,22 @@
 #include "graph_visualizer.h"
 
 #include <dlfcn.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <zlib.h>
 
+#include <algorithm>
 #include <cctype>
+#include <cstring>
 #include <sstream>
 
+#include "android-base/stringprintf.h"
+
 #include "art_method.h"
+#include "base/leb128.h"
+#include "base/os.h"
+#include "base/unix_file/fd_file.h"
+#include "base/utils.h"
 #include "bounds_check_elimination.h"
 #include "builder.h"
 #include "code_generator.h"
@@ -844,13 +855,133 @@ class HGraphVisualizerPrinter : public HGraphDelegateVisitor {
   DISALLOW_COPY_AND_ASSIGN(HGraphVisualizerPrinter);
 };
 
+/**
+ * HGraph visitor to generate the compact binary snapshot described in graph_visualizer.h.
+ */
+class HGraphSnapshotPrinter : public ValueObject {
+ public:
+  explicit HGraphSnapshotPrinter(std::ostream& output) : output_(output), buffer_() {}
+
+  void PrintHeader() {
+    static constexpr const char* kKindNames[] = {
+#define DECLARE_KIND_NAME(type, super) #type,
+      FOR_EACH_INSTRUCTION(DECLARE_KIND_NAME)
+#undef DECLARE_KIND_NAME
+    };
+    buffer_.push_back('H');
+    EncodeUnsignedLeb128(&buffer_, HGraphVisualizer::kSnapshotVersion);
+    EncodeUnsignedLeb128(&buffer_, arraysize(kKindNames));
+    for (const char* kind_name : kKindNames) {
+      PrintString(kind_name);
+    }
+    Flush();
+  }
+
+  void PrintMethod(const char* method_name) {
+    buffer_.push_back('M');
+    PrintString(method_name);
+    Flush();
+  }
+
+  void PrintGraph(HGraph* graph,
+                  const char* pass_name,
+                  bool is_after_pass,
+                  bool graph_in_bad_state) {
+    buffer_.push_back('G');
+    PrintString(pass_name);
+    EncodeUnsignedLeb128(&buffer_, (is_after_pass ? 1u : 0u) | (graph_in_bad_state ? 2u : 0u));
+    size_t num_blocks = 0u;
+    for (HBasicBlock* block : graph->GetBlocks()) {
+      if (block != nullptr) {
+        ++num_blocks;
+      }
+    }
+    EncodeUnsignedLeb128(&buffer_, num_blocks);
+    for (HBasicBlock* block : graph->GetBlocks()) {
+      if (block != nullptr) {
+        PrintBlock(block);
+      }
+    }
+    Flush();
+  }
+
+ private:
+  void PrintString(const char* str) {
+    size_t length = strlen(str);
+    EncodeUnsignedLeb128(&buffer_, length);
+    buffer_.insert(buffer_.end(), str, str + length);
+  }
+
+  void PrintBlocks(const ArenaVector<HBasicBlock*>& blocks) {
+    EncodeUnsignedLeb128(&buffer_, blocks.size());
+    for (HBasicBlock* block : blocks) {
+      EncodeUnsignedLeb128(&buffer_, block->GetBlockId());
+    }
+  }
+
+  void PrintBlock(HBasicBlock* block) {
+    EncodeUnsignedLeb128(&buffer_, block->GetBlockId());
+    EncodeUnsignedLeb128(&buffer_,
+                         (block->IsCatchBlock() ? 1u : 0u) | (block->IsLoopHeader() ? 2u : 0u));
+    HBasicBlock* dominator = block->GetDominator();
+    EncodeUnsignedLeb128(&buffer_, dominator != nullptr ? dominator->GetBlockId() + 1u : 0u);
+    PrintBlocks(block->GetPredecessors());
+    PrintBlocks(block->GetSuccessors());
+    size_t num_instructions = 0u;
+    for (HInstructionIterator it(block->GetPhis()); !it.Done(); it.Advance()) {
+      ++num_instructions;
+    }
+    for (HInstructionIterator it(block->GetInstructions()); !it.Done(); it.Advance()) {
+      ++num_instructions;
+    }
+    EncodeUnsignedLeb128(&buffer_, num_instructions);
+    for (HInstructionIterator it(block->GetPhis()); !it.Done(); it.Advance()) {
+      PrintInstruction(it.Current());
+    }
+    for (HInstructionIterator it(block->GetInstructions()); !it.Done(); it.Advance()) {
+      PrintInstruction(it.Current());
+    }
+  }
+
+  void PrintInstructionId(HInstruction* instruction) {
+    // Instructions not added to the graph, e.g. in a bad state, have the id -1.
+    EncodeUnsignedLeb128(&buffer_, static_cast<uint32_t>(instruction->GetId() + 1));
+  }
+
+  void PrintInstruction(HInstruction* instruction) {
+    PrintInstructionId(instruction);
+    EncodeUnsignedLeb128(&buffer_, static_cast<uint32_t>(instruction->GetKind()));
+    EncodeUnsignedLeb128(&buffer_, static_cast<uint32_t>(instruction->GetType()));
+    HInputsRef inputs = instruction->GetInputs();
+    EncodeUnsignedLeb128(&buffer_, inputs.size());
+    for (HInstruction* input : inputs) {
+      PrintInstructionId(input);
+    }
+  }
+
+  void Flush() {
+    output_.write(reinterpret_cast<const char*>(buffer_.data()), buffer_.size());
+    buffer_.clear();
+  }
+
+  std::ostream& output_;
+  std::vector<uint8_t> buffer_;
+
+  DISALLOW_COPY_AND_ASSIGN(HGraphSnapshotPrinter);
+};
+
 HGraphVisualizer::HGraphVisualizer(std::ostream* output,
                                    HGraph* graph,
-                                   const CodeGenerator& codegen)
-  : output_(output), graph_(graph), codegen_(codegen) {}
+                                   const CodeGenerator& codegen,
+                                   CompilerOptions::DumpCfgFormat format)
+  : output_(output), graph_(graph), codegen_(codegen), format_(format) {}
 
 void HGraphVisualizer::PrintHeader(const char* method_name) const {
   DCHECK(output_ != nullptr);
+  if (format_ == CompilerOptions::DumpCfgFormat::kSnapshot) {
+    HGraphSnapshotPrinter(*output_).PrintMethod(method_name);
+    return;
+  }
   HGraphVisualizerPrinter printer(graph_, *output_, "", true, false, codegen_);
   printer.StartTag("compilation");
   printer.PrintProperty("name", method_name);
@@ -865,6 +996,11 @@ void HGraphVisualizer::DumpGraph(const char* pass_name,
                                  bool graph_in_bad_state) const {
   DCHECK(output_ != nullptr);
   if (!graph_->GetBlocks().empty()) {
+    if (format_ == CompilerOptions::DumpCfgFormat::kSnapshot) {
+      HGraphSnapshotPrinter(*output_).PrintGraph(
+          graph_, pass_name, is_after_pass, graph_in_bad_state);
+      return;
+    }
     HGraphVisualizerPrinter printer(graph_,
                                     *output_,
                                     pass_name,
@@ -878,6 +1014,12 @@ void HGraphVisualizer::DumpGraph(const char* pass_name,
 void HGraphVisualizer::DumpGraphWithDisassembly() const {
   DCHECK(output_ != nullptr);
   if (!graph_->GetBlocks().empty()) {
+    if (format_ == CompilerOptions::DumpCfgFormat::kSnapshot) {
+      // The snapshot does not include the generated code.
+      HGraphSnapshotPrinter(*output_).PrintGraph(
+          graph_, "disassembly", /* is_after_pass */ true, /* graph_in_bad_state */ false);
+      return;
+    }
     HGraphVisualizerPrinter printer(graph_,
                                     *output_,
                                     "disassembly",
@@ -889,4 +1031,183 @@ void HGraphVisualizer::DumpGraphWithDisassembly() const {
   }
 }
 
+void HGraphVisualizer::PrintSnapshotHeader(std::ostream* output) {
+  DCHECK(output != nullptr);
+  HGraphSnapshotPrinter(*output).PrintHeader();
+}
+
+// A file of the visualizer output, compressed with gzip if requested.
+class HGraphVisualizerOutput::Stream {
+ public:
+  Stream(std::unique_ptr<File> file, gzFile gz_file)
+      : file_(std::move(file)), gz_file_(gz_file) {}
+
+  ~Stream() {
+    if (gz_file_ != nullptr) {
+      if (gzclose(gz_file_) != Z_OK) {
+        LOG(WARNING) << "Failed to close compressed CFG dump";
+      }
+    } else if (file_->FlushClose() != 0) {
+      PLOG(WARNING) << "Failed to close CFG dump " << file_->GetPath();
+    }
+  }
+
+  bool Write(const std::string& data) {
+    if (gz_file_ != nullptr) {
+      // gzwrite() takes an unsigned length, write large dumps in chunks.
+      static constexpr size_t kMaxChunkSize = 1 * GB;
+      for (size_t pos = 0; pos != data.size(); ) {
+        unsigned chunk_size = static_cast<unsigned>(std::min(data.size() - pos, kMaxChunkSize));
+        if (gzwrite(gz_file_, data.data() + pos, chunk_size) != static_cast<int>(chunk_size)) {
+          return false;
+        }
+        pos += chunk_size;
+      }
+      return true;
+    }
+    return file_->WriteFully(data.data(), data.size());
+  }
+
+ private:
+  // The file, whose descriptor is owned by `gz_file_` when compressing.
+  std::unique_ptr<File> file_;
+  gzFile gz_file_;
+
+  DISALLOW_COPY_AND_ASSIGN(Stream);
+};
+
+HGraphVisualizerOutput::HGraphVisualizerOutput(const CompilerOptions& options)
+    : file_name_(options.GetDumpCfgFileName()),
+      append_(options.GetDumpCfgAppend()),
+      per_thread_(options.GetDumpCfgPerThread()),
+      format_(options.GetDumpCfgFormat()),
+      compression_(options.GetDumpCfgCompression()),
+      methods_(options.GetDumpCfgMethods()),
+      passes_(options.GetDumpCfgPasses()),
+      lock_("Visualizer dump lock"),
+      shared_stream_(),
+      thread_streams_() {}
+
+HGraphVisualizerOutput::~HGraphVisualizerOutput() {}
+
+std::unique_ptr<HGraphVisualizerOutput> HGraphVisualizerOutput::Create(
+    const CompilerOptions& options, std::string* error_msg) {
+  DCHECK(!options.GetDumpCfgFileName().empty());
+  std::unique_ptr<HGraphVisualizerOutput> output(new HGraphVisualizerOutput(options));
+  if (!output->per_thread_) {
+    Stream* stream = output->OpenStream(output->file_name_, error_msg);
+    if (stream == nullptr) {
+      return nullptr;
+    }
+    MutexLock mu(Thread::Current(), output->lock_);
+    output->shared_stream_.reset(stream);
+  }
+  return output;
+}
+
+HGraphVisualizerOutput::Stream* HGraphVisualizerOutput::OpenStream(const std::string& file_name,
+                                                                   std::string* error_msg) const {
+  int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (append_ ? O_APPEND : O_TRUNC);
+  std::unique_ptr<File> file(
+      OS::OpenFileWithFlags(file_name.c_str(), flags, /* auto_flush */ false));
+  if (file == nullptr) {
+    *error_msg = android::base::StringPrintf("Failed to open CFG dump %s: %s",
+                                             file_name.c_str(),
+                                             strerror(errno));
+    return nullptr;
+  }
+  gzFile gz_file = nullptr;
+  if (compression_ == CompilerOptions::DumpCfgCompression::kGzip) {
+    // Appending adds a new gzip member, which decompresses as a continuation of the file.
+    gz_file = gzdopen(file->Fd(), append_ ? "ab" : "wb");
+    if (gz_file == nullptr) {
+      *error_msg = "Failed to start compressing CFG dump " + file_name;
+      return nullptr;
+    }
+    file->Release();
+  }
+  std::unique_ptr<Stream> stream(new Stream(std::move(file), gz_file));
+  if (format_ == CompilerOptions::DumpCfgFormat::kSnapshot) {
+    std::ostringstream header;
+    HGraphVisualizer::PrintSnapshotHeader(&header);
+    if (!stream->Write(header.str())) {
+      *error_msg = "Failed to write CFG dump " + file_name;
+      return nullptr;
+    }
+  }
+  return stream.release();
+}
+
+std::string HGraphVisualizerOutput::GetThreadFileName(pid_t tid) const {
+  // Insert the thread id before the extensions, so that tools still recognize the files.
+  size_t base_name_start = file_name_.rfind('/');
+  base_name_start = (base_name_start == std::string::npos) ? 0u : base_name_start + 1u;
+  size_t extension_start = file_name_.find('.', base_name_start);
+  if (extension_start == std::string::npos) {
+    extension_start = file_name_.size();
+  }
+  return android::base::StringPrintf("%s.%d%s",
+                                     file_name_.substr(0u, extension_start).c_str(),
+                                     static_cast<int>(tid),
+                                     file_name_.substr(extension_start).c_str());
+}
+
+static bool MatchesAnyPattern(const std::vector<std::string>& patterns, const char* name) {
+  for (const std::string& pattern : patterns) {
+    if (fnmatch(pattern.c_str(), name, /* flags */ 0) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool HGraphVisualizerOutput::IsMethodDumped(const char* method_name) const {
+  return methods_.empty() || MatchesAnyPattern(methods_, method_name);
+}
+
+bool HGraphVisualizerOutput::IsPassDumped(const char* pass_name) const {
+  if (passes_.empty() || MatchesAnyPattern(passes_, pass_name)) {
+    return true;
+  }
+  // Also match passes by their name without the "$<suffix>" that distinguishes the
+  // occurrences of the same optimization, e.g. "dead_code_elimination$initial".
+  const char* suffix = strchr(pass_name, '$');
+  return suffix != nullptr &&
+      MatchesAnyPattern(passes_, std::string(pass_name, suffix - pass_name).c_str());
+}
+
+void HGraphVisualizerOutput::Write(const std::string& data) {
+  if (data.empty()) {
+    return;
+  }
+  Thread* self = Thread::Current();
+  if (!per_thread_) {
+    MutexLock mu(self, lock_);
+    if (shared_stream_ != nullptr && !shared_stream_->Write(data)) {
+      LOG(WARNING) << "Failed to write CFG dump " << file_name_ << ", disabling it";
+      shared_stream_.reset();
+    }
+    return;
+  }
+  pid_t tid = GetTid();
+  Stream* stream;
+  {
+    MutexLock mu(self, lock_);
+    auto it = thread_streams_.find(tid);
+    if (it == thread_streams_.end()) {
+      std::string error_msg;
+      std::unique_ptr<Stream> new_stream(OpenStream(GetThreadFileName(tid), &error_msg));
+      if (new_stream == nullptr) {
+        LOG(WARNING) << error_msg;
+      }
+      it = thread_streams_.emplace(tid, std::move(new_stream)).first;
+    }
+    stream = it->second.get();
+  }
+  // The stream of this thread is not written by any other thread.
+  if (stream != nullptr && !stream->Write(data)) {
+    LOG(WARNING) << "Failed to write CFG dump " << GetThreadFileName(tid);
+  }
+}
+
 }  // namespace art
@@ -17,11 +17,19 @@
 #ifndef ART_COMPILER_OPTIMIZING_GRAPH_VISUALIZER_H_
 #define ART_COMPILER_OPTIMIZING_GRAPH_VISUALIZER_H_
 
+#include <sys/types.h>
+
+#include <map>
+#include <memory>
 #include <ostream>
+#include <string>
+#include <vector>
 
 #include "arch/instruction_set.h"
 #include "base/arena_containers.h"
+#include "base/mutex.h"
 #include "base/value_object.h"
+#include "driver/compiler_options.h"
 
 namespace art {
 
@@ -33,7 +41,6 @@ class SlowPathCode;
 
 /**
  * This class outputs the HGraph in the C1visualizer format.
- * Note: Currently only works if the compiler is single threaded.
  */
 struct GeneratedCodeInterval {
   size_t start;
@@ -97,24 +104,97 @@ class DisassemblyInformation {
   ArenaVector<SlowPathCodeInfo> slow_path_intervals_;
 };
 
+// Outputs the HGraph either in the C1visualizer format or as a compact binary snapshot.
+//
+// A snapshot is a sequence of records starting with a tag byte. Integers are unsigned
+// LEB128 and strings are a length followed by the characters:
+//   'H' header:  version, number of instruction kinds, name of each kind.
+//   'M' method:  name. The graphs that follow belong to this method.
+//   'G' graph:   pass name, flags (1: after pass, 2: bad state), number of blocks and each
+//                block as id, flags (1: catch block, 2: loop header), dominator id + 1 (0 if
+//                none), predecessor ids, successor ids (both prefixed by their count), the
+//                number of phis and instructions and each of them as id + 1 (0 if none),
+//                kind, type and input ids + 1 prefixed by their count.
+// A header is written at the start of each output stream, and again when appending to an
+// existing one.
 class HGraphVisualizer : public ValueObject {
  public:
+  static constexpr uint32_t kSnapshotVersion = 1;
+
   HGraphVisualizer(std::ostream* output,
                    HGraph* graph,
-                   const CodeGenerator& codegen);
+                   const CodeGenerator& codegen,
+                   CompilerOptions::DumpCfgFormat format =
+                       CompilerOptions::DumpCfgFormat::kC1Visualizer);
 
   void PrintHeader(const char* method_name) const;
   void DumpGraph(const char* pass_name, bool is_after_pass, bool graph_in_bad_state) const;
   void DumpGraphWithDisassembly() const;
 
+  static void PrintSnapshotHeader(std::ostream* output);
+
  private:
   std::ostream* const output_;
   HGraph* const graph_;
   const CodeGenerator& codegen_;
+  const CompilerOptions::DumpCfgFormat format_;
 
   DISALLOW_COPY_AND_ASSIGN(HGraphVisualizer);
 };
 
+// Destination of the graphs dumped with --dump-cfg, shared by all compiler threads.
+//
+// Compiler threads buffer the dump of a method and write it in one piece, so that methods
+// compiled concurrently do not interleave in a shared file. With --dump-cfg-per-thread,
+// each thread writes to its own file named after the thread id instead, and can write
+// partial dumps of large methods without synchronization.
+class HGraphVisualizerOutput {
+ public:
+  static std::unique_ptr<HGraphVisualizerOutput> Create(const CompilerOptions& options,
+                                                        std::string* error_msg);
+
+  ~HGraphVisualizerOutput();
+
+  // Whether graphs of `method_name` should be dumped, according to --dump-cfg-methods.
+  bool IsMethodDumped(const char* method_name) const;
+  // Whether graphs should be dumped around `pass_name`, according to --dump-cfg-passes.
+  bool IsPassDumped(const char* pass_name) const;
+
+  CompilerOptions::DumpCfgFormat GetFormat() const {
+    return format_;
+  }
+
+  bool IsPerThread() const {
+    return per_thread_;
+  }
+
+  // Append `data` to the output of the calling thread.
+  void Write(const std::string& data) REQUIRES(!lock_);
+
+ private:
+  class Stream;
+
+  explicit HGraphVisualizerOutput(const CompilerOptions& options);
+
+  Stream* OpenStream(const std::string& file_name, std::string* error_msg) const;
+  std::string GetThreadFileName(pid_t tid) const;
+
+  const std::string file_name_;
+  const bool append_;
+  const bool per_thread_;
+  const CompilerOptions::DumpCfgFormat format_;
+  const CompilerOptions::DumpCfgCompression compression_;
+  const std::vector<std::string> methods_;
+  const std::vector<std::string> passes_;
+
+  Mutex lock_;
+  std::unique_ptr<Stream> shared_stream_ GUARDED_BY(lock_);
+  // Streams of --dump-cfg-per-thread, only written by their thread.
+  std::map<pid_t, std::unique_ptr<Stream>> thread_streams_ GUARDED_BY(lock_);
+
+  DISALLOW_COPY_AND_ASSIGN(HGraphVisualizerOutput);
+};
+
 }  // namespace art
 
 #endif  // ART_COMPILER_OPTIMIZING_GRAPH_VISUALIZER_H_
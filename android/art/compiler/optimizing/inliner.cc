@@ -1430,6 +1430,7 @@ bool HInliner::TryBuildAndInline(HInvoke* invoke_instruction,
       LOG_SUCCESS() << "Successfully replaced pattern of invoke "
                     << method->PrettyMethod();
       MaybeRecordStat(stats_, MethodCompilationStat::kReplacedInvokeWithSimplePattern);
+      outermost_graph_->AddInlinedMethod(method);
       return true;
     }
     LOG_FAIL(stats_, MethodCompilationStat::kNotInlinedWont)
@@ -1499,6 +1500,7 @@ bool HInliner::TryBuildAndInline(HInvoke* invoke_instruction,
 
   LOG_SUCCESS() << method->PrettyMethod();
   MaybeRecordStat(stats_, MethodCompilationStat::kInlinedInvoke);
+  outermost_graph_->AddInlinedMethod(method);
   return true;
 }
 
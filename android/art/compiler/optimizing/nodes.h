@@ -48,6 +48,7 @@
 namespace art {
 
 class ArenaStack;
+class CompilationBudget;
 class GraphChecker;
 class HBasicBlock;
 class HConstructorFence;
@@ -128,6 +129,7 @@ enum GraphAnalysisResult {
   kAnalysisInvalidBytecode,
   kAnalysisFailThrowCatchLoop,
   kAnalysisFailAmbiguousArrayOp,
+  kAnalysisOverBudget,
   kAnalysisSuccess,
 };
 
@@ -349,7 +351,10 @@ class HGraph : public ArenaObject<kArenaAllocGraph> {
         art_method_(nullptr),
         inexact_object_rti_(ReferenceTypeInfo::CreateInvalid()),
         osr_(osr),
-        cha_single_implementation_list_(allocator->Adapter(kArenaAllocCHA)) {
+        compilation_budget_(nullptr),
+        compiled_over_budget_(false),
+        cha_single_implementation_list_(allocator->Adapter(kArenaAllocCHA)),
+        inlined_methods_(allocator->Adapter(kArenaAllocGraph)) {
     blocks_.reserve(kDefaultNumberOfBlocks);
   }
 
@@ -581,6 +586,14 @@ class HGraph : public ArenaObject<kArenaAllocGraph> {
     cha_single_implementation_list_.insert(method);
   }
 
+  const ArenaSet<ArtMethod*>& GetInlinedMethods() const {
+    return inlined_methods_;
+  }
+
+  void AddInlinedMethod(ArtMethod* method) {
+    inlined_methods_.insert(method);
+  }
+
   bool HasShouldDeoptimizeFlag() const {
     return number_of_cha_guards_ != 0;
   }
@@ -600,6 +613,14 @@ class HGraph : public ArenaObject<kArenaAllocGraph> {
   ArtMethod* GetArtMethod() const { return art_method_; }
   void SetArtMethod(ArtMethod* method) { art_method_ = method; }
 
+  // The budget for compiling this graph, or null if unlimited.
+  CompilationBudget* GetCompilationBudget() const { return compilation_budget_; }
+  void SetCompilationBudget(CompilationBudget* budget) { compilation_budget_ = budget; }
+
+  // Whether the budget ran out and the graph was compiled with the degraded pass list.
+  bool IsCompiledOverBudget() const { return compiled_over_budget_; }
+  void SetCompiledOverBudget() { compiled_over_budget_ = true; }
+
   // Returns an instruction with the opposite Boolean value from 'cond'.
   // The instruction has been inserted into the graph, either as a constant, or
   // before cursor.
@@ -751,9 +772,17 @@ class HGraph : public ArenaObject<kArenaAllocGraph> {
   // compiled code entries which the interpreter can directly jump to.
   const bool osr_;
 
+  // Resource limits polled at pass boundaries. Not owned; null means unlimited.
+  CompilationBudget* compilation_budget_;
+  bool compiled_over_budget_;
+
   // List of methods that are assumed to have single implementation.
   ArenaSet<ArtMethod*> cha_single_implementation_list_;
 
+  // Methods whose code was inlined or pattern-substituted into this graph, recorded on the
+  // outermost graph.
+  ArenaSet<ArtMethod*> inlined_methods_;
+
   friend class SsaBuilder;           // For caching constants.
   friend class SsaLivenessAnalysis;  // For the linear order.
   friend class HInliner;             // For the reverse post order.
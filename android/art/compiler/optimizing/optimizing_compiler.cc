@@ -16,7 +16,6 @@
 
 #include "optimizing_compiler.h"
 
-#include <fstream>
 #include <memory>
 #include <sstream>
 
@@ -29,9 +28,11 @@
 #include "base/macros.h"
 #include "base/mutex.h"
 #include "base/scoped_arena_allocator.h"
+#include "base/time_utils.h"
 #include "base/timing_logger.h"
 #include "builder.h"
 #include "code_generator.h"
+#include "compilation_budget.h"
 #include "compiled_method.h"
 #include "compiler.h"
 #include "debug/elf_debug_writer.h"
@@ -39,6 +40,7 @@
 #include "dex/dex_file_types.h"
 #include "dex/verification_results.h"
 #include "dex/verified_method.h"
+#include "driver/compiled_method_cache.h"
 #include "driver/compiler_driver-inl.h"
 #include "driver/compiler_options.h"
 #include "driver/dex_compilation_unit.h"
@@ -101,15 +103,17 @@ class CodeVectorAllocator FINAL : public CodeAllocator {
  */
 static constexpr const char kStringFilter[] = "";
 
+// Size of the buffered dump above which it is written to a per-thread visualizer output.
+static constexpr size_t kVisualizerFlushThreshold = 1 * MB;
+
 class PassScope;
 
 class PassObserver : public ValueObject {
  public:
   PassObserver(HGraph* graph,
                CodeGenerator* codegen,
-               std::ostream* visualizer_output,
-               CompilerDriver* compiler_driver,
-               Mutex& dump_mutex)
+               HGraphVisualizerOutput* visualizer_output,
+               CompilerDriver* compiler_driver)
       : graph_(graph),
         cached_method_name_(),
         timing_logger_enabled_(compiler_driver->GetCompilerOptions().GetDumpTimings()),
@@ -117,14 +121,19 @@ class PassObserver : public ValueObject {
         disasm_info_(graph->GetAllocator()),
         visualizer_oss_(),
         visualizer_output_(visualizer_output),
-        visualizer_enabled_(!compiler_driver->GetCompilerOptions().GetDumpCfgFileName().empty()),
-        visualizer_(&visualizer_oss_, graph, *codegen),
-        visualizer_dump_mutex_(dump_mutex),
+        visualizer_enabled_(visualizer_output != nullptr),
+        visualizer_(&visualizer_oss_,
+                    graph,
+                    *codegen,
+                    compiler_driver->GetCompilerOptions().GetDumpCfgFormat()),
         graph_in_bad_state_(false) {
     if (timing_logger_enabled_ || visualizer_enabled_) {
       if (!IsVerboseMethod(compiler_driver, GetMethodName())) {
         timing_logger_enabled_ = visualizer_enabled_ = false;
       }
+      if (visualizer_enabled_ && !visualizer_output_->IsMethodDumped(GetMethodName())) {
+        visualizer_enabled_ = false;
+      }
       if (visualizer_enabled_) {
         visualizer_.PrintHeader(GetMethodName());
         codegen->SetDisassemblyInformation(&disasm_info_);
@@ -137,13 +146,16 @@ class PassObserver : public ValueObject {
       LOG(INFO) << "TIMINGS " << GetMethodName();
       LOG(INFO) << Dumpable<TimingLogger>(timing_logger_);
     }
-    DCHECK(visualizer_oss_.str().empty());
+    // Write what remains of the dump of the method.
+    if (visualizer_enabled_) {
+      FlushVisualizer();
+    }
   }
 
-  void DumpDisassembly() REQUIRES(!visualizer_dump_mutex_) {
-    if (visualizer_enabled_) {
+  void DumpDisassembly() {
+    if (visualizer_enabled_ && visualizer_output_->IsPassDumped("disassembly")) {
       visualizer_.DumpGraphWithDisassembly();
-      FlushVisualizer();
+      MaybeFlushVisualizer();
     }
   }
 
@@ -158,34 +170,41 @@ class PassObserver : public ValueObject {
   }
 
  private:
-  void StartPass(const char* pass_name) REQUIRES(!visualizer_dump_mutex_) {
+  void StartPass(const char* pass_name) {
     VLOG(compiler) << "Starting pass: " << pass_name;
     // Dump graph first, then start timer.
-    if (visualizer_enabled_) {
+    if (visualizer_enabled_ && visualizer_output_->IsPassDumped(pass_name)) {
       visualizer_.DumpGraph(pass_name, /* is_after_pass */ false, graph_in_bad_state_);
-      FlushVisualizer();
+      MaybeFlushVisualizer();
     }
     if (timing_logger_enabled_) {
       timing_logger_.StartTiming(pass_name);
     }
   }
 
-  void FlushVisualizer() REQUIRES(!visualizer_dump_mutex_) {
-    MutexLock mu(Thread::Current(), visualizer_dump_mutex_);
-    *visualizer_output_ << visualizer_oss_.str();
-    visualizer_output_->flush();
+  void FlushVisualizer() {
+    visualizer_output_->Write(visualizer_oss_.str());
     visualizer_oss_.str("");
     visualizer_oss_.clear();
   }
 
-  void EndPass(const char* pass_name) REQUIRES(!visualizer_dump_mutex_) {
+  // A shared output receives the dump of a method in one piece. Per-thread outputs receive
+  // it in chunks to bound the memory used by large methods.
+  void MaybeFlushVisualizer() {
+    if (visualizer_output_->IsPerThread() &&
+        static_cast<size_t>(visualizer_oss_.tellp()) >= kVisualizerFlushThreshold) {
+      FlushVisualizer();
+    }
+  }
+
+  void EndPass(const char* pass_name) {
     // Pause timer first, then dump graph.
     if (timing_logger_enabled_) {
       timing_logger_.EndTiming();
     }
-    if (visualizer_enabled_) {
+    if (visualizer_enabled_ && visualizer_output_->IsPassDumped(pass_name)) {
       visualizer_.DumpGraph(pass_name, /* is_after_pass */ true, graph_in_bad_state_);
-      FlushVisualizer();
+      MaybeFlushVisualizer();
     }
 
     // Validate the HGraph if running in debug mode.
@@ -227,10 +246,9 @@ class PassObserver : public ValueObject {
   DisassemblyInformation disasm_info_;
 
   std::ostringstream visualizer_oss_;
-  std::ostream* visualizer_output_;
+  HGraphVisualizerOutput* const visualizer_output_;
   bool visualizer_enabled_;
   HGraphVisualizer visualizer_;
-  Mutex& visualizer_dump_mutex_;
 
   // Flag to be set by the compiler if the pass failed and the graph is not
   // expected to validate.
@@ -298,13 +316,16 @@ class OptimizingCompiler FINAL : public Compiler {
       REQUIRES_SHARED(Locks::mutator_lock_);
 
  private:
-  void RunOptimizations(HGraph* graph,
+  // Run the passes in `definitions`. Unless `required` is set, stop at the first pass
+  // boundary where the graph's compilation budget is exhausted and return false.
+  bool RunOptimizations(HGraph* graph,
                         CodeGenerator* codegen,
                         const DexCompilationUnit& dex_compilation_unit,
                         PassObserver* pass_observer,
                         VariableSizedHandleScope* handles,
                         const OptimizationDef definitions[],
-                        size_t length) const {
+                        size_t length,
+                        bool required = false) const {
     // Convert definitions to optimization passes.
     ArenaVector<HOptimization*> optimizations = ConstructOptimizations(
         definitions,
@@ -319,22 +340,35 @@ class OptimizingCompiler FINAL : public Compiler {
     DCHECK_EQ(length, optimizations.size());
     // Run the optimization passes one by one.
     for (size_t i = 0; i < length; ++i) {
+      if (!required && IsCompilationBudgetExhausted(graph)) {
+        return false;
+      }
       PassScope scope(optimizations[i]->GetPassName(), pass_observer);
       optimizations[i]->Run();
     }
+    return true;
   }
 
-  template <size_t length> void RunOptimizations(
+  template <size_t length> bool RunOptimizations(
       HGraph* graph,
       CodeGenerator* codegen,
       const DexCompilationUnit& dex_compilation_unit,
       PassObserver* pass_observer,
       VariableSizedHandleScope* handles,
-      const OptimizationDef (&definitions)[length]) const {
-    RunOptimizations(
-        graph, codegen, dex_compilation_unit, pass_observer, handles, definitions, length);
+      const OptimizationDef (&definitions)[length],
+      bool required = false) const {
+    return RunOptimizations(graph,
+                            codegen,
+                            dex_compilation_unit,
+                            pass_observer,
+                            handles,
+                            definitions,
+                            length,
+                            required);
   }
 
+  // Run the default pass list. If the compilation budget runs out on the way, skip the
+  // remaining optimizations and only run the passes code generation relies on.
   void RunOptimizations(HGraph* graph,
                         CodeGenerator* codegen,
                         const DexCompilationUnit& dex_compilation_unit,
@@ -370,7 +404,8 @@ class OptimizingCompiler FINAL : public Compiler {
                                      ArtMethod* method,
                                      VariableSizedHandleScope* handles) const;
 
-  void MaybeRunInliner(HGraph* graph,
+  // Returns false if the compilation budget was exhausted before the inliner could run.
+  bool MaybeRunInliner(HGraph* graph,
                        CodeGenerator* codegen,
                        const DexCompilationUnit& dex_compilation_unit,
                        PassObserver* pass_observer,
@@ -387,9 +422,7 @@ class OptimizingCompiler FINAL : public Compiler {
 
   std::unique_ptr<OptimizingCompilerStats> compilation_stats_;
 
-  std::unique_ptr<std::ostream> visualizer_output_;
-
-  mutable Mutex dump_mutex_;  // To synchronize visualizer writing.
+  std::unique_ptr<HGraphVisualizerOutput> visualizer_output_;
 
   DISALLOW_COPY_AND_ASSIGN(OptimizingCompiler);
 };
@@ -397,18 +430,18 @@ class OptimizingCompiler FINAL : public Compiler {
 static const int kMaximumCompilationTimeBeforeWarning = 100; /* ms */
 
 OptimizingCompiler::OptimizingCompiler(CompilerDriver* driver)
-    : Compiler(driver, kMaximumCompilationTimeBeforeWarning),
-      dump_mutex_("Visualizer dump lock") {}
+    : Compiler(driver, kMaximumCompilationTimeBeforeWarning) {}
 
 void OptimizingCompiler::Init() {
   // Enable C1visualizer output. Must be done in Init() because the compiler
   // driver is not fully initialized when passed to the compiler's constructor.
   CompilerDriver* driver = GetCompilerDriver();
-  const std::string cfg_file_name = driver->GetCompilerOptions().GetDumpCfgFileName();
-  if (!cfg_file_name.empty()) {
-    std::ios_base::openmode cfg_file_mode =
-        driver->GetCompilerOptions().GetDumpCfgAppend() ? std::ofstream::app : std::ofstream::out;
-    visualizer_output_.reset(new std::ofstream(cfg_file_name, cfg_file_mode));
+  if (!driver->GetCompilerOptions().GetDumpCfgFileName().empty()) {
+    std::string error_msg;
+    visualizer_output_ = HGraphVisualizerOutput::Create(driver->GetCompilerOptions(), &error_msg);
+    if (visualizer_output_ == nullptr) {
+      LOG(WARNING) << error_msg;
+    }
   }
   if (driver->GetCompilerOptions().GetDumpStats()) {
     compilation_stats_.reset(new OptimizingCompilerStats());
@@ -439,7 +472,7 @@ static bool IsInstructionSetSupported(InstructionSet instruction_set) {
       || instruction_set == InstructionSet::kX86_64;
 }
 
-void OptimizingCompiler::MaybeRunInliner(HGraph* graph,
+bool OptimizingCompiler::MaybeRunInliner(HGraph* graph,
                                          CodeGenerator* codegen,
                                          const DexCompilationUnit& dex_compilation_unit,
                                          PassObserver* pass_observer,
@@ -447,17 +480,17 @@ void OptimizingCompiler::MaybeRunInliner(HGraph* graph,
   const CompilerOptions& compiler_options = GetCompilerDriver()->GetCompilerOptions();
   bool should_inline = (compiler_options.GetInlineMaxCodeUnits() > 0);
   if (!should_inline) {
-    return;
+    return true;
   }
   OptimizationDef optimizations[] = {
     OptDef(OptimizationPass::kInliner)
   };
-  RunOptimizations(graph,
-                   codegen,
-                   dex_compilation_unit,
-                   pass_observer,
-                   handles,
-                   optimizations);
+  return RunOptimizations(graph,
+                          codegen,
+                          dex_compilation_unit,
+                          pass_observer,
+                          handles,
+                          optimizations);
 }
 
 void OptimizingCompiler::RunArchOptimizations(HGraph* graph,
@@ -480,7 +513,8 @@ void OptimizingCompiler::RunArchOptimizations(HGraph* graph,
                        dex_compilation_unit,
                        pass_observer,
                        handles,
-                       arm_optimizations);
+                       arm_optimizations,
+                       /* required */ true);
       break;
     }
 #endif
@@ -497,7 +531,8 @@ void OptimizingCompiler::RunArchOptimizations(HGraph* graph,
                        dex_compilation_unit,
                        pass_observer,
                        handles,
-                       arm64_optimizations);
+                       arm64_optimizations,
+                       /* required */ true);
       break;
     }
 #endif
@@ -514,7 +549,8 @@ void OptimizingCompiler::RunArchOptimizations(HGraph* graph,
                        dex_compilation_unit,
                        pass_observer,
                        handles,
-                       mips_optimizations);
+                       mips_optimizations,
+                       /* required */ true);
       break;
     }
 #endif
@@ -529,7 +565,8 @@ void OptimizingCompiler::RunArchOptimizations(HGraph* graph,
                        dex_compilation_unit,
                        pass_observer,
                        handles,
-                       mips64_optimizations);
+                       mips64_optimizations,
+                       /* required */ true);
       break;
     }
 #endif
@@ -546,7 +583,8 @@ void OptimizingCompiler::RunArchOptimizations(HGraph* graph,
                        dex_compilation_unit,
                        pass_observer,
                        handles,
-                       x86_optimizations);
+                       x86_optimizations,
+                       /* required */ true);
       break;
     }
 #endif
@@ -562,7 +600,8 @@ void OptimizingCompiler::RunArchOptimizations(HGraph* graph,
                        dex_compilation_unit,
                        pass_observer,
                        handles,
-                       x86_64_optimizations);
+                       x86_64_optimizations,
+                       /* required */ true);
       break;
     }
 #endif
@@ -637,14 +676,13 @@ void OptimizingCompiler::RunOptimizations(HGraph* graph,
     OptDef(OptimizationPass::kInstructionSimplifier),
     OptDef(OptimizationPass::kDeadCodeElimination, "dead_code_elimination$initial")
   };
-  RunOptimizations(graph,
-                   codegen,
-                   dex_compilation_unit,
-                   pass_observer,
-                   handles,
-                   optimizations1);
-
-  MaybeRunInliner(graph, codegen, dex_compilation_unit, pass_observer, handles);
+  bool completed = RunOptimizations(graph,
+                                    codegen,
+                                    dex_compilation_unit,
+                                    pass_observer,
+                                    handles,
+                                    optimizations1) &&
+      MaybeRunInliner(graph, codegen, dex_compilation_unit, pass_observer, handles);
 
   OptimizationDef optimizations2[] = {
     // SelectGenerator depends on the InstructionSimplifier removing
@@ -677,12 +715,30 @@ void OptimizingCompiler::RunOptimizations(HGraph* graph,
     // complicated sinking logic to split a fence with many inputs.
     OptDef(OptimizationPass::kConstructorFenceRedundancyElimination)
   };
-  RunOptimizations(graph,
-                   codegen,
-                   dex_compilation_unit,
-                   pass_observer,
-                   handles,
-                   optimizations2);
+  completed = completed && RunOptimizations(graph,
+                                            codegen,
+                                            dex_compilation_unit,
+                                            pass_observer,
+                                            handles,
+                                            optimizations2);
+
+  if (!completed) {
+    VLOG(compiler) << "Compilation budget (" << graph->GetCompilationBudget()->GetExhaustedResource()
+                   << ") exhausted, skipping remaining optimizations of "
+                   << graph->PrettyMethod();
+    MaybeRecordStat(compilation_stats_.get(), MethodCompilationStat::kCompiledDegradedOverBudget);
+    OptimizationDef over_budget_optimizations[] = {
+      // See instruction_simplifier$before_codegen above.
+      OptDef(OptimizationPass::kInstructionSimplifier, "instruction_simplifier$over_budget")
+    };
+    RunOptimizations(graph,
+                     codegen,
+                     dex_compilation_unit,
+                     pass_observer,
+                     handles,
+                     over_budget_optimizations,
+                     /* required */ true);
+  }
 
   RunArchOptimizations(graph, codegen, dex_compilation_unit, pass_observer, handles);
 }
@@ -809,11 +865,15 @@ CodeGenerator* OptimizingCompiler::TryCompile(ArenaAllocator* allocator,
   codegen->GetAssembler()->cfi().SetEnabled(
       compiler_driver->GetCompilerOptions().GenerateAnyDebugInfo());
 
+  CompilationBudget budget(MsToNs(compiler_options.GetMethodTimeBudgetMs()),
+                           compiler_options.GetMethodArenaBudgetMb() * MB,
+                           compiler_options.GetMethodInstructionBudget());
+  ScopedCompilationBudget scoped_budget(graph, &budget);
+
   PassObserver pass_observer(graph,
                              codegen.get(),
                              visualizer_output_.get(),
-                             compiler_driver,
-                             dump_mutex_);
+                             compiler_driver);
 
   {
     VLOG(compiler) << "Building " << pass_observer.GetMethodName();
@@ -850,6 +910,13 @@ CodeGenerator* OptimizingCompiler::TryCompile(ArenaAllocator* allocator,
                           MethodCompilationStat::kNotCompiledAmbiguousArrayOp);
         }
           break;
+        case kAnalysisOverBudget: {
+          VLOG(compiler) << "Compilation budget (" << budget.GetExhaustedResource()
+                         << ") exhausted while building " << pass_observer.GetMethodName();
+          MaybeRecordStat(compilation_stats_.get(),
+                          MethodCompilationStat::kNotCompiledOverBudget);
+        }
+          break;
         case kAnalysisSuccess:
           UNREACHABLE();
       }
@@ -866,6 +933,11 @@ CodeGenerator* OptimizingCompiler::TryCompile(ArenaAllocator* allocator,
 
   RegisterAllocator::Strategy regalloc_strategy =
     compiler_options.GetRegisterAllocationStrategy();
+  if (IsCompilationBudgetExhausted(graph)) {
+    // Graph coloring can take much longer than linear scan on large graphs.
+    regalloc_strategy = RegisterAllocator::kRegisterAllocatorLinearScan;
+    graph->SetCompiledOverBudget();
+  }
   AllocateRegisters(graph,
                     codegen.get(),
                     &pass_observer,
@@ -930,8 +1002,7 @@ CodeGenerator* OptimizingCompiler::TryCompileIntrinsic(
   PassObserver pass_observer(graph,
                              codegen.get(),
                              visualizer_output_.get(),
-                             compiler_driver,
-                             dump_mutex_);
+                             compiler_driver);
 
   {
     VLOG(compiler) << "Building intrinsic graph " << pass_observer.GetMethodName();
@@ -1000,6 +1071,18 @@ CompiledMethod* OptimizingCompiler::Compile(const DexFile::CodeItem* code_item,
   if (compiler_driver->IsMethodVerifiedWithoutFailures(method_idx, class_def_idx, dex_file) ||
       verifier::CanCompilerHandleVerificationFailure(
           verified_method->GetEncounteredVerificationFailures())) {
+    CompiledMethodCache* cache = compiler_driver->GetCompiledMethodCache();
+    CompiledMethodCache::Key cache_key;
+    bool cacheable = cache != nullptr &&
+        cache->ComputeKey(
+            dex_file, method_idx, class_def_idx, code_item, access_flags, invoke_type, &cache_key);
+    if (cacheable) {
+      compiled_method = cache->Lookup(dex_file, cache_key);
+      if (compiled_method != nullptr) {
+        MaybeRecordStat(compilation_stats_.get(), MethodCompilationStat::kCompiledFromCache);
+        return compiled_method;
+      }
+    }
     ArenaAllocator allocator(runtime->GetArenaPool());
     ArenaStack arena_stack(runtime->GetArenaPool());
     CodeVectorAllocator code_allocator(&allocator);
@@ -1053,6 +1136,10 @@ CompiledMethod* OptimizingCompiler::Compile(const DexFile::CodeItem* code_item,
                              compiled_intrinsic ? nullptr : code_item);
       if (compiled_intrinsic) {
         compiled_method->MarkAsIntrinsic();
+      } else if (cacheable && !codegen->GetGraph()->IsCompiledOverBudget()) {
+        // Code degraded by the compilation budget depends on timing, do not cache it.
+        ScopedObjectAccess soa(Thread::Current());
+        cache->Store(dex_file, cache_key, compiled_method, codegen->GetGraph()->GetInlinedMethods());
       }
 
       if (kArenaAllocatorCountAllocations) {
@@ -34,6 +34,7 @@ enum class MethodCompilationStat {
   kCompiledNativeStub,
   kCompiledIntrinsic,
   kCompiledBytecode,
+  kCompiledFromCache,
   kCHAInline,
   kInlinedInvoke,
   kReplacedInvokeWithSimplePattern,
@@ -59,6 +60,8 @@ enum class MethodCompilationStat {
   kNotCompiledUnsupportedIsa,
   kNotCompiledVerificationError,
   kNotCompiledVerifyAtRuntime,
+  kNotCompiledOverBudget,
+  kCompiledDegradedOverBudget,
   kInlinedMonomorphicCall,
   kInlinedPolymorphicCall,
   kMonomorphicCall,
@@ -133,7 +136,11 @@ class OptimizingCompilerStats {
     uint32_t compiled_native_stubs = GetStat(MethodCompilationStat::kCompiledNativeStub);
     uint32_t bytecode_attempts =
         GetStat(MethodCompilationStat::kAttemptBytecodeCompilation);
-    if (compiled_intrinsics == 0u && compiled_native_stubs == 0u && bytecode_attempts == 0u) {
+    uint32_t compiled_from_cache = GetStat(MethodCompilationStat::kCompiledFromCache);
+    if (compiled_intrinsics == 0u &&
+        compiled_native_stubs == 0u &&
+        bytecode_attempts == 0u &&
+        compiled_from_cache == 0u) {
       LOG(INFO) << "Did not compile any method.";
     } else {
       uint32_t compiled_bytecode_methods =
@@ -141,9 +148,10 @@ class OptimizingCompilerStats {
       // Successful intrinsic compilation preempts other compilation attempts but failed intrinsic
       // compilation shall still count towards bytecode or native stub compilation attempts.
       uint32_t num_compilation_attempts =
-          compiled_intrinsics + compiled_native_stubs + bytecode_attempts;
+          compiled_intrinsics + compiled_native_stubs + bytecode_attempts + compiled_from_cache;
       uint32_t num_successful_compilations =
-          compiled_intrinsics + compiled_native_stubs + compiled_bytecode_methods;
+          compiled_intrinsics + compiled_native_stubs + compiled_bytecode_methods +
+          compiled_from_cache;
       float compiled_percent = num_successful_compilations * 100.0f / num_compilation_attempts;
       LOG(INFO) << "Attempted compilation of "
           << num_compilation_attempts << " methods: " << std::fixed << std::setprecision(2)
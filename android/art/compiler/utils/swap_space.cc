@@ -16,6 +16,7 @@
 
 #include "swap_space.h"
 
+#include <fcntl.h>
 #include <sys/mman.h>
 
 #include <algorithm>
@@ -62,6 +63,8 @@ inline void SwapSpace::InsertChunk(const SpaceChunk& chunk) {
 SwapSpace::SwapSpace(int fd, size_t initial_size)
     : fd_(fd),
       size_(0),
+      resident_budget_(0u),
+      allocated_since_release_(0u),
       lock_("SwapSpace lock", static_cast<LockLevel>(LockLevel::kDefaultMutexLevel - 1)) {
   // Assume that the file is unlinked.
 
@@ -105,10 +108,45 @@ static size_t CollectFree(const FreeByStartSet& free_by_start, const FreeBySizeS
   return sum1;
 }
 
+void SwapSpace::SetResidentBudget(size_t budget) {
+  MutexLock lock(Thread::Current(), lock_);
+  resident_budget_ = budget;
+}
+
+void SwapSpace::ReleaseResidentPages() {
+  MutexLock lock(Thread::Current(), lock_);
+  ReleaseResidentPagesLocked();
+}
+
+void SwapSpace::ReleaseResidentPagesLocked() {
+#if !defined(__APPLE__)
+  // Start writing the dirty pages back so that they become reclaimable sooner.
+  if (sync_file_range(fd_, 0, size_, SYNC_FILE_RANGE_WRITE) != 0) {
+    PLOG(WARNING) << "Failed to start writing back swap file";
+  }
+  // The mappings are shared, so dropping the pages keeps their contents in the file. This is
+  // also safe while other threads write to allocated chunks, they just fault the page back in.
+  for (const SpaceChunk& map : maps_) {
+    if (madvise(map.ptr, map.size, MADV_DONTNEED) != 0) {
+      PLOG(WARNING) << "Failed to release swap space pages at "
+          << static_cast<const void*>(map.ptr) << " size=" << map.size;
+    }
+  }
+#endif
+  allocated_since_release_ = 0u;
+}
+
 void* SwapSpace::Alloc(size_t size) {
   MutexLock lock(Thread::Current(), lock_);
   size = RoundUp(size, 8U);
 
+  if (resident_budget_ != 0u) {
+    allocated_since_release_ += size;
+    if (allocated_since_release_ >= resident_budget_) {
+      ReleaseResidentPagesLocked();
+    }
+  }
+
   // Check the free list for something that fits.
   // TODO: Smarter implementation. Global biggest chunk, ...
   auto it = free_by_start_.empty()
@@ -178,6 +216,7 @@ SwapSpace::SpaceChunk SwapSpace::NewFileChunk(size_t min_size) {
   }
   size_ += next_part;
   SpaceChunk new_chunk = {ptr, next_part};
+  maps_.push_back(new_chunk);
   return new_chunk;
 #else
   UNUSED(min_size, kMininumMapSize);
@@ -43,6 +43,15 @@ class SwapSpace {
     return size_;
   }
 
+  // Release the resident pages of the file mapping whenever `budget` bytes have been allocated
+  // since the last release, zero to never release them. The data stays in the file and is paged
+  // back in on access, so the memory held by the swap space is mostly page cache that the kernel
+  // can reclaim once written back, rather than growing with the allocated size.
+  void SetResidentBudget(size_t budget) REQUIRES(!lock_);
+
+  // Release the resident pages of the file mapping now.
+  void ReleaseResidentPages() REQUIRES(!lock_);
+
  private:
   // Chunk of space.
   struct SpaceChunk {
@@ -90,6 +99,7 @@ class SwapSpace {
   typedef std::set<FreeBySizeEntry, FreeBySizeComparator> FreeBySizeSet;
 
   SpaceChunk NewFileChunk(size_t min_size) REQUIRES(lock_);
+  void ReleaseResidentPagesLocked() REQUIRES(lock_);
 
   void RemoveChunk(FreeBySizeSet::const_iterator free_by_size_pos) REQUIRES(lock_);
   void InsertChunk(const SpaceChunk& chunk) REQUIRES(lock_);
@@ -104,6 +114,11 @@ class SwapSpace {
   // Free chunks ordered by size.
   FreeBySizeSet free_by_size_ GUARDED_BY(lock_);
 
+  // All the mappings of the file, for releasing their resident pages.
+  std::vector<SpaceChunk> maps_ GUARDED_BY(lock_);
+  size_t resident_budget_ GUARDED_BY(lock_);
+  size_t allocated_since_release_ GUARDED_BY(lock_);
+
   mutable Mutex lock_ DEFAULT_MUTEX_ACQUIRED_AFTER;
   DISALLOW_COPY_AND_ASSIGN(SwapSpace);
 };
@@ -21,6 +21,7 @@
 #include <sys/types.h>
 
 #include <cstdio>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -80,4 +81,32 @@ TEST_F(SwapSpaceTest, Swap) {
   SwapTest(true);
 }
 
+TEST_F(SwapSpaceTest, ResidentBudget) {
+  ScratchFile scratch;
+  int fd = scratch.GetFd();
+  unlink(scratch.GetFilename().c_str());
+
+  SwapSpace pool(fd, 1 * MB);
+  pool.SetResidentBudget(64 * KB);
+  SwapAllocator<void> alloc(&pool);
+
+  // Released pages must keep their contents, including the pages of vectors still being filled.
+  std::vector<SwapVector<int32_t>> vectors;
+  for (size_t i = 0; i != 64u; ++i) {
+    vectors.emplace_back(alloc);
+    for (int32_t j = 0; j < 10000; ++j) {
+      vectors.back().push_back(j + static_cast<int32_t>(i));
+    }
+  }
+  pool.ReleaseResidentPages();
+  for (size_t i = 0; i != vectors.size(); ++i) {
+    for (int32_t j = 0; j < 10000; ++j) {
+      ASSERT_EQ(j + static_cast<int32_t>(i), vectors[i][j]);
+    }
+  }
+  vectors.clear();
+
+  scratch.Close();
+}
+
 }  // namespace art
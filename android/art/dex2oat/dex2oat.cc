@@ -20,6 +20,7 @@
 #include <sys/stat.h>
 #include "base/memory_tool.h"
 
+#include <algorithm>
 #include <forward_list>
 #include <fstream>
 #include <iostream>
@@ -63,12 +64,17 @@
 #include "debug/elf_debug_writer.h"
 #include "debug/method_debug_info.h"
 #include "dexlayout.h"
+#include "dex/code_item_accessors-inl.h"
 #include "dex/descriptors_names.h"
 #include "dex/dex_file-inl.h"
+#include "dex/dex_extraction_cache.h"
+#include "dex/dex_file_verifier.h"
+#include "dex/dex_verification_cache.h"
 #include "dex/quick_compiler_callbacks.h"
 #include "dex/verification_results.h"
 #include "dex2oat_options.h"
 #include "dex2oat_return_codes.h"
+#include "driver/compiled_method_cache.h"
 #include "driver/compiler_driver.h"
 #include "driver/compiler_options.h"
 #include "driver/compiler_options_map-inl.h"
@@ -250,6 +256,15 @@ NO_RETURN static void Usage(const char* fmt, ...) {
   UsageError("      descriptor.");
   UsageError("      Example: --output-vdex-fd=6");
   UsageError("");
+  UsageError("  --original-vdex=<file.vdex>: specifies a vdex file with the dex files that the");
+  UsageError("      input was derived from by only changing method code, e.g. before");
+  UsageError("      deobfuscation. The verification of the classes whose code did not change is");
+  UsageError("      taken from it and only the other classes are verified.");
+  UsageError("      Example: --original-vdex=/data/app/base.vdex");
+  UsageError("");
+  UsageError("  --original-vdex-fd=<number>: same as --original-vdex via a file descriptor.");
+  UsageError("      Example: --original-vdex-fd=7");
+  UsageError("");
   UsageError("  --oat-location=<oat-name>: specifies a symbolic name for the file corresponding");
   UsageError("      to the file descriptor specified by --oat-fd.");
   UsageError("      Example: --oat-location=/data/dalvik-cache/system@app@Calculator.apk.oat");
@@ -348,6 +363,23 @@ NO_RETURN static void Usage(const char* fmt, ...) {
              CompilerOptions::kDefaultInlineMaxCodeUnits);
   UsageError("      Default: %d", CompilerOptions::kDefaultInlineMaxCodeUnits);
   UsageError("");
+  UsageError("  --method-time-budget-ms=<ms>: wall time the optimizing compiler may spend on a");
+  UsageError("      single method. Past the budget, the remaining optimizations are skipped and");
+  UsageError("      the method is compiled with a cheaper pass list, or not compiled at all if");
+  UsageError("      building its graph already used up the budget. Zero means unlimited.");
+  UsageError("      Example: --method-time-budget-ms=500");
+  UsageError("      Default: %zu", CompilerOptions::kDefaultMethodTimeBudgetMs);
+  UsageError("");
+  UsageError("  --method-arena-budget-mb=<mb>: like --method-time-budget-ms, for the arena memory");
+  UsageError("      used by the graph of a single method.");
+  UsageError("      Example: --method-arena-budget-mb=256");
+  UsageError("      Default: %zu", CompilerOptions::kDefaultMethodArenaBudgetMb);
+  UsageError("");
+  UsageError("  --method-instruction-budget=<count>: like --method-time-budget-ms, for the number");
+  UsageError("      of HIR instructions created for a single method.");
+  UsageError("      Example: --method-instruction-budget=100000");
+  UsageError("      Default: %zu", CompilerOptions::kDefaultMethodInstructionBudget);
+  UsageError("");
   UsageError("  --dump-timings: display a breakdown of where time was spent");
   UsageError("");
   UsageError("  -g");
@@ -399,10 +431,40 @@ NO_RETURN static void Usage(const char* fmt, ...) {
   UsageError("      Example: --swap-dex-count-threshold=10");
   UsageError("      Default: %zu", kDefaultMinDexFilesForSwap);
   UsageError("");
+  UsageError("  --swap-resident-budget=<megabytes>: always use swap for apps and drop the");
+  UsageError("      resident pages of the swap file each time this much compiled data has been");
+  UsageError("      added, so that memory use does not grow with the app size. Without");
+  UsageError("      --swap-file or --swap-fd, an unlinked swap file is created next to the oat");
+  UsageError("      file.");
+  UsageError("      Example: --swap-resident-budget=64");
+  UsageError("");
   UsageError("  --very-large-app-threshold=<size>: specifies the minimum total dex file size in");
   UsageError("      bytes to consider the input \"very large\" and reduce compilation done.");
   UsageError("      Example: --very-large-app-threshold=100000000");
   UsageError("");
+  UsageError("  --compiled-method-cache=<directory>: reuse compiled methods from previous");
+  UsageError("      compilations with the same options and store newly compiled ones there.");
+  UsageError("      Not used when compiling an image or with a profile.");
+  UsageError("      Example: --compiled-method-cache=/tmp/dex2oat-cache");
+  UsageError("");
+  UsageError("  --compiled-method-cache-max-size=<megabytes>: after compiling, evict the least");
+  UsageError("      recently used entries of the --compiled-method-cache directory until it holds");
+  UsageError("      at most this size. 0 keeps all entries.");
+  UsageError("      Example: --compiled-method-cache-max-size=%zu",
+             CompiledMethodCache::kDefaultMaxSizeMb);
+  UsageError("      Default: %zu", CompiledMethodCache::kDefaultMaxSizeMb);
+  UsageError("");
+  UsageError("  --dex-verification-cache=<directory>: skip the structural verification of dex");
+  UsageError("      files that passed it in a previous run, as recorded in the directory. The");
+  UsageError("      directory must be owned and only writable by the current user.");
+  UsageError("      Example: --dex-verification-cache=/tmp/dex2oat-verified");
+  UsageError("");
+  UsageError("  --dex-extraction-cache=<directory>: map compressed dex files of the class loader");
+  UsageError("      context from copies inflated there by a previous run instead of inflating");
+  UsageError("      them again. The directory must be owned and only writable by the current");
+  UsageError("      user.");
+  UsageError("      Example: --dex-extraction-cache=/tmp/dex2oat-extracted");
+  UsageError("");
   UsageError("  --app-image-fd=<file-descriptor>: specify output file descriptor for app image.");
   UsageError("      The image is non-empty only if a profile is passed in.");
   UsageError("      Example: --app-image-fd=10");
@@ -423,6 +485,26 @@ NO_RETURN static void Usage(const char* fmt, ...) {
   UsageError("      the default behavior). This option is only meaningful when used with");
   UsageError("      --dump-cfg.");
   UsageError("");
+  UsageError("  --dump-cfg-per-thread: write the CFGs compiled by each thread to a separate file");
+  UsageError("      named after the thread id, e.g. output.1234.cfg, instead of a shared file.");
+  UsageError("");
+  UsageError("  --dump-cfg-format=(c1visualizer|snapshot): format of the dumped CFGs, either");
+  UsageError("      the c1visualizer text or a compact binary snapshot of the graph.");
+  UsageError("      Default: c1visualizer");
+  UsageError("");
+  UsageError("  --dump-cfg-compression=(none|gzip): compression of the dumped CFGs.");
+  UsageError("      Default: none");
+  UsageError("");
+  UsageError("  --dump-cfg-methods=<pattern>,...: only dump the CFGs of methods whose pretty name");
+  UsageError("      matches one of the shell wildcard patterns.");
+  UsageError("      Example: --dump-cfg-methods='*Foo.bar*','void Baz.*'");
+  UsageError("");
+  UsageError("  --dump-cfg-passes=<pattern>,...: only dump the CFGs before and after the passes");
+  UsageError("      matching one of the shell wildcard patterns. Passes can be matched with or");
+  UsageError("      without the '$' suffix of their name. The generated code is dumped with");
+  UsageError("      the pass 'disassembly'.");
+  UsageError("      Example: --dump-cfg-passes=inliner,dead_code_elimination,disassembly");
+  UsageError("");
   UsageError("  --classpath-dir=<directory-path>: directory used to resolve relative class paths.");
   UsageError("");
   UsageError("  --class-loader-context=<string spec>: a string specifying the intended");
@@ -604,6 +686,157 @@ class WatchDog {
   bool shutting_down_;
 };
 
+// Whether the id arrays starting at `lhs` and `rhs` hold the same `count` ids.
+template <typename T>
+static bool HaveSameIds(const T* lhs, const T* rhs, size_t count) {
+  return count == 0u || memcmp(lhs, rhs, count * sizeof(T)) == 0;
+}
+
+static bool HaveSameTypes(const DexFile::TypeList* lhs, const DexFile::TypeList* rhs) {
+  uint32_t size = (lhs != nullptr) ? lhs->Size() : 0u;
+  if (size != ((rhs != nullptr) ? rhs->Size() : 0u)) {
+    return false;
+  }
+  for (uint32_t i = 0; i != size; ++i) {
+    if (lhs->GetTypeItem(i).type_idx_ != rhs->GetTypeItem(i).type_idx_) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Whether `lhs` and `rhs` declare the same strings, types, prototypes, fields and methods under
+// the same indices.
+static bool HaveSameIds(const DexFile& lhs, const DexFile& rhs) {
+  if (lhs.NumStringIds() != rhs.NumStringIds() ||
+      lhs.NumTypeIds() != rhs.NumTypeIds() ||
+      lhs.NumProtoIds() != rhs.NumProtoIds() ||
+      lhs.NumFieldIds() != rhs.NumFieldIds() ||
+      lhs.NumMethodIds() != rhs.NumMethodIds() ||
+      lhs.NumClassDefs() != rhs.NumClassDefs()) {
+    return false;
+  }
+  for (uint32_t i = 0; i != lhs.NumStringIds(); ++i) {
+    uint32_t lhs_length;
+    uint32_t rhs_length;
+    const char* lhs_data = lhs.StringDataAndUtf16LengthByIdx(dex::StringIndex(i), &lhs_length);
+    const char* rhs_data = rhs.StringDataAndUtf16LengthByIdx(dex::StringIndex(i), &rhs_length);
+    if (lhs_length != rhs_length || strcmp(lhs_data, rhs_data) != 0) {
+      return false;
+    }
+  }
+  for (uint32_t i = 0; i != lhs.NumProtoIds(); ++i) {
+    const DexFile::ProtoId& lhs_proto = lhs.GetProtoId(i);
+    const DexFile::ProtoId& rhs_proto = rhs.GetProtoId(i);
+    if (lhs_proto.shorty_idx_ != rhs_proto.shorty_idx_ ||
+        lhs_proto.return_type_idx_ != rhs_proto.return_type_idx_ ||
+        !HaveSameTypes(lhs.GetProtoParameters(lhs_proto), rhs.GetProtoParameters(rhs_proto))) {
+      return false;
+    }
+  }
+  return
+      HaveSameIds(&lhs.GetTypeId(dex::TypeIndex(0)), &rhs.GetTypeId(dex::TypeIndex(0)),
+                  lhs.NumTypeIds()) &&
+      (lhs.NumFieldIds() == 0u ||
+       HaveSameIds(&lhs.GetFieldId(0), &rhs.GetFieldId(0), lhs.NumFieldIds())) &&
+      (lhs.NumMethodIds() == 0u ||
+       HaveSameIds(&lhs.GetMethodId(0), &rhs.GetMethodId(0), lhs.NumMethodIds()));
+}
+
+// Whether the code items have the same instructions and exception handlers.
+static bool HaveSameCode(const DexFile& lhs_dex_file,
+                         const DexFile::CodeItem* lhs_code_item,
+                         const DexFile& rhs_dex_file,
+                         const DexFile::CodeItem* rhs_code_item) {
+  if (lhs_code_item == nullptr || rhs_code_item == nullptr) {
+    return lhs_code_item == rhs_code_item;
+  }
+  CodeItemDataAccessor lhs(lhs_dex_file, lhs_code_item);
+  CodeItemDataAccessor rhs(rhs_dex_file, rhs_code_item);
+  if (lhs.RegistersSize() != rhs.RegistersSize() ||
+      lhs.InsSize() != rhs.InsSize() ||
+      lhs.OutsSize() != rhs.OutsSize() ||
+      lhs.TriesSize() != rhs.TriesSize() ||
+      lhs.InsnsSizeInCodeUnits() != rhs.InsnsSizeInCodeUnits() ||
+      memcmp(lhs.Insns(), rhs.Insns(), lhs.InsnsSizeInCodeUnits() * sizeof(uint16_t)) != 0) {
+    return false;
+  }
+  if (lhs.TriesSize() == 0u) {
+    return true;
+  }
+  // The handlers follow the try items.
+  const uint8_t* lhs_tries = reinterpret_cast<const uint8_t*>(lhs.TryItems().begin());
+  const uint8_t* rhs_tries = reinterpret_cast<const uint8_t*>(rhs.TryItems().begin());
+  size_t lhs_size = reinterpret_cast<const uint8_t*>(lhs.CodeItemDataEnd()) - lhs_tries;
+  size_t rhs_size = reinterpret_cast<const uint8_t*>(rhs.CodeItemDataEnd()) - rhs_tries;
+  return lhs_size == rhs_size && memcmp(lhs_tries, rhs_tries, lhs_size) == 0;
+}
+
+// Find the classes of `dex_file` whose code differs from `original`. Returns false if the dex
+// files differ in anything else than method code, e.g. in their class hierarchy or in the
+// declared fields or methods. The verification of a class only depends on the declarations of
+// the other classes of the app, so the VerifierDeps of `original` remain valid for all classes
+// of `dex_file` whose code did not change.
+static bool FindChangedClassDefs(const DexFile& original,
+                                 const DexFile& dex_file,
+                                 /*out*/ std::vector<bool>* changed_class_defs,
+                                 /*out*/ std::string* error_msg) {
+  if (!HaveSameIds(original, dex_file)) {
+    *error_msg = StringPrintf("%s does not have the same ids as %s",
+                              dex_file.GetLocation().c_str(),
+                              original.GetLocation().c_str());
+    return false;
+  }
+  changed_class_defs->assign(dex_file.NumClassDefs(), false);
+  for (uint32_t i = 0; i != dex_file.NumClassDefs(); ++i) {
+    const DexFile::ClassDef& original_class_def = original.GetClassDef(i);
+    const DexFile::ClassDef& class_def = dex_file.GetClassDef(i);
+    const uint8_t* original_class_data = original.GetClassData(original_class_def);
+    const uint8_t* class_data = dex_file.GetClassData(class_def);
+    if (original_class_def.class_idx_ != class_def.class_idx_ ||
+        original_class_def.access_flags_ != class_def.access_flags_ ||
+        original_class_def.superclass_idx_ != class_def.superclass_idx_ ||
+        !HaveSameTypes(original.GetInterfacesList(original_class_def),
+                       dex_file.GetInterfacesList(class_def)) ||
+        (original_class_data == nullptr) != (class_data == nullptr)) {
+      *error_msg = StringPrintf("Class %s differs from %s",
+                                dex_file.GetClassDescriptor(class_def),
+                                original.GetLocation().c_str());
+      return false;
+    }
+    if (class_data == nullptr) {
+      continue;
+    }
+    ClassDataItemIterator original_it(original, original_class_data);
+    ClassDataItemIterator it(dex_file, class_data);
+    if (original_it.NumStaticFields() != it.NumStaticFields() ||
+        original_it.NumInstanceFields() != it.NumInstanceFields() ||
+        original_it.NumDirectMethods() != it.NumDirectMethods() ||
+        original_it.NumVirtualMethods() != it.NumVirtualMethods()) {
+      *error_msg = StringPrintf("Class %s declares other members than in %s",
+                                dex_file.GetClassDescriptor(class_def),
+                                original.GetLocation().c_str());
+      return false;
+    }
+    for (; it.HasNext(); original_it.Next(), it.Next()) {
+      if (original_it.GetMemberIndex() != it.GetMemberIndex() ||
+          original_it.GetRawMemberAccessFlags() != it.GetRawMemberAccessFlags()) {
+        *error_msg = StringPrintf("Class %s declares other members than in %s",
+                                  dex_file.GetClassDescriptor(class_def),
+                                  original.GetLocation().c_str());
+        return false;
+      }
+      if (it.IsAtMethod() && !HaveSameCode(original,
+                                           original_it.GetMethodCodeItem(),
+                                           dex_file,
+                                           it.GetMethodCodeItem())) {
+        (*changed_class_defs)[i] = true;
+      }
+    }
+  }
+  return true;
+}
+
 class Dex2Oat FINAL {
  public:
   explicit Dex2Oat(TimingLogger* timings) :
@@ -764,6 +997,13 @@ class Dex2Oat FINAL {
       Usage("--oat-symbols should not be used with --oat-fd");
     }
 
+    if (swap_resident_budget_mb_ != 0u &&
+        swap_fd_ == -1 &&
+        swap_file_name_.empty() &&
+        oat_filenames_.empty()) {
+      Usage("--swap-resident-budget needs --swap-file or --swap-fd when used with --oat-fd");
+    }
+
     if (!parser_options->oat_symbols.empty() && is_host_) {
       Usage("--oat-symbols should not be used with --host");
     }
@@ -781,6 +1021,20 @@ class Dex2Oat FINAL {
       Usage("An input vdex should not be passed with a .dm file");
     }
 
+    if (original_vdex_fd_ != -1 && !original_vdex_.empty()) {
+      Usage("Can't have both --original-vdex-fd and --original-vdex");
+    }
+
+    if (original_vdex_fd_ != -1 || !original_vdex_.empty()) {
+      if (input_vdex_fd_ != -1 || !input_vdex_.empty() ||
+          dm_fd_ != -1 || !dm_file_location_.empty()) {
+        Usage("An original vdex should not be passed with an input vdex or a .dm file");
+      }
+      if (!image_filenames_.empty()) {
+        Usage("--original-vdex should not be used with --image");
+      }
+    }
+
     if (!parser_options->oat_symbols.empty() &&
         parser_options->oat_symbols.size() != oat_filenames_.size()) {
       Usage("--oat-file arguments do not match --oat-symbols arguments");
@@ -1203,6 +1457,8 @@ class Dex2Oat FINAL {
     AssignIfExists(args, M::OutputVdex, &output_vdex_);
     AssignIfExists(args, M::DmFd, &dm_fd_);
     AssignIfExists(args, M::DmFile, &dm_file_location_);
+    AssignIfExists(args, M::OriginalVdexFd, &original_vdex_fd_);
+    AssignIfExists(args, M::OriginalVdex, &original_vdex_);
     AssignIfExists(args, M::OatFd, &oat_fd_);
     AssignIfExists(args, M::OatLocation, &oat_location_);
     AssignIfExists(args, M::Watchdog, &parser_options->watch_dog_enabled);
@@ -1224,7 +1480,12 @@ class Dex2Oat FINAL {
     AssignIfExists(args, M::SwapFileFd, &swap_fd_);
     AssignIfExists(args, M::SwapDexSizeThreshold, &min_dex_file_cumulative_size_for_swap_);
     AssignIfExists(args, M::SwapDexCountThreshold, &min_dex_files_for_swap_);
+    AssignIfExists(args, M::SwapResidentBudget, &swap_resident_budget_mb_);
     AssignIfExists(args, M::VeryLargeAppThreshold, &very_large_threshold_);
+    AssignIfExists(args, M::CompiledMethodCache, &compiled_method_cache_dir_);
+    AssignIfExists(args, M::CompiledMethodCacheMaxSize, &compiled_method_cache_max_size_mb_);
+    AssignIfExists(args, M::DexVerificationCache, &dex_verification_cache_dir_);
+    AssignIfExists(args, M::DexExtractionCache, &dex_extraction_cache_dir_);
     AssignIfExists(args, M::AppImageFile, &app_image_file_name_);
     AssignIfExists(args, M::AppImageFileFd, &app_image_fd_);
     AssignIfExists(args, M::NoInlineFrom, &no_inline_from_string_);
@@ -1297,6 +1558,18 @@ class Dex2Oat FINAL {
 
     ProcessOptions(parser_options.get());
 
+    // Large input dex files are verified with the compiler threads.
+    DexFileVerifier::SetDefaultNumThreads(thread_count_);
+
+    if (!dex_verification_cache_dir_.empty() &&
+        !DexVerificationCache::Enable(dex_verification_cache_dir_, &error_msg)) {
+      Usage(error_msg.c_str());
+    }
+    if (!dex_extraction_cache_dir_.empty() &&
+        !DexExtractionCache::Enable(dex_extraction_cache_dir_, &error_msg)) {
+      Usage(error_msg.c_str());
+    }
+
     // Insert some compiler things.
     InsertCompileOptions(argc, argv);
   }
@@ -1478,6 +1751,12 @@ class Dex2Oat FINAL {
     //
     // If the swap fd is -1 and we have a swap-file string, open the given file as a swap file. We
     // will immediately unlink to satisfy the swap fd assumption.
+    //
+    // A swap resident budget needs a swap file, so without one, use a file next to the oat file.
+    if (swap_fd_ == -1 && swap_file_name_.empty() && swap_resident_budget_mb_ != 0u) {
+      DCHECK(!oat_filenames_.empty());
+      swap_file_name_ = std::string(oat_filenames_[0]) + ".swap";
+    }
     if (swap_fd_ == -1 && !swap_file_name_.empty()) {
       std::unique_ptr<File> swap_file(OS::CreateEmptyFile(swap_file_name_.c_str()));
       if (swap_file.get() == nullptr) {
@@ -1711,9 +1990,12 @@ class Dex2Oat FINAL {
 
     // Make sure that we didn't create the driver, yet.
     CHECK(driver_ == nullptr);
-    // If we use a swap file, ensure we are above the threshold to make it necessary.
+    // If we use a swap file, ensure we are above the threshold to make it necessary, unless
+    // a resident budget asks for swap regardless of the app size.
     if (swap_fd_ != -1) {
-      if (!UseSwap(IsBootImage(), dex_files_)) {
+      bool use_swap = (swap_resident_budget_mb_ != 0u) ? !IsBootImage()
+                                                        : UseSwap(IsBootImage(), dex_files_);
+      if (!use_swap) {
         close(swap_fd_);
         swap_fd_ = -1;
         VLOG(compiler) << "Decided to run without swap.";
@@ -1880,6 +2162,23 @@ class Dex2Oat FINAL {
     if (!IsBootImage()) {
       driver_->SetClasspathDexFiles(class_loader_context_->FlattenOpenedDexFiles());
     }
+    if (swap_resident_budget_mb_ != 0u) {
+      driver_->GetCompiledMethodStorage()->SetSwapResidentBudget(swap_resident_budget_mb_ * MB);
+    }
+    if (!compiled_method_cache_dir_.empty()) {
+      std::string error_msg;
+      std::unique_ptr<CompiledMethodCache> cache = CompiledMethodCache::Create(
+          compiled_method_cache_dir_,
+          driver_.get(),
+          IsBootImage() ? std::vector<const DexFile*>()
+                        : class_loader_context_->FlattenOpenedDexFiles(),
+          &error_msg);
+      if (cache == nullptr) {
+        LOG(WARNING) << error_msg;
+      } else {
+        driver_->SetCompiledMethodCache(std::move(cache));
+      }
+    }
 
     const bool compile_individually = ShouldCompileDexFilesIndividually();
     if (compile_individually) {
@@ -1908,7 +2207,10 @@ class Dex2Oat FINAL {
     } else {
       // Create the main VerifierDeps, here instead of in the compiler since we want to aggregate
       // the results for all the dex files, not just the results for the current dex file.
-      callbacks_->SetVerifierDeps(new verifier::VerifierDeps(dex_files_));
+      // With an original vdex, start from its VerifierDeps instead.
+      if (!ReuseOriginalVerification()) {
+        callbacks_->SetVerifierDeps(new verifier::VerifierDeps(dex_files_));
+      }
     }
     // Invoke the compilation.
     if (compile_individually) {
@@ -1945,6 +2247,16 @@ class Dex2Oat FINAL {
       }
     }
     driver_->CompileAll(class_loader, dex_files, timings_);
+    CompiledMethodCache* compiled_method_cache = driver_->GetCompiledMethodCache();
+    if (compiled_method_cache != nullptr && compiled_method_cache_max_size_mb_ != 0u) {
+      TimingLogger::ScopedTiming t2("Trim compiled method cache", timings_);
+      compiled_method_cache->Trim(compiled_method_cache_max_size_mb_ * MB);
+    }
+    if (swap_resident_budget_mb_ != 0u) {
+      // Start the oat writing, which reads the compiled data back in order, from a small
+      // resident set.
+      driver_->GetCompiledMethodStorage()->ReleaseSwapResidentPages();
+    }
     return class_loader;
   }
 
@@ -2369,6 +2681,81 @@ class Dex2Oat FINAL {
   }
 
  private:
+  // Set up the VerifierDeps of the original vdex, if any, so that only the classes whose code
+  // changed since are verified. Returns false if there is no original vdex or it cannot be used,
+  // in which case all classes are verified.
+  bool ReuseOriginalVerification() {
+    if (original_vdex_fd_ == -1 && original_vdex_.empty()) {
+      return false;
+    }
+    TimingLogger::ScopedTiming t("Compare with original dex files", timings_);
+    std::string error_msg;
+    std::unique_ptr<VdexFile> original_vdex;
+    if (original_vdex_fd_ != -1) {
+      struct stat s;
+      if (TEMP_FAILURE_RETRY(fstat(original_vdex_fd_, &s)) == -1) {
+        PLOG(WARNING) << "Failed getting length of original vdex file";
+        return false;
+      }
+      original_vdex = VdexFile::Open(original_vdex_fd_,
+                                     s.st_size,
+                                     "original vdex",
+                                     /* writable */ false,
+                                     /* low_4gb */ false,
+                                     /* unquicken */ true,
+                                     &error_msg);
+    } else {
+      original_vdex = VdexFile::Open(original_vdex_,
+                                     /* writable */ false,
+                                     /* low_4gb */ false,
+                                     /* unquicken */ true,
+                                     &error_msg);
+    }
+    // If there's any problem with the original vdex, just warn and verify everything.
+    if (original_vdex == nullptr) {
+      LOG(WARNING) << "Failed opening original vdex file: " << error_msg;
+      return false;
+    }
+    if (!original_vdex->HasDexSection()) {
+      LOG(WARNING) << "Original vdex file does not contain dex files";
+      return false;
+    }
+    std::vector<std::unique_ptr<const DexFile>> original_dex_files;
+    if (!original_vdex->OpenAllDexFiles(&original_dex_files, &error_msg)) {
+      LOG(WARNING) << "Failed opening the dex files of the original vdex file: " << error_msg;
+      return false;
+    }
+    if (original_dex_files.size() != dex_files_.size()) {
+      LOG(WARNING) << "Original vdex file has " << original_dex_files.size()
+                   << " dex files instead of " << dex_files_.size();
+      return false;
+    }
+    std::vector<std::vector<bool>> changed_class_defs(dex_files_.size());
+    size_t num_classes = 0u;
+    size_t num_changed_classes = 0u;
+    for (size_t i = 0; i != dex_files_.size(); ++i) {
+      if (!FindChangedClassDefs(*original_dex_files[i],
+                                *dex_files_[i],
+                                &changed_class_defs[i],
+                                &error_msg)) {
+        LOG(WARNING) << "Cannot reuse the verification of the original vdex file: " << error_msg;
+        return false;
+      }
+      num_classes += changed_class_defs[i].size();
+      num_changed_classes +=
+          std::count(changed_class_defs[i].begin(), changed_class_defs[i].end(), true);
+    }
+    // The VerifierDeps refer to strings by their index, which the dex files have in common.
+    callbacks_->SetVerifierDeps(
+        new verifier::VerifierDeps(dex_files_, original_vdex->GetVerifierDepsData()));
+    for (size_t i = 0; i != dex_files_.size(); ++i) {
+      driver_->SetChangedClassDefs(dex_files_[i], std::move(changed_class_defs[i]));
+    }
+    LOG(INFO) << "Reusing verification of " << (num_classes - num_changed_classes) << " of "
+              << num_classes << " classes";
+    return true;
+  }
+
   bool UseSwap(bool is_image, const std::vector<const DexFile*>& dex_files) {
     if (is_image) {
       // Don't use swap, we know generation should succeed, and we don't want to slow it down.
@@ -2832,6 +3219,13 @@ class Dex2Oat FINAL {
               << ((Runtime::Current() != nullptr && driver_ != nullptr) ?
                   driver_->GetMemoryUsageString(kIsDebugBuild || VLOG_IS_ON(compiler)) :
                   "");
+    if (DexVerificationCache::Get() != nullptr) {
+      LOG(INFO) << "Dex verification cache hits: " << DexVerificationCache::Get()->GetNumHits();
+    }
+    if (DexExtractionCache::Get() != nullptr) {
+      LOG(INFO) << "Dex extraction cache hits: " << DexExtractionCache::Get()->GetNumHits()
+                << ", extractions: " << DexExtractionCache::Get()->GetNumExtractions();
+    }
   }
 
   std::string StripIsaFrom(const char* image_filename, InstructionSet isa) {
@@ -2893,6 +3287,8 @@ class Dex2Oat FINAL {
   std::unique_ptr<VdexFile> input_vdex_file_;
   int dm_fd_;
   std::string dm_file_location_;
+  int original_vdex_fd_ = -1;
+  std::string original_vdex_;
   std::unique_ptr<ZipArchive> dm_file_;
   std::vector<const char*> dex_filenames_;
   std::vector<const char*> dex_locations_;
@@ -2942,7 +3338,12 @@ class Dex2Oat FINAL {
   int swap_fd_;
   size_t min_dex_files_for_swap_ = kDefaultMinDexFilesForSwap;
   size_t min_dex_file_cumulative_size_for_swap_ = kDefaultMinDexFileCumulativeSizeForSwap;
+  size_t swap_resident_budget_mb_ = 0u;
   size_t very_large_threshold_ = std::numeric_limits<size_t>::max();
+  std::string compiled_method_cache_dir_;
+  size_t compiled_method_cache_max_size_mb_ = CompiledMethodCache::kDefaultMaxSizeMb;
+  std::string dex_verification_cache_dir_;
+  std::string dex_extraction_cache_dir_;
   std::string app_image_file_name_;
   int app_image_fd_;
   std::string profile_file_;
@@ -92,6 +92,12 @@ static void AddGeneratedArtifactMappings(Builder& builder) {
       .Define("--dm-file=_")
           .WithType<std::string>()
           .IntoKey(M::DmFile)
+      .Define("--original-vdex-fd=_")
+          .WithType<int>()
+          .IntoKey(M::OriginalVdexFd)
+      .Define("--original-vdex=_")
+          .WithType<std::string>()
+          .IntoKey(M::OriginalVdex)
       .Define("--oat-file=_")
           .WithType<std::vector<std::string>>().AppendValues()
           .IntoKey(M::OatFiles)
@@ -152,7 +158,10 @@ static void AddSwapMappings(Builder& builder) {
           .IntoKey(M::SwapDexSizeThreshold)
       .Define("--swap-dex-count-threshold=_")
           .WithType<unsigned int>()
-          .IntoKey(M::SwapDexCountThreshold);
+          .IntoKey(M::SwapDexCountThreshold)
+      .Define("--swap-resident-budget=_")
+          .WithType<unsigned int>()
+          .IntoKey(M::SwapResidentBudget);
 }
 
 static void AddCompilerMappings(Builder& builder) {
@@ -231,6 +240,18 @@ static Parser CreateArgumentParser() {
       .Define("--very-large-app-threshold=_")
           .WithType<unsigned int>()
           .IntoKey(M::VeryLargeAppThreshold)
+      .Define("--compiled-method-cache=_")
+          .WithType<std::string>()
+          .IntoKey(M::CompiledMethodCache)
+      .Define("--compiled-method-cache-max-size=_")
+          .WithType<unsigned int>()
+          .IntoKey(M::CompiledMethodCacheMaxSize)
+      .Define("--dex-verification-cache=_")
+          .WithType<std::string>()
+          .IntoKey(M::DexVerificationCache)
+      .Define("--dex-extraction-cache=_")
+          .WithType<std::string>()
+          .IntoKey(M::DexExtractionCache)
       .Define("--force-determinism")
           .IntoKey(M::ForceDeterminism)
       .Define("--copy-dex-files=_")
@@ -15,13 +15,18 @@
  */
 
 #include <regex>
+#include <set>
 #include <sstream>
 #include <string>
 #include <vector>
 
+#include <dirent.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#include <zlib.h>
 
+#include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/stringprintf.h>
 
@@ -1163,6 +1168,79 @@ TEST_F(Dex2oatClassLoaderContextTest, ContextWithOtherDexFiles) {
   RunTest(context.c_str(), expected_classpath_key.c_str(), true);
 }
 
+TEST_F(Dex2oatClassLoaderContextTest, DexVerificationCache) {
+  std::string dex_location = GetUsedDexLocation();
+  Copy(GetDexSrc1(), dex_location);
+  std::vector<std::unique_ptr<const DexFile>> dex_files = OpenTestDexFiles("Nested");
+  std::string cache_dir = GetScratchDir() + "/verified";
+  ASSERT_EQ(0, mkdir(cache_dir.c_str(), 0700));
+  std::vector<std::string> extra_args = {
+      "--class-loader-context=PCL[" + dex_files[0]->GetLocation() + "]",
+      "--dex-verification-cache=" + cache_dir,
+      "--runtime-arg",
+      "-Xuse-stderr-logger" };
+
+  // The first compilation verifies the classpath and records it, the second one skips it.
+  GenerateOdexForTest(dex_location, GetUsedOatLocation(), CompilerFilter::kQuicken, extra_args);
+  EXPECT_NE(std::string::npos, output_.find("Dex verification cache hits: 0")) << output_;
+  output_.clear();
+  GenerateOdexForTest(dex_location, GetUsedOatLocation(), CompilerFilter::kQuicken, extra_args);
+  EXPECT_NE(std::string::npos, output_.find("Dex verification cache hits: ")) << output_;
+  EXPECT_EQ(std::string::npos, output_.find("Dex verification cache hits: 0")) << output_;
+
+  // A directory writable by others is rejected.
+  ASSERT_EQ(0, chmod(cache_dir.c_str(), 0777));
+  output_.clear();
+  GenerateOdexForTest(dex_location,
+                      GetOdexDir() + "/Untrusted.odex",
+                      CompilerFilter::kQuicken,
+                      extra_args,
+                      /* expect_success */ false);
+  EXPECT_NE(std::string::npos, output_.find("is not a directory owned")) << output_;
+
+  ClearDirectory(cache_dir.c_str());
+  rmdir(cache_dir.c_str());
+}
+
+TEST_F(Dex2oatClassLoaderContextTest, DexExtractionCache) {
+  std::string dex_location = GetUsedDexLocation();
+  Copy(GetDexSrc1(), dex_location);
+  // A classpath jar with a compressed dex file.
+  std::string classpath_location = GetScratchDir() + "/compressed_classpath.jar";
+  {
+    std::unique_ptr<File> classpath_file(OS::CreateEmptyFile(classpath_location.c_str()));
+    ASSERT_TRUE(classpath_file != nullptr);
+    FILE* file = fdopen(classpath_file->Fd(), "w+b");
+    ZipWriter writer(file);
+    writer.StartEntry("classes.dex", ZipWriter::kCompress);
+    std::unique_ptr<const DexFile> dex(OpenTestDexFile("Nested"));
+    ASSERT_GE(writer.WriteBytes(dex->Begin(), dex->Size()), 0);
+    writer.FinishEntry();
+    writer.Finish();
+    ASSERT_EQ(0, fflush(file));
+    ASSERT_EQ(classpath_file->FlushCloseOrErase(), 0);
+  }
+  std::string cache_dir = GetScratchDir() + "/extracted";
+  ASSERT_EQ(0, mkdir(cache_dir.c_str(), 0700));
+  std::vector<std::string> extra_args = {
+      "--class-loader-context=PCL[" + classpath_location + "]",
+      "--dex-extraction-cache=" + cache_dir,
+      "--runtime-arg",
+      "-Xuse-stderr-logger" };
+
+  // The first compilation inflates the classpath dex file, the second one maps it.
+  GenerateOdexForTest(dex_location, GetUsedOatLocation(), CompilerFilter::kQuicken, extra_args);
+  EXPECT_NE(std::string::npos, output_.find("extractions: 1")) << output_;
+  output_.clear();
+  GenerateOdexForTest(dex_location, GetUsedOatLocation(), CompilerFilter::kQuicken, extra_args);
+  EXPECT_NE(std::string::npos, output_.find("extractions: 0")) << output_;
+  EXPECT_EQ(std::string::npos, output_.find("Dex extraction cache hits: 0")) << output_;
+
+  ClearDirectory(cache_dir.c_str());
+  rmdir(cache_dir.c_str());
+  unlink(classpath_location.c_str());
+}
+
 TEST_F(Dex2oatClassLoaderContextTest, ContextWithStrippedDexFiles) {
   std::string stripped_classpath = GetScratchDir() + "/stripped_classpath.jar";
   Copy(GetStrippedDexSrc1(), stripped_classpath);
@@ -1612,6 +1690,124 @@ TEST_F(Dex2oatDedupeCode, DedupeTest) {
   EXPECT_LT(dedupe_size, no_dedupe_size);
 }
 
+class Dex2oatDumpCfgTest : public Dex2oatTest {
+ protected:
+  // Compiles Statics with the given --dump-cfg options.
+  void DumpCfg(const std::vector<std::string>& dump_cfg_args) {
+    std::unique_ptr<const DexFile> dex(OpenTestDexFile("Statics"));
+    GenerateOdexForTest(dex->GetLocation(),
+                        GetScratchDir() + "/base.odex",
+                        CompilerFilter::Filter::kSpeed,
+                        dump_cfg_args);
+  }
+
+  static std::string ReadGzipFile(const std::string& file_name) {
+    gzFile gz_file = gzopen(file_name.c_str(), "rb");
+    CHECK(gz_file != nullptr) << file_name;
+    std::string contents;
+    char buffer[4096];
+    int bytes_read;
+    while ((bytes_read = gzread(gz_file, buffer, sizeof(buffer))) > 0) {
+      contents.append(buffer, bytes_read);
+    }
+    CHECK_EQ(bytes_read, 0) << file_name;
+    CHECK_EQ(gzclose(gz_file), Z_OK) << file_name;
+    return contents;
+  }
+
+  // The date of each compilation differs between runs.
+  static std::string RemoveDates(const std::string& dump) {
+    return std::regex_replace(dump, std::regex("\n *date [0-9]+\n"), "\n");
+  }
+
+  // Returns the methods and the pass names, without their "$<suffix>", dumped in `dump`.
+  static void ParseDump(const std::string& dump,
+                        std::set<std::string>* methods,
+                        std::set<std::string>* passes) {
+    std::smatch match;
+    std::regex method_regex("begin_compilation\n *name \"[^\"]*\"\n *method \"([^\"]*)\"");
+    for (auto it = dump.cbegin(); std::regex_search(it, dump.cend(), match, method_regex);) {
+      methods->insert(match[1].str());
+      it = match[0].second;
+    }
+    std::regex pass_regex("begin_cfg\n *name \"([^\"$ ]*)[^\"]*\"");
+    for (auto it = dump.cbegin(); std::regex_search(it, dump.cend(), match, pass_regex);) {
+      passes->insert(match[1].str());
+      it = match[0].second;
+    }
+  }
+};
+
+TEST_F(Dex2oatDumpCfgTest, PerThreadFileNames) {
+  const std::string shared_name = GetScratchDir() + "/shared.cfg";
+  DumpCfg({ "--dump-cfg=" + shared_name, "-j1" });
+  std::string shared_dump;
+  ASSERT_TRUE(android::base::ReadFileToString(shared_name, &shared_dump));
+  std::set<std::string> shared_methods;
+  std::set<std::string> shared_passes;
+  ParseDump(shared_dump, &shared_methods, &shared_passes);
+  ASSERT_FALSE(shared_methods.empty());
+
+  // The thread id goes before the extension: thread.cfg.gz is written to thread.<tid>.cfg.gz.
+  const std::string thread_dir = GetScratchDir() + "/threads";
+  ASSERT_EQ(0, mkdir(thread_dir.c_str(), 0700));
+  DumpCfg({ "--dump-cfg=" + thread_dir + "/thread.cfg.gz",
+            "--dump-cfg-per-thread",
+            "--dump-cfg-compression=gzip",
+            "-j4" });
+  std::set<std::string> thread_methods;
+  std::set<std::string> thread_passes;
+  size_t num_files = 0u;
+  DIR* dir = opendir(thread_dir.c_str());
+  ASSERT_TRUE(dir != nullptr);
+  for (dirent* entry = readdir(dir); entry != nullptr; entry = readdir(dir)) {
+    std::string name = entry->d_name;
+    if (name == "." || name == "..") {
+      continue;
+    }
+    EXPECT_TRUE(std::regex_match(name, std::regex("thread\\.[0-9]+\\.cfg\\.gz"))) << name;
+    ParseDump(ReadGzipFile(thread_dir + "/" + name), &thread_methods, &thread_passes);
+    ++num_files;
+  }
+  closedir(dir);
+  EXPECT_NE(0u, num_files);
+  EXPECT_EQ(shared_methods, thread_methods);
+  EXPECT_EQ(shared_passes, thread_passes);
+}
+
+TEST_F(Dex2oatDumpCfgTest, MethodAndPassFilters) {
+  const std::string file_name = GetScratchDir() + "/filtered.cfg";
+  DumpCfg({ "--dump-cfg=" + file_name,
+            "-j1",
+            "--dump-cfg-methods=*Statics.getS0(),java.lang.String Statics.getS?()",
+            "--dump-cfg-passes=builder,dead_code_elimination,disassembly" });
+  std::string dump;
+  ASSERT_TRUE(android::base::ReadFileToString(file_name, &dump));
+  std::set<std::string> methods;
+  std::set<std::string> passes;
+  ParseDump(dump, &methods, &passes);
+  EXPECT_EQ((std::set<std::string> { "boolean Statics.getS0()",
+                                     "java.lang.String Statics.getS8()" }),
+            methods);
+  // dead_code_elimination is matched by the names of its occurrences, e.g.
+  // "dead_code_elimination$initial".
+  EXPECT_EQ((std::set<std::string> { "builder", "dead_code_elimination", "disassembly" }), passes);
+}
+
+TEST_F(Dex2oatDumpCfgTest, GzipCompression) {
+  const std::string file_name = GetScratchDir() + "/plain.cfg";
+  // Dump the methods in a deterministic order.
+  DumpCfg({ "--dump-cfg=" + file_name, "-j1" });
+  std::string plain_dump;
+  ASSERT_TRUE(android::base::ReadFileToString(file_name, &plain_dump));
+  ASSERT_FALSE(plain_dump.empty());
+
+  const std::string gzip_file_name = GetScratchDir() + "/compressed.cfg.gz";
+  DumpCfg({ "--dump-cfg=" + gzip_file_name, "-j1", "--dump-cfg-compression=gzip" });
+  std::string gzip_dump = ReadGzipFile(gzip_file_name);
+  EXPECT_EQ(RemoveDates(plain_dump), RemoveDates(gzip_dump));
+}
+
 TEST_F(Dex2oatTest, UncompressedTest) {
   std::unique_ptr<const DexFile> dex(OpenTestDexFile("MainUncompressed"));
   std::string out_dir = GetScratchDir();
@@ -2024,6 +2220,57 @@ TEST_F(Dex2oatTest, QuickenedInput) {
   ASSERT_EQ(vdex_unquickened->FlushCloseOrErase(), 0) << "Could not flush and close";
 }
 
+// Test that only the classes whose code changed since the original vdex are verified again.
+TEST_F(Dex2oatTest, ReuseOriginalVerification) {
+  const std::string original_dex_location = GetTestDexFileName("ManyMethods");
+  const std::string original_odex_location = GetOdexDir() + "/original.odex";
+  const std::string original_vdex_location = GetOdexDir() + "/original.vdex";
+  GenerateOdexForTest(original_dex_location,
+                      original_odex_location,
+                      CompilerFilter::kVerify,
+                      { kDisableCompactDex });
+
+  // Change the string loaded by the first const-string, as a deobfuscator decrypting strings
+  // would. This only changes the code of one class.
+  ScratchFile temp_dex;
+  size_t num_classes = 0u;
+  MutateDexFile(temp_dex.GetFile(), original_dex_location, [&num_classes] (DexFile* dex) {
+    num_classes = dex->NumClassDefs();
+    for (size_t i = 0; i < dex->NumClassDefs(); ++i) {
+      const uint8_t* data = dex->GetClassData(dex->GetClassDef(i));
+      if (data == nullptr) {
+        continue;
+      }
+      ClassDataItemIterator it(*dex, data);
+      it.SkipAllFields();
+      for (; it.HasNextMethod(); it.Next()) {
+        for (const DexInstructionPcPair& inst : CodeItemInstructionAccessor(
+                 *dex, it.GetMethodCodeItem())) {
+          if (inst->Opcode() == Instruction::CONST_STRING) {
+            uint16_t string_idx =
+                static_cast<uint16_t>((inst->VRegB_21c() + 1u) % dex->NumStringIds());
+            const_cast<Instruction&>(inst.Inst()).SetVRegB_21c(string_idx);
+            return;
+          }
+        }
+      }
+    }
+    LOG(FATAL) << "Failed to find a const-string instruction";
+  });
+
+  GenerateOdexForTest(temp_dex.GetFilename(),
+                      GetOdexDir() + "/deobfuscated.odex",
+                      CompilerFilter::kQuicken,
+                      { kDisableCompactDex,
+                        "--original-vdex=" + original_vdex_location,
+                        "--runtime-arg",
+                        "-Xuse-stderr-logger" });
+  std::string expected = StringPrintf("Reusing verification of %zu of %zu classes",
+                                      num_classes - 1u,
+                                      num_classes);
+  EXPECT_NE(std::string::npos, output_.find(expected)) << output_;
+}
+
 // Test that compact dex generation with invalid dex files doesn't crash dex2oat. b/75970654
 TEST_F(Dex2oatTest, CompactDexInvalidSource) {
   ScratchFile invalid_dex;
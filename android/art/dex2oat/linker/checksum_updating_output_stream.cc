@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "checksum_updating_output_stream.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+
+#include "oat.h"
+#include "thread-current-inl.h"
+#include "thread_pool.h"
+
+namespace art {
+namespace linker {
+
+struct ChecksumUpdatingOutputStream::Chunk {
+  std::vector<uint8_t> data;
+  uint32_t checksum = 0u;
+};
+
+class ChecksumUpdatingOutputStream::ChecksumTask FINAL : public SelfDeletingTask {
+ public:
+  explicit ChecksumTask(Chunk* chunk) : chunk_(chunk) { }
+
+  void Run(Thread* self ATTRIBUTE_UNUSED) OVERRIDE {
+    chunk_->checksum =
+        adler32(adler32(0L, Z_NULL, 0), chunk_->data.data(), chunk_->data.size());
+  }
+
+ private:
+  Chunk* const chunk_;
+};
+
+static ThreadPool* GetThreadPoolWithWorkers(ThreadPool* thread_pool) {
+  return (thread_pool != nullptr && thread_pool->GetThreadCount() != 0u) ? thread_pool : nullptr;
+}
+
+ChecksumUpdatingOutputStream::ChecksumUpdatingOutputStream(OutputStream* out,
+                                                           OatHeader* oat_header,
+                                                           ThreadPool* thread_pool)
+    : OutputStream(out->GetLocation()),
+      out_(out),
+      oat_header_(oat_header),
+      thread_pool_(GetThreadPoolWithWorkers(thread_pool)),
+      // Keep every worker and the writing thread busy while more chunks are filled.
+      max_queued_chunks_(thread_pool_ != nullptr ? 2u * (thread_pool_->GetThreadCount() + 1u)
+                                                 : 0u),
+      num_queued_chunks_(0u),
+      workers_started_(false) { }
+
+ChecksumUpdatingOutputStream::~ChecksumUpdatingOutputStream() {
+  FinishChecksum();
+}
+
+bool ChecksumUpdatingOutputStream::WriteFully(const void* buffer, size_t byte_count) {
+  UpdateChecksum(buffer, byte_count);
+  return out_->WriteFully(buffer, byte_count);
+}
+
+off_t ChecksumUpdatingOutputStream::Seek(off_t offset, Whence whence) {
+  return out_->Seek(offset, whence);
+}
+
+bool ChecksumUpdatingOutputStream::Flush() {
+  FinishChecksum();
+  return out_->Flush();
+}
+
+void ChecksumUpdatingOutputStream::UpdateChecksum(const void* buffer, size_t byte_count) {
+  if (thread_pool_ == nullptr) {
+    oat_header_->UpdateChecksum(buffer, byte_count);
+    return;
+  }
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(buffer);
+  while (byte_count != 0u) {
+    if (num_queued_chunks_ == chunks_.size()) {
+      chunks_.emplace_back(new Chunk());
+      chunks_.back()->data.reserve(kChunkSize);
+    }
+    Chunk* chunk = chunks_[num_queued_chunks_].get();
+    size_t size = std::min(byte_count, kChunkSize - chunk->data.size());
+    chunk->data.insert(chunk->data.end(), data, data + size);
+    data += size;
+    byte_count -= size;
+    if (chunk->data.size() == kChunkSize) {
+      QueueCurrentChunk();
+    }
+  }
+}
+
+void ChecksumUpdatingOutputStream::QueueCurrentChunk() {
+  DCHECK_LT(num_queued_chunks_, chunks_.size());
+  Thread* self = Thread::Current();
+  thread_pool_->AddTask(self, new ChecksumTask(chunks_[num_queued_chunks_].get()));
+  ++num_queued_chunks_;
+  if (!workers_started_) {
+    thread_pool_->StartWorkers(self);
+    workers_started_ = true;
+  }
+  if (num_queued_chunks_ == max_queued_chunks_) {
+    FinishQueuedChunks();
+  }
+}
+
+void ChecksumUpdatingOutputStream::FinishQueuedChunks() {
+  DCHECK(num_queued_chunks_ == chunks_.size() || chunks_[num_queued_chunks_]->data.empty());
+  if (num_queued_chunks_ == 0u) {
+    return;
+  }
+  // The writing thread helps with the remaining chunks. It may hold the mutator lock while
+  // writing code, which is fine as the tasks do not need it.
+  thread_pool_->Wait(Thread::Current(), /* do_work */ true, /* may_hold_locks */ true);
+  for (size_t i = 0; i != num_queued_chunks_; ++i) {
+    Chunk* chunk = chunks_[i].get();
+    oat_header_->CombineChecksum(chunk->checksum, chunk->data.size());
+    chunk->data.clear();
+  }
+  num_queued_chunks_ = 0u;
+}
+
+void ChecksumUpdatingOutputStream::FinishChecksum() {
+  if (thread_pool_ == nullptr) {
+    return;
+  }
+  if (num_queued_chunks_ != chunks_.size() && !chunks_[num_queued_chunks_]->data.empty()) {
+    QueueCurrentChunk();
+  }
+  FinishQueuedChunks();
+  if (workers_started_) {
+    thread_pool_->StopWorkers(Thread::Current());
+    workers_started_ = false;
+  }
+}
+
+}  // namespace linker
+}  // namespace art
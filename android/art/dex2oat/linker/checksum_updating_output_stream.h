@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_DEX2OAT_LINKER_CHECKSUM_UPDATING_OUTPUT_STREAM_H_
+#define ART_DEX2OAT_LINKER_CHECKSUM_UPDATING_OUTPUT_STREAM_H_
+
+#include <memory>
+#include <vector>
+
+#include "base/globals.h"
+#include "base/macros.h"
+#include "linker/output_stream.h"
+
+namespace art {
+
+class OatHeader;
+class ThreadPool;
+
+namespace linker {
+
+// OutputStream wrapper that updates the oat checksum with the data written through it. Given a
+// thread pool with workers, the data is copied to chunks that are checksummed by the pool and
+// combined in order with OatHeader::CombineChecksum(), so that the writing thread mostly pays for
+// the copy. The checksum is the same as when updating it on the writing thread.
+class ChecksumUpdatingOutputStream FINAL : public OutputStream {
+ public:
+  static constexpr size_t kChunkSize = 1 * MB;
+
+  // The checksum is updated on the writing thread if `thread_pool` is null or has no workers.
+  // Otherwise the pool must not be used for anything else while the stream is alive, and the
+  // stream must be used from a thread attached to the runtime.
+  ChecksumUpdatingOutputStream(OutputStream* out,
+                               OatHeader* oat_header,
+                               ThreadPool* thread_pool = nullptr);
+  ~ChecksumUpdatingOutputStream();
+
+  bool WriteFully(const void* buffer, size_t byte_count) OVERRIDE;
+  off_t Seek(off_t offset, Whence whence) OVERRIDE;
+  bool Flush() OVERRIDE;
+
+ private:
+  struct Chunk;
+  class ChecksumTask;
+
+  void UpdateChecksum(const void* buffer, size_t byte_count);
+  // Queue the chunk being filled on the thread pool.
+  void QueueCurrentChunk();
+  // Wait for the queued chunks and fold their checksums into the oat header, in order.
+  void FinishQueuedChunks();
+  // Fold all data written so far into the oat header checksum.
+  void FinishChecksum();
+
+  OutputStream* const out_;
+  OatHeader* const oat_header_;
+  ThreadPool* const thread_pool_;
+  // Number of chunks queued on the thread pool before waiting for them.
+  const size_t max_queued_chunks_;
+  // Chunks in the order of the data. The first `num_queued_chunks_` ones are queued on the thread
+  // pool and the next one, if any, is being filled.
+  std::vector<std::unique_ptr<Chunk>> chunks_;
+  size_t num_queued_chunks_;
+  bool workers_started_;
+
+  DISALLOW_COPY_AND_ASSIGN(ChecksumUpdatingOutputStream);
+};
+
+}  // namespace linker
+}  // namespace art
+
+#endif  // ART_DEX2OAT_LINKER_CHECKSUM_UPDATING_OUTPUT_STREAM_H_
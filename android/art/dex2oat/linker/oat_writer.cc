@@ -51,6 +51,7 @@
 #include "image_writer.h"
 #include "jit/profile_compilation_info.h"
 #include "linker/buffered_output_stream.h"
+#include "linker/checksum_updating_output_stream.h"
 #include "linker/file_output_stream.h"
 #include "linker/index_bss_mapping_encoder.h"
 #include "linker/linker_patch.h"
@@ -95,29 +96,6 @@ const UnalignedDexFileHeader* AsUnalignedDexFileHeader(const uint8_t* raw_data)
     return reinterpret_cast<const UnalignedDexFileHeader*>(raw_data);
 }
 
-class ChecksumUpdatingOutputStream : public OutputStream {
- public:
-  ChecksumUpdatingOutputStream(OutputStream* out, OatHeader* oat_header)
-      : OutputStream(out->GetLocation()), out_(out), oat_header_(oat_header) { }
-
-  bool WriteFully(const void* buffer, size_t byte_count) OVERRIDE {
-    oat_header_->UpdateChecksum(buffer, byte_count);
-    return out_->WriteFully(buffer, byte_count);
-  }
-
-  off_t Seek(off_t offset, Whence whence) OVERRIDE {
-    return out_->Seek(offset, whence);
-  }
-
-  bool Flush() OVERRIDE {
-    return out_->Flush();
-  }
-
- private:
-  OutputStream* const out_;
-  OatHeader* const oat_header_;
-};
-
 inline uint32_t CodeAlignmentSize(uint32_t header_offset, const CompiledMethod& compiled_method) {
   // We want to align the code rather than the preheader.
   uint32_t unaligned_code_offset = header_offset + sizeof(OatQuickMethodHeader);
@@ -2582,7 +2560,9 @@ bool OatWriter::WriteRodata(OutputStream* out) {
   size_t relative_offset = current_offset - file_offset;
 
   // Wrap out to update checksum with each write.
-  ChecksumUpdatingOutputStream checksum_updating_out(out, oat_header_.get());
+  ChecksumUpdatingOutputStream checksum_updating_out(out,
+                                                     oat_header_.get(),
+                                                     compiler_driver_->GetThreadPool());
   out = &checksum_updating_out;
 
   relative_offset = WriteClassOffsets(out, file_offset, relative_offset);
@@ -2891,7 +2871,9 @@ bool OatWriter::WriteCode(OutputStream* out) {
   CHECK(write_state_ == WriteState::kWriteText);
 
   // Wrap out to update checksum with each write.
-  ChecksumUpdatingOutputStream checksum_updating_out(out, oat_header_.get());
+  ChecksumUpdatingOutputStream checksum_updating_out(out,
+                                                     oat_header_.get(),
+                                                     compiler_driver_->GetThreadPool());
   out = &checksum_updating_out;
 
   SetMultiOatRelativePatcherAdjustment();
@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include <zlib.h>
+
 #include "android-base/stringprintf.h"
 
 #include "arch/instruction_set_features.h"
@@ -35,6 +37,7 @@
 #include "entrypoints/quick/quick_entrypoints.h"
 #include "jit/profile_compilation_info.h"
 #include "linker/buffered_output_stream.h"
+#include "linker/checksum_updating_output_stream.h"
 #include "linker/elf_writer.h"
 #include "linker/elf_writer_quick.h"
 #include "linker/file_output_stream.h"
@@ -46,6 +49,7 @@
 #include "oat_file-inl.h"
 #include "oat_writer.h"
 #include "scoped_thread_state_change-inl.h"
+#include "thread_pool.h"
 #include "vdex_file.h"
 
 namespace art {
@@ -905,5 +909,90 @@ TEST_F(OatTest, UpdateChecksum) {
   EXPECT_EQ(216138397U, oat_header->GetChecksum());
 }
 
+TEST_F(OatTest, CombineChecksum) {
+  InstructionSet insn_set = InstructionSet::kX86;
+  std::string error_msg;
+  std::unique_ptr<const InstructionSetFeatures> insn_features(
+    InstructionSetFeatures::FromVariant(insn_set, "default", &error_msg));
+  ASSERT_TRUE(insn_features.get() != nullptr) << error_msg;
+  std::unique_ptr<OatHeader> oat_header(OatHeader::Create(insn_set,
+                                                          insn_features.get(),
+                                                          0u,
+                                                          nullptr));
+  oat_header->UpdateChecksum(OatHeader::kOatMagic, sizeof(OatHeader::kOatMagic));
+
+  // Combining the checksum of a chunk computed on its own gives the same result as updating the
+  // checksum with the chunk's data.
+  uint32_t chunk_checksum = adler32(adler32(0L, Z_NULL, 0),
+                                    OatHeader::kOatMagic,
+                                    sizeof(OatHeader::kOatMagic));
+  oat_header->CombineChecksum(chunk_checksum, sizeof(OatHeader::kOatMagic));
+  EXPECT_EQ(216138397U, oat_header->GetChecksum());
+
+  // An empty chunk does not change the checksum.
+  oat_header->CombineChecksum(adler32(0L, Z_NULL, 0), 0u);
+  EXPECT_EQ(216138397U, oat_header->GetChecksum());
+}
+
+static void WriteThroughChecksumUpdatingOutputStream(const std::vector<uint8_t>& data,
+                                                     ThreadPool* thread_pool,
+                                                     OatHeader* oat_header,
+                                                     /*out*/ std::vector<uint8_t>* output) {
+  // Write sizes below, at and above the chunk size, so that writes start and end at various
+  // offsets within the chunks and some span several chunks.
+  const size_t kChunkSize = ChecksumUpdatingOutputStream::kChunkSize;
+  const size_t kWriteSizes[] = { 1u, 7u, kChunkSize - 3u, 4 * KB, 2u * kChunkSize + 5u };
+  VectorOutputStream out("checksum test", output);
+  ChecksumUpdatingOutputStream checksum_out(&out, oat_header, thread_pool);
+  size_t offset = 0u;
+  for (size_t i = 0; offset != data.size(); ++i) {
+    size_t size = std::min(kWriteSizes[i % arraysize(kWriteSizes)], data.size() - offset);
+    ASSERT_TRUE(checksum_out.WriteFully(&data[offset], size));
+    offset += size;
+  }
+  ASSERT_TRUE(checksum_out.Flush());
+}
+
+TEST_F(OatTest, ChecksumUpdatingOutputStream) {
+  InstructionSet insn_set = InstructionSet::kX86;
+  std::string error_msg;
+  std::unique_ptr<const InstructionSetFeatures> insn_features(
+    InstructionSetFeatures::FromVariant(insn_set, "default", &error_msg));
+  ASSERT_TRUE(insn_features.get() != nullptr) << error_msg;
+  std::unique_ptr<OatHeader> serial_header(OatHeader::Create(insn_set,
+                                                             insn_features.get(),
+                                                             0u,
+                                                             nullptr));
+  std::unique_ptr<OatHeader> parallel_header(OatHeader::Create(insn_set,
+                                                               insn_features.get(),
+                                                               0u,
+                                                               nullptr));
+
+  // Enough data for the stream to wait for its queued chunks several times with two workers.
+  std::vector<uint8_t> data(9u * ChecksumUpdatingOutputStream::kChunkSize + 12345u);
+  for (size_t i = 0; i != data.size(); ++i) {
+    data[i] = static_cast<uint8_t>((i * 2654435761u) >> 24);
+  }
+
+  std::vector<uint8_t> serial_output;
+  WriteThroughChecksumUpdatingOutputStream(data,
+                                           /* thread_pool */ nullptr,
+                                           serial_header.get(),
+                                           &serial_output);
+  std::vector<uint8_t> parallel_output;
+  {
+    ThreadPool thread_pool("Checksum test thread pool", 2u);
+    WriteThroughChecksumUpdatingOutputStream(data,
+                                             &thread_pool,
+                                             parallel_header.get(),
+                                             &parallel_output);
+  }
+
+  EXPECT_TRUE(serial_output == data);
+  EXPECT_TRUE(parallel_output == data);
+  EXPECT_NE(serial_header->GetChecksum(), adler32(0L, Z_NULL, 0));
+  EXPECT_EQ(serial_header->GetChecksum(), parallel_header->GetChecksum());
+}
+
 }  // namespace linker
 }  // namespace art
@@ -36,7 +36,9 @@
 
 #include <inttypes.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <algorithm>
 #include <memory>
 #include <sstream>
 #include <vector>
@@ -45,6 +47,7 @@
 #include "android-base/logging.h"
 #include "android-base/stringprintf.h"
 
+#include "base/parallel_for.h"
 #include "dex/code_item_accessors-inl.h"
 #include "dex/dex_file-inl.h"
 #include "dex/dex_file_exception_helpers.h"
@@ -61,9 +64,10 @@ namespace art {
 struct Options gOptions;
 
 /*
- * Output file. Defaults to stdout.
+ * Output file. Defaults to stdout. Threads dumping classes in parallel
+ * redirect their own copy into an in-memory buffer.
  */
-FILE* gOutFile = stdout;
+thread_local FILE* gOutFile = stdout;
 
 /*
  * Data types that match the definitions in the VM specification.
@@ -77,6 +81,12 @@ typedef int16_t  s2;
 typedef int32_t  s4;
 typedef int64_t  s8;
 
+/*
+ * Number of class definitions dumped in parallel before their output is
+ * written, in order, to the output file.
+ */
+static constexpr u4 kClassesPerParallelChunk = 1024;
+
 /*
  * Basic information about a field or a method.
  */
@@ -1558,6 +1568,49 @@ static void dumpCfg(const DexFile* dex_file, int idx) {
   }
 }
 
+/*
+ * Returns the dot-separated package name of a well-formed class descriptor.
+ * The caller must free() the result.
+ */
+static char* createPackageName(const char* classDescriptor) {
+  char* mangle = strdup(classDescriptor + 1);
+  mangle[strlen(mangle)-1] = '\0';
+
+  // Reduce to just the package name.
+  char* lastSlash = strrchr(mangle, '/');
+  if (lastSlash != nullptr) {
+    *lastSlash = '\0';
+  } else {
+    *mangle = '\0';
+  }
+
+  for (char* cp = mangle; *cp != '\0'; cp++) {
+    if (*cp == '/') {
+      *cp = '.';
+    }
+  }  // for
+  return mangle;
+}
+
+/*
+ * Returns the package name that dumpClass() records for the class, or
+ * nullptr if it does not open a package. The caller must free() the result.
+ */
+static char* createDumpedPackageName(const DexFile* pDexFile, int idx) {
+  const DexFile::ClassDef& pClassDef = pDexFile->GetClassDef(idx);
+  if (gOptions.outputFormat != OUTPUT_XML ||
+      gOptions.showCfg ||
+      (gOptions.exportsOnly && (pClassDef.access_flags_ & kAccPublic) == 0)) {
+    return nullptr;
+  }
+  const char* classDescriptor = pDexFile->StringByTypeIdx(pClassDef.class_idx_);
+  if (!(classDescriptor[0] == 'L' &&
+        classDescriptor[strlen(classDescriptor)-1] == ';')) {
+    return nullptr;
+  }
+  return createPackageName(classDescriptor);
+}
+
 /*
  * Dumps the class.
  *
@@ -1596,23 +1649,7 @@ static void dumpClass(const DexFile* pDexFile, int idx, char** pLastPackage) {
     // Arrays and primitives should not be defined explicitly. Keep going?
     LOG(WARNING) << "Malformed class name '" << classDescriptor << "'";
   } else if (gOptions.outputFormat == OUTPUT_XML) {
-    char* mangle = strdup(classDescriptor + 1);
-    mangle[strlen(mangle)-1] = '\0';
-
-    // Reduce to just the package name.
-    char* lastSlash = strrchr(mangle, '/');
-    if (lastSlash != nullptr) {
-      *lastSlash = '\0';
-    } else {
-      *mangle = '\0';
-    }
-
-    for (char* cp = mangle; *cp != '\0'; cp++) {
-      if (*cp == '/') {
-        *cp = '.';
-      }
-    }  // for
-
+    char* mangle = createPackageName(classDescriptor);
     if (*pLastPackage == nullptr || strcmp(mangle, *pLastPackage) != 0) {
       // Start of a new package.
       if (*pLastPackage != nullptr) {
@@ -1979,6 +2016,53 @@ static void dumpCallSite(const DexFile* pDexFile, u4 idx) {
   }
 }
 
+/*
+ * Dumps all classes like the serial loop in processDexFile(), on
+ * gOptions.numThreads threads. Each class is dumped into its own in-memory
+ * buffer and the buffers are written in class order, so the output is
+ * identical to the serial one.
+ */
+static void dumpClassesParallel(const DexFile* pDexFile, char** pLastPackage) {
+  const u4 classDefsSize = pDexFile->GetHeader().class_defs_size_;
+  struct ClassOutput {
+    char* data = nullptr;
+    size_t size = 0;
+  };
+  std::vector<ClassOutput> outputs(std::min(classDefsSize, kClassesPerParallelChunk));
+  // The XML output opens a package when it differs from the one of the last
+  // class, so the package each class starts with is computed up front.
+  std::vector<char*> lastPackages(outputs.size());
+  for (u4 begin = 0; begin < classDefsSize; begin += kClassesPerParallelChunk) {
+    const u4 end = std::min(classDefsSize, begin + kClassesPerParallelChunk);
+    for (u4 i = begin; i < end; i++) {
+      lastPackages[i - begin] = *pLastPackage != nullptr ? strdup(*pLastPackage) : nullptr;
+      char* package = createDumpedPackageName(pDexFile, i);
+      if (package != nullptr) {
+        free(*pLastPackage);
+        *pLastPackage = package;
+      }
+    }  // for
+
+    FILE* outFile = gOutFile;
+    ParallelFor(end - begin, gOptions.numThreads, [&](size_t j) {
+      ClassOutput& output = outputs[j];
+      gOutFile = open_memstream(&output.data, &output.size);
+      CHECK(gOutFile != nullptr) << "open_memstream failed";
+      dumpClass(pDexFile, begin + j, &lastPackages[j]);
+      fclose(gOutFile);
+    });
+    gOutFile = outFile;
+
+    for (u4 i = begin; i < end; i++) {
+      ClassOutput& output = outputs[i - begin];
+      fwrite(output.data, 1, output.size, gOutFile);
+      free(output.data);
+      output = ClassOutput();
+      free(lastPackages[i - begin]);
+    }  // for
+  }  // for
+}
+
 /*
  * Dumps the requested sections of the file.
  */
@@ -2007,9 +2091,13 @@ static void processDexFile(const char* fileName,
   // Iterate over all classes.
   char* package = nullptr;
   const u4 classDefsSize = pDexFile->GetHeader().class_defs_size_;
-  for (u4 i = 0; i < classDefsSize; i++) {
-    dumpClass(pDexFile, i, &package);
-  }  // for
+  if (gOptions.numThreads > 1) {
+    dumpClassesParallel(pDexFile, &package);
+  } else {
+    for (u4 i = 0; i < classDefsSize; i++) {
+      dumpClass(pDexFile, i, &package);
+    }  // for
+  }
 
   // Iterate over all method handles.
   for (u4 i = 0; i < pDexFile->NumMethodHandles(); ++i) {
@@ -2034,37 +2122,50 @@ static void processDexFile(const char* fileName,
 }
 
 /*
- * Processes a single file (either direct .dex or indirect .zip/.jar/.apk).
+ * Opens all dex files of a file (either direct .dex or indirect .zip/.jar/.apk).
+ * The dex files point into "content", which must outlive them.
  */
-int processFile(const char* fileName) {
-  //if (gOptions.verbose) {
-  if (0) {
-    fprintf(gOutFile, "Processing '%s'...\n", fileName);
-  }
-
+bool openDexFiles(const char* fileName,
+                  std::string* content,
+                  std::vector<std::unique_ptr<const DexFile>>* dexFiles) {
   const bool kVerifyChecksum = !gOptions.ignoreBadChecksum;
   const bool kVerify = !gOptions.disableVerifier;
-  std::string content;
   // If the file is not a .dex file, the function tries .zip/.jar/.apk files,
   // all of which are Zip archives with "classes.dex" inside.
   // TODO: add an api to android::base to read a std::vector<uint8_t>.
-  if (!android::base::ReadFileToString(fileName, &content)) {
+  if (!android::base::ReadFileToString(fileName, content)) {
     LOG(ERROR) << "ReadFileToString failed";
-    return -1;
+    return false;
   }
   const DexFileLoader dex_file_loader;
   std::string error_msg;
-  std::vector<std::unique_ptr<const DexFile>> dex_files;
-  if (!dex_file_loader.OpenAll(reinterpret_cast<const uint8_t*>(content.data()),
-                               content.size(),
+  if (!dex_file_loader.OpenAll(reinterpret_cast<const uint8_t*>(content->data()),
+                               content->size(),
                                fileName,
                                kVerify,
                                kVerifyChecksum,
                                &error_msg,
-                               &dex_files)) {
+                               dexFiles)) {
     // Display returned error message to user. Note that this error behavior
     // differs from the error messages shown by the original Dalvik dexdump.
     LOG(ERROR) << error_msg;
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Processes a single file (either direct .dex or indirect .zip/.jar/.apk).
+ */
+int processFile(const char* fileName) {
+  //if (gOptions.verbose) {
+  if (0) {
+    fprintf(gOutFile, "Processing '%s'...\n", fileName);
+  }
+
+  std::string content;
+  std::vector<std::unique_ptr<const DexFile>> dex_files;
+  if (!openDexFiles(fileName, &content, &dex_files)) {
     return -1;
   }
 
@@ -28,12 +28,20 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include <memory>
+#include <string>
+#include <vector>
+
 namespace art {
 
+class DexFile;
+
 /* Supported output formats. */
 enum OutputFormat {
   OUTPUT_PLAIN = 0,  // default
   OUTPUT_XML,        // XML-style
+  OUTPUT_JSON,       // JSON, method differences only
+  OUTPUT_CSV,        // CSV, method differences only
 };
 
 /* Command-line options. */
@@ -50,12 +58,17 @@ struct Options {
   bool verbose;
   OutputFormat outputFormat;
   const char* outputFileName;
+  const char* diffFileName;
+  int numThreads;
 };
 
 /* Prototypes. */
 extern struct Options gOptions;
-extern FILE* gOutFile;
+extern thread_local FILE* gOutFile;
 int processFile(const char* fileName);
+bool openDexFiles(const char* fileName,
+                  std::string* content,
+                  std::vector<std::unique_ptr<const DexFile>>* dexFiles);
 
 }  // namespace art
 
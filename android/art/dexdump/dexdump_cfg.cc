@@ -32,6 +32,36 @@
 
 namespace art {
 
+// Collects the dex pcs that are targets of branches and switches.
+static void collectBranchTargets(const CodeItemDataAccessor& accessor,
+                                 std::set<uint32_t>* targets) {
+  for (const DexInstructionPcPair& pair : accessor) {
+    const Instruction* inst = &pair.Inst();
+    if (inst->IsBranch()) {
+      targets->insert(pair.DexPc() + inst->GetTargetOffset());
+    } else if (inst->IsSwitch()) {
+      const uint16_t* insns = reinterpret_cast<const uint16_t*>(inst);
+      int32_t switch_offset = insns[1] | (static_cast<int32_t>(insns[2]) << 16);
+      const uint16_t* switch_insns = insns + switch_offset;
+      uint32_t switch_count = switch_insns[1];
+      int32_t targets_offset;
+      if ((*insns & 0xff) == Instruction::PACKED_SWITCH) {
+        /* 0=sig, 1=count, 2/3=firstKey */
+        targets_offset = 4;
+      } else {
+        /* 0=sig, 1=count, 2..count*2 = keys */
+        targets_offset = 2 + 2 * switch_count;
+      }
+      for (uint32_t targ = 0; targ < switch_count; targ++) {
+        int32_t offset =
+            static_cast<int32_t>(switch_insns[targets_offset + targ * 2]) |
+            static_cast<int32_t>(switch_insns[targets_offset + targ * 2 + 1] << 16);
+        targets->insert(pair.DexPc() + offset);
+      }
+    }
+  }
+}
+
 static void dumpMethodCFGImpl(const DexFile* dex_file,
                               uint32_t dex_method_idx,
                               const DexFile::CodeItem* code_item,
@@ -42,34 +72,7 @@ static void dumpMethodCFGImpl(const DexFile* dex_file,
   CodeItemDataAccessor accessor(*dex_file, code_item);
 
   std::set<uint32_t> dex_pc_is_branch_target;
-  {
-    // Go and populate.
-    for (const DexInstructionPcPair& pair : accessor) {
-      const Instruction* inst = &pair.Inst();
-      if (inst->IsBranch()) {
-        dex_pc_is_branch_target.insert(pair.DexPc() + inst->GetTargetOffset());
-      } else if (inst->IsSwitch()) {
-        const uint16_t* insns = reinterpret_cast<const uint16_t*>(inst);
-        int32_t switch_offset = insns[1] | (static_cast<int32_t>(insns[2]) << 16);
-        const uint16_t* switch_insns = insns + switch_offset;
-        uint32_t switch_count = switch_insns[1];
-        int32_t targets_offset;
-        if ((*insns & 0xff) == Instruction::PACKED_SWITCH) {
-          /* 0=sig, 1=count, 2/3=firstKey */
-          targets_offset = 4;
-        } else {
-          /* 0=sig, 1=count, 2..count*2 = keys */
-          targets_offset = 2 + 2 * switch_count;
-        }
-        for (uint32_t targ = 0; targ < switch_count; targ++) {
-          int32_t offset =
-              static_cast<int32_t>(switch_insns[targets_offset + targ * 2]) |
-              static_cast<int32_t>(switch_insns[targets_offset + targ * 2 + 1] << 16);
-          dex_pc_is_branch_target.insert(pair.DexPc() + offset);
-        }
-      }
-    }
-  }
+  collectBranchTargets(accessor, &dex_pc_is_branch_target);
 
   // Create nodes for "basic blocks."
   std::map<uint32_t, uint32_t> dex_pc_to_node_id;  // This only has entries for block starts.
@@ -391,4 +394,27 @@ void DumpMethodCFG(const DexFile* dex_file, uint32_t dex_method_idx, std::ostrea
   os << "Something went wrong, didn't find the method in the class data.";
 }
 
+size_t CountMethodBasicBlocks(const DexFile* dex_file, const DexFile::CodeItem* code_item) {
+  if (code_item == nullptr) {
+    return 0u;
+  }
+  CodeItemDataAccessor accessor(*dex_file, code_item);
+  std::set<uint32_t> dex_pc_is_branch_target;
+  collectBranchTargets(accessor, &dex_pc_is_branch_target);
+
+  // Same block boundaries as the nodes of DumpMethodCFG().
+  size_t num_blocks = 0u;
+  bool force_new_block = false;
+  for (const DexInstructionPcPair& pair : accessor) {
+    const uint32_t dex_pc = pair.DexPc();
+    if (dex_pc == 0 ||
+        (dex_pc_is_branch_target.find(dex_pc) != dex_pc_is_branch_target.end()) ||
+        force_new_block) {
+      num_blocks++;
+    }
+    force_new_block = pair.Inst().IsSwitch() || pair.Inst().IsBasicBlockEnd();
+  }
+  return num_blocks;
+}
+
 }  // namespace art
@@ -20,12 +20,15 @@
 #include <inttypes.h>
 #include <ostream>
 
-namespace art {
+#include "dex/dex_file.h"
 
-class DexFile;
+namespace art {
 
 void DumpMethodCFG(const DexFile* dex_file, uint32_t dex_method_idx, std::ostream& os);
 
+// Returns the number of basic blocks DumpMethodCFG() shows for the code item.
+size_t CountMethodBasicBlocks(const DexFile* dex_file, const DexFile::CodeItem* code_item);
+
 }  // namespace art
 
 #endif  // ART_DEXDUMP_DEXDUMP_CFG_H_
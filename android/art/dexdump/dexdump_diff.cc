@@ -0,0 +1,440 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dexdump_diff.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "dex/code_item_accessors-inl.h"
+#include "dex/dex_file-inl.h"
+#include "dex/dex_file_exception_helpers.h"
+#include "dex/dex_instruction-inl.h"
+#include "dex/modifiers.h"
+#include "dexdump.h"
+#include "dexdump_cfg.h"
+
+namespace art {
+
+namespace {
+
+// A method of one version of the dex files.
+struct MethodCode {
+  const DexFile* dex_file;
+  const DexFile::CodeItem* code_item;
+  // Access flags of the field ids of `dex_file`, zero for fields defined elsewhere.
+  const std::vector<uint32_t>* field_access_flags;
+  uint64_t hash;
+};
+
+struct MethodStats {
+  size_t instructions = 0u;
+  size_t basic_blocks = 0u;
+  size_t branches = 0u;
+  size_t opaque_field_accesses = 0u;
+
+  void Add(const MethodStats& other) {
+    instructions += other.instructions;
+    basic_blocks += other.basic_blocks;
+    branches += other.branches;
+    opaque_field_accesses += other.opaque_field_accesses;
+  }
+};
+
+struct MethodDiff {
+  const std::string* method;
+  const char* status;
+  MethodStats before;
+  MethodStats after;
+};
+
+// FNV-1a, so that identical methods are recognized without comparing them pairwise.
+class CodeHasher {
+ public:
+  void Update(const void* data, size_t size) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+    for (size_t i = 0; i != size; ++i) {
+      hash_ = (hash_ ^ bytes[i]) * UINT64_C(1099511628211);
+    }
+  }
+
+  template <typename T>
+  void UpdateValue(T value) {
+    Update(&value, sizeof(value));
+  }
+
+  // Includes the terminator so that consecutive strings cannot run into each other.
+  void UpdateString(const char* str) {
+    Update(str, strlen(str) + 1u);
+  }
+
+  uint64_t Get() const {
+    return hash_;
+  }
+
+ private:
+  uint64_t hash_ = UINT64_C(14695981039346656037);
+};
+
+void HashMethodId(CodeHasher* hasher, const DexFile& dex_file, uint32_t method_idx) {
+  const DexFile::MethodId& method_id = dex_file.GetMethodId(method_idx);
+  hasher->UpdateString(dex_file.GetMethodDeclaringClassDescriptor(method_id));
+  hasher->UpdateString(dex_file.GetMethodName(method_id));
+  hasher->UpdateString(dex_file.GetMethodSignature(method_id).ToString().c_str());
+}
+
+void HashFieldId(CodeHasher* hasher, const DexFile& dex_file, uint32_t field_idx) {
+  const DexFile::FieldId& field_id = dex_file.GetFieldId(field_idx);
+  hasher->UpdateString(dex_file.GetFieldDeclaringClassDescriptor(field_id));
+  hasher->UpdateString(dex_file.GetFieldName(field_id));
+  hasher->UpdateString(dex_file.GetFieldTypeDescriptor(field_id));
+}
+
+// Hashes `inst` with its constant pool indices replaced by the symbols they refer to, as
+// the indices of unchanged code shift whenever a string, type, field or method is added
+// to or removed from the dex file.
+void HashInstruction(CodeHasher* hasher, const DexFile& dex_file, const Instruction& inst) {
+  const Instruction::IndexType index_type = Instruction::IndexTypeOf(inst.Opcode());
+  switch (index_type) {
+    case Instruction::kIndexTypeRef:
+    case Instruction::kIndexStringRef:
+    case Instruction::kIndexMethodRef:
+    case Instruction::kIndexFieldRef:
+    case Instruction::kIndexMethodAndProtoRef:
+    case Instruction::kIndexMethodHandleRef:
+    case Instruction::kIndexProtoRef:
+      break;
+    default:
+      // Payloads and call sites, whose arguments live in the encoded array of the call site,
+      // are hashed as they are. So are quickened offsets, which do not depend on the pools.
+      hasher->Update(&inst, inst.SizeInCodeUnits() * sizeof(uint16_t));
+      return;
+  }
+  // All formats with a pool index keep it from the second code unit on, and none of them
+  // is longer than the four code units of invoke-polymorphic.
+  const Instruction::Format format = Instruction::FormatOf(inst.Opcode());
+  uint16_t units[4] = {};
+  const size_t size_in_code_units = inst.SizeInCodeUnits();
+  DCHECK_LE(size_in_code_units, arraysize(units));
+  memcpy(units, &inst, size_in_code_units * sizeof(uint16_t));
+  units[1] = 0u;
+  if (format == Instruction::k31c) {
+    units[2] = 0u;
+  } else if (format == Instruction::k45cc || format == Instruction::k4rcc) {
+    units[3] = 0u;
+  }
+  hasher->Update(units, size_in_code_units * sizeof(uint16_t));
+
+  const uint32_t index = (format == Instruction::k22c) ? inst.VRegC() : inst.VRegB();
+  switch (index_type) {
+    case Instruction::kIndexTypeRef:
+      hasher->UpdateString(dex_file.StringByTypeIdx(dex::TypeIndex(index)));
+      break;
+    case Instruction::kIndexStringRef:
+      hasher->UpdateString(dex_file.StringDataByIdx(dex::StringIndex(index)));
+      break;
+    case Instruction::kIndexMethodRef:
+      HashMethodId(hasher, dex_file, index);
+      break;
+    case Instruction::kIndexFieldRef:
+      HashFieldId(hasher, dex_file, index);
+      break;
+    case Instruction::kIndexMethodAndProtoRef:
+      HashMethodId(hasher, dex_file, index);
+      hasher->UpdateString(
+          dex_file.GetProtoSignature(dex_file.GetProtoId(inst.VRegH())).ToString().c_str());
+      break;
+    case Instruction::kIndexMethodHandleRef: {
+      const DexFile::MethodHandleItem& item = dex_file.GetMethodHandle(index);
+      hasher->UpdateValue(item.method_handle_type_);
+      if (static_cast<DexFile::MethodHandleType>(item.method_handle_type_) <=
+          DexFile::MethodHandleType::kInstanceGet) {
+        HashFieldId(hasher, dex_file, item.field_or_method_idx_);
+      } else {
+        HashMethodId(hasher, dex_file, item.field_or_method_idx_);
+      }
+      break;
+    }
+    case Instruction::kIndexProtoRef:
+      hasher->UpdateString(
+          dex_file.GetProtoSignature(dex_file.GetProtoId(index)).ToString().c_str());
+      break;
+    default:
+      LOG(FATAL) << "Unexpected index type " << static_cast<int>(index_type);
+      UNREACHABLE();
+  }
+}
+
+// Hash of the code item that does not depend on how the constant pools are numbered, so that
+// methods which only moved in the pools of a rebuilt dex file still compare identical.
+uint64_t HashCodeItem(const DexFile& dex_file, const DexFile::CodeItem* code_item) {
+  CodeHasher hasher;
+  if (code_item == nullptr) {
+    return hasher.Get();
+  }
+  CodeItemDataAccessor accessor(dex_file, code_item);
+  hasher.UpdateValue(accessor.RegistersSize());
+  hasher.UpdateValue(accessor.InsSize());
+  hasher.UpdateValue(accessor.OutsSize());
+  hasher.UpdateValue(accessor.InsnsSizeInCodeUnits());
+  for (const DexInstructionPcPair& inst : accessor) {
+    HashInstruction(&hasher, dex_file, inst.Inst());
+  }
+  hasher.UpdateValue(accessor.TriesSize());
+  for (const DexFile::TryItem& try_item : accessor.TryItems()) {
+    hasher.UpdateValue(try_item.start_addr_);
+    hasher.UpdateValue(try_item.insn_count_);
+    for (CatchHandlerIterator it(accessor, try_item); it.HasNext(); it.Next()) {
+      const dex::TypeIndex type_idx = it.GetHandlerTypeIndex();
+      // Catch-all handlers have no type.
+      hasher.UpdateString(type_idx.IsValid() ? dex_file.StringByTypeIdx(type_idx) : "");
+      hasher.UpdateValue(it.GetHandlerAddress());
+    }
+  }
+  return hasher.Get();
+}
+
+bool IsOpaqueField(const MethodCode& code, uint32_t field_idx) {
+  static constexpr uint32_t kOpaqueFieldFlags = kAccPrivate | kAccStatic;
+  return field_idx < code.field_access_flags->size() &&
+         ((*code.field_access_flags)[field_idx] & kOpaqueFieldFlags) == kOpaqueFieldFlags;
+}
+
+MethodStats ComputeStats(const MethodCode& code) {
+  MethodStats stats;
+  if (code.code_item == nullptr) {
+    return stats;
+  }
+  CodeItemDataAccessor accessor(*code.dex_file, code.code_item);
+  for (const DexInstructionPcPair& pair : accessor) {
+    const Instruction& inst = pair.Inst();
+    stats.instructions++;
+    if ((inst.IsBranch() && !inst.IsUnconditional()) || inst.IsSwitch()) {
+      stats.branches++;
+    }
+    switch (inst.Opcode()) {
+      case Instruction::SGET:
+      case Instruction::SGET_WIDE:
+      case Instruction::SGET_OBJECT:
+      case Instruction::SGET_BOOLEAN:
+      case Instruction::SGET_BYTE:
+      case Instruction::SGET_CHAR:
+      case Instruction::SGET_SHORT:
+      case Instruction::SPUT:
+      case Instruction::SPUT_WIDE:
+      case Instruction::SPUT_OBJECT:
+      case Instruction::SPUT_BOOLEAN:
+      case Instruction::SPUT_BYTE:
+      case Instruction::SPUT_CHAR:
+      case Instruction::SPUT_SHORT:
+        if (IsOpaqueField(code, inst.VRegB_21c())) {
+          stats.opaque_field_accesses++;
+        }
+        break;
+      default:
+        break;
+    }
+  }
+  stats.basic_blocks = CountMethodBasicBlocks(code.dex_file, code.code_item);
+  return stats;
+}
+
+// Collects the methods of `dex_files` by their pretty signature.
+void CollectMethods(const std::vector<std::unique_ptr<const DexFile>>& dex_files,
+                    std::vector<std::unique_ptr<std::vector<uint32_t>>>* field_access_flags,
+                    std::map<std::string, MethodCode>* methods) {
+  for (const std::unique_ptr<const DexFile>& dex_file : dex_files) {
+    field_access_flags->push_back(
+        std::make_unique<std::vector<uint32_t>>(dex_file->NumFieldIds(), 0u));
+    std::vector<uint32_t>* flags = field_access_flags->back().get();
+    for (uint32_t i = 0; i != dex_file->NumClassDefs(); ++i) {
+      const uint8_t* class_data = dex_file->GetClassData(dex_file->GetClassDef(i));
+      if (class_data == nullptr) {
+        continue;
+      }
+      for (ClassDataItemIterator it(*dex_file, class_data); it.HasNextStaticField(); it.Next()) {
+        (*flags)[it.GetMemberIndex()] = it.GetRawMemberAccessFlags();
+      }
+    }
+  }
+  for (size_t d = 0; d != dex_files.size(); ++d) {
+    const DexFile* dex_file = dex_files[d].get();
+    for (uint32_t i = 0; i != dex_file->NumClassDefs(); ++i) {
+      const uint8_t* class_data = dex_file->GetClassData(dex_file->GetClassDef(i));
+      if (class_data == nullptr) {
+        continue;
+      }
+      ClassDataItemIterator it(*dex_file, class_data);
+      it.SkipAllFields();
+      for (; it.HasNextMethod(); it.Next()) {
+        const DexFile::CodeItem* code_item = it.GetMethodCodeItem();
+        MethodCode code = { dex_file,
+                            code_item,
+                            (*field_access_flags)[d].get(),
+                            HashCodeItem(*dex_file, code_item) };
+        methods->emplace(dex_file->PrettyMethod(it.GetMemberIndex()), code);
+      }
+    }
+  }
+}
+
+void PrintJsonString(const char* str) {
+  fputc('"', gOutFile);
+  for (const char* p = str; *p != '\0'; ++p) {
+    const unsigned char c = static_cast<unsigned char>(*p);
+    if (c == '"' || c == '\\') {
+      fprintf(gOutFile, "\\%c", c);
+    } else if (c < 0x20) {
+      fprintf(gOutFile, "\\u%04x", c);
+    } else {
+      fputc(c, gOutFile);
+    }
+  }
+  fputc('"', gOutFile);
+}
+
+void PrintCsvString(const char* str) {
+  fputc('"', gOutFile);
+  for (const char* p = str; *p != '\0'; ++p) {
+    if (*p == '"') {
+      fputc('"', gOutFile);
+    }
+    fputc(*p, gOutFile);
+  }
+  fputc('"', gOutFile);
+}
+
+void PrintJsonStats(const MethodStats& before, const MethodStats& after) {
+  fprintf(gOutFile,
+          "\"instructions\": [%zu, %zu], \"basic_blocks\": [%zu, %zu], "
+          "\"branches\": [%zu, %zu], \"opaque_field_accesses\": [%zu, %zu]",
+          before.instructions, after.instructions,
+          before.basic_blocks, after.basic_blocks,
+          before.branches, after.branches,
+          before.opaque_field_accesses, after.opaque_field_accesses);
+}
+
+void PrintCsvStats(const MethodStats& before, const MethodStats& after) {
+  fprintf(gOutFile, ",%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu\n",
+          before.instructions, after.instructions,
+          before.basic_blocks, after.basic_blocks,
+          before.branches, after.branches,
+          before.opaque_field_accesses, after.opaque_field_accesses);
+}
+
+}  // namespace
+
+int processDiff(const char* beforeFileName, const char* afterFileName) {
+  std::string before_content;
+  std::string after_content;
+  std::vector<std::unique_ptr<const DexFile>> before_dex_files;
+  std::vector<std::unique_ptr<const DexFile>> after_dex_files;
+  if (!openDexFiles(beforeFileName, &before_content, &before_dex_files) ||
+      !openDexFiles(afterFileName, &after_content, &after_dex_files)) {
+    return -1;
+  }
+
+  std::vector<std::unique_ptr<std::vector<uint32_t>>> field_access_flags;
+  std::map<std::string, MethodCode> before_methods;
+  std::map<std::string, MethodCode> after_methods;
+  CollectMethods(before_dex_files, &field_access_flags, &before_methods);
+  CollectMethods(after_dex_files, &field_access_flags, &after_methods);
+
+  // Walk both sorted maps together.
+  size_t num_identical = 0u;
+  size_t num_changed = 0u;
+  size_t num_removed = 0u;
+  size_t num_added = 0u;
+  std::vector<MethodDiff> diffs;
+  MethodStats total_before;
+  MethodStats total_after;
+  auto before_it = before_methods.begin();
+  auto after_it = after_methods.begin();
+  while (before_it != before_methods.end() || after_it != after_methods.end()) {
+    MethodDiff diff;
+    if (after_it == after_methods.end() ||
+        (before_it != before_methods.end() && before_it->first < after_it->first)) {
+      diff = { &before_it->first, "removed", ComputeStats(before_it->second), MethodStats() };
+      ++before_it;
+      num_removed++;
+    } else if (before_it == before_methods.end() || after_it->first < before_it->first) {
+      diff = { &after_it->first, "added", MethodStats(), ComputeStats(after_it->second) };
+      ++after_it;
+      num_added++;
+    } else {
+      const bool identical = before_it->second.hash == after_it->second.hash;
+      if (!identical) {
+        diff = { &before_it->first,
+                 "changed",
+                 ComputeStats(before_it->second),
+                 ComputeStats(after_it->second) };
+      }
+      ++before_it;
+      ++after_it;
+      if (identical) {
+        num_identical++;
+        continue;
+      }
+      num_changed++;
+    }
+    total_before.Add(diff.before);
+    total_after.Add(diff.after);
+    diffs.push_back(diff);
+  }
+
+  if (gOptions.outputFormat == OUTPUT_CSV) {
+    fprintf(gOutFile,
+            "method,status,instructions_before,instructions_after,"
+            "basic_blocks_before,basic_blocks_after,branches_before,branches_after,"
+            "opaque_field_accesses_before,opaque_field_accesses_after\n");
+    for (const MethodDiff& diff : diffs) {
+      PrintCsvString(diff.method->c_str());
+      fprintf(gOutFile, ",%s", diff.status);
+      PrintCsvStats(diff.before, diff.after);
+    }
+    fprintf(gOutFile, "*,total");
+    PrintCsvStats(total_before, total_after);
+    return 0;
+  }
+
+  fprintf(gOutFile, "{\n  \"before\": ");
+  PrintJsonString(beforeFileName);
+  fprintf(gOutFile, ",\n  \"after\": ");
+  PrintJsonString(afterFileName);
+  fprintf(gOutFile,
+          ",\n  \"methods\": {\"identical\": %zu, \"changed\": %zu, \"removed\": %zu, "
+          "\"added\": %zu},\n  \"total\": {",
+          num_identical, num_changed, num_removed, num_added);
+  PrintJsonStats(total_before, total_after);
+  fprintf(gOutFile, "},\n  \"differences\": [");
+  for (size_t i = 0; i != diffs.size(); ++i) {
+    fprintf(gOutFile, "%s\n    {\"method\": ", (i == 0u) ? "" : ",");
+    PrintJsonString(diffs[i].method->c_str());
+    fprintf(gOutFile, ", \"status\": \"%s\", ", diffs[i].status);
+    PrintJsonStats(diffs[i].before, diffs[i].after);
+    fprintf(gOutFile, "}");
+  }
+  fprintf(gOutFile, "%s]\n}\n", diffs.empty() ? "" : "\n  ");
+  return 0;
+}
+
+}  // namespace art
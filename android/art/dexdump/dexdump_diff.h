@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Method-level comparison of two versions of the same dex files, e.g. before
+ * and after deobfuscation.
+ */
+
+#ifndef ART_DEXDUMP_DEXDUMP_DIFF_H_
+#define ART_DEXDUMP_DEXDUMP_DIFF_H_
+
+namespace art {
+
+/*
+ * Pairs the methods of both files by class, name and signature and writes
+ * a summary of the differences to gOutFile, as JSON or CSV depending on
+ * gOptions.outputFormat. Methods whose code is identical up to the numbering
+ * of the constant pools are only counted.
+ * For the others, the report gives the number of instructions, basic blocks,
+ * conditional branches and accesses to private static fields (the fields
+ * used by opaque predicates) in each version.
+ */
+int processDiff(const char* beforeFileName, const char* afterFileName);
+
+}  // namespace art
+
+#endif  // ART_DEXDUMP_DEXDUMP_DIFF_H_
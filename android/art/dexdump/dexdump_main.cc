@@ -23,35 +23,46 @@
  */
 
 #include "dexdump.h"
+#include "dexdump_diff.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
 #include <android-base/logging.h>
 
+#include "dex/dex_file_verifier.h"
+
 namespace art {
 
 static const char* gProgName = "dexdump";
 
+/*
+ * Size of the output buffer used when dumping on multiple threads.
+ */
+static constexpr size_t kParallelOutputBufferSize = 1024 * 1024;
+
 /*
  * Shows usage.
  */
 static void usage(void) {
   LOG(ERROR) << "Copyright (C) 2007 The Android Open Source Project\n";
-  LOG(ERROR) << gProgName << ": [-a] [-c] [-d] [-e] [-f] [-h] [-i] [-j] [-l layout] [-o outfile]"
-                  " dexfile...\n";
+  LOG(ERROR) << gProgName << ": [-a] [-c] [-d] [-D before] [-e] [-f] [-h] [-i] [-j] [-l layout]"
+                  " [-o outfile] [-t threads] dexfile...\n";
   LOG(ERROR) << " -a : display annotations";
   LOG(ERROR) << " -c : verify checksum and exit";
   LOG(ERROR) << " -d : disassemble code sections";
+  LOG(ERROR) << " -D : compare the methods of the given file with those of each dexfile";
   LOG(ERROR) << " -e : display exported items only";
   LOG(ERROR) << " -f : display summary information from file header";
   LOG(ERROR) << " -g : display CFG for dex";
   LOG(ERROR) << " -h : display file header details";
   LOG(ERROR) << " -i : ignore checksum failures";
   LOG(ERROR) << " -j : disable dex file verification";
-  LOG(ERROR) << " -l : output layout, either 'plain' or 'xml'";
+  LOG(ERROR) << " -l : output layout, either 'plain' or 'xml' ('json' or 'csv' with -D)";
   LOG(ERROR) << " -o : output file name (defaults to stdout)";
+  LOG(ERROR) << " -t : number of threads dumping classes (defaults to 1)";
 }
 
 /*
@@ -62,10 +73,11 @@ int dexdumpDriver(int argc, char** argv) {
   bool wantUsage = false;
   memset(&gOptions, 0, sizeof(gOptions));
   gOptions.verbose = true;
+  gOptions.numThreads = 1;
 
   // Parse all arguments.
   while (1) {
-    const int ic = getopt(argc, argv, "acdefghijl:o:");
+    const int ic = getopt(argc, argv, "acdD:efghijl:o:t:");
     if (ic < 0) {
       break;  // done
     }
@@ -79,6 +91,9 @@ int dexdumpDriver(int argc, char** argv) {
       case 'd':  // disassemble Dalvik instructions
         gOptions.disassemble = true;
         break;
+      case 'D':  // compare with another file
+        gOptions.diffFileName = optarg;
+        break;
       case 'e':  // exported items only
         gOptions.exportsOnly = true;
         break;
@@ -103,6 +118,10 @@ int dexdumpDriver(int argc, char** argv) {
         } else if (strcmp(optarg, "xml") == 0) {
           gOptions.outputFormat = OUTPUT_XML;
           gOptions.verbose = false;
+        } else if (strcmp(optarg, "json") == 0) {
+          gOptions.outputFormat = OUTPUT_JSON;
+        } else if (strcmp(optarg, "csv") == 0) {
+          gOptions.outputFormat = OUTPUT_CSV;
         } else {
           wantUsage = true;
         }
@@ -110,6 +129,13 @@ int dexdumpDriver(int argc, char** argv) {
       case 'o':  // output file
         gOptions.outputFileName = optarg;
         break;
+      case 't':  // number of threads
+        gOptions.numThreads = atoi(optarg);
+        if (gOptions.numThreads < 1) {
+          LOG(ERROR) << "Bad number of threads '" << optarg << "'";
+          wantUsage = true;
+        }
+        break;
       default:
         wantUsage = true;
         break;
@@ -125,6 +151,17 @@ int dexdumpDriver(int argc, char** argv) {
     LOG(ERROR) << "Can't specify both -c and -i";
     wantUsage = true;
   }
+  if (gOptions.diffFileName != nullptr) {
+    if (gOptions.outputFormat == OUTPUT_PLAIN) {
+      gOptions.outputFormat = OUTPUT_JSON;
+    } else if (gOptions.outputFormat == OUTPUT_XML) {
+      LOG(ERROR) << "Can't specify -D with the xml layout";
+      wantUsage = true;
+    }
+  } else if (gOptions.outputFormat == OUTPUT_JSON || gOptions.outputFormat == OUTPUT_CSV) {
+    LOG(ERROR) << "The json and csv layouts require -D";
+    wantUsage = true;
+  }
   if (wantUsage) {
     usage();
     return 2;
@@ -139,10 +176,22 @@ int dexdumpDriver(int argc, char** argv) {
     }
   }
 
+  // Large dex files are also verified with the dumping threads.
+  DexFileVerifier::SetDefaultNumThreads(gOptions.numThreads);
+
+  // Write the merged output of the dumping threads in large chunks.
+  if (gOptions.numThreads > 1) {
+    setvbuf(gOutFile, nullptr, _IOFBF, kParallelOutputBufferSize);
+  }
+
   // Process all files supplied on command line.
   int result = 0;
   while (optind < argc) {
-    result |= processFile(argv[optind++]);
+    if (gOptions.diffFileName != nullptr) {
+      result |= processDiff(gOptions.diffFileName, argv[optind++]);
+    } else {
+      result |= processFile(argv[optind++]);
+    }
   }  // while
   return result != 0;
 }
@@ -18,13 +18,18 @@
 #include <string>
 #include <vector>
 
+#include <string.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "android-base/file.h"
+
 #include "arch/instruction_set.h"
 #include "base/os.h"
 #include "base/utils.h"
 #include "common_runtime_test.h"
+#include "dex/code_item_accessors-inl.h"
+#include "dex/dex_file-inl.h"
 #include "exec_utils.h"
 
 namespace art {
@@ -78,4 +83,121 @@ TEST_F(DexDumpTest, XMLOutput) {
     dex_file_}, &error_msg)) << error_msg;
 }
 
+TEST_F(DexDumpTest, ParallelOutputIsIdentical) {
+  const std::vector<std::vector<std::string>> layouts = {
+    {"-d", "-f", "-h", "-l", "plain"},
+    {"-l", "xml"},
+  };
+  for (const std::vector<std::string>& layout : layouts) {
+    ScratchFile serial_output;
+    ScratchFile parallel_output;
+    std::vector<std::string> serial_args = layout;
+    serial_args.insert(serial_args.end(), {"-o", serial_output.GetFilename(), dex_file_});
+    std::vector<std::string> parallel_args = layout;
+    parallel_args.insert(parallel_args.end(),
+                         {"-t", "4", "-o", parallel_output.GetFilename(), dex_file_});
+    std::string error_msg;
+    ASSERT_TRUE(Exec(serial_args, &error_msg)) << error_msg;
+    ASSERT_TRUE(Exec(parallel_args, &error_msg)) << error_msg;
+    std::string serial;
+    std::string parallel;
+    ASSERT_TRUE(android::base::ReadFileToString(serial_output.GetFilename(), &serial));
+    ASSERT_TRUE(android::base::ReadFileToString(parallel_output.GetFilename(), &parallel));
+    EXPECT_FALSE(serial.empty());
+    EXPECT_TRUE(serial == parallel) << layout[layout.size() - 1];
+  }
+}
+
+TEST_F(DexDumpTest, BadThreadCount) {
+  std::string error_msg;
+  ASSERT_FALSE(Exec({"-t", "0", dex_file_}, &error_msg)) << error_msg;
+}
+
+TEST_F(DexDumpTest, DiffIdenticalFiles) {
+  ScratchFile json_output;
+  ScratchFile csv_output;
+  std::string error_msg;
+  ASSERT_TRUE(Exec({"-D", dex_file_, "-o", json_output.GetFilename(), dex_file_},
+                   &error_msg)) << error_msg;
+  ASSERT_TRUE(Exec({"-D", dex_file_, "-l", "csv", "-o", csv_output.GetFilename(), dex_file_},
+                   &error_msg)) << error_msg;
+  std::string json;
+  std::string csv;
+  ASSERT_TRUE(android::base::ReadFileToString(json_output.GetFilename(), &json));
+  ASSERT_TRUE(android::base::ReadFileToString(csv_output.GetFilename(), &csv));
+  EXPECT_NE(std::string::npos, json.find("\"changed\": 0, \"removed\": 0, \"added\": 0"))
+      << json;
+  EXPECT_NE(std::string::npos, json.find("\"differences\": []")) << json;
+  // Only the header and the total.
+  EXPECT_EQ(std::string::npos, csv.find("\n\""));
+  EXPECT_NE(std::string::npos, csv.find("\n*,total,0,0,0,0,0,0,0,0\n")) << csv;
+}
+
+// Returns the code units of the method `name` of the only class of `dex_file`.
+static std::vector<uint16_t> GetInsns(const DexFile& dex_file, const char* name) {
+  const uint8_t* class_data = dex_file.GetClassData(dex_file.GetClassDef(0));
+  ClassDataItemIterator it(dex_file, class_data);
+  it.SkipAllFields();
+  for (; it.HasNextMethod(); it.Next()) {
+    if (strcmp(dex_file.GetMethodName(dex_file.GetMethodId(it.GetMemberIndex())), name) == 0) {
+      CodeItemInstructionAccessor accessor(dex_file, it.GetMethodCodeItem());
+      return std::vector<uint16_t>(accessor.Insns(),
+                                   accessor.Insns() + accessor.InsnsSizeInCodeUnits());
+    }
+  }
+  return std::vector<uint16_t>();
+}
+
+TEST_F(DexDumpTest, DiffRenumberedPools) {
+  const std::string before = GetTestDexFileName("DexDiffA");
+  const std::string after = GetTestDexFileName("DexDiffB");
+  {
+    // The test is only meaningful if the unchanged method got different indices.
+    std::unique_ptr<const DexFile> before_dex_file = OpenTestDexFile("DexDiffA");
+    std::unique_ptr<const DexFile> after_dex_file = OpenTestDexFile("DexDiffB");
+    std::vector<uint16_t> before_insns = GetInsns(*before_dex_file, "unchanged");
+    std::vector<uint16_t> after_insns = GetInsns(*after_dex_file, "unchanged");
+    ASSERT_FALSE(before_insns.empty());
+    ASSERT_EQ(before_insns.size(), after_insns.size());
+    ASSERT_TRUE(before_insns != after_insns);
+  }
+  ScratchFile json_output;
+  ScratchFile csv_output;
+  std::string error_msg;
+  ASSERT_TRUE(Exec({"-D", before, "-o", json_output.GetFilename(), after},
+                   &error_msg)) << error_msg;
+  ASSERT_TRUE(Exec({"-D", before, "-l", "csv", "-o", csv_output.GetFilename(), after},
+                   &error_msg)) << error_msg;
+  std::string json;
+  std::string csv;
+  ASSERT_TRUE(android::base::ReadFileToString(json_output.GetFilename(), &json));
+  ASSERT_TRUE(android::base::ReadFileToString(csv_output.GetFilename(), &csv));
+  // The constructor and unchanged() only differ in their indices.
+  EXPECT_NE(std::string::npos,
+            json.find("\"identical\": 2, \"changed\": 1, \"removed\": 1, \"added\": 1"))
+      << json;
+  EXPECT_NE(std::string::npos,
+            json.find("{\"method\": \"java.lang.String DexDiff.changed()\", "
+                      "\"status\": \"changed\""))
+      << json;
+  EXPECT_NE(std::string::npos,
+            json.find("{\"method\": \"void DexDiff.removed()\", \"status\": \"removed\""))
+      << json;
+  EXPECT_NE(std::string::npos,
+            json.find("{\"method\": \"void DexDiff.added()\", \"status\": \"added\""))
+      << json;
+  EXPECT_EQ(std::string::npos, json.find("unchanged")) << json;
+  EXPECT_NE(std::string::npos, csv.find("\n\"java.lang.String DexDiff.changed()\",changed,"))
+      << csv;
+  EXPECT_NE(std::string::npos, csv.find("\n\"void DexDiff.removed()\",removed,")) << csv;
+  EXPECT_NE(std::string::npos, csv.find("\n\"void DexDiff.added()\",added,")) << csv;
+  EXPECT_EQ(std::string::npos, csv.find("unchanged")) << csv;
+}
+
+TEST_F(DexDumpTest, DiffBadLayout) {
+  std::string error_msg;
+  ASSERT_FALSE(Exec({"-D", dex_file_, "-l", "xml", dex_file_}, &error_msg)) << error_msg;
+  ASSERT_FALSE(Exec({"-l", "csv", dex_file_}, &error_msg)) << error_msg;
+}
+
 }  // namespace art
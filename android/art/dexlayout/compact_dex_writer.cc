@@ -50,7 +50,7 @@ uint32_t CompactDexWriter::WriteDebugInfoOffsetTable(Stream* stream) {
   };
 
   for (InvokeType invoke_type : invoke_types) {
-    for (const std::unique_ptr<dex_ir::ClassDef>& class_def : collections.ClassDefs()) {
+    for (dex_ir::ClassDef* class_def : collections.ClassDefs()) {
       // Skip classes that are not defined in this dex file.
       dex_ir::ClassData* class_data = class_def->GetClassData();
       if (class_data == nullptr) {
@@ -212,6 +212,7 @@ void CompactDexWriter::WriteDebugInfoItem(Stream* stream, dex_ir::DebugInfoItem*
 
 CompactDexWriter::Deduper::Deduper(bool enabled, DexContainer::Section* section)
     : enabled_(enabled),
+      section_(section),
       dedupe_map_(/*bucket_count*/ 32,
                   HashedMemoryRange::HashEqual(section),
                   HashedMemoryRange::HashEqual(section)) {}
@@ -222,7 +223,9 @@ uint32_t CompactDexWriter::Deduper::Dedupe(uint32_t data_start,
   if (!enabled_) {
     return kDidNotDedupe;
   }
-  HashedMemoryRange range {data_start, data_end - data_start};
+  const uint32_t length = data_end - data_start;
+  DCHECK_LE(data_end, section_->Size());
+  HashedMemoryRange range {data_start, length, HashBytes(section_->Begin() + data_start, length)};
   auto existing = dedupe_map_.emplace(range, item_offset);
   if (!existing.second) {
     // Failed to insert means we deduped, return the existing item offset.
@@ -239,7 +242,7 @@ void CompactDexWriter::SortDebugInfosByMethodIndex() {
   };
   std::map<const dex_ir::DebugInfoItem*, uint32_t> method_idx_map;
   for (InvokeType invoke_type : invoke_types) {
-    for (std::unique_ptr<dex_ir::ClassDef>& class_def : collections.ClassDefs()) {
+    for (dex_ir::ClassDef* class_def : collections.ClassDefs()) {
       // Skip classes that are not defined in this dex file.
       dex_ir::ClassData* class_data = class_def->GetClassData();
       if (class_data == nullptr) {
@@ -259,10 +262,9 @@ void CompactDexWriter::SortDebugInfosByMethodIndex() {
   }
   std::sort(collections.DebugInfoItems().begin(),
             collections.DebugInfoItems().end(),
-            [&](const std::unique_ptr<dex_ir::DebugInfoItem>& a,
-                const std::unique_ptr<dex_ir::DebugInfoItem>& b) {
-    auto it_a = method_idx_map.find(a.get());
-    auto it_b = method_idx_map.find(b.get());
+            [&](const dex_ir::DebugInfoItem* a, const dex_ir::DebugInfoItem* b) {
+    auto it_a = method_idx_map.find(a);
+    auto it_b = method_idx_map.find(b);
     uint32_t idx_a = it_a != method_idx_map.end() ? it_a->second : 0u;
     uint32_t idx_b = it_b != method_idx_map.end() ? it_b->second : 0u;
     return idx_a < idx_b;
@@ -341,7 +343,7 @@ bool CompactDexWriter::CanGenerateCompactDex(std::string* error_msg) {
   std::vector<dex_ir::CodeItem*> method_id_code_item(collections.MethodIdsSize(), nullptr);
   std::vector<dex_ir::DebugInfoItem*> method_id_debug_info(collections.MethodIdsSize(), nullptr);
   for (InvokeType invoke_type : invoke_types) {
-    for (std::unique_ptr<dex_ir::ClassDef>& class_def : collections.ClassDefs()) {
+    for (dex_ir::ClassDef* class_def : collections.ClassDefs()) {
       // Skip classes that are not defined in this dex file.
       dex_ir::ClassData* class_data = class_def->GetClassData();
       if (class_data == nullptr) {
@@ -528,8 +530,10 @@ bool CompactDexWriter::Write(DexContainer* output, std::string* error_msg)  {
 
   // Clear the dedupe to prevent interdex code item deduping. This does not currently work well with
   // dex2oat's class unloading. The issue is that verification encounters quickened opcodes after
-  // the first dex gets unloaded.
-  code_item_dedupe_->Clear();
+  // the first dex gets unloaded. Outputs that are not quickened in place may opt in.
+  if (!dex_layout_->GetOptions().dedupe_across_dex_files_) {
+    code_item_dedupe_->Clear();
+  }
 
   return true;
 }
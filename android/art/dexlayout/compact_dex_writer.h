@@ -54,6 +54,8 @@ class CompactDexWriter : public DexWriter {
      public:
       uint32_t offset_;
       uint32_t length_;
+      // Hash of the data, computed once so that growing the map does not read it again.
+      size_t hash_;
 
       class HashEqual {
        public:
@@ -61,7 +63,7 @@ class CompactDexWriter : public DexWriter {
 
         // Equal function.
         bool operator()(const HashedMemoryRange& a, const HashedMemoryRange& b) const {
-          if (a.length_ != b.length_) {
+          if (a.length_ != b.length_ || a.hash_ != b.hash_) {
             return false;
           }
           const uint8_t* data = Data();
@@ -73,7 +75,7 @@ class CompactDexWriter : public DexWriter {
         // Hash function.
         size_t operator()(const HashedMemoryRange& range) const {
           DCHECK_LE(range.offset_ + range.length_, section_->Size());
-          return HashBytes(Data() + range.offset_, range.length_);
+          return range.hash_;
         }
 
         ALWAYS_INLINE uint8_t* Data() const {
@@ -87,6 +89,8 @@ class CompactDexWriter : public DexWriter {
 
     const bool enabled_;
 
+    DexContainer::Section* const section_;
+
     // Dedupe map.
     std::unordered_map<HashedMemoryRange,
                        uint32_t,
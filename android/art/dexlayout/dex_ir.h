@@ -22,6 +22,7 @@
 #include <stdint.h>
 
 #include <map>
+#include <memory>
 #include <vector>
 
 #include "base/leb128.h"
@@ -107,7 +108,8 @@ class AbstractDispatcher {
   DISALLOW_COPY_AND_ASSIGN(AbstractDispatcher);
 };
 
-// Collections become owners of the objects added by moving them into unique pointers.
+// Collections own the objects created through them. Items of each type are constructed in place
+// in large chunks of storage, bump allocated and freed together when the collection goes away.
 template<class T> class CollectionBase {
  public:
   CollectionBase() = default;
@@ -128,9 +130,20 @@ template<class T> class CollectionBase {
 
 template<class T> class CollectionVector : public CollectionBase<T> {
  public:
-  using Vector = std::vector<std::unique_ptr<T>>;
+  // Items in output order. The pointers do not own the items, the collection does.
+  using Vector = std::vector<T*>;
   CollectionVector() = default;
 
+  ~CollectionVector() {
+    // `collection_` may have been reordered but still holds every item exactly once.
+    for (T* object : collection_) {
+      object->~T();
+    }
+    for (T* chunk : chunks_) {
+      std::allocator<T>().deallocate(chunk, kItemsPerChunk);
+    }
+  }
+
   uint32_t Size() const { return collection_.size(); }
   Vector& Collection() { return collection_; }
   const Vector& Collection() const { return collection_; }
@@ -141,10 +154,7 @@ template<class T> class CollectionVector : public CollectionBase<T> {
     auto it = map.begin();
     CHECK_EQ(map.size(), Size());
     for (size_t i = 0; i < Size(); ++i) {
-      // There are times when the array will temporarily contain the same pointer twice, doing the
-      // release here sure there is no double free errors.
-      Collection()[i].release();
-      Collection()[i].reset(it->second);
+      collection_[i] = it->second;
       ++it;
     }
   }
@@ -152,24 +162,40 @@ template<class T> class CollectionVector : public CollectionBase<T> {
  protected:
   Vector collection_;
 
-  void AddItem(T* object) {
-    collection_.push_back(std::unique_ptr<T>(object));
+  template <class... Args>
+  T* CreateAndAddItem(Args&&... args) {
+    if (last_chunk_used_ == kItemsPerChunk) {
+      chunks_.push_back(std::allocator<T>().allocate(kItemsPerChunk));
+      last_chunk_used_ = 0u;
+    }
+    T* object = new (chunks_.back() + last_chunk_used_) T(std::forward<Args>(args)...);
+    ++last_chunk_used_;
+    collection_.push_back(object);
+    return object;
   }
 
  private:
+  static constexpr size_t kItemsPerChunk = 256u;
+
+  // Storage for the items, only the last chunk may have unused slots.
+  std::vector<T*> chunks_;
+  size_t last_chunk_used_ = kItemsPerChunk;
+
   friend class Collections;
   DISALLOW_COPY_AND_ASSIGN(CollectionVector);
 };
 
 template<class T> class IndexedCollectionVector : public CollectionVector<T> {
  public:
-  using Vector = std::vector<std::unique_ptr<T>>;
+  using Vector = std::vector<T*>;
   IndexedCollectionVector() = default;
 
  private:
-  void AddIndexedItem(T* object, uint32_t index) {
+  template <class... Args>
+  T* CreateAndAddIndexedItem(uint32_t index, Args&&... args) {
+    T* object = CollectionVector<T>::CreateAndAddItem(std::forward<Args>(args)...);
     object->SetIndex(index);
-    CollectionVector<T>::collection_.push_back(std::unique_ptr<T>(object));
+    return object;
   }
 
   friend class Collections;
@@ -260,6 +286,9 @@ class Collections {
                                    const DexFile::CodeItem* disk_code_item,
                                    uint32_t offset,
                                    uint32_t dex_method_index);
+  // Add "fixup" references to the types, strings, methods and fields used by `code_item`. This
+  // only reads the id collections, so it may run concurrently for different code items.
+  void CreateCodeFixups(CodeItem* code_item);
   ClassData* CreateClassData(const DexFile& dex_file, const uint8_t* encoded_data, uint32_t offset);
   void AddAnnotationsFromMapListSection(const DexFile& dex_file,
                                         uint32_t start_offset,
@@ -267,35 +296,35 @@ class Collections {
 
   StringId* GetStringId(uint32_t index) {
     CHECK_LT(index, StringIdsSize());
-    return StringIds()[index].get();
+    return StringIds()[index];
   }
   TypeId* GetTypeId(uint32_t index) {
     CHECK_LT(index, TypeIdsSize());
-    return TypeIds()[index].get();
+    return TypeIds()[index];
   }
   ProtoId* GetProtoId(uint32_t index) {
     CHECK_LT(index, ProtoIdsSize());
-    return ProtoIds()[index].get();
+    return ProtoIds()[index];
   }
   FieldId* GetFieldId(uint32_t index) {
     CHECK_LT(index, FieldIdsSize());
-    return FieldIds()[index].get();
+    return FieldIds()[index];
   }
   MethodId* GetMethodId(uint32_t index) {
     CHECK_LT(index, MethodIdsSize());
-    return MethodIds()[index].get();
+    return MethodIds()[index];
   }
   ClassDef* GetClassDef(uint32_t index) {
     CHECK_LT(index, ClassDefsSize());
-    return ClassDefs()[index].get();
+    return ClassDefs()[index];
   }
   CallSiteId* GetCallSiteId(uint32_t index) {
     CHECK_LT(index, CallSiteIdsSize());
-    return CallSiteIds()[index].get();
+    return CallSiteIds()[index];
   }
   MethodHandleItem* GetMethodHandle(uint32_t index) {
     CHECK_LT(index, MethodHandleItemsSize());
-    return MethodHandleItems()[index].get();
+    return MethodHandleItems()[index];
   }
 
   StringId* GetStringIdOrNullPtr(uint32_t index) {
@@ -373,30 +402,32 @@ class Collections {
   // Sort the vectors buy map order (same order that was used in the input file).
   void SortVectorsByMapOrder();
 
-  template <typename Type>
-  void AddItem(CollectionMap<Type>& map,
-               CollectionVector<Type>& vector,
-               Type* item,
-               uint32_t offset) {
+  template <typename Type, class... Args>
+  Type* CreateAndAddItem(CollectionMap<Type>& map,
+                         CollectionVector<Type>& vector,
+                         uint32_t offset,
+                         Args&&... args) {
     DCHECK(!map.GetExistingObject(offset));
+    Type* item = vector.CreateAndAddItem(std::forward<Args>(args)...);
     DCHECK(!item->OffsetAssigned());
     if (eagerly_assign_offsets_) {
       item->SetOffset(offset);
     }
     map.AddItem(item, offset);
-    vector.AddItem(item);
+    return item;
   }
 
-  template <typename Type>
-  void AddIndexedItem(IndexedCollectionVector<Type>& vector,
-                      Type* item,
-                      uint32_t offset,
-                      uint32_t index) {
+  template <typename Type, class... Args>
+  Type* CreateAndAddIndexedItem(IndexedCollectionVector<Type>& vector,
+                                uint32_t offset,
+                                uint32_t index,
+                                Args&&... args) {
+    Type* item = vector.CreateAndAddIndexedItem(index, std::forward<Args>(args)...);
     DCHECK(!item->OffsetAssigned());
     if (eagerly_assign_offsets_) {
       item->SetOffset(offset);
     }
-    vector.AddIndexedItem(item, index);
+    return item;
   }
 
   void SetEagerlyAssignOffsets(bool eagerly_assign_offsets) {
@@ -20,6 +20,8 @@
 #include <vector>
 
 #include "dex_ir_builder.h"
+
+#include "base/parallel_for.h"
 #include "dexlayout.h"
 
 namespace art {
@@ -86,6 +88,12 @@ Header* DexIrBuilder(const DexFile& dex_file,
     }
     collections.CreateClassDef(dex_file, i);
   }
+  // Scanning the bytecode for the ids it references is the most expensive part of building the
+  // code items, and it only reads the id collections created above.
+  CollectionVector<CodeItem>::Vector& code_items = collections.CodeItems();
+  ParallelFor(code_items.size(), options.num_threads_, [&](size_t i) {
+    collections.CreateCodeFixups(code_items[i]);
+  });
   // MapItem.
   collections.SetMapListOffset(disk_header.map_off_);
   // CallSiteIds and MethodHandleItems.
@@ -49,8 +49,8 @@ bool VerifyOutputDexFile(dex_ir::Header* orig_header,
   return true;
 }
 
-template<class T> bool VerifyIds(std::vector<std::unique_ptr<T>>& orig,
-                                 std::vector<std::unique_ptr<T>>& output,
+template<class T> bool VerifyIds(std::vector<T*>& orig,
+                                 std::vector<T*>& output,
                                  const char* section_name,
                                  std::string* error_msg) {
   if (orig.size() != output.size()) {
@@ -59,7 +59,7 @@ template<class T> bool VerifyIds(std::vector<std::unique_ptr<T>>& orig,
     return false;
   }
   for (size_t i = 0; i < orig.size(); ++i) {
-    if (!VerifyId(orig[i].get(), output[i].get(), error_msg)) {
+    if (!VerifyId(orig[i], output[i], error_msg)) {
       return false;
     }
   }
@@ -181,8 +181,8 @@ struct ClassDefCompare {
 
 // The class defs may have a new order due to dexlayout. Use the class's class_idx to uniquely
 // identify them and sort them for comparison.
-bool VerifyClassDefs(std::vector<std::unique_ptr<dex_ir::ClassDef>>& orig,
-                     std::vector<std::unique_ptr<dex_ir::ClassDef>>& output,
+bool VerifyClassDefs(std::vector<dex_ir::ClassDef*>& orig,
+                     std::vector<dex_ir::ClassDef*>& output,
                      std::string* error_msg) {
   if (orig.size() != output.size()) {
     *error_msg = StringPrintf(
@@ -193,8 +193,8 @@ bool VerifyClassDefs(std::vector<std::unique_ptr<dex_ir::ClassDef>>& orig,
   std::set<dex_ir::ClassDef*, ClassDefCompare> orig_set;
   std::set<dex_ir::ClassDef*, ClassDefCompare> output_set;
   for (size_t i = 0; i < orig.size(); ++i) {
-    orig_set.insert(orig[i].get());
-    output_set.insert(output[i].get());
+    orig_set.insert(orig[i]);
+    output_set.insert(output[i]);
   }
   auto orig_iter = orig_set.begin();
   auto output_iter = output_set.begin();
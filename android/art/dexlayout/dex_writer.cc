@@ -20,6 +20,7 @@
 
 #include <vector>
 
+#include "base/parallel_for.h"
 #include "compact_dex_writer.h"
 #include "dex/compact_dex_file.h"
 #include "dex/dex_file_layout.h"
@@ -231,7 +232,7 @@ void DexWriter::WriteEncodedMethods(Stream* stream, dex_ir::MethodItemVector* me
 // function that takes a CollectionVector<T> and uses overloading.
 void DexWriter::WriteStringIds(Stream* stream, bool reserve_only) {
   const uint32_t start = stream->Tell();
-  for (std::unique_ptr<dex_ir::StringId>& string_id : header_->GetCollections().StringIds()) {
+  for (dex_ir::StringId* string_id : header_->GetCollections().StringIds()) {
     stream->AlignTo(SectionAlignment(DexFile::kDexTypeStringIdItem));
     if (reserve_only) {
       stream->Skip(string_id->GetSize());
@@ -256,8 +257,8 @@ void DexWriter::WriteStringData(Stream* stream, dex_ir::StringData* string_data)
 
 void DexWriter::WriteStringDatas(Stream* stream) {
   const uint32_t start = stream->Tell();
-  for (std::unique_ptr<dex_ir::StringData>& string_data : header_->GetCollections().StringDatas()) {
-    WriteStringData(stream, string_data.get());
+  for (dex_ir::StringData* string_data : header_->GetCollections().StringDatas()) {
+    WriteStringData(stream, string_data);
   }
   if (compute_offsets_ && start != stream->Tell()) {
     header_->GetCollections().SetStringDatasOffset(start);
@@ -267,9 +268,9 @@ void DexWriter::WriteStringDatas(Stream* stream) {
 void DexWriter::WriteTypeIds(Stream* stream) {
   uint32_t descriptor_idx[1];
   const uint32_t start = stream->Tell();
-  for (std::unique_ptr<dex_ir::TypeId>& type_id : header_->GetCollections().TypeIds()) {
+  for (dex_ir::TypeId* type_id : header_->GetCollections().TypeIds()) {
     stream->AlignTo(SectionAlignment(DexFile::kDexTypeTypeIdItem));
-    ProcessOffset(stream, type_id.get());
+    ProcessOffset(stream, type_id);
     descriptor_idx[0] = type_id->GetStringId()->GetIndex();
     stream->Write(descriptor_idx, type_id->GetSize());
   }
@@ -282,10 +283,10 @@ void DexWriter::WriteTypeLists(Stream* stream) {
   uint32_t size[1];
   uint16_t list[1];
   const uint32_t start = stream->Tell();
-  for (std::unique_ptr<dex_ir::TypeList>& type_list : header_->GetCollections().TypeLists()) {
+  for (dex_ir::TypeList* type_list : header_->GetCollections().TypeLists()) {
     stream->AlignTo(SectionAlignment(DexFile::kDexTypeTypeList));
     size[0] = type_list->GetTypeList()->size();
-    ProcessOffset(stream, type_list.get());
+    ProcessOffset(stream, type_list);
     stream->Write(size, sizeof(uint32_t));
     for (const dex_ir::TypeId* type_id : *type_list->GetTypeList()) {
       list[0] = type_id->GetIndex();
@@ -300,9 +301,9 @@ void DexWriter::WriteTypeLists(Stream* stream) {
 void DexWriter::WriteProtoIds(Stream* stream, bool reserve_only) {
   uint32_t buffer[3];
   const uint32_t start = stream->Tell();
-  for (std::unique_ptr<dex_ir::ProtoId>& proto_id : header_->GetCollections().ProtoIds()) {
+  for (dex_ir::ProtoId* proto_id : header_->GetCollections().ProtoIds()) {
     stream->AlignTo(SectionAlignment(DexFile::kDexTypeProtoIdItem));
-    ProcessOffset(stream, proto_id.get());
+    ProcessOffset(stream, proto_id);
     if (reserve_only) {
       stream->Skip(proto_id->GetSize());
     } else {
@@ -320,9 +321,9 @@ void DexWriter::WriteProtoIds(Stream* stream, bool reserve_only) {
 void DexWriter::WriteFieldIds(Stream* stream) {
   uint16_t buffer[4];
   const uint32_t start = stream->Tell();
-  for (std::unique_ptr<dex_ir::FieldId>& field_id : header_->GetCollections().FieldIds()) {
+  for (dex_ir::FieldId* field_id : header_->GetCollections().FieldIds()) {
     stream->AlignTo(SectionAlignment(DexFile::kDexTypeFieldIdItem));
-    ProcessOffset(stream, field_id.get());
+    ProcessOffset(stream, field_id);
     buffer[0] = field_id->Class()->GetIndex();
     buffer[1] = field_id->Type()->GetIndex();
     buffer[2] = field_id->Name()->GetIndex();
@@ -337,9 +338,9 @@ void DexWriter::WriteFieldIds(Stream* stream) {
 void DexWriter::WriteMethodIds(Stream* stream) {
   uint16_t buffer[4];
   const uint32_t start = stream->Tell();
-  for (std::unique_ptr<dex_ir::MethodId>& method_id : header_->GetCollections().MethodIds()) {
+  for (dex_ir::MethodId* method_id : header_->GetCollections().MethodIds()) {
     stream->AlignTo(SectionAlignment(DexFile::kDexTypeMethodIdItem));
-    ProcessOffset(stream, method_id.get());
+    ProcessOffset(stream, method_id);
     buffer[0] = method_id->Class()->GetIndex();
     buffer[1] = method_id->Proto()->GetIndex();
     buffer[2] = method_id->Name()->GetIndex();
@@ -353,10 +354,9 @@ void DexWriter::WriteMethodIds(Stream* stream) {
 
 void DexWriter::WriteEncodedArrays(Stream* stream) {
   const uint32_t start = stream->Tell();
-  for (std::unique_ptr<dex_ir::EncodedArrayItem>& encoded_array :
-      header_->GetCollections().EncodedArrayItems()) {
+  for (dex_ir::EncodedArrayItem* encoded_array : header_->GetCollections().EncodedArrayItems()) {
     stream->AlignTo(SectionAlignment(DexFile::kDexTypeEncodedArrayItem));
-    ProcessOffset(stream, encoded_array.get());
+    ProcessOffset(stream, encoded_array);
     WriteEncodedArray(stream, encoded_array->GetEncodedValues());
   }
   if (compute_offsets_ && start != stream->Tell()) {
@@ -367,11 +367,10 @@ void DexWriter::WriteEncodedArrays(Stream* stream) {
 void DexWriter::WriteAnnotations(Stream* stream) {
   uint8_t visibility[1];
   const uint32_t start = stream->Tell();
-  for (std::unique_ptr<dex_ir::AnnotationItem>& annotation :
-      header_->GetCollections().AnnotationItems()) {
+  for (dex_ir::AnnotationItem* annotation : header_->GetCollections().AnnotationItems()) {
     stream->AlignTo(SectionAlignment(DexFile::kDexTypeAnnotationItem));
     visibility[0] = annotation->GetVisibility();
-    ProcessOffset(stream, annotation.get());
+    ProcessOffset(stream, annotation);
     stream->Write(visibility, sizeof(uint8_t));
     WriteEncodedAnnotation(stream, annotation->GetAnnotation());
   }
@@ -384,11 +383,10 @@ void DexWriter::WriteAnnotationSets(Stream* stream) {
   uint32_t size[1];
   uint32_t annotation_off[1];
   const uint32_t start = stream->Tell();
-  for (std::unique_ptr<dex_ir::AnnotationSetItem>& annotation_set :
-      header_->GetCollections().AnnotationSetItems()) {
+  for (dex_ir::AnnotationSetItem* annotation_set : header_->GetCollections().AnnotationSetItems()) {
     stream->AlignTo(SectionAlignment(DexFile::kDexTypeAnnotationSetItem));
     size[0] = annotation_set->GetItems()->size();
-    ProcessOffset(stream, annotation_set.get());
+    ProcessOffset(stream, annotation_set);
     stream->Write(size, sizeof(uint32_t));
     for (dex_ir::AnnotationItem* annotation : *annotation_set->GetItems()) {
       annotation_off[0] = annotation->GetOffset();
@@ -404,11 +402,11 @@ void DexWriter::WriteAnnotationSetRefs(Stream* stream) {
   uint32_t size[1];
   uint32_t annotations_off[1];
   const uint32_t start = stream->Tell();
-  for (std::unique_ptr<dex_ir::AnnotationSetRefList>& annotation_set_ref :
+  for (dex_ir::AnnotationSetRefList* annotation_set_ref :
       header_->GetCollections().AnnotationSetRefLists()) {
     stream->AlignTo(SectionAlignment(DexFile::kDexTypeAnnotationSetRefList));
     size[0] = annotation_set_ref->GetItems()->size();
-    ProcessOffset(stream, annotation_set_ref.get());
+    ProcessOffset(stream, annotation_set_ref);
     stream->Write(size, sizeof(uint32_t));
     for (dex_ir::AnnotationSetItem* annotation_set : *annotation_set_ref->GetItems()) {
       annotations_off[0] = annotation_set == nullptr ? 0 : annotation_set->GetOffset();
@@ -424,10 +422,10 @@ void DexWriter::WriteAnnotationsDirectories(Stream* stream) {
   uint32_t directory_buffer[4];
   uint32_t annotation_buffer[2];
   const uint32_t start = stream->Tell();
-  for (std::unique_ptr<dex_ir::AnnotationsDirectoryItem>& annotations_directory :
+  for (dex_ir::AnnotationsDirectoryItem* annotations_directory :
       header_->GetCollections().AnnotationsDirectoryItems()) {
     stream->AlignTo(SectionAlignment(DexFile::kDexTypeAnnotationsDirectoryItem));
-    ProcessOffset(stream, annotations_directory.get());
+    ProcessOffset(stream, annotations_directory);
     directory_buffer[0] = annotations_directory->GetClassAnnotation() == nullptr ? 0 :
         annotations_directory->GetClassAnnotation()->GetOffset();
     directory_buffer[1] = annotations_directory->GetFieldAnnotations() == nullptr ? 0 :
@@ -475,9 +473,8 @@ void DexWriter::WriteDebugInfoItem(Stream* stream, dex_ir::DebugInfoItem* debug_
 
 void DexWriter::WriteDebugInfoItems(Stream* stream) {
   const uint32_t start = stream->Tell();
-  for (std::unique_ptr<dex_ir::DebugInfoItem>& debug_info :
-      header_->GetCollections().DebugInfoItems()) {
-    WriteDebugInfoItem(stream, debug_info.get());
+  for (dex_ir::DebugInfoItem* debug_info : header_->GetCollections().DebugInfoItems()) {
+    WriteDebugInfoItem(stream, debug_info);
   }
   if (compute_offsets_ && start != stream->Tell()) {
     header_->GetCollections().SetDebugInfoItemsOffset(start);
@@ -558,12 +555,12 @@ void DexWriter::WriteCodeItems(Stream* stream, bool reserve_only) {
         DexLayoutSections::SectionType::kSectionTypeCode)];
   }
   const uint32_t start = stream->Tell();
-  for (auto& code_item : header_->GetCollections().CodeItems()) {
+  for (dex_ir::CodeItem* code_item : header_->GetCollections().CodeItems()) {
     uint32_t start_offset = stream->Tell();
-    WriteCodeItem(stream, code_item.get(), reserve_only);
+    WriteCodeItem(stream, code_item, reserve_only);
     // Only add the section hotness info once.
     if (!reserve_only && code_section != nullptr) {
-      auto it = dex_layout_->LayoutHotnessInfo().code_item_layout_.find(code_item.get());
+      auto it = dex_layout_->LayoutHotnessInfo().code_item_layout_.find(code_item);
       if (it != dex_layout_->LayoutHotnessInfo().code_item_layout_.end()) {
         code_section->parts_[static_cast<size_t>(it->second)].CombineSection(
             start_offset,
@@ -577,10 +574,61 @@ void DexWriter::WriteCodeItems(Stream* stream, bool reserve_only) {
   }
 }
 
+void DexWriter::WriteReservedCodeItems(Stream* stream) {
+  const size_t num_threads = (dex_layout_ != nullptr) ? dex_layout_->GetOptions().num_threads_ : 1u;
+  if (num_threads <= 1u || !compute_offsets_) {
+    WriteCodeItems(stream, /*reserve_only*/ false);
+    return;
+  }
+  // Reserving assigned the offsets of the code items and grew the section past them. A stream may
+  // still ask for a few bytes past the last code item, so grow the section by that much up front
+  // and let each code item be written with its own stream that must not resize the section.
+  auto& code_items = header_->GetCollections().CodeItems();
+  DexContainer::Section* const section = stream->GetSection();
+  {
+    // Grow the section through `stream` so that it keeps pointing to the storage.
+    Stream::ScopedSeek seek(stream, section->Size() + Stream::kLeb128Reserve);
+  }
+  const size_t section_size = section->Size();
+  std::vector<uint32_t> end_offsets(code_items.size());
+  ParallelFor(code_items.size(), num_threads, [&](size_t i) {
+    Stream item_stream(section);
+    item_stream.DisallowResize();
+    item_stream.Seek(code_items[i]->GetOffset());
+    WriteCodeItem(&item_stream, code_items[i], /*reserve_only*/ false);
+    end_offsets[i] = item_stream.Tell();
+  });
+  CHECK_EQ(section->Size(), section_size);
+
+  DexLayoutSection* code_section = nullptr;
+  if (dex_layout_ != nullptr) {
+    code_section = &dex_layout_->GetSections().sections_[static_cast<size_t>(
+        DexLayoutSections::SectionType::kSectionTypeCode)];
+  }
+  const uint32_t start = stream->Tell();
+  for (size_t i = 0; i < code_items.size(); ++i) {
+    // Like WriteCodeItems, a section part starts where the previous code item ended.
+    uint32_t start_offset = stream->Tell();
+    stream->Seek(end_offsets[i]);
+    if (code_section != nullptr) {
+      auto it = dex_layout_->LayoutHotnessInfo().code_item_layout_.find(code_items[i]);
+      if (it != dex_layout_->LayoutHotnessInfo().code_item_layout_.end()) {
+        code_section->parts_[static_cast<size_t>(it->second)].CombineSection(
+            start_offset,
+            stream->Tell());
+      }
+    }
+  }
+
+  if (start != stream->Tell()) {
+    header_->GetCollections().SetCodeItemsOffset(start);
+  }
+}
+
 void DexWriter::WriteClassDefs(Stream* stream, bool reserve_only) {
   const uint32_t start = stream->Tell();
   uint32_t class_def_buffer[8];
-  for (std::unique_ptr<dex_ir::ClassDef>& class_def : header_->GetCollections().ClassDefs()) {
+  for (dex_ir::ClassDef* class_def : header_->GetCollections().ClassDefs()) {
     stream->AlignTo(SectionAlignment(DexFile::kDexTypeClassDefItem));
     if (reserve_only) {
       stream->Skip(class_def->GetSize());
@@ -608,10 +656,9 @@ void DexWriter::WriteClassDefs(Stream* stream, bool reserve_only) {
 
 void DexWriter::WriteClassDatas(Stream* stream) {
   const uint32_t start = stream->Tell();
-  for (const std::unique_ptr<dex_ir::ClassData>& class_data :
-      header_->GetCollections().ClassDatas()) {
+  for (dex_ir::ClassData* class_data : header_->GetCollections().ClassDatas()) {
     stream->AlignTo(SectionAlignment(DexFile::kDexTypeClassDataItem));
-    ProcessOffset(stream, class_data.get());
+    ProcessOffset(stream, class_data);
     stream->WriteUleb128(class_data->StaticFields()->size());
     stream->WriteUleb128(class_data->InstanceFields()->size());
     stream->WriteUleb128(class_data->DirectMethods()->size());
@@ -629,8 +676,7 @@ void DexWriter::WriteClassDatas(Stream* stream) {
 void DexWriter::WriteCallSiteIds(Stream* stream, bool reserve_only) {
   const uint32_t start = stream->Tell();
   uint32_t call_site_off[1];
-  for (std::unique_ptr<dex_ir::CallSiteId>& call_site_id :
-      header_->GetCollections().CallSiteIds()) {
+  for (dex_ir::CallSiteId* call_site_id : header_->GetCollections().CallSiteIds()) {
     stream->AlignTo(SectionAlignment(DexFile::kDexTypeCallSiteIdItem));
     if (reserve_only) {
       stream->Skip(call_site_id->GetSize());
@@ -647,8 +693,7 @@ void DexWriter::WriteCallSiteIds(Stream* stream, bool reserve_only) {
 void DexWriter::WriteMethodHandles(Stream* stream) {
   const uint32_t start = stream->Tell();
   uint16_t method_handle_buff[4];
-  for (std::unique_ptr<dex_ir::MethodHandleItem>& method_handle :
-      header_->GetCollections().MethodHandleItems()) {
+  for (dex_ir::MethodHandleItem* method_handle : header_->GetCollections().MethodHandleItems()) {
     stream->AlignTo(SectionAlignment(DexFile::kDexTypeMethodHandleItem));
     method_handle_buff[0] = static_cast<uint16_t>(method_handle->GetMethodHandleType());
     method_handle_buff[1] = 0;  // unused.
@@ -830,7 +875,7 @@ bool DexWriter::Write(DexContainer* output, std::string* error_msg) {
   {
     // Actually write code items since debug info offsets are calculated now.
     Stream::ScopedSeek seek(stream, code_items_offset);
-    WriteCodeItems(stream, /*reserve_only*/ false);
+    WriteReservedCodeItems(stream);
   }
 
   WriteEncodedArrays(stream);
@@ -65,10 +65,14 @@ class DexWriter {
   static constexpr uint32_t kDexSectionWordAlignment = 4;
 
   // Stream that writes into a dex container section. Do not have two streams pointing to the same
-  // backing storage as there may be invalidation of backing storage to resize the section.
+  // backing storage as there may be invalidation of backing storage to resize the section, unless
+  // all of them disallow resizing.
   // Random access stream (consider refactoring).
   class Stream {
    public:
+    // Upper bound of the bytes a stream may need past its position for a single LEB128 write.
+    static constexpr size_t kLeb128Reserve = 8u;
+
     explicit Stream(DexContainer::Section* section) : section_(section) {
       SyncWithSection();
     }
@@ -77,6 +81,15 @@ class DexWriter {
       return data_;
     }
 
+    DexContainer::Section* GetSection() const {
+      return section_;
+    }
+
+    // Make growing the section fatal, for streams sharing the section with other threads.
+    void DisallowResize() {
+      resizable_ = false;
+    }
+
     // Functions are not virtual (yet) for speed.
     size_t Tell() const {
       return position_;
@@ -112,7 +125,7 @@ class DexWriter {
     }
 
     ALWAYS_INLINE size_t WriteSleb128(int32_t value) {
-      EnsureStorage(8);
+      EnsureStorage(kLeb128Reserve);
       uint8_t* ptr = &data_[position_];
       const size_t len = EncodeSignedLeb128(ptr, value) - ptr;
       position_ += len;
@@ -120,7 +133,7 @@ class DexWriter {
     }
 
     ALWAYS_INLINE size_t WriteUleb128(uint32_t value) {
-      EnsureStorage(8);
+      EnsureStorage(kLeb128Reserve);
       uint8_t* ptr = &data_[position_];
       const size_t len = EncodeUnsignedLeb128(ptr, value) - ptr;
       position_ += len;
@@ -156,6 +169,7 @@ class DexWriter {
     ALWAYS_INLINE void EnsureStorage(size_t length) {
       size_t end = position_ + length;
       while (UNLIKELY(end > data_size_)) {
+        CHECK(resizable_) << "Resizing a section shared with other streams";
         section_->Resize(data_size_ * 3 / 2 + 1);
         SyncWithSection();
       }
@@ -173,6 +187,8 @@ class DexWriter {
     uint8_t* data_ = nullptr;
     // Cached Size from the container to provide faster accesses.
     size_t data_size_ = 0u;
+    // Whether the stream may grow the section.
+    bool resizable_ = true;
   };
 
   static inline constexpr uint32_t SectionAlignment(DexFile::MapItemType type) {
@@ -253,6 +269,8 @@ class DexWriter {
   // Data section.
   void WriteDebugInfoItems(Stream* stream);
   void WriteCodeItems(Stream* stream, bool reserve_only);
+  // Write the code items into the space reserved by WriteCodeItems(stream, true).
+  void WriteReservedCodeItems(Stream* stream);
   void WriteTypeLists(Stream* stream);
   void WriteStringDatas(Stream* stream);
   void WriteClassDatas(Stream* stream);
@@ -50,6 +50,7 @@
 #include "dex_writer.h"
 #include "jit/profile_compilation_info.h"
 #include "mem_map.h"
+#include "vdex_file.h"
 
 namespace art {
 
@@ -1562,16 +1563,16 @@ void DexLayout::DumpDexFile() {
 
 void DexLayout::LayoutClassDefsAndClassData(const DexFile* dex_file) {
   std::vector<dex_ir::ClassDef*> new_class_def_order;
-  for (std::unique_ptr<dex_ir::ClassDef>& class_def : header_->GetCollections().ClassDefs()) {
+  for (dex_ir::ClassDef* class_def : header_->GetCollections().ClassDefs()) {
     dex::TypeIndex type_idx(class_def->ClassType()->GetIndex());
     if (info_->ContainsClass(*dex_file, type_idx)) {
-      new_class_def_order.push_back(class_def.get());
+      new_class_def_order.push_back(class_def);
     }
   }
-  for (std::unique_ptr<dex_ir::ClassDef>& class_def : header_->GetCollections().ClassDefs()) {
+  for (dex_ir::ClassDef* class_def : header_->GetCollections().ClassDefs()) {
     dex::TypeIndex type_idx(class_def->ClassType()->GetIndex());
     if (!info_->ContainsClass(*dex_file, type_idx)) {
-      new_class_def_order.push_back(class_def.get());
+      new_class_def_order.push_back(class_def);
     }
   }
   std::unordered_set<dex_ir::ClassData*> visited_class_data;
@@ -1583,10 +1584,8 @@ void DexLayout::LayoutClassDefsAndClassData(const DexFile* dex_file) {
     if (class_data != nullptr && visited_class_data.find(class_data) == visited_class_data.end()) {
       visited_class_data.insert(class_data);
       // Overwrite the existing vector with the new ordering, note that the sets of objects are
-      // equivalent, but the order changes. This is why this is not a memory leak.
-      // TODO: Consider cleaning this up with a shared_ptr.
-      class_datas[class_data_index].release();
-      class_datas[class_data_index].reset(class_data);
+      // equivalent, but the order changes.
+      class_datas[class_data_index] = class_data;
       ++class_data_index;
     }
   }
@@ -1600,10 +1599,8 @@ void DexLayout::LayoutClassDefsAndClassData(const DexFile* dex_file) {
     CHECK_EQ(new_class_def_order.size(), class_defs.size());
     for (size_t i = 0; i < class_defs.size(); ++i) {
       // Overwrite the existing vector with the new ordering, note that the sets of objects are
-      // equivalent, but the order changes. This is why this is not a memory leak.
-      // TODO: Consider cleaning this up with a shared_ptr.
-      class_defs[i].release();
-      class_defs[i].reset(new_class_def_order[i]);
+      // equivalent, but the order changes.
+      class_defs[i] = new_class_def_order[i];
     }
   }
 }
@@ -1612,7 +1609,7 @@ void DexLayout::LayoutStringData(const DexFile* dex_file) {
   const size_t num_strings = header_->GetCollections().StringIds().size();
   std::vector<bool> is_shorty(num_strings, false);
   std::vector<bool> from_hot_method(num_strings, false);
-  for (std::unique_ptr<dex_ir::ClassDef>& class_def : header_->GetCollections().ClassDefs()) {
+  for (dex_ir::ClassDef* class_def : header_->GetCollections().ClassDefs()) {
     // A name of a profile class is probably going to get looked up by ClassTable::Lookup, mark it
     // as hot. Add its super class and interfaces as well, which can be used during initialization.
     const bool is_profile_class =
@@ -1678,8 +1675,8 @@ void DexLayout::LayoutStringData(const DexFile* dex_file) {
   }
   // Sort string data by specified order.
   std::vector<dex_ir::StringId*> string_ids;
-  for (auto& string_id : header_->GetCollections().StringIds()) {
-    string_ids.push_back(string_id.get());
+  for (dex_ir::StringId* string_id : header_->GetCollections().StringIds()) {
+    string_ids.push_back(string_id);
   }
   std::sort(string_ids.begin(),
             string_ids.end(),
@@ -1704,16 +1701,15 @@ void DexLayout::LayoutStringData(const DexFile* dex_file) {
   // Now we know what order we want the string data, reorder them.
   size_t data_index = 0;
   for (dex_ir::StringId* string_id : string_ids) {
-    string_datas[data_index].release();
-    string_datas[data_index].reset(string_id->DataItem());
+    string_datas[data_index] = string_id->DataItem();
     ++data_index;
   }
   if (kIsDebugBuild) {
     std::unordered_set<dex_ir::StringData*> visited;
-    for (const std::unique_ptr<dex_ir::StringData>& data : string_datas) {
-      visited.insert(data.get());
+    for (dex_ir::StringData* data : string_datas) {
+      visited.insert(data);
     }
-    for (auto& string_id : header_->GetCollections().StringIds()) {
+    for (dex_ir::StringId* string_id : header_->GetCollections().StringIds()) {
       CHECK(visited.find(string_id->DataItem()) != visited.end());
     }
   }
@@ -1732,7 +1728,7 @@ void DexLayout::LayoutCodeItems(const DexFile* dex_file) {
 
   // Assign hotness flags to all code items.
   for (InvokeType invoke_type : invoke_types) {
-    for (std::unique_ptr<dex_ir::ClassDef>& class_def : header_->GetCollections().ClassDefs()) {
+    for (dex_ir::ClassDef* class_def : header_->GetCollections().ClassDefs()) {
       const bool is_profile_class =
           info_->ContainsClass(*dex_file, dex::TypeIndex(class_def->ClassType()->GetIndex()));
 
@@ -1782,8 +1778,8 @@ void DexLayout::LayoutCodeItems(const DexFile* dex_file) {
         header_->GetCollections().CodeItems();
   if (VLOG_IS_ON(dex)) {
     size_t layout_count[static_cast<size_t>(LayoutType::kLayoutTypeCount)] = {};
-    for (const std::unique_ptr<dex_ir::CodeItem>& code_item : code_items) {
-      auto it = code_item_layout.find(code_item.get());
+    for (dex_ir::CodeItem* code_item : code_items) {
+      auto it = code_item_layout.find(code_item);
       DCHECK(it != code_item_layout.end());
       ++layout_count[static_cast<size_t>(it->second)];
     }
@@ -1796,10 +1792,9 @@ void DexLayout::LayoutCodeItems(const DexFile* dex_file) {
   // all the offsets. Stable sort to preserve any existing locality that might be there.
   std::stable_sort(code_items.begin(),
                    code_items.end(),
-                   [&](const std::unique_ptr<dex_ir::CodeItem>& a,
-                       const std::unique_ptr<dex_ir::CodeItem>& b) {
-    auto it_a = code_item_layout.find(a.get());
-    auto it_b = code_item_layout.find(b.get());
+                   [&](dex_ir::CodeItem* a, dex_ir::CodeItem* b) {
+    auto it_a = code_item_layout.find(a);
+    auto it_b = code_item_layout.find(b);
     DCHECK(it_a != code_item_layout.end());
     DCHECK(it_b != code_item_layout.end());
     const LayoutType layout_type_a = it_a->second;
@@ -1814,24 +1809,31 @@ void DexLayout::LayoutOutputFile(const DexFile* dex_file) {
   LayoutCodeItems(dex_file);
 }
 
+std::string DexLayout::GetOutputLocation(const std::string& location) const {
+  DCHECK(options_.output_dex_directory_ != nullptr);
+  std::string output_location(options_.output_dex_directory_);
+  size_t last_slash = location.rfind('/');
+  std::string directory = location.substr(0, last_slash + 1);
+  if (output_location == directory) {
+    output_location = location + ".new";
+  } else if (last_slash != std::string::npos) {
+    output_location += location.substr(last_slash);
+  } else {
+    output_location += "/" + location + ".new";
+  }
+  return output_location;
+}
+
 bool DexLayout::OutputDexFile(const DexFile* input_dex_file,
                               bool compute_offsets,
                               std::unique_ptr<DexContainer>* dex_container,
                               std::string* error_msg) {
   const std::string& dex_file_location = input_dex_file->GetLocation();
   std::unique_ptr<File> new_file;
-  // If options_.output_dex_directory_ is non null, we are outputting to a file.
-  if (options_.output_dex_directory_ != nullptr) {
-    std::string output_location(options_.output_dex_directory_);
-    size_t last_slash = dex_file_location.rfind('/');
-    std::string dex_file_directory = dex_file_location.substr(0, last_slash + 1);
-    if (output_location == dex_file_directory) {
-      output_location = dex_file_location + ".new";
-    } else if (last_slash != std::string::npos) {
-      output_location += dex_file_location.substr(last_slash);
-    } else {
-      output_location += "/" + dex_file_location + ".new";
-    }
+  // If options_.output_dex_directory_ is non null, we are outputting to a file. With a shared
+  // data section, the caller writes all the dex files at once.
+  if (options_.output_dex_directory_ != nullptr && !options_.dedupe_across_dex_files_) {
+    std::string output_location = GetOutputLocation(dex_file_location);
     new_file.reset(OS::CreateEmptyFile(output_location.c_str()));
     if (new_file == nullptr) {
       LOG(ERROR) << "Could not create dex writer output file: " << output_location;
@@ -1968,6 +1970,90 @@ bool DexLayout::ProcessDexFile(const char* file_name,
   return true;
 }
 
+/*
+ * Lays out all the dex files of one input into a single container, so that they share one data
+ * section in which code and data items are deduplicated across dex files, and writes them to
+ * "<output>.vdex" with the dex section dex2oat writes: each dex file preceded by its (empty)
+ * quickening table offset and 4-byte aligned, followed by the shared data section. The data
+ * offset in each header is relative to the start of that dex file. The vdex file has no
+ * verifier deps nor quickening info, and VdexFile::OpenAllDexFiles opens its dex files.
+ */
+bool DexLayout::ProcessDexFilesWithSharedData(
+    const char* file_name,
+    const std::vector<std::unique_ptr<const DexFile>>& dex_files,
+    std::string* error_msg) {
+  CHECK(options_.compact_dex_level_ != CompactDexLevel::kCompactDexLevelNone);
+  std::unique_ptr<DexContainer> container;
+  std::vector<std::vector<uint8_t>> main_sections;
+  for (size_t i = 0; i < dex_files.size(); i++) {
+    if (!ProcessDexFile(file_name, dex_files[i].get(), i, &container, error_msg)) {
+      return false;
+    }
+    DexContainer::Section* const main_section = container->GetMainSection();
+    main_sections.emplace_back(main_section->Begin(), main_section->End());
+    // The next dex file is written from the start of the main section.
+    main_section->Clear();
+  }
+  if (container == nullptr) {
+    return true;
+  }
+
+  DexContainer::Section* const data_section = container->GetDataSection();
+  const uint32_t dex_section_offset = sizeof(VdexFile::VerifierDepsHeader) +
+      main_sections.size() * sizeof(VdexFile::VdexChecksum) +
+      sizeof(VdexFile::DexSectionHeader);
+  std::vector<uint32_t> dex_file_offsets;
+  uint32_t offset = dex_section_offset;
+  for (const std::vector<uint8_t>& main_section : main_sections) {
+    offset += sizeof(VdexFile::QuickeningTableOffsetType);
+    dex_file_offsets.push_back(offset);
+    offset = RoundUp(offset + main_section.size(), DexWriter::kDexSectionWordAlignment);
+  }
+  // The dex files must end where the dex size says, so the padding that aligns the shared data
+  // counts as shared data.
+  const uint32_t dex_size = offset - dex_section_offset;
+  const uint32_t data_offset = RoundUp(offset, DexWriter::kDataSectionAlignment);
+  const uint32_t shared_data_size = data_offset - offset + data_section->Size();
+
+  std::vector<uint8_t> vdex(data_offset + data_section->Size(), 0u);
+  new (vdex.data()) VdexFile::VerifierDepsHeader(main_sections.size(),
+                                                 /* verifier_deps_size */ 0u,
+                                                 /* has_dex_section */ true);
+  VdexFile::VdexChecksum* const checksums =
+      reinterpret_cast<VdexFile::VdexChecksum*>(vdex.data() + sizeof(VdexFile::VerifierDepsHeader));
+  new (vdex.data() + dex_section_offset - sizeof(VdexFile::DexSectionHeader))
+      VdexFile::DexSectionHeader(dex_size, shared_data_size, /* quickening_info_size */ 0u);
+  for (size_t i = 0; i < main_sections.size(); i++) {
+    checksums[i] = dex_files[i]->GetLocationChecksum();
+    uint8_t* const dex_begin = vdex.data() + dex_file_offsets[i];
+    memcpy(dex_begin, main_sections[i].data(), main_sections[i].size());
+    // The checksum does not cover the data offset, so it stays valid.
+    reinterpret_cast<DexFile::Header*>(dex_begin)->data_off_ = data_offset - dex_file_offsets[i];
+  }
+  memcpy(vdex.data() + data_offset, data_section->Begin(), data_section->Size());
+
+  std::string output_location = GetOutputLocation(file_name) + ".vdex";
+  std::unique_ptr<File> new_file(OS::CreateEmptyFile(output_location.c_str()));
+  if (new_file == nullptr) {
+    *error_msg = "Could not create dex writer output file: " + output_location;
+    return false;
+  }
+  if (!new_file->WriteFully(vdex.data(), vdex.size())) {
+    *error_msg = "Failed to write " + output_location;
+    new_file->Erase();
+    return false;
+  }
+  if (new_file->FlushCloseOrErase() != 0) {
+    *error_msg = "Failed to flush and close " + output_location;
+    return false;
+  }
+  if (options_.verbose_) {
+    fprintf(out_file_, "Wrote %zu dex files with %zu bytes of shared data to '%s'\n",
+            main_sections.size(), data_section->Size(), output_location.c_str());
+  }
+  return true;
+}
+
 /*
  * Processes a single file (either direct .dex or indirect .zip/.jar/.apk).
  */
@@ -1994,6 +2080,10 @@ int DexLayout::ProcessFile(const char* file_name) {
   // all dex files found in given file.
   if (options_.checksum_only_) {
     fprintf(out_file_, "Checksum verified\n");
+  } else if (options_.dedupe_across_dex_files_ && options_.output_dex_directory_ != nullptr) {
+    if (!ProcessDexFilesWithSharedData(file_name, dex_files, &error_msg)) {
+      LOG(WARNING) << "Failed to run dex files in " << file_name << " : " << error_msg;
+    }
   } else {
     for (size_t i = 0; i < dex_files.size(); i++) {
       // Pass in a null container to avoid output by default.
@@ -66,6 +66,12 @@ class Options {
   bool update_checksum_ = false;
   CompactDexLevel compact_dex_level_ = CompactDexLevel::kCompactDexLevelNone;
   bool dedupe_code_items_ = true;
+  // Write all the dex files of an input file with one shared data section and deduplicate code
+  // items across them, so code items may lie in the owned data of another dex file. Requires
+  // compact dex.
+  bool dedupe_across_dex_files_ = false;
+  // Number of threads used to build the IR and write the output. The output does not depend on it.
+  size_t num_threads_ = 1u;
   OutputFormat output_format_ = kOutputPlain;
   const char* output_dex_directory_ = nullptr;
   const char* output_file_name_ = nullptr;
@@ -168,6 +174,10 @@ class DexLayout {
   // Creates a new layout for the dex file based on profile info.
   // Currently reorders ClassDefs, ClassDataItems, and CodeItems.
   void LayoutOutputFile(const DexFile* dex_file);
+  std::string GetOutputLocation(const std::string& location) const;
+  bool ProcessDexFilesWithSharedData(const char* file_name,
+                                     const std::vector<std::unique_ptr<const DexFile>>& dex_files,
+                                     std::string* error_msg);
   bool OutputDexFile(const DexFile* input_dex_file,
                      bool compute_offsets,
                      std::unique_ptr<DexContainer>* dex_container,
@@ -24,6 +24,7 @@
 
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -32,6 +33,7 @@
 #include <android-base/logging.h>
 
 #include "base/logging.h"  // For InitLogging.
+#include "dex/dex_file_verifier.h"
 #include "jit/profile_compilation_info.h"
 #include "mem_map.h"
 #include "runtime.h"
@@ -46,8 +48,8 @@ static const char* kProgramName = "dexlayout";
 static void Usage(void) {
   LOG(ERROR) << "Copyright (C) 2016 The Android Open Source Project\n";
   LOG(ERROR) << kProgramName
-             << ": [-a] [-c] [-d] [-e] [-f] [-h] [-i] [-l layout] [-o outfile] [-p profile]"
-                " [-s] [-t] [-v] [-w directory] dexfile...\n";
+             << ": [-a] [-c] [-d] [-e] [-f] [-h] [-i] [-j threads] [-l layout] [-m] [-o outfile]"
+                " [-p profile] [-s] [-t] [-v] [-w directory] dexfile...\n";
   LOG(ERROR) << " -a : display annotations";
   LOG(ERROR) << " -b : build dex_ir";
   LOG(ERROR) << " -c : verify checksum and exit";
@@ -56,7 +58,10 @@ static void Usage(void) {
   LOG(ERROR) << " -f : display summary information from file header";
   LOG(ERROR) << " -h : display file header details";
   LOG(ERROR) << " -i : ignore checksum failures";
+  LOG(ERROR) << " -j : number of threads used to build and write the output (defaults to 1)";
   LOG(ERROR) << " -l : output layout, either 'plain' or 'xml'";
+  LOG(ERROR) << " -m : with -w, write all dex files of each input to one vdex file with a shared"
+                " data section, deduplicating code items across them (requires -x fast)";
   LOG(ERROR) << " -o : output file name (defaults to stdout)";
   LOG(ERROR) << " -p : profile file name (defaults to no profile)";
   LOG(ERROR) << " -s : visualize reference pattern";
@@ -81,7 +86,7 @@ int DexlayoutDriver(int argc, char** argv) {
 
   // Parse all arguments.
   while (1) {
-    const int ic = getopt(argc, argv, "abcdefghil:o:p:stvw:x:");
+    const int ic = getopt(argc, argv, "abcdefghij:l:mo:p:stvw:x:");
     if (ic < 0) {
       break;  // done
     }
@@ -110,6 +115,12 @@ int DexlayoutDriver(int argc, char** argv) {
       case 'i':  // continue even if checksum is bad
         options.ignore_bad_checksum_ = true;
         break;
+      case 'j':  // number of threads
+        options.num_threads_ = strtoul(optarg, nullptr, 10);
+        if (options.num_threads_ == 0) {
+          want_usage = true;
+        }
+        break;
       case 'l':  // layout
         if (strcmp(optarg, "plain") == 0) {
           options.output_format_ = kOutputPlain;
@@ -120,6 +131,9 @@ int DexlayoutDriver(int argc, char** argv) {
           want_usage = true;
         }
         break;
+      case 'm':  // shared data section across dex files
+        options.dedupe_across_dex_files_ = true;
+        break;
       case 'o':  // output file
         options.output_file_name_ = optarg;
         break;
@@ -164,11 +178,19 @@ int DexlayoutDriver(int argc, char** argv) {
     LOG(ERROR) << "Can't specify both -c and -i";
     want_usage = true;
   }
+  if (options.dedupe_across_dex_files_ &&
+      options.compact_dex_level_ == CompactDexLevel::kCompactDexLevelNone) {
+    LOG(ERROR) << "-m requires compact dex (-x fast)";
+    want_usage = true;
+  }
   if (want_usage) {
     Usage();
     return 2;
   }
 
+  // Large input dex files are also verified with the layout threads.
+  DexFileVerifier::SetDefaultNumThreads(options.num_threads_);
+
   // Open alternative output file.
   FILE* out_file = stdout;
   if (options.output_file_name_) {
@@ -29,9 +29,12 @@
 #include "dex/code_item_accessors-inl.h"
 #include "dex/dex_file-inl.h"
 #include "dex/dex_file_loader.h"
+#include "dex_ir_builder.h"
+#include "dex_verify.h"
 #include "dexlayout.h"
 #include "exec_utils.h"
 #include "jit/profile_compilation_info.h"
+#include "vdex_file.h"
 
 namespace art {
 
@@ -840,4 +843,148 @@ TEST_F(DexLayoutTest, ClassFilter) {
   }
 }
 
+TEST_F(DexLayoutTest, DedupeAcrossDexFiles) {
+  std::vector<std::unique_ptr<const DexFile>> dex_files;
+  std::string error_msg;
+  const ArtDexFileLoader dex_file_loader;
+  const std::string input_jar = GetTestDexFileName("ManyMethods");
+  CHECK(dex_file_loader.Open(input_jar.c_str(),
+                             input_jar.c_str(),
+                             /*verify*/ true,
+                             /*verify_checksum*/ true,
+                             &error_msg,
+                             &dex_files)) << error_msg;
+  ASSERT_EQ(dex_files.size(), 1u);
+  const DexFile* const dex_file = dex_files[0].get();
+
+  // Write the dex file twice into the same container. When deduplicating across dex files, the
+  // code items of the second copy are those of the first one.
+  size_t data_sizes[2];
+  for (bool dedupe_across_dex_files : { false, true }) {
+    Options options;
+    options.compact_dex_level_ = CompactDexLevel::kCompactDexLevelFast;
+    options.dedupe_across_dex_files_ = dedupe_across_dex_files;
+    DexLayout dexlayout(options,
+                        /*info*/ nullptr,
+                        /*out_file*/ nullptr,
+                        /*header*/ nullptr);
+    std::unique_ptr<DexContainer> out;
+    std::vector<uint8_t> main_sections[2];
+    for (size_t i = 0; i < 2u; ++i) {
+      ASSERT_TRUE(dexlayout.ProcessDexFile(dex_file->GetLocation().c_str(),
+                                           dex_file,
+                                           /*dex_file_index*/ i,
+                                           &out,
+                                           &error_msg)) << error_msg;
+      main_sections[i].assign(out->GetMainSection()->Begin(), out->GetMainSection()->End());
+      out->GetMainSection()->Clear();
+    }
+    // Both dex files must be readable with the shared data section.
+    for (const std::vector<uint8_t>& main_section : main_sections) {
+      std::unique_ptr<const DexFile> output_dex_file(
+          dex_file_loader.OpenWithDataSection(
+              main_section.data(),
+              main_section.size(),
+              out->GetDataSection()->Begin(),
+              out->GetDataSection()->Size(),
+              dex_file->GetLocation().c_str(),
+              /* checksum */ 0,
+              /*oat_dex_file*/ nullptr,
+              /* verify */ false,
+              /*verify_checksum*/ false,
+              &error_msg));
+      ASSERT_TRUE(output_dex_file != nullptr) << error_msg;
+      EXPECT_EQ(dex_file->NumMethodIds(), output_dex_file->NumMethodIds());
+    }
+    data_sizes[dedupe_across_dex_files ? 1 : 0] = out->GetDataSection()->Size();
+  }
+  EXPECT_LT(data_sizes[1], data_sizes[0]);
+}
+
+TEST_F(DexLayoutTest, ParallelOutputIsIdentical) {
+  std::vector<std::unique_ptr<const DexFile>> dex_files;
+  std::string error_msg;
+  const ArtDexFileLoader dex_file_loader;
+  const std::string input_jar = GetTestDexFileName("ManyMethods");
+  CHECK(dex_file_loader.Open(input_jar.c_str(),
+                             input_jar.c_str(),
+                             /*verify*/ true,
+                             /*verify_checksum*/ true,
+                             &error_msg,
+                             &dex_files)) << error_msg;
+  ASSERT_EQ(dex_files.size(), 1u);
+  const DexFile* const dex_file = dex_files[0].get();
+
+  std::vector<uint8_t> outputs[2];
+  for (size_t num_threads : { 1u, 4u }) {
+    Options options;
+    options.num_threads_ = num_threads;
+    DexLayout dexlayout(options,
+                        /*info*/ nullptr,
+                        /*out_file*/ nullptr,
+                        /*header*/ nullptr);
+    std::unique_ptr<DexContainer> out;
+    ASSERT_TRUE(dexlayout.ProcessDexFile(dex_file->GetLocation().c_str(),
+                                         dex_file,
+                                         /*dex_file_index*/ 0,
+                                         &out,
+                                         &error_msg)) << error_msg;
+    std::vector<uint8_t>& output = outputs[(num_threads == 1u) ? 0 : 1];
+    output.assign(out->GetMainSection()->Begin(), out->GetMainSection()->End());
+    output.insert(output.end(), out->GetDataSection()->Begin(), out->GetDataSection()->End());
+  }
+  ASSERT_FALSE(outputs[0].empty());
+  EXPECT_TRUE(outputs[0] == outputs[1]);
+}
+
+TEST_F(DexLayoutTest, SharedDataVdex) {
+  // Disable test on target.
+  TEST_DISABLED_FOR_TARGET();
+  ScratchFile tmp_file;
+  const std::string& tmp_name = tmp_file.GetFilename();
+  const std::string tmp_dir = tmp_name.substr(0, tmp_name.rfind('/') + 1);
+  const std::string input_jar = GetTestDexFileName("MultiDex");
+  std::string error_msg;
+  ASSERT_TRUE(DexLayoutExec({"-m", "-x", "fast", "-w", tmp_dir, "-o", tmp_name, input_jar},
+                            &error_msg,
+                            /*pass_default_cdex_option*/ false)) << error_msg;
+
+  const std::string vdex_location = tmp_dir + input_jar.substr(input_jar.rfind('/')) + ".vdex";
+  std::unique_ptr<VdexFile> vdex(VdexFile::Open(vdex_location,
+                                                /*writable*/ false,
+                                                /*low_4gb*/ false,
+                                                /*unquicken*/ false,
+                                                &error_msg));
+  ASSERT_TRUE(vdex != nullptr) << error_msg;
+  std::vector<std::unique_ptr<const DexFile>> output_dex_files;
+  ASSERT_TRUE(vdex->OpenAllDexFiles(&output_dex_files, &error_msg)) << error_msg;
+
+  std::vector<std::unique_ptr<const DexFile>> input_dex_files;
+  const ArtDexFileLoader dex_file_loader;
+  ASSERT_TRUE(dex_file_loader.Open(input_jar.c_str(),
+                                   input_jar.c_str(),
+                                   /*verify*/ true,
+                                   /*verify_checksum*/ true,
+                                   &error_msg,
+                                   &input_dex_files)) << error_msg;
+  ASSERT_EQ(input_dex_files.size(), 2u);
+  ASSERT_EQ(input_dex_files.size(), output_dex_files.size());
+  Options options;
+  for (size_t i = 0; i < input_dex_files.size(); ++i) {
+    EXPECT_EQ(input_dex_files[i]->GetLocationChecksum(), vdex->GetLocationChecksum(i));
+    const DexFile* const output_dex_file = output_dex_files[i].get();
+    ASSERT_TRUE(output_dex_file->IsCompactDexFile());
+    // Compare the contents of every item, code items included, with the input.
+    std::unique_ptr<dex_ir::Header> output_header(
+        dex_ir::DexIrBuilder(*output_dex_file, /*eagerly_assign_offsets*/ true, options));
+    std::unique_ptr<dex_ir::Header> input_header(
+        dex_ir::DexIrBuilder(*input_dex_files[i], /*eagerly_assign_offsets*/ true, options));
+    EXPECT_TRUE(VerifyOutputDexFile(output_header.get(), input_header.get(), &error_msg))
+        << i << ": " << error_msg;
+  }
+  vdex.reset();
+  output_dex_files.clear();
+  ASSERT_TRUE(UnlinkFile(vdex_location));
+}
+
 }  // namespace art
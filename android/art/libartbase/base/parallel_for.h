@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_LIBARTBASE_BASE_PARALLEL_FOR_H_
+#define ART_LIBARTBASE_BASE_PARALLEL_FOR_H_
+
+#include <stddef.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace art {
+
+// Call `work` with each index in [0, count), on up to `num_threads` threads including the calling
+// one. Indices are handed out in increasing order, but may complete in any order: `work` must only
+// write to state owned by its index. Meant for tools that do not have a runtime thread pool.
+template <typename Work>
+void ParallelFor(size_t count, size_t num_threads, const Work& work) {
+  std::atomic<size_t> next_index(0u);
+  auto run = [&]() {
+    for (size_t index = next_index++; index < count; index = next_index++) {
+      work(index);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < std::min(num_threads, count); ++i) {
+    threads.emplace_back(run);
+  }
+  run();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+}  // namespace art
+
+#endif  // ART_LIBARTBASE_BASE_PARALLEL_FOR_H_
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "parallel_for.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace art {
+
+static void CheckVisitsEachIndexOnce(size_t count, size_t num_threads) {
+  std::vector<std::atomic<size_t>> visits(count);
+  for (std::atomic<size_t>& visit : visits) {
+    visit.store(0u);
+  }
+  ParallelFor(count, num_threads, [&](size_t i) {
+    ++visits[i];
+  });
+  for (size_t i = 0; i < count; ++i) {
+    EXPECT_EQ(1u, visits[i].load()) << "index " << i << " with " << num_threads << " threads";
+  }
+}
+
+TEST(ParallelFor, VisitsEachIndexOnce) {
+  CheckVisitsEachIndexOnce(0u, 4u);
+  CheckVisitsEachIndexOnce(1000u, 1u);
+  CheckVisitsEachIndexOnce(1000u, 4u);
+  // More threads than work.
+  CheckVisitsEachIndexOnce(3u, 8u);
+}
+
+TEST(ParallelFor, RunsOnCallingThread) {
+  const std::thread::id caller = std::this_thread::get_id();
+  bool on_caller = false;
+  ParallelFor(1u, 4u, [&](size_t) {
+    on_caller = (std::this_thread::get_id() == caller);
+  });
+  EXPECT_TRUE(on_caller);
+}
+
+}  // namespace art
@@ -18,12 +18,16 @@
 
 #include <inttypes.h>
 
+#include <algorithm>
+#include <atomic>
 #include <limits>
 #include <memory>
+#include <thread>
 
 #include "android-base/stringprintf.h"
 
 #include "base/leb128.h"
+#include "base/parallel_for.h"
 #include "code_item_accessors-inl.h"
 #include "descriptors_names.h"
 #include "dex_file-inl.h"
@@ -71,6 +75,52 @@ static uint32_t MapTypeToBitMask(DexFile::MapItemType map_item_type) {
   return 0;
 }
 
+// Run `fn(i)` for each task `i` below `num_tasks` with ParallelFor(). `fn` returns false if the
+// task failed, and the tasks after the first failed one may then be skipped.
+template <typename Fn>
+static void RunTasks(size_t num_threads, size_t num_tasks, const Fn& fn) {
+  std::atomic<size_t> first_failed_task(num_tasks);
+  ParallelFor(num_tasks, num_threads, [&](size_t i) {
+    if (i < first_failed_task.load(std::memory_order_relaxed) && !fn(i)) {
+      size_t failed = first_failed_task.load(std::memory_order_relaxed);
+      while (i < failed && !first_failed_task.compare_exchange_weak(failed, i)) {
+      }
+    }
+  });
+}
+
+// Number of items of a section checked by each task of CheckInterSectionParallel().
+static constexpr uint32_t kInterSectionItemsPerTask = 1024u;
+
+// Whether CheckInterSection() iterates over the items of the sections of this type.
+static bool HasInterSectionChecks(DexFile::MapItemType map_item_type) {
+  switch (map_item_type) {
+    case DexFile::kDexTypeHeaderItem:
+    case DexFile::kDexTypeMapList:
+    case DexFile::kDexTypeTypeList:
+    case DexFile::kDexTypeCodeItem:
+    case DexFile::kDexTypeStringDataItem:
+    case DexFile::kDexTypeDebugInfoItem:
+    case DexFile::kDexTypeAnnotationItem:
+    case DexFile::kDexTypeEncodedArrayItem:
+      return false;
+    case DexFile::kDexTypeStringIdItem:
+    case DexFile::kDexTypeTypeIdItem:
+    case DexFile::kDexTypeProtoIdItem:
+    case DexFile::kDexTypeFieldIdItem:
+    case DexFile::kDexTypeMethodIdItem:
+    case DexFile::kDexTypeClassDefItem:
+    case DexFile::kDexTypeCallSiteIdItem:
+    case DexFile::kDexTypeMethodHandleItem:
+    case DexFile::kDexTypeAnnotationSetRefList:
+    case DexFile::kDexTypeAnnotationSetItem:
+    case DexFile::kDexTypeClassDataItem:
+    case DexFile::kDexTypeAnnotationsDirectoryItem:
+      return true;
+  }
+  return false;
+}
+
 static bool IsDataSectionType(DexFile::MapItemType map_item_type) {
   switch (map_item_type) {
     case DexFile::kDexTypeHeaderItem:
@@ -223,15 +273,28 @@ const DexFile::ProtoId* DexFileVerifier::CheckLoadProtoId(uint32_t idx, const ch
     error_stmt;                                               \
   }
 
+// Number of threads used by Verify() for large dex files, see SetDefaultNumThreads().
+static std::atomic<size_t> gDefaultNumThreads(1u);
+
+void DexFileVerifier::SetDefaultNumThreads(size_t num_threads) {
+  gDefaultNumThreads.store(std::max<size_t>(num_threads, 1u), std::memory_order_relaxed);
+}
+
 bool DexFileVerifier::Verify(const DexFile* dex_file,
                              const uint8_t* begin,
                              size_t size,
                              const char* location,
                              bool verify_checksum,
-                             std::string* error_msg) {
+                             std::string* error_msg,
+                             size_t num_threads) {
+  if (num_threads == 0u) {
+    num_threads = (size >= kParallelVerificationMinSize)
+        ? gDefaultNumThreads.load(std::memory_order_relaxed)
+        : 1u;
+  }
   std::unique_ptr<DexFileVerifier> verifier(
       new DexFileVerifier(dex_file, begin, size, location, verify_checksum));
-  if (!verifier->Verify()) {
+  if (!verifier->Verify(num_threads)) {
     *error_msg = verifier->FailureReason();
     return false;
   }
@@ -360,15 +423,23 @@ bool DexFileVerifier::CheckSizeLimit(uint32_t size, uint32_t limit, const char*
 }
 
 bool DexFileVerifier::CheckHeader() {
+  return CheckFileSize() &&
+      CheckChecksum(dex_file_->CalculateChecksum()) &&
+      CheckHeaderContents();
+}
+
+bool DexFileVerifier::CheckFileSize() {
   // Check file size from the header.
   uint32_t expected_size = header_->file_size_;
   if (size_ != expected_size) {
     ErrorStringPrintf("Bad file size (%zd, expected %u)", size_, expected_size);
     return false;
   }
+  return true;
+}
 
-  uint32_t adler_checksum = dex_file_->CalculateChecksum();
-  // Compute and verify the checksum in the header.
+bool DexFileVerifier::CheckChecksum(uint32_t adler_checksum) {
+  // Verify the checksum in the header.
   if (adler_checksum != header_->checksum_) {
     if (verify_checksum_) {
       ErrorStringPrintf("Bad checksum (%08x, expected %08x)", adler_checksum, header_->checksum_);
@@ -378,7 +449,10 @@ bool DexFileVerifier::CheckHeader() {
           "Ignoring bad checksum (%08x, expected %08x)", adler_checksum, header_->checksum_);
     }
   }
+  return true;
+}
 
+bool DexFileVerifier::CheckHeaderContents() {
   // Check the contents of the header.
   if (header_->endian_tag_ != DexFile::kDexEndianConstant) {
     ErrorStringPrintf("Unexpected endian_tag: %x", header_->endian_tag_);
@@ -1776,6 +1850,9 @@ bool DexFileVerifier::CheckIntraSectionIterate(size_t offset, uint32_t section_c
       DCHECK(offset_to_type_map_.Find(aligned_offset) == offset_to_type_map_.end());
       offset_to_type_map_.Insert(std::pair<uint32_t, uint16_t>(aligned_offset, type));
     }
+    if (record_item_offsets_) {
+      item_offsets_.push_back(aligned_offset);
+    }
 
     aligned_offset = ptr_ - begin_;
     if (UNLIKELY(aligned_offset > size_)) {
@@ -1867,6 +1944,74 @@ bool DexFileVerifier::CheckIntraDataSection(size_t offset,
   return true;
 }
 
+bool DexFileVerifier::CheckIntraSectionItems(const DexFile::MapItem* item, size_t* offset) {
+  const DexFile::MapList* map = reinterpret_cast<const DexFile::MapList*>(begin_ + header_->map_off_);
+  uint32_t section_offset = item->offset_;
+  uint32_t section_count = item->size_;
+  DexFile::MapItemType type = static_cast<DexFile::MapItemType>(item->type_);
+
+  // Check each item based on its type.
+  switch (type) {
+    case DexFile::kDexTypeHeaderItem:
+      if (UNLIKELY(section_count != 1)) {
+        ErrorStringPrintf("Multiple header items");
+        return false;
+      }
+      if (UNLIKELY(section_offset != 0)) {
+        ErrorStringPrintf("Header at %x, not at start of file", section_offset);
+        return false;
+      }
+      ptr_ = begin_ + header_->header_size_;
+      *offset = header_->header_size_;
+      break;
+    case DexFile::kDexTypeStringIdItem:
+    case DexFile::kDexTypeTypeIdItem:
+    case DexFile::kDexTypeProtoIdItem:
+    case DexFile::kDexTypeFieldIdItem:
+    case DexFile::kDexTypeMethodIdItem:
+    case DexFile::kDexTypeClassDefItem:
+      if (!CheckIntraIdSection(section_offset, section_count, type)) {
+        return false;
+      }
+      *offset = ptr_ - begin_;
+      break;
+    case DexFile::kDexTypeMapList:
+      if (UNLIKELY(section_count != 1)) {
+        ErrorStringPrintf("Multiple map list items");
+        return false;
+      }
+      if (UNLIKELY(section_offset != header_->map_off_)) {
+        ErrorStringPrintf("Map not at header-defined offset: %x, expected %x",
+                          section_offset, header_->map_off_);
+        return false;
+      }
+      ptr_ += sizeof(uint32_t) + (map->size_ * sizeof(DexFile::MapItem));
+      *offset = section_offset + sizeof(uint32_t) + (map->size_ * sizeof(DexFile::MapItem));
+      break;
+    case DexFile::kDexTypeMethodHandleItem:
+    case DexFile::kDexTypeCallSiteIdItem:
+      CheckIntraSectionIterate(section_offset, section_count, type);
+      *offset = ptr_ - begin_;
+      break;
+    case DexFile::kDexTypeTypeList:
+    case DexFile::kDexTypeAnnotationSetRefList:
+    case DexFile::kDexTypeAnnotationSetItem:
+    case DexFile::kDexTypeClassDataItem:
+    case DexFile::kDexTypeCodeItem:
+    case DexFile::kDexTypeStringDataItem:
+    case DexFile::kDexTypeDebugInfoItem:
+    case DexFile::kDexTypeAnnotationItem:
+    case DexFile::kDexTypeEncodedArrayItem:
+    case DexFile::kDexTypeAnnotationsDirectoryItem:
+      if (!CheckIntraDataSection(section_offset, section_count, type)) {
+        return false;
+      }
+      *offset = ptr_ - begin_;
+      break;
+  }
+  return true;
+}
+
 bool DexFileVerifier::CheckIntraSection() {
   const DexFile::MapList* map = reinterpret_cast<const DexFile::MapList*>(begin_ + header_->map_off_);
   const DexFile::MapItem* item = map->list_;
@@ -1878,7 +2023,6 @@ bool DexFileVerifier::CheckIntraSection() {
   while (count--) {
     const size_t current_offset = offset;
     uint32_t section_offset = item->offset_;
-    uint32_t section_count = item->size_;
     DexFile::MapItemType type = static_cast<DexFile::MapItemType>(item->type_);
 
     // Check for padding and overlap between items.
@@ -1889,64 +2033,8 @@ bool DexFileVerifier::CheckIntraSection() {
       return false;
     }
 
-    // Check each item based on its type.
-    switch (type) {
-      case DexFile::kDexTypeHeaderItem:
-        if (UNLIKELY(section_count != 1)) {
-          ErrorStringPrintf("Multiple header items");
-          return false;
-        }
-        if (UNLIKELY(section_offset != 0)) {
-          ErrorStringPrintf("Header at %x, not at start of file", section_offset);
-          return false;
-        }
-        ptr_ = begin_ + header_->header_size_;
-        offset = header_->header_size_;
-        break;
-      case DexFile::kDexTypeStringIdItem:
-      case DexFile::kDexTypeTypeIdItem:
-      case DexFile::kDexTypeProtoIdItem:
-      case DexFile::kDexTypeFieldIdItem:
-      case DexFile::kDexTypeMethodIdItem:
-      case DexFile::kDexTypeClassDefItem:
-        if (!CheckIntraIdSection(section_offset, section_count, type)) {
-          return false;
-        }
-        offset = ptr_ - begin_;
-        break;
-      case DexFile::kDexTypeMapList:
-        if (UNLIKELY(section_count != 1)) {
-          ErrorStringPrintf("Multiple map list items");
-          return false;
-        }
-        if (UNLIKELY(section_offset != header_->map_off_)) {
-          ErrorStringPrintf("Map not at header-defined offset: %x, expected %x",
-                            section_offset, header_->map_off_);
-          return false;
-        }
-        ptr_ += sizeof(uint32_t) + (map->size_ * sizeof(DexFile::MapItem));
-        offset = section_offset + sizeof(uint32_t) + (map->size_ * sizeof(DexFile::MapItem));
-        break;
-      case DexFile::kDexTypeMethodHandleItem:
-      case DexFile::kDexTypeCallSiteIdItem:
-        CheckIntraSectionIterate(section_offset, section_count, type);
-        offset = ptr_ - begin_;
-        break;
-      case DexFile::kDexTypeTypeList:
-      case DexFile::kDexTypeAnnotationSetRefList:
-      case DexFile::kDexTypeAnnotationSetItem:
-      case DexFile::kDexTypeClassDataItem:
-      case DexFile::kDexTypeCodeItem:
-      case DexFile::kDexTypeStringDataItem:
-      case DexFile::kDexTypeDebugInfoItem:
-      case DexFile::kDexTypeAnnotationItem:
-      case DexFile::kDexTypeEncodedArrayItem:
-      case DexFile::kDexTypeAnnotationsDirectoryItem:
-        if (!CheckIntraDataSection(section_offset, section_count, type)) {
-          return false;
-        }
-        offset = ptr_ - begin_;
-        break;
+    if (!CheckIntraSectionItems(item, &offset)) {
+      return false;
     }
 
     if (offset == current_offset) {
@@ -1960,10 +2048,74 @@ bool DexFileVerifier::CheckIntraSection() {
   return true;
 }
 
+bool DexFileVerifier::CheckIntraSectionParallel(size_t num_threads) {
+  const DexFile::MapList* map = reinterpret_cast<const DexFile::MapList*>(begin_ + header_->map_off_);
+  uint32_t count = map->size_;
+
+  // Check each section on its own, assuming that it is correctly placed.
+  struct SectionResult {
+    std::unique_ptr<DexFileVerifier> verifier;
+    bool success;
+    size_t end_offset;
+  };
+  std::vector<SectionResult> results(count);
+  RunTasks(num_threads, count, [&](size_t i) {
+    SectionResult* result = &results[i];
+    result->verifier.reset(new DexFileVerifier(this));
+    result->verifier->record_item_offsets_ = true;
+    result->verifier->ptr_ = begin_ + map->list_[i].offset_;
+    result->success = result->verifier->CheckIntraSectionItems(&map->list_[i],
+                                                               &result->end_offset);
+    return result->success;
+  });
+
+  // Check the placement of the sections and merge the results in the order of the map, so
+  // that the first error is the one that CheckIntraSection() reports.
+  size_t offset = 0;
+  ptr_ = begin_;
+  section_item_offsets_.resize(count);
+  for (uint32_t i = 0; i != count; ++i) {
+    const DexFile::MapItem* item = &map->list_[i];
+    const size_t current_offset = offset;
+    uint32_t section_offset = item->offset_;
+    DexFile::MapItemType type = static_cast<DexFile::MapItemType>(item->type_);
+
+    if (!CheckPadding(offset, section_offset, type)) {
+      return false;
+    } else if (UNLIKELY(offset > section_offset)) {
+      ErrorStringPrintf("Section overlap or out-of-order map: %zx, %x", offset, section_offset);
+      return false;
+    }
+
+    DexFileVerifier* verifier = results[i].verifier.get();
+    DCHECK(verifier != nullptr);
+    if (!results[i].success) {
+      failure_reason_ = verifier->failure_reason_;
+      return false;
+    }
+    for (const std::pair<uint32_t, uint16_t>& entry : verifier->offset_to_type_map_) {
+      DCHECK(offset_to_type_map_.Find(entry.first) == offset_to_type_map_.end());
+      offset_to_type_map_.Insert(entry);
+    }
+    section_item_offsets_[i] = std::move(verifier->item_offsets_);
+    results[i].verifier.reset();
+    offset = results[i].end_offset;
+    ptr_ = begin_ + offset;
+
+    if (offset == current_offset) {
+        ErrorStringPrintf("Unknown map item type %x", type);
+        return false;
+    }
+  }
+
+  return true;
+}
+
 bool DexFileVerifier::CheckOffsetToTypeMap(size_t offset, uint16_t type) {
   DCHECK_NE(offset, 0u);
-  auto it = offset_to_type_map_.Find(offset);
-  if (UNLIKELY(it == offset_to_type_map_.end())) {
+  const OffsetTypeMap& offset_to_type_map = GetOffsetToTypeMap();
+  auto it = offset_to_type_map.Find(offset);
+  if (UNLIKELY(it == offset_to_type_map.end())) {
     ErrorStringPrintf("No data map entry found @ %zx; expected %x", offset, type);
     return false;
   }
@@ -2264,11 +2416,10 @@ bool DexFileVerifier::CheckInterClassDefItem() {
     return false;
   }
   // Check for duplicate class def.
-  if (defined_classes_.find(item->class_idx_) != defined_classes_.end()) {
+  if (item == first_duplicate_class_def_) {
     ErrorStringPrintf("Redefinition of class with type idx: '%d'", item->class_idx_.index_);
     return false;
   }
-  defined_classes_.insert(item->class_idx_);
 
   LOAD_STRING_BY_TYPE(class_descriptor, item->class_idx_, "inter_class_def_item class_idx")
   if (UNLIKELY(!IsValidDescriptor(class_descriptor) || class_descriptor[0] != 'L')) {
@@ -2669,7 +2820,9 @@ bool DexFileVerifier::CheckInterAnnotationsDirectoryItem() {
 
 bool DexFileVerifier::CheckInterSectionIterate(size_t offset,
                                                uint32_t count,
-                                               DexFile::MapItemType type) {
+                                               DexFile::MapItemType type,
+                                               uint32_t first_index,
+                                               const void* previous_item) {
   // Get the right alignment mask for the type of section.
   size_t alignment_mask;
   switch (type) {
@@ -2682,8 +2835,8 @@ bool DexFileVerifier::CheckInterSectionIterate(size_t offset,
   }
 
   // Iterate through the items in the section.
-  previous_item_ = nullptr;
-  for (uint32_t i = 0; i < count; i++) {
+  previous_item_ = previous_item;
+  for (uint32_t i = first_index; i < first_index + count; i++) {
     uint32_t new_offset = (offset + alignment_mask) & ~alignment_mask;
     ptr_ = begin_ + new_offset;
     const uint8_t* prev_ptr = ptr_;
@@ -2801,11 +2954,29 @@ bool DexFileVerifier::CheckInterSectionIterate(size_t offset,
   return true;
 }
 
+void DexFileVerifier::FindFirstDuplicateClassDef() {
+  // The class defs have been checked to be within the file.
+  const DexFile::ClassDef* class_defs =
+      reinterpret_cast<const DexFile::ClassDef*>(begin_ + header_->class_defs_off_);
+  std::vector<bool> defined_classes(std::numeric_limits<uint16_t>::max() + 1u, false);
+  first_duplicate_class_def_ = nullptr;
+  for (uint32_t i = 0; i != header_->class_defs_size_; ++i) {
+    uint16_t class_idx = class_defs[i].class_idx_.index_;
+    if (defined_classes[class_idx]) {
+      first_duplicate_class_def_ = &class_defs[i];
+      break;
+    }
+    defined_classes[class_idx] = true;
+  }
+}
+
 bool DexFileVerifier::CheckInterSection() {
   const DexFile::MapList* map = reinterpret_cast<const DexFile::MapList*>(begin_ + header_->map_off_);
   const DexFile::MapItem* item = map->list_;
   uint32_t count = map->size_;
 
+  FindFirstDuplicateClassDef();
+
   // Cross check the items listed in the map.
   while (count--) {
     uint32_t section_offset = item->offset_;
@@ -2855,7 +3026,96 @@ bool DexFileVerifier::CheckInterSection() {
   return true;
 }
 
-bool DexFileVerifier::Verify() {
+bool DexFileVerifier::CheckInterSectionParallel(size_t num_threads) {
+  const DexFile::MapList* map = reinterpret_cast<const DexFile::MapList*>(begin_ + header_->map_off_);
+  uint32_t count = map->size_;
+
+  FindFirstDuplicateClassDef();
+
+  // Split the sections into ranges of items, using the item offsets found by the
+  // intra-section checks.
+  struct Task {
+    uint32_t section;
+    uint32_t first_index;
+    uint32_t count;
+    std::unique_ptr<DexFileVerifier> verifier;
+    bool success;
+  };
+  std::vector<Task> tasks;
+  for (uint32_t i = 0; i != count; ++i) {
+    DexFile::MapItemType type = static_cast<DexFile::MapItemType>(map->list_[i].type_);
+    if (!HasInterSectionChecks(type)) {
+      continue;
+    }
+    uint32_t section_count = map->list_[i].size_;
+    if (section_item_offsets_[i].size() != section_count) {
+      // Not all items were found, check the section in one piece.
+      tasks.push_back(Task{i, 0u, section_count, nullptr, false});
+      continue;
+    }
+    for (uint32_t first = 0; first < section_count; first += kInterSectionItemsPerTask) {
+      uint32_t task_count = std::min(section_count - first, kInterSectionItemsPerTask);
+      tasks.push_back(Task{i, first, task_count, nullptr, false});
+    }
+  }
+
+  RunTasks(num_threads, tasks.size(), [&](size_t t) {
+    Task* task = &tasks[t];
+    const DexFile::MapItem* item = &map->list_[task->section];
+    const std::vector<uint32_t>& item_offsets = section_item_offsets_[task->section];
+    size_t offset = item->offset_;
+    const void* previous_item = nullptr;
+    if (task->first_index != 0u) {
+      offset = item_offsets[task->first_index];
+      previous_item = begin_ + item_offsets[task->first_index - 1u];
+    }
+    task->verifier.reset(new DexFileVerifier(this));
+    task->success = task->verifier->CheckInterSectionIterate(
+        offset,
+        task->count,
+        static_cast<DexFile::MapItemType>(item->type_),
+        task->first_index,
+        previous_item);
+    return task->success;
+  });
+
+  // Report the failure of the first item in the order of the map, as CheckInterSection() does.
+  for (Task& task : tasks) {
+    if (!task.success) {
+      DCHECK(task.verifier != nullptr);
+      failure_reason_ = task.verifier->failure_reason_;
+      return false;
+    }
+  }
+  return true;
+}
+
+bool DexFileVerifier::Verify(size_t num_threads) {
+  if (num_threads > 1u) {
+    // Check the file size first as CheckHeader() does, then compute the checksum while
+    // checking the rest of the file.
+    if (!CheckFileSize()) {
+      return false;
+    }
+    uint32_t adler_checksum = 0u;
+    std::thread checksum_thread([this, &adler_checksum]() {
+      adler_checksum = dex_file_->CalculateChecksum();
+    });
+    bool success = CheckHeaderContents() &&
+        CheckMap() &&
+        CheckIntraSectionParallel(num_threads) &&
+        CheckInterSectionParallel(num_threads);
+    checksum_thread.join();
+    // A bad checksum takes precedence over the other errors.
+    std::string failure_reason = std::move(failure_reason_);
+    failure_reason_.clear();
+    if (!CheckChecksum(adler_checksum)) {
+      return false;
+    }
+    failure_reason_ = std::move(failure_reason);
+    return success;
+  }
+
   // Check the header.
   if (!CheckHeader()) {
     return false;
@@ -18,6 +18,7 @@
 #define ART_LIBDEXFILE_DEX_DEX_FILE_VERIFIER_H_
 
 #include <unordered_set>
+#include <vector>
 
 #include "base/hash_map.h"
 #include "base/safe_map.h"
@@ -28,12 +29,25 @@ namespace art {
 
 class DexFileVerifier {
  public:
+  // Only dex files at least this large are verified with the default number of threads.
+  static constexpr size_t kParallelVerificationMinSize = 4 * MB;
+
+  // Set the number of threads used to verify large dex files when the caller of Verify() does
+  // not ask for a specific number. This is one unless a tool such as dex2oat opts in, so that
+  // the runtime and the zygote never start threads to open a dex file.
+  static void SetDefaultNumThreads(size_t num_threads);
+
+  // Verify the dex file. With more than one thread, the checksum is computed while the
+  // sections of the map and ranges of their items are checked on separate threads. The
+  // reported error is the same as with a single thread. Zero uses the default number of
+  // threads for dex files of at least kParallelVerificationMinSize and one thread otherwise.
   static bool Verify(const DexFile* dex_file,
                      const uint8_t* begin,
                      size_t size,
                      const char* location,
                      bool verify_checksum,
-                     std::string* error_msg);
+                     std::string* error_msg,
+                     size_t num_threads = 0u);
 
   const std::string& FailureReason() const {
     return failure_reason_;
@@ -51,11 +65,29 @@ class DexFileVerifier {
         location_(location),
         verify_checksum_(verify_checksum),
         header_(&dex_file->GetHeader()),
+        parent_(nullptr),
         ptr_(nullptr),
-        previous_item_(nullptr)  {
+        previous_item_(nullptr),
+        record_item_offsets_(false),
+        first_duplicate_class_def_(nullptr) {
   }
 
-  bool Verify();
+  // Create a verifier checking part of the dex file for `parent` on another thread.
+  explicit DexFileVerifier(const DexFileVerifier* parent)
+      : dex_file_(parent->dex_file_),
+        begin_(parent->begin_),
+        size_(parent->size_),
+        location_(parent->location_),
+        verify_checksum_(parent->verify_checksum_),
+        header_(parent->header_),
+        parent_(parent),
+        ptr_(nullptr),
+        previous_item_(nullptr),
+        record_item_offsets_(false),
+        first_duplicate_class_def_(parent->first_duplicate_class_def_) {
+  }
+
+  bool Verify(size_t num_threads);
 
   bool CheckShortyDescriptorMatch(char shorty_char, const char* descriptor, bool is_return_type);
   bool CheckListSize(const void* start, size_t count, size_t element_size, const char* label);
@@ -70,6 +102,9 @@ class DexFileVerifier {
   bool CheckIndex(uint32_t field, uint32_t limit, const char* label);
 
   bool CheckHeader();
+  bool CheckFileSize();
+  bool CheckChecksum(uint32_t adler_checksum);
+  bool CheckHeaderContents();
   bool CheckMap();
 
   uint32_t ReadUnsignedLittleEndian(uint32_t size);
@@ -127,7 +162,11 @@ class DexFileVerifier {
   bool CheckIntraSectionIterate(size_t offset, uint32_t count, DexFile::MapItemType type);
   bool CheckIntraIdSection(size_t offset, uint32_t count, DexFile::MapItemType type);
   bool CheckIntraDataSection(size_t offset, uint32_t count, DexFile::MapItemType type);
+  // Check the items of the section described by `item`, with ptr_ at the start of the section.
+  // Sets `offset` to the end of the section.
+  bool CheckIntraSectionItems(const DexFile::MapItem* item, size_t* offset);
   bool CheckIntraSection();
+  bool CheckIntraSectionParallel(size_t num_threads);
 
   bool CheckOffsetToTypeMap(size_t offset, uint16_t type);
 
@@ -149,8 +188,16 @@ class DexFileVerifier {
   bool CheckInterClassDataItem();
   bool CheckInterAnnotationsDirectoryItem();
 
-  bool CheckInterSectionIterate(size_t offset, uint32_t count, DexFile::MapItemType type);
+  // Check `count` items from `offset`. `first_index` is the index of the first item in its
+  // section and `previous_item` the item before it, if any.
+  bool CheckInterSectionIterate(size_t offset,
+                                uint32_t count,
+                                DexFile::MapItemType type,
+                                uint32_t first_index = 0u,
+                                const void* previous_item = nullptr);
+  void FindFirstDuplicateClassDef();
   bool CheckInterSection();
+  bool CheckInterSectionParallel(size_t num_threads);
 
   // Load a string by (type) index. Checks whether the index is in bounds, printing the error if
   // not. If there is an error, null is returned.
@@ -203,6 +250,8 @@ class DexFileVerifier {
   const char* const location_;
   const bool verify_checksum_;
   const DexFile::Header* const header_;
+  // The verifier that created this one to check part of the dex file, or null.
+  const DexFileVerifier* const parent_;
 
   struct OffsetTypeMapEmptyFn {
     // Make a hash map slot empty by making the offset 0. Offset 0 is a valid dex file offset that
@@ -226,19 +275,33 @@ class DexFileVerifier {
       return a == b;
     }
   };
+  using OffsetTypeMap = HashMap<uint32_t,
+                                uint16_t,
+                                OffsetTypeMapEmptyFn,
+                                OffsetTypeMapHashCompareFn,
+                                OffsetTypeMapHashCompareFn>;
+
+  // The map of the parent, which is complete once the inter-section checks start.
+  const OffsetTypeMap& GetOffsetToTypeMap() const {
+    return (parent_ != nullptr) ? parent_->offset_to_type_map_ : offset_to_type_map_;
+  }
+
   // Map from offset to dex file type, HashMap for performance reasons.
-  HashMap<uint32_t,
-          uint16_t,
-          OffsetTypeMapEmptyFn,
-          OffsetTypeMapHashCompareFn,
-          OffsetTypeMapHashCompareFn> offset_to_type_map_;
+  OffsetTypeMap offset_to_type_map_;
   const uint8_t* ptr_;
   const void* previous_item_;
 
   std::string failure_reason_;
 
-  // Set of type ids for which there are ClassDef elements in the dex file.
-  std::unordered_set<decltype(DexFile::ClassDef::class_idx_)> defined_classes_;
+  // Whether to record the offset of each item checked by CheckIntraSectionIterate in
+  // item_offsets_, so that the sections can be split for the inter-section checks.
+  bool record_item_offsets_;
+  std::vector<uint32_t> item_offsets_;
+  // The offsets of the items of each section of the map, when checking in parallel.
+  std::vector<std::vector<uint32_t>> section_item_offsets_;
+
+  // The first ClassDef whose class is also defined by an earlier one, or null.
+  const DexFile::ClassDef* first_duplicate_class_def_;
 };
 
 }  // namespace art
@@ -18,8 +18,10 @@
 
 #include <zlib.h>
 
+#include <algorithm>
 #include <functional>
 #include <memory>
+#include <vector>
 
 #include "base/bit_utils.h"
 #include "base/leb128.h"
@@ -78,7 +80,8 @@ class DexFileVerifierTest : public testing::Test {
                                            dex_file->Size(),
                                            location,
                                            kVerifyChecksum,
-                                           &error_msg);
+                                           &error_msg,
+                                           /* num_threads */ 1u);
     if (expected_error == nullptr) {
       EXPECT_TRUE(success) << error_msg;
     } else {
@@ -87,6 +90,20 @@ class DexFileVerifierTest : public testing::Test {
         EXPECT_NE(error_msg.find(expected_error), std::string::npos) << error_msg;
       }
     }
+
+    // Parallel verification must report the same error.
+    std::string parallel_error_msg;
+    bool parallel_success = DexFileVerifier::Verify(dex_file.get(),
+                                                    dex_file->Begin(),
+                                                    dex_file->Size(),
+                                                    location,
+                                                    kVerifyChecksum,
+                                                    &parallel_error_msg,
+                                                    /* num_threads */ 4u);
+    EXPECT_EQ(success, parallel_success);
+    if (!success) {
+      EXPECT_EQ(error_msg, parallel_error_msg);
+    }
   }
 };
 
@@ -1660,6 +1677,31 @@ TEST_F(DexFileVerifierTest, Checksum) {
                                        /*verify_checksum*/ true,
                                        &error_msg));
   EXPECT_NE(error_msg.find("Bad checksum"), std::string::npos) << error_msg;
+  EXPECT_FALSE(DexFileVerifier::Verify(dex_file.get(),
+                                       dex_file->Begin(),
+                                       dex_file->Size(),
+                                       "bad checksum, verify",
+                                       /*verify_checksum*/ true,
+                                       &error_msg,
+                                       /*num_threads*/ 4u));
+  EXPECT_NE(error_msg.find("Bad checksum"), std::string::npos) << error_msg;
+}
+
+TEST_F(DexFileVerifierTest, ChecksumMatchesZlib) {
+  std::vector<uint8_t> data(3 * 5552u + 100u);
+  uint32_t seed = 1u;
+  for (uint8_t& value : data) {
+    seed = seed * 1103515245u + 12345u;
+    value = static_cast<uint8_t>(seed >> 16);
+  }
+  for (size_t size : {0u, 1u, 31u, 32u, 33u, 5535u, 5536u, 5537u, 5552u, 11104u, 16756u}) {
+    uint32_t expected = adler32(adler32(0L, Z_NULL, 0), data.data(), size);
+    EXPECT_EQ(expected, DexFile::ChecksumMemoryRange(data.data(), size)) << size;
+  }
+  // All bytes set maximizes the sums.
+  std::fill(data.begin(), data.end(), 0xffu);
+  uint32_t expected = adler32(adler32(0L, Z_NULL, 0), data.data(), data.size());
+  EXPECT_EQ(expected, DexFile::ChecksumMemoryRange(data.data(), data.size()));
 }
 
 TEST_F(DexFileVerifierTest, BadStaticMethodName) {
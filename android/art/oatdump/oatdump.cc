@@ -17,11 +17,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <algorithm>
+#include <atomic>
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <mutex>
 #include <set>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -49,6 +54,7 @@
 #include "dex/dex_file-inl.h"
 #include "dex/dex_instruction-inl.h"
 #include "dex/string_reference.h"
+#include "dex/utf.h"
 #include "disassembler.h"
 #include "gc/accounting/space_bitmap-inl.h"
 #include "gc/space/image_space.h"
@@ -382,30 +388,17 @@ class OatDumperOptions {
   const char* const app_oat_;
   uint32_t addr2instr_;
   Handle<mirror::ClassLoader>* class_loader_;
+  // Methods to dump instead of the whole oat file, as Lpackage/Class;->name(signature). The
+  // signature may be omitted to dump all the methods with the name.
+  std::vector<std::string> methods_;
+  // Number of threads disassembling classes when dumping the whole oat file without a runtime.
+  size_t num_threads_ = 1u;
 };
 
 class OatDumper {
  public:
   OatDumper(const OatFile& oat_file, const OatDumperOptions& options)
-    : oat_file_(oat_file),
-      oat_dex_files_(oat_file.GetOatDexFiles()),
-      options_(options),
-      resolved_addr2instr_(0),
-      instruction_set_(oat_file_.GetOatHeader().GetInstructionSet()),
-      disassembler_(Disassembler::Create(instruction_set_,
-                                         new DisassemblerOptions(
-                                             options_.absolute_addresses_,
-                                             oat_file.Begin(),
-                                             oat_file.End(),
-                                             true /* can_read_literals_ */,
-                                             Is64BitInstructionSet(instruction_set_)
-                                                 ? &Thread::DumpThreadOffset<PointerSize::k64>
-                                                 : &Thread::DumpThreadOffset<PointerSize::k32>))) {
-    CHECK(options_.class_loader_ != nullptr);
-    CHECK(options_.class_filter_ != nullptr);
-    CHECK(options_.method_filter_ != nullptr);
-    AddAllOffsets();
-  }
+    : OatDumper(oat_file, options, /* shared_stats */ nullptr) {}
 
   ~OatDumper() {
     delete disassembler_;
@@ -418,6 +411,10 @@ class OatDumper {
   typedef std::vector<std::unique_ptr<const DexFile>> DexFileUniqV;
 
   bool Dump(std::ostream& os) {
+    if (!options_.methods_.empty()) {
+      return DumpMethods(os);
+    }
+
     bool success = true;
     const OatHeader& oat_header = oat_file_.GetOatHeader();
 
@@ -650,6 +647,9 @@ class OatDumper {
     }
     uintptr_t begin_offset = reinterpret_cast<uintptr_t>(oat_data) -
                              reinterpret_cast<uintptr_t>(oat_file_.Begin());
+    if (offsets_.empty()) {
+      AddAllOffsets();
+    }
     auto it = offsets_.upper_bound(begin_offset);
     CHECK(it != offsets_.end());
     uintptr_t end_offset = *it;
@@ -766,18 +766,22 @@ class OatDumper {
     // Since code has deduplication, seen tracks already seen pointers to avoid double counting
     // deduplicated code and tables.
     std::unordered_set<const void*> seen;
+    // Guards the above when classes are dumped in parallel.
+    std::mutex lock;
 
     // Returns true if it was newly added.
     bool AddBitsIfUnique(ByteKind kind, int64_t count, const void* address) {
+      std::lock_guard<std::mutex> guard(lock);
       if (seen.insert(address).second == true) {
         // True means the address was not already in the set.
-        AddBits(kind, count);
+        bits[kind] += count;
         return true;
       }
       return false;
     }
 
     void AddBits(ByteKind kind, int64_t count) {
+      std::lock_guard<std::mutex> guard(lock);
       bits[kind] += count;
     }
 
@@ -884,6 +888,30 @@ class OatDumper {
   };
 
  private:
+  // Worker dumpers used to dump classes in parallel have their own disassembler and add to
+  // the statistics of the main dumper.
+  OatDumper(const OatFile& oat_file, const OatDumperOptions& options, Stats* shared_stats)
+    : oat_file_(oat_file),
+      oat_dex_files_(oat_file.GetOatDexFiles()),
+      options_(options),
+      resolved_addr2instr_(0),
+      instruction_set_(oat_file_.GetOatHeader().GetInstructionSet()),
+      disassembler_(Disassembler::Create(instruction_set_,
+                                         new DisassemblerOptions(
+                                             options_.absolute_addresses_,
+                                             oat_file.Begin(),
+                                             oat_file.End(),
+                                             true /* can_read_literals_ */,
+                                             Is64BitInstructionSet(instruction_set_)
+                                                 ? &Thread::DumpThreadOffset<PointerSize::k64>
+                                                 : &Thread::DumpThreadOffset<PointerSize::k32>))),
+      stats_(shared_stats != nullptr ? *shared_stats : own_stats_) {
+    CHECK(options_.class_loader_ != nullptr);
+    CHECK(options_.class_filter_ != nullptr);
+    CHECK(options_.method_filter_ != nullptr);
+  }
+
+  // Only needed by ComputeSize(), which computes the offsets on first use.
   void AddAllOffsets() {
     // We don't know the length of the code for each method, but we need to know where to stop
     // when disassembling. What we do know is that a region of code will be followed by some other
@@ -1092,38 +1120,181 @@ class OatDumper {
                          table_offset + table_size - 1);
     }
 
-    VariableIndentationOutputStream vios(&os);
-    ScopedIndentation indent1(&vios);
-    for (size_t class_def_index = 0;
-         class_def_index < dex_file->NumClassDefs();
-         class_def_index++) {
-      const DexFile::ClassDef& class_def = dex_file->GetClassDef(class_def_index);
-      const char* descriptor = dex_file->GetClassDescriptor(class_def);
+    if (CanDumpClassesInParallel()) {
+      success = DumpOatClassDefsInParallel(os, oat_dex_file, *dex_file);
+    } else {
+      VariableIndentationOutputStream vios(&os);
+      ScopedIndentation indent1(&vios);
+      for (size_t class_def_index = 0;
+           class_def_index < dex_file->NumClassDefs();
+           class_def_index++) {
+        if (!DumpOatClassDef(os, &vios, oat_dex_file, *dex_file, class_def_index, &stop_analysis)) {
+          success = false;
+        }
+        if (stop_analysis) {
+          os << std::flush;
+          return success;
+        }
+      }
+    }
+    os << "\n";
+    os << std::flush;
+    return success;
+  }
 
-      // TODO: Support regex
-      if (DescriptorToDot(descriptor).find(options_.class_filter_) == std::string::npos) {
-        continue;
+  bool DumpOatClassDef(std::ostream& os,
+                       VariableIndentationOutputStream* vios,
+                       const OatFile::OatDexFile& oat_dex_file,
+                       const DexFile& dex_file,
+                       size_t class_def_index,
+                       bool* stop_analysis) {
+    const DexFile::ClassDef& class_def = dex_file.GetClassDef(class_def_index);
+    const char* descriptor = dex_file.GetClassDescriptor(class_def);
+
+    // TODO: Support regex
+    if (DescriptorToDot(descriptor).find(options_.class_filter_) == std::string::npos) {
+      return true;
+    }
+
+    uint32_t oat_class_offset = oat_dex_file.GetOatClassOffset(class_def_index);
+    const OatFile::OatClass oat_class = oat_dex_file.GetOatClass(class_def_index);
+    os << StringPrintf("%zd: %s (offset=0x%08x) (type_idx=%d)",
+                       class_def_index, descriptor, oat_class_offset, class_def.class_idx_.index_)
+       << " (" << oat_class.GetStatus() << ")"
+       << " (" << oat_class.GetType() << ")\n";
+    // TODO: include bitmap here if type is kOatClassSomeCompiled?
+    if (options_.list_classes_) {
+      return true;
+    }
+    return DumpOatClass(vios, oat_class, dex_file, class_def, stop_analysis);
+  }
+
+  // Disassembling dominates the time it takes to dump a large oat file. Without a runtime,
+  // dumping a class only reads the oat file, so classes can be dumped on several threads into
+  // separate buffers that are then written out in order. The verifier dump needs a runtime and
+  // --addr2instr stops at the first match, so both keep dumping sequentially.
+  bool CanDumpClassesInParallel() const {
+    return options_.num_threads_ > 1u &&
+           Runtime::Current() == nullptr &&
+           resolved_addr2instr_ == 0 &&
+           !options_.list_classes_;
+  }
+
+  bool DumpOatClassDefsInParallel(std::ostream& os,
+                                  const OatFile::OatDexFile& oat_dex_file,
+                                  const DexFile& dex_file) {
+    // Classes are dumped in batches to bound the memory used by the buffers.
+    static constexpr size_t kClassesPerBatch = 256u;
+    const size_t num_class_defs = dex_file.NumClassDefs();
+    const size_t num_threads = std::min(options_.num_threads_, num_class_defs);
+    // Each thread needs its own disassembler, so the other threads get their own dumper.
+    std::vector<std::unique_ptr<OatDumper>> dumpers;
+    for (size_t i = 1; i < num_threads; ++i) {
+      dumpers.emplace_back(new OatDumper(oat_file_, options_, &stats_));
+    }
+    std::vector<std::string> buffers(kClassesPerBatch);
+    std::atomic<bool> success(true);
+    for (size_t batch_begin = 0; batch_begin < num_class_defs; batch_begin += kClassesPerBatch) {
+      const size_t batch_end = std::min(batch_begin + kClassesPerBatch, num_class_defs);
+      std::atomic<size_t> next_class_def_index(batch_begin);
+      auto dump_classes = [&](OatDumper* dumper) {
+        for (size_t class_def_index = next_class_def_index.fetch_add(1u);
+             class_def_index < batch_end;
+             class_def_index = next_class_def_index.fetch_add(1u)) {
+          std::ostringstream oss;
+          VariableIndentationOutputStream vios(&oss);
+          ScopedIndentation indent1(&vios);
+          bool stop_analysis = false;
+          if (!dumper->DumpOatClassDef(
+                  oss, &vios, oat_dex_file, dex_file, class_def_index, &stop_analysis)) {
+            success.store(false);
+          }
+          buffers[class_def_index - batch_begin] = oss.str();
+        }
+      };
+      std::vector<std::thread> threads;
+      for (const std::unique_ptr<OatDumper>& dumper : dumpers) {
+        threads.emplace_back(dump_classes, dumper.get());
       }
+      dump_classes(this);
+      for (std::thread& thread : threads) {
+        thread.join();
+      }
+      for (size_t i = 0, num_buffers = batch_end - batch_begin; i != num_buffers; ++i) {
+        os << buffers[i];
+        std::string().swap(buffers[i]);
+      }
+    }
+    return success.load();
+  }
 
-      uint32_t oat_class_offset = oat_dex_file.GetOatClassOffset(class_def_index);
-      const OatFile::OatClass oat_class = oat_dex_file.GetOatClass(class_def_index);
-      os << StringPrintf("%zd: %s (offset=0x%08x) (type_idx=%d)",
-                         class_def_index, descriptor, oat_class_offset, class_def.class_idx_.index_)
-         << " (" << oat_class.GetStatus() << ")"
-         << " (" << oat_class.GetType() << ")\n";
-      // TODO: include bitmap here if type is kOatClassSomeCompiled?
-      if (options_.list_classes_) {
+  // Dump only the methods given with --method, finding their classes through the type lookup
+  // table of each oat dex file instead of walking all the class defs.
+  bool DumpMethods(std::ostream& os) {
+    bool success = true;
+    VariableIndentationOutputStream vios(&os);
+    for (const std::string& method : options_.methods_) {
+      size_t arrow = method.find("->");
+      if (arrow == std::string::npos || arrow == 0u || arrow + 2u == method.size()) {
+        os << "Invalid method '" << method << "', expected Lpackage/Class;->name(signature)\n";
+        success = false;
         continue;
       }
-      if (!DumpOatClass(&vios, oat_class, *dex_file, class_def, &stop_analysis)) {
-        success = false;
+      const std::string descriptor = method.substr(0u, arrow);
+      std::string name = method.substr(arrow + 2u);
+      std::string signature;
+      size_t paren = name.find('(');
+      if (paren != std::string::npos) {
+        signature = name.substr(paren);
+        name.resize(paren);
       }
-      if (stop_analysis) {
-        os << std::flush;
-        return success;
+
+      bool found = false;
+      for (const OatFile::OatDexFile* oat_dex_file : oat_dex_files_) {
+        CHECK(oat_dex_file != nullptr);
+        std::string error_msg;
+        const DexFile* const dex_file = OpenDexFile(oat_dex_file, &error_msg);
+        if (dex_file == nullptr) {
+          os << "Failed to open dex file '" << oat_dex_file->GetDexFileLocation()
+             << "': " << error_msg << "\n";
+          success = false;
+          continue;
+        }
+        const DexFile::ClassDef* class_def = OatFile::OatDexFile::FindClassDef(
+            *dex_file, descriptor.c_str(), ComputeModifiedUtf8Hash(descriptor.c_str()));
+        if (class_def == nullptr) {
+          continue;
+        }
+        const uint8_t* class_data = dex_file->GetClassData(*class_def);
+        if (class_data != nullptr) {
+          const uint16_t class_def_index = dex_file->GetIndexForClassDef(*class_def);
+          const OatFile::OatClass oat_class = oat_dex_file->GetOatClass(class_def_index);
+          ClassDataItemIterator it(*dex_file, class_data);
+          it.SkipAllFields();
+          for (uint32_t class_method_index = 0; it.HasNextMethod(); ++class_method_index) {
+            const DexFile::MethodId& method_id = dex_file->GetMethodId(it.GetMemberIndex());
+            if (name == dex_file->GetMethodName(method_id) &&
+                (signature.empty() ||
+                 signature == dex_file->GetMethodSignature(method_id).ToString())) {
+              found = true;
+              bool addr_found = false;
+              if (!DumpOatMethod(&vios, *class_def, class_method_index, oat_class, *dex_file,
+                                 it.GetMemberIndex(), it.GetMethodCodeItem(),
+                                 it.GetRawMemberAccessFlags(), &addr_found)) {
+                success = false;
+              }
+            }
+            it.Next();
+          }
+        }
+        // The first dex file defining the class is the one the class loader would use.
+        break;
+      }
+      if (!found) {
+        os << "NOT FOUND: " << method << "\n";
+        success = false;
       }
     }
-    os << "\n";
     os << std::flush;
     return success;
   }
@@ -1968,7 +2139,8 @@ class OatDumper {
   const InstructionSet instruction_set_;
   std::set<uintptr_t> offsets_;
   Disassembler* disassembler_;
-  Stats stats_;
+  Stats own_stats_;
+  Stats& stats_;
 };
 
 class ImageDumper {
@@ -3151,6 +3323,246 @@ static int SymbolizeOat(const char* oat_filename,
   return EXIT_SUCCESS;
 }
 
+// Compares the size of the compiled code of the same methods in two oat files, e.g. the
+// obfuscated and the deobfuscated builds of an app. Methods are matched by class, name and
+// signature. Code shared by deduplicated methods is attributed to each of them.
+class OatCodeSizeComparator {
+ public:
+  struct Sizes {
+    size_t code_bytes = 0u;
+    size_t stack_map_bytes = 0u;  // CodeInfo without the inline infos.
+    size_t inline_info_bytes = 0u;
+
+    void Add(const Sizes& other) {
+      code_bytes += other.code_bytes;
+      stack_map_bytes += other.stack_map_bytes;
+      inline_info_bytes += other.inline_info_bytes;
+    }
+
+    bool operator==(const Sizes& other) const {
+      return code_bytes == other.code_bytes &&
+             stack_map_bytes == other.stack_map_bytes &&
+             inline_info_bytes == other.inline_info_bytes;
+    }
+  };
+
+  // Sizes of the compiled methods by pretty class name and pretty method.
+  typedef std::map<std::string, std::map<std::string, Sizes>> ClassSizes;
+
+  // Collect the sizes of the compiled methods of `oat_file`. The dex files are opened into
+  // `dex_files` rather than the global cache keyed by OatDexFile, as the two compared oat files
+  // are different and each must own its dex files.
+  static bool CollectSizes(const OatFile& oat_file,
+                           /*out*/ std::vector<std::unique_ptr<const DexFile>>* dex_files,
+                           /*out*/ ClassSizes* class_sizes) {
+    bool success = true;
+    for (const OatFile::OatDexFile* oat_dex_file : oat_file.GetOatDexFiles()) {
+      CHECK(oat_dex_file != nullptr);
+      std::string error_msg;
+      std::unique_ptr<const DexFile> opened_dex_file = oat_dex_file->OpenDexFile(&error_msg);
+      const DexFile* const dex_file = opened_dex_file.get();
+      if (dex_file == nullptr) {
+        LOG(ERROR) << "Failed to open dex file '" << oat_dex_file->GetDexFileLocation()
+                   << "': " << error_msg;
+        success = false;
+        continue;
+      }
+      dex_files->push_back(std::move(opened_dex_file));
+      for (size_t class_def_index = 0;
+           class_def_index < dex_file->NumClassDefs();
+           class_def_index++) {
+        const DexFile::ClassDef& class_def = dex_file->GetClassDef(class_def_index);
+        const uint8_t* class_data = dex_file->GetClassData(class_def);
+        if (class_data == nullptr) {
+          continue;
+        }
+        const OatFile::OatClass oat_class = oat_dex_file->GetOatClass(class_def_index);
+        std::map<std::string, Sizes>& method_sizes =
+            (*class_sizes)[PrettyDescriptor(dex_file->GetClassDescriptor(class_def))];
+        ClassDataItemIterator it(*dex_file, class_data);
+        it.SkipAllFields();
+        for (uint32_t class_method_index = 0; it.HasNextMethod(); ++class_method_index) {
+          const OatQuickMethodHeader* method_header =
+              oat_class.GetOatMethod(class_method_index).GetOatQuickMethodHeader();
+          if (method_header != nullptr && method_header->GetCodeSize() != 0u) {
+            // The first definition of a class wins, as for the class loader.
+            method_sizes.emplace(dex_file->PrettyMethod(it.GetMemberIndex(), true),
+                                 GetSizes(method_header));
+          }
+          it.Next();
+        }
+      }
+    }
+    return success;
+  }
+
+  static void Compare(const ClassSizes& before, const ClassSizes& after, std::ostream& os) {
+    struct ClassDelta {
+      const std::string* class_name;
+      Sizes before;
+      Sizes after;
+    };
+    std::vector<ClassDelta> class_deltas;
+    std::set<std::string> class_names;
+    for (const auto& entry : before) {
+      class_names.insert(entry.first);
+    }
+    for (const auto& entry : after) {
+      class_names.insert(entry.first);
+    }
+    for (const std::string& class_name : class_names) {
+      ClassDelta delta = { &class_name, Sizes(), Sizes() };
+      for (const auto& entry : GetMethodSizes(before, class_name)) {
+        delta.before.Add(entry.second);
+      }
+      for (const auto& entry : GetMethodSizes(after, class_name)) {
+        delta.after.Add(entry.second);
+      }
+      class_deltas.push_back(delta);
+    }
+    // Largest savings first.
+    std::stable_sort(class_deltas.begin(),
+                     class_deltas.end(),
+                     [](const ClassDelta& lhs, const ClassDelta& rhs) {
+                       return GetDelta(lhs.before.code_bytes, lhs.after.code_bytes) <
+                              GetDelta(rhs.before.code_bytes, rhs.after.code_bytes);
+                     });
+
+    Sizes total_before;
+    Sizes total_after;
+    size_t num_changed = 0u;
+    size_t num_removed = 0u;
+    size_t num_added = 0u;
+    size_t num_unchanged = 0u;
+    VariableIndentationOutputStream vios(&os);
+    vios.Stream() << "CODE SIZE COMPARISON (bytes, before -> after):\n";
+    for (const ClassDelta& class_delta : class_deltas) {
+      total_before.Add(class_delta.before);
+      total_after.Add(class_delta.after);
+      const std::map<std::string, Sizes>& before_methods =
+          GetMethodSizes(before, *class_delta.class_name);
+      const std::map<std::string, Sizes>& after_methods =
+          GetMethodSizes(after, *class_delta.class_name);
+      std::set<std::string> method_names;
+      for (const auto& entry : before_methods) {
+        method_names.insert(entry.first);
+      }
+      for (const auto& entry : after_methods) {
+        method_names.insert(entry.first);
+      }
+      bool class_printed = false;
+      for (const std::string& method_name : method_names) {
+        auto before_it = before_methods.find(method_name);
+        auto after_it = after_methods.find(method_name);
+        const char* status = "";
+        if (after_it == after_methods.end()) {
+          status = " (removed)";
+          ++num_removed;
+        } else if (before_it == before_methods.end()) {
+          status = " (added)";
+          ++num_added;
+        } else if (before_it->second == after_it->second) {
+          ++num_unchanged;
+          continue;
+        } else {
+          ++num_changed;
+        }
+        if (!class_printed) {
+          vios.Stream() << *class_delta.class_name << ": "
+                        << FormatSizes(class_delta.before, class_delta.after) << "\n";
+          class_printed = true;
+        }
+        ScopedIndentation indent1(&vios);
+        vios.Stream() << method_name << status << ": "
+                      << FormatSizes(before_it != before_methods.end() ? before_it->second : Sizes(),
+                                     after_it != after_methods.end() ? after_it->second : Sizes())
+                      << "\n";
+      }
+    }
+    vios.Stream() << "\nTOTAL: " << FormatSizes(total_before, total_after) << "\n";
+    vios.Stream() << StringPrintf("methods: %zu changed, %zu removed, %zu added, %zu unchanged\n",
+                                  num_changed,
+                                  num_removed,
+                                  num_added,
+                                  num_unchanged);
+    vios.Stream() << std::flush;
+  }
+
+ private:
+  static const std::map<std::string, Sizes>& GetMethodSizes(const ClassSizes& class_sizes,
+                                                           const std::string& class_name) {
+    static const std::map<std::string, Sizes> kNoMethods;
+    auto it = class_sizes.find(class_name);
+    return (it != class_sizes.end()) ? it->second : kNoMethods;
+  }
+
+  static Sizes GetSizes(const OatQuickMethodHeader* method_header) {
+    Sizes sizes;
+    sizes.code_bytes = method_header->GetCodeSize();
+    if (method_header->IsOptimized()) {
+      CodeInfoEncoding encoding(method_header->GetOptimizedCodeInfoPtr());
+      size_t inline_info_bits =
+          encoding.inline_info.encoding.BitSize() * encoding.inline_info.num_entries;
+      sizes.inline_info_bytes = RoundUp(inline_info_bits, kBitsPerByte) / kBitsPerByte;
+      sizes.stack_map_bytes =
+          encoding.HeaderSize() + encoding.NonHeaderSize() - sizes.inline_info_bytes;
+    }
+    return sizes;
+  }
+
+  static ssize_t GetDelta(size_t before, size_t after) {
+    return static_cast<ssize_t>(after) - static_cast<ssize_t>(before);
+  }
+
+  static std::string FormatSizes(const Sizes& before, const Sizes& after) {
+    return StringPrintf("code %zu -> %zu (%+zd), stack maps %zu -> %zu (%+zd), "
+                            "inline info %zu -> %zu (%+zd)",
+                        before.code_bytes,
+                        after.code_bytes,
+                        GetDelta(before.code_bytes, after.code_bytes),
+                        before.stack_map_bytes,
+                        after.stack_map_bytes,
+                        GetDelta(before.stack_map_bytes, after.stack_map_bytes),
+                        before.inline_info_bytes,
+                        after.inline_info_bytes,
+                        GetDelta(before.inline_info_bytes, after.inline_info_bytes));
+  }
+};
+
+static int CompareOatCodeSize(const char* before_filename,
+                              const char* dex_filename,
+                              const char* after_filename,
+                              std::ostream* os) {
+  // Both oat files and their dex files stay open until the comparison is done.
+  const char* filenames[] = { before_filename, after_filename };
+  std::unique_ptr<OatFile> oat_files[arraysize(filenames)];
+  std::vector<std::unique_ptr<const DexFile>> dex_files[arraysize(filenames)];
+  OatCodeSizeComparator::ClassSizes sizes[arraysize(filenames)];
+  for (size_t i = 0; i != arraysize(filenames); ++i) {
+    std::string error_msg;
+    oat_files[i].reset(OatFile::Open(/* zip_fd */ -1,
+                                     filenames[i],
+                                     filenames[i],
+                                     nullptr,
+                                     nullptr,
+                                     false,
+                                     /*low_4gb*/false,
+                                     i == 0u ? dex_filename : nullptr,
+                                     &error_msg));
+    if (oat_files[i] == nullptr) {
+      LOG(ERROR) << "Failed to open oat file from '" << filenames[i] << "': " << error_msg;
+      return EXIT_FAILURE;
+    }
+    if (!OatCodeSizeComparator::CollectSizes(*oat_files[i], &dex_files[i], &sizes[i])) {
+      return EXIT_FAILURE;
+    }
+  }
+  *os << "before: " << before_filename << "\n";
+  *os << "after: " << after_filename << "\n\n";
+  OatCodeSizeComparator::Compare(sizes[0], sizes[1], *os);
+  return EXIT_SUCCESS;
+}
+
 class IMTDumper {
  public:
   static bool Dump(Runtime* runtime,
@@ -3630,10 +4042,14 @@ struct OatdumpArgs : public CmdlineArgs {
       class_filter_ = option.substr(strlen("--class-filter=")).data();
     } else if (option.starts_with("--method-filter=")) {
       method_filter_ = option.substr(strlen("--method-filter=")).data();
+    } else if (option.starts_with("--method=")) {
+      methods_.push_back(option.substr(strlen("--method=")).ToString());
     } else if (option.starts_with("--list-classes")) {
       list_classes_ = true;
     } else if (option.starts_with("--list-methods")) {
       list_methods_ = true;
+    } else if (option.starts_with("--compare-oat-file=")) {
+      compare_oat_filename_ = option.substr(strlen("--compare-oat-file=")).data();
     } else if (option.starts_with("--export-dex-to=")) {
       export_dex_location_ = option.substr(strlen("--export-dex-to=")).data();
     } else if (option.starts_with("--addr2instr=")) {
@@ -3641,6 +4057,12 @@ struct OatdumpArgs : public CmdlineArgs {
         *error_msg = "Address conversion failed";
         return kParseError;
       }
+    } else if (option.starts_with("--jobs=")) {
+      if (!ParseUint(option.substr(strlen("--jobs=")).data(), &num_threads_) ||
+          num_threads_ == 0u) {
+        *error_msg = "--jobs must be a positive number";
+        return kParseError;
+      }
     } else if (option.starts_with("--app-image=")) {
       app_image_ = option.substr(strlen("--app-image=")).data();
     } else if (option.starts_with("--app-oat=")) {
@@ -3675,6 +4097,9 @@ struct OatdumpArgs : public CmdlineArgs {
     } else if (image_location_ != nullptr && oat_filename_ != nullptr) {
       *error_msg = "Either --image or --oat-file must be specified but not both";
       return kParseError;
+    } else if (compare_oat_filename_ != nullptr && oat_filename_ == nullptr) {
+      *error_msg = "--compare-oat-file requires --oat-file";
+      return kParseError;
     }
 
     return kParseOk;
@@ -3739,6 +4164,21 @@ struct OatdumpArgs : public CmdlineArgs {
         "  --method-filter=<method name>: only dumps methods that contain the filter.\n"
         "      Example: --method-filter=foo\n"
         "\n"
+        "  --method=<Lpackage/Class;->name(signature)>: only dumps the given method, found\n"
+        "      through the type lookup table without walking the other classes. The signature\n"
+        "      may be omitted to dump all the methods with the name. May be repeated.\n"
+        "      Example: --method='Lcom/example/Foo;->bar(I)V'\n"
+        "\n"
+        "  --jobs=<count>: number of threads disassembling classes when dumping an oat file\n"
+        "      without an image.\n"
+        "      Example: --jobs=8\n"
+        "\n"
+        "  --compare-oat-file=<file.odex>: compare the size of the compiled code of the\n"
+        "      methods of the --oat-file with the same methods in the given oat file, e.g.\n"
+        "      the obfuscated and the deobfuscated builds of an app. Outputs the changes of\n"
+        "      native code, stack map and inline info sizes by class and method.\n"
+        "      Example: --oat-file=obfuscated.odex --compare-oat-file=deobfuscated.odex\n"
+        "\n"
         "  --export-dex-to=<directory>: may be used to export oat embedded dex files.\n"
         "      Example: --export-dex-to=/data/local/tmp\n"
         "\n"
@@ -3765,6 +4205,8 @@ struct OatdumpArgs : public CmdlineArgs {
   const char* dex_filename_ = nullptr;
   const char* class_filter_ = "";
   const char* method_filter_ = "";
+  std::vector<std::string> methods_;
+  size_t num_threads_ = 1u;
   const char* image_location_ = nullptr;
   std::string elf_filename_prefix_;
   std::string imt_dump_;
@@ -3779,6 +4221,7 @@ struct OatdumpArgs : public CmdlineArgs {
   bool imt_stat_dump_ = false;
   uint32_t addr2instr_ = 0;
   const char* export_dex_location_ = nullptr;
+  const char* compare_oat_filename_ = nullptr;
   const char* app_image_ = nullptr;
   const char* app_oat_ = nullptr;
 };
@@ -3804,11 +4247,14 @@ struct OatdumpMain : public CmdlineMain<OatdumpArgs> {
         args_->app_image_,
         args_->app_oat_,
         args_->addr2instr_));
+    oat_dumper_options_->methods_ = args_->methods_;
+    oat_dumper_options_->num_threads_ = args_->num_threads_;
 
     return (args_->boot_image_location_ != nullptr ||
             args_->image_location_ != nullptr ||
             !args_->imt_dump_.empty()) &&
-          !args_->symbolize_;
+          !args_->symbolize_ &&
+          args_->compare_oat_filename_ == nullptr;
   }
 
   virtual bool ExecuteWithoutRuntime() OVERRIDE {
@@ -3825,6 +4271,11 @@ struct OatdumpMain : public CmdlineMain<OatdumpArgs> {
       bool no_bits = args_->only_keep_debug_;
       return SymbolizeOat(args_->oat_filename_, args_->dex_filename_, args_->output_name_, no_bits)
           == EXIT_SUCCESS;
+    } else if (args_->compare_oat_filename_ != nullptr) {
+      return CompareOatCodeSize(args_->oat_filename_,
+                                args_->dex_filename_,
+                                args_->compare_oat_filename_,
+                                args_->os_) == EXIT_SUCCESS;
     } else {
       return DumpOat(nullptr,
                      args_->oat_filename_,
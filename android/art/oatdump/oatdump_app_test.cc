@@ -46,4 +46,39 @@ TEST_F(OatDumpTest, TestPicAppWithBootImageStatic) {
   ASSERT_TRUE(Exec(kStatic, kModeOatWithBootImage, {}, kListAndCode, &error_msg)) << error_msg;
 }
 
+TEST_F(OatDumpTest, TestCompareAppOat) {
+  std::string error_msg;
+  // The same app compiled with and without native code.
+  const std::string before_odex = tmp_dir_ + "/before.odex";
+  const std::string after_odex = tmp_dir_ + "/after.odex";
+  ASSERT_TRUE(GenerateAppOdexFile(kDynamic, {"--runtime-arg", "-Xmx64M"}, before_odex, &error_msg))
+      << error_msg;
+  ASSERT_TRUE(GenerateAppOdexFile(kDynamic,
+                                  {"--runtime-arg", "-Xmx64M", "--compiler-filter=quicken"},
+                                  after_odex,
+                                  &error_msg)) << error_msg;
+
+  const std::string output_file = tmp_dir_ + "/compare.txt";
+  ASSERT_TRUE(ForkAndExecAndWait({GetExecutableFilePath(kDynamic, "oatdump"),
+                                  "--oat-file=" + before_odex,
+                                  "--compare-oat-file=" + after_odex,
+                                  "--output=" + output_file},
+                                 &error_msg)) << error_msg;
+  std::string output;
+  ASSERT_TRUE(android::base::ReadFileToString(output_file, &output));
+  EXPECT_NE(output.find("CODE SIZE COMPARISON"), std::string::npos) << output;
+
+  // The compiled code of Main.getA() is gone in the quickened oat file.
+  const std::string method_prefix = "java.lang.String Main.getA() (removed): code ";
+  const size_t method_pos = output.find(method_prefix);
+  ASSERT_NE(method_pos, std::string::npos) << output;
+  const size_t before_code_size =
+      strtoul(output.c_str() + method_pos + method_prefix.size(), nullptr, 10);
+  EXPECT_GT(before_code_size, 0u) << output;
+  const std::string code_delta = std::to_string(before_code_size) + " -> 0 (-" +
+      std::to_string(before_code_size) + ")";
+  EXPECT_EQ(output.compare(method_pos + method_prefix.size(), code_delta.size(), code_delta), 0)
+      << output;
+}
+
 }  // namespace art
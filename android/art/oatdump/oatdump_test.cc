@@ -61,6 +61,66 @@ TEST_F(OatDumpTest, TestListMethodsStatic) {
   ASSERT_TRUE(Exec(kStatic, kModeArt, {"--list-methods"}, kListOnly, &error_msg)) << error_msg;
 }
 
+TEST_F(OatDumpTest, TestJobs) {
+  std::string error_msg;
+  ASSERT_TRUE(Exec(kDynamic, kModeOat, {"--jobs=4"}, kListAndCode, &error_msg)) << error_msg;
+  // Classes are disassembled on several threads but written in class order, so the output must
+  // not depend on the number of jobs.
+  const std::string serial_output = tmp_dir_ + "/jobs1.txt";
+  const std::string parallel_output = tmp_dir_ + "/jobs4.txt";
+  ASSERT_TRUE(ExecOatToFile(kDynamic, {"--jobs=1"}, serial_output, &error_msg)) << error_msg;
+  ASSERT_TRUE(ExecOatToFile(kDynamic, {"--jobs=4"}, parallel_output, &error_msg)) << error_msg;
+  ExpectSameFileContents(serial_output, parallel_output);
+}
+
+TEST_F(OatDumpTest, TestMethod) {
+  std::string error_msg;
+  const std::string output_file = tmp_dir_ + "/method.txt";
+  std::string output;
+  // Without a signature, all the overloads are dumped.
+  ASSERT_TRUE(ExecOatToFile(kDynamic, {"--method=Ljava/lang/Object;->wait"}, output_file,
+                            &error_msg)) << error_msg;
+  ASSERT_TRUE(android::base::ReadFileToString(output_file, &output));
+  EXPECT_NE(output.find("void java.lang.Object.wait() (dex_method_idx="), std::string::npos)
+      << output;
+  EXPECT_NE(output.find("void java.lang.Object.wait(long) (dex_method_idx="), std::string::npos)
+      << output;
+  EXPECT_NE(output.find("void java.lang.Object.wait(long, int) (dex_method_idx="),
+            std::string::npos) << output;
+  EXPECT_NE(output.find("CODE:"), std::string::npos) << output;
+  // Only methods are dumped, not the oat header.
+  EXPECT_EQ(output.find("MAGIC:"), std::string::npos) << output;
+
+  // With a signature, only that overload is dumped.
+  ASSERT_EQ(unlink(output_file.c_str()), 0);
+  ASSERT_TRUE(ExecOatToFile(kDynamic, {"--method=Ljava/lang/Object;->wait(J)V"}, output_file,
+                            &error_msg)) << error_msg;
+  ASSERT_TRUE(android::base::ReadFileToString(output_file, &output));
+  EXPECT_NE(output.find("void java.lang.Object.wait(long) (dex_method_idx="), std::string::npos)
+      << output;
+  EXPECT_EQ(output.find("void java.lang.Object.wait() (dex_method_idx="), std::string::npos)
+      << output;
+  EXPECT_EQ(output.find("void java.lang.Object.wait(long, int) (dex_method_idx="),
+            std::string::npos) << output;
+}
+
+TEST_F(OatDumpTest, TestMethodNotFound) {
+  std::string error_msg;
+  const std::string output_file = tmp_dir_ + "/method.txt";
+  EXPECT_FALSE(ExecOatToFile(kDynamic, {"--method=Ljava/lang/Object;->noSuchMethod()V"},
+                             output_file, &error_msg));
+  std::string output;
+  ASSERT_TRUE(android::base::ReadFileToString(output_file, &output));
+  EXPECT_NE(output.find("NOT FOUND: Ljava/lang/Object;->noSuchMethod()V"), std::string::npos)
+      << output;
+  EXPECT_EQ(output.find("(dex_method_idx="), std::string::npos) << output;
+}
+
+TEST_F(OatDumpTest, TestCompareOat) {
+  std::string error_msg;
+  ASSERT_TRUE(Exec(kDynamic, kModeCompareOat, {}, kListOnly, &error_msg)) << error_msg;
+}
+
 TEST_F(OatDumpTest, TestSymbolize) {
   std::string error_msg;
   ASSERT_TRUE(Exec(kDynamic, kModeSymbolize, {}, kListOnly, &error_msg)) << error_msg;
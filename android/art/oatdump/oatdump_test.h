@@ -17,10 +17,13 @@
 #ifndef ART_OATDUMP_OATDUMP_TEST_H_
 #define ART_OATDUMP_OATDUMP_TEST_H_
 
+#include <algorithm>
+#include <fstream>
 #include <sstream>
 #include <string>
 #include <vector>
 
+#include "android-base/file.h"
 #include "android-base/strings.h"
 
 #include "arch/instruction_set.h"
@@ -93,6 +96,7 @@ class OatDumpTest : public CommonRuntimeTest {
     kModeOatWithBootImage,
     kModeArt,
     kModeSymbolize,
+    kModeCompareOat,  // Compare the code size of the core oat file with itself.
   };
 
   // Display style.
@@ -114,6 +118,14 @@ class OatDumpTest : public CommonRuntimeTest {
   bool GenerateAppOdexFile(Flavor flavor,
                            const std::vector<std::string>& args,
                            /*out*/ std::string* error_msg) {
+    return GenerateAppOdexFile(flavor, args, GetAppOdexName(), error_msg);
+  }
+
+  // Compile the app into `odex_location`, with the speed filter unless `args` give another one.
+  bool GenerateAppOdexFile(Flavor flavor,
+                           const std::vector<std::string>& args,
+                           const std::string& odex_location,
+                           /*out*/ std::string* error_msg) {
     std::string dex2oat_path = GetExecutableFilePath(flavor, "dex2oat");
     std::vector<std::string> exec_argv = {
         dex2oat_path,
@@ -126,9 +138,13 @@ class OatDumpTest : public CommonRuntimeTest {
         "--boot-image=" + GetCoreArtLocation(),
         "--instruction-set=" + std::string(GetInstructionSetString(kRuntimeISA)),
         "--dex-file=" + GetTestDexFileName(GetAppBaseName().c_str()),
-        "--oat-file=" + GetAppOdexName(),
-        "--compiler-filter=speed"
+        "--oat-file=" + odex_location
     };
+    if (std::none_of(args.begin(), args.end(), [](const std::string& arg) {
+          return android::base::StartsWith(arg, "--compiler-filter=");
+        })) {
+      exec_argv.push_back("--compiler-filter=speed");
+    }
     exec_argv.insert(exec_argv.end(), args.begin(), args.end());
 
     return ForkAndExecAndWait(exec_argv, error_msg);
@@ -150,6 +166,13 @@ class OatDumpTest : public CommonRuntimeTest {
     if (mode == kModeSymbolize) {
       exec_argv.push_back("--symbolize=" + core_oat_location_);
       exec_argv.push_back("--output=" + core_oat_location_ + ".symbolize");
+    } else if (mode == kModeCompareOat) {
+      exec_argv.push_back("--oat-file=" + core_oat_location_);
+      exec_argv.push_back("--compare-oat-file=" + core_oat_location_);
+      expected_prefixes.push_back("before:");
+      expected_prefixes.push_back("after:");
+      expected_prefixes.push_back("CODE SIZE COMPARISON");
+      expected_prefixes.push_back("TOTAL:");
     } else {
       expected_prefixes.push_back("Dex file data for");
       expected_prefixes.push_back("Num string ids:");
@@ -251,6 +274,49 @@ class OatDumpTest : public CommonRuntimeTest {
     return result;
   }
 
+  // Run oatdump on the core oat file with custom arguments, writing its output to `output_file`.
+  bool ExecOatToFile(Flavor flavor,
+                     const std::vector<std::string>& args,
+                     const std::string& output_file,
+                     /*out*/ std::string* error_msg) {
+    std::vector<std::string> exec_argv = {
+        GetExecutableFilePath(flavor, "oatdump"),
+        "--oat-file=" + core_oat_location_,
+        "--output=" + output_file
+    };
+    exec_argv.insert(exec_argv.end(), args.begin(), args.end());
+    return ForkAndExecAndWait(exec_argv, error_msg);
+  }
+
+  // Expect two files to have the same contents, without reading all of them in memory.
+  void ExpectSameFileContents(const std::string& expected_file, const std::string& actual_file) {
+    std::ifstream expected(expected_file, std::ios::binary);
+    std::ifstream actual(actual_file, std::ios::binary);
+    ASSERT_TRUE(expected.good()) << expected_file;
+    ASSERT_TRUE(actual.good()) << actual_file;
+    static constexpr size_t kChunkSize = 64 * KB;
+    std::vector<char> expected_chunk(kChunkSize);
+    std::vector<char> actual_chunk(kChunkSize);
+    size_t offset = 0u;
+    while (true) {
+      expected.read(expected_chunk.data(), kChunkSize);
+      actual.read(actual_chunk.data(), kChunkSize);
+      const size_t expected_size = static_cast<size_t>(expected.gcount());
+      const size_t actual_size = static_cast<size_t>(actual.gcount());
+      const size_t size = std::min(expected_size, actual_size);
+      const auto mismatch =
+          std::mismatch(expected_chunk.begin(), expected_chunk.begin() + size, actual_chunk.begin());
+      ASSERT_TRUE(mismatch.first == expected_chunk.begin() + size && expected_size == actual_size)
+          << actual_file << " differs from " << expected_file << " at offset "
+          << offset + (mismatch.first - expected_chunk.begin());
+      if (size == 0u) {
+        break;
+      }
+      offset += size;
+    }
+    EXPECT_GT(offset, 0u);
+  }
+
   bool ForkAndExec(const std::vector<std::string>& exec_argv,
                    /*out*/ pid_t* pid,
                    /*out*/ int* pipe_fd,
@@ -0,0 +1,365 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_set>
+#include <utility>
+
+#include "deobfuscation_profile.h"
+#include "dex/code_item_accessors-inl.h"
+#include "dex/dex_file-inl.h"
+#include "dex/dex_instruction-inl.h"
+#include "dex/type_reference.h"
+#include "jit/profile_compilation_info.h"
+
+namespace art {
+
+using Hotness = ProfileCompilationInfo::MethodHotness;
+
+static constexpr size_t kMaxClassHierarchyDepth = 1024u;
+
+// The profile data of a dex file, added to the profile in bulk once complete.
+struct DexProfileData {
+  std::set<uint16_t> hot_methods;
+  std::set<uint16_t> startup_methods;
+  std::set<dex::TypeIndex> classes;
+};
+
+// Return the definition of the class with the given descriptor, or a reference without
+// a dex file if none of the dex files defines it.
+static TypeReference FindClassDef(const std::vector<std::unique_ptr<const DexFile>>& dex_files,
+                                  const char* descriptor) {
+  for (const std::unique_ptr<const DexFile>& dex_file : dex_files) {
+    const DexFile::TypeId* type_id = dex_file->FindTypeId(descriptor);
+    if (type_id != nullptr) {
+      dex::TypeIndex type_index = dex_file->GetIndexForTypeId(*type_id);
+      if (dex_file->FindClassDef(type_index) != nullptr) {
+        return TypeReference(dex_file.get(), type_index);
+      }
+    }
+  }
+  return TypeReference(/* dex_file */ nullptr, dex::TypeIndex());
+}
+
+// Return the code item of the method, or null if it is not defined in its dex file or
+// has no code.
+static const DexFile::CodeItem* FindCodeItem(const MethodReference& ref) {
+  const DexFile* dex_file = ref.dex_file;
+  const DexFile::ClassDef* class_def = dex_file->FindClassDef(ref.GetMethodId().class_idx_);
+  if (class_def == nullptr) {
+    return nullptr;
+  }
+  const uint8_t* class_data = dex_file->GetClassData(*class_def);
+  if (class_data == nullptr) {
+    return nullptr;
+  }
+  ClassDataItemIterator it(*dex_file, class_data);
+  it.SkipAllFields();
+  for (; it.HasNextMethod(); it.Next()) {
+    if (it.GetMemberIndex() == ref.index) {
+      return it.GetMethodCodeItem();
+    }
+  }
+  return nullptr;
+}
+
+static bool IsStaticPut(Instruction::Code opcode) {
+  return opcode >= Instruction::SPUT && opcode <= Instruction::SPUT_SHORT;
+}
+
+static bool IsStaticFieldAccess(Instruction::Code opcode) {
+  return opcode >= Instruction::SGET && opcode <= Instruction::SPUT_SHORT;
+}
+
+static bool IsMethodInvoke(const Instruction& inst) {
+  if (!inst.IsInvoke()) {
+    return false;
+  }
+  Instruction::IndexType index_type = Instruction::IndexTypeOf(inst.Opcode());
+  return index_type == Instruction::kIndexMethodRef ||
+         index_type == Instruction::kIndexMethodAndProtoRef;
+}
+
+static bool IsStaticInvoke(Instruction::Code opcode) {
+  return opcode == Instruction::INVOKE_STATIC || opcode == Instruction::INVOKE_STATIC_RANGE;
+}
+
+// Return the method with the given name and signature (any signature if null) declared by
+// the class `class_ref`, or a reference without a dex file if it declares none.
+static MethodReference FindDeclaredMethod(const TypeReference& class_ref,
+                                          const char* name,
+                                          const Signature* signature) {
+  const DexFile* dex_file = class_ref.dex_file;
+  const DexFile::ClassDef* class_def = dex_file->FindClassDef(class_ref.TypeIndex());
+  const uint8_t* class_data = dex_file->GetClassData(*class_def);
+  if (class_data != nullptr) {
+    ClassDataItemIterator it(*dex_file, class_data);
+    it.SkipAllFields();
+    for (; it.HasNextMethod(); it.Next()) {
+      const DexFile::MethodId& method_id = dex_file->GetMethodId(it.GetMemberIndex());
+      if (strcmp(dex_file->GetMethodName(method_id), name) == 0 &&
+          (signature == nullptr || dex_file->GetMethodSignature(method_id) == *signature)) {
+        return MethodReference(dex_file, it.GetMemberIndex());
+      }
+    }
+  }
+  return MethodReference(/* file */ nullptr, dex::kDexNoIndex);
+}
+
+// Walks the methods statically reachable from the entry point classes breadth first and
+// marks them as startup methods.
+class EntryPointReachability {
+ public:
+  EntryPointReachability(const std::vector<std::unique_ptr<const DexFile>>& dex_files,
+                         std::map<const DexFile*, DexProfileData>* profile_data)
+      : dex_files_(dex_files), profile_data_(profile_data), startup_method_count_(0u) {}
+
+  void AddEntryPoint(const TypeReference& class_ref) {
+    InitializeClass(class_ref);
+    const DexFile* dex_file = class_ref.dex_file;
+    const uint8_t* class_data =
+        dex_file->GetClassData(*dex_file->FindClassDef(class_ref.TypeIndex()));
+    if (class_data == nullptr) {
+      return;
+    }
+    ClassDataItemIterator it(*dex_file, class_data);
+    it.SkipAllFields();
+    for (; it.HasNextMethod(); it.Next()) {
+      AddMethod(MethodReference(dex_file, it.GetMemberIndex()));
+    }
+  }
+
+  // Mark the methods at most `max_depth` calls away from the entry points.
+  void Run(uint32_t max_depth) {
+    std::vector<MethodReference> current;
+    for (uint32_t depth = 0; !next_.empty(); ++depth) {
+      current.clear();
+      std::swap(current, next_);
+      for (const MethodReference& ref : current) {
+        const DexFile::CodeItem* code_item = FindCodeItem(ref);
+        if (code_item == nullptr) {
+          continue;
+        }
+        DexProfileData& data = (*profile_data_)[ref.dex_file];
+        if (data.startup_methods.insert(ref.index).second) {
+          ++startup_method_count_;
+        }
+        if (depth < max_depth) {
+          VisitCode(ref, code_item);
+        }
+      }
+    }
+  }
+
+  size_t GetStartupMethodCount() const {
+    return startup_method_count_;
+  }
+
+ private:
+  void AddMethod(const MethodReference& ref) {
+    if (ref.dex_file != nullptr && visited_methods_.insert(ref).second) {
+      next_.push_back(ref);
+    }
+  }
+
+  // Add the class and its super classes to the profile and queue their initializers.
+  void InitializeClass(TypeReference class_ref) {
+    while (class_ref.dex_file != nullptr && initialized_classes_.insert(class_ref).second) {
+      const DexFile* dex_file = class_ref.dex_file;
+      (*profile_data_)[dex_file].classes.insert(class_ref.TypeIndex());
+      AddMethod(FindDeclaredMethod(class_ref, "<clinit>", /* signature */ nullptr));
+      const DexFile::ClassDef* class_def = dex_file->FindClassDef(class_ref.TypeIndex());
+      if (!class_def->superclass_idx_.IsValid()) {
+        break;
+      }
+      class_ref = FindClassDef(dex_files_, dex_file->StringByTypeIdx(class_def->superclass_idx_));
+    }
+  }
+
+  // Return the method invoked through `method_id`, looking in the super classes of the
+  // referenced class as well.
+  MethodReference ResolveMethod(const DexFile& dex_file, const DexFile::MethodId& method_id) {
+    const char* name = dex_file.GetMethodName(method_id);
+    const Signature signature = dex_file.GetMethodSignature(method_id);
+    TypeReference class_ref =
+        FindClassDef(dex_files_, dex_file.GetMethodDeclaringClassDescriptor(method_id));
+    // Bound the walk in case of a cycle of super classes in an invalid dex file.
+    for (size_t i = 0; class_ref.dex_file != nullptr && i != kMaxClassHierarchyDepth; ++i) {
+      MethodReference ref = FindDeclaredMethod(class_ref, name, &signature);
+      if (ref.dex_file != nullptr) {
+        return ref;
+      }
+      const DexFile::ClassDef* class_def =
+          class_ref.dex_file->FindClassDef(class_ref.TypeIndex());
+      if (!class_def->superclass_idx_.IsValid()) {
+        break;
+      }
+      class_ref = FindClassDef(
+          dex_files_, class_ref.dex_file->StringByTypeIdx(class_def->superclass_idx_));
+    }
+    return MethodReference(/* file */ nullptr, dex::kDexNoIndex);
+  }
+
+  void VisitCode(const MethodReference& ref, const DexFile::CodeItem* code_item) {
+    const DexFile& dex_file = *ref.dex_file;
+    for (const DexInstructionPcPair& inst : CodeItemInstructionAccessor(dex_file, code_item)) {
+      const Instruction::Code opcode = inst->Opcode();
+      if (IsMethodInvoke(inst.Inst())) {
+        MethodReference target = ResolveMethod(dex_file, dex_file.GetMethodId(inst->VRegB()));
+        if (target.dex_file != nullptr && IsStaticInvoke(opcode)) {
+          InitializeClass(TypeReference(target.dex_file, target.GetMethodId().class_idx_));
+        }
+        AddMethod(target);
+      } else if (opcode == Instruction::NEW_INSTANCE) {
+        InitializeClass(FindClassDef(
+            dex_files_, dex_file.StringByTypeIdx(dex::TypeIndex(inst->VRegB_21c()))));
+      } else if (IsStaticFieldAccess(opcode)) {
+        const DexFile::FieldId& field_id = dex_file.GetFieldId(inst->VRegB_21c());
+        InitializeClass(FindClassDef(dex_files_, dex_file.StringByTypeIdx(field_id.class_idx_)));
+      }
+    }
+  }
+
+  const std::vector<std::unique_ptr<const DexFile>>& dex_files_;
+  std::map<const DexFile*, DexProfileData>* const profile_data_;
+  std::set<MethodReference> visited_methods_;
+  std::set<TypeReference> initialized_classes_;
+  // The methods of the next depth.
+  std::vector<MethodReference> next_;
+  size_t startup_method_count_;
+};
+
+void GenerateDeobfuscationProfile(
+    const std::vector<std::unique_ptr<const DexFile>>& dex_files,
+    const std::vector<MethodReference>& deobfuscated_methods,
+    const std::vector<TypeReference>& entry_points,
+    const DeobfuscationProfileOptions& options,
+    bool verbose,
+    ProfileCompilationInfo* out_profile) {
+  std::map<const DexFile*, DexProfileData> profile_data;
+  // Pretty names of the deobfuscated methods and their classes, to find the invokes of
+  // the methods from any dex file.
+  std::unordered_set<std::string> deobfuscated_names;
+  std::unordered_set<std::string> deobfuscated_classes;
+  size_t startup_class_count = 0;
+
+  for (const MethodReference& ref : deobfuscated_methods) {
+    const DexFile* dex_file = ref.dex_file;
+    const DexFile::MethodId& method_id = ref.GetMethodId();
+    profile_data[dex_file].hot_methods.insert(ref.index);
+    deobfuscated_names.insert(ref.PrettyMethod());
+    deobfuscated_classes.insert(dex_file->GetMethodDeclaringClassDescriptor(method_id));
+
+    if (strcmp(dex_file->GetMethodName(method_id), "<clinit>") != 0) {
+      continue;
+    }
+    // Opaque predicates typically read static fields set up by the class initializer, so
+    // make the classes it initializes startup classes.
+    profile_data[dex_file].startup_methods.insert(ref.index);
+    const DexFile::CodeItem* code_item = FindCodeItem(ref);
+    if (code_item == nullptr) {
+      continue;
+    }
+    for (const DexInstructionPcPair& inst : CodeItemInstructionAccessor(*dex_file, code_item)) {
+      if (!IsStaticPut(inst->Opcode())) {
+        continue;
+      }
+      const DexFile::FieldId& field_id = dex_file->GetFieldId(inst->VRegB_21c());
+      TypeReference class_ref =
+          FindClassDef(dex_files, dex_file->StringByTypeIdx(field_id.class_idx_));
+      if (class_ref.dex_file != nullptr &&
+          profile_data[class_ref.dex_file].classes.insert(class_ref.TypeIndex()).second) {
+        ++startup_class_count;
+      }
+    }
+  }
+
+  size_t caller_count = 0;
+  if (options.include_callers && !deobfuscated_names.empty()) {
+    for (const std::unique_ptr<const DexFile>& dex_file : dex_files) {
+      // Flag the method ids of this dex file which refer to a deobfuscated method.
+      std::vector<bool> is_deobfuscated(dex_file->NumMethodIds(), false);
+      bool has_deobfuscated = false;
+      for (uint32_t i = 0; i < dex_file->NumMethodIds(); ++i) {
+        const char* class_descriptor =
+            dex_file->GetMethodDeclaringClassDescriptor(dex_file->GetMethodId(i));
+        if (deobfuscated_classes.count(class_descriptor) != 0 &&
+            deobfuscated_names.count(dex_file->PrettyMethod(i)) != 0) {
+          is_deobfuscated[i] = true;
+          has_deobfuscated = true;
+        }
+      }
+      if (!has_deobfuscated) {
+        continue;
+      }
+      DexProfileData& data = profile_data[dex_file.get()];
+      for (uint32_t i = 0; i < dex_file->NumClassDefs(); ++i) {
+        const uint8_t* class_data = dex_file->GetClassData(dex_file->GetClassDef(i));
+        if (class_data == nullptr) {
+          continue;
+        }
+        ClassDataItemIterator it(*dex_file, class_data);
+        it.SkipAllFields();
+        for (; it.HasNextMethod(); it.Next()) {
+          const DexFile::CodeItem* code_item = it.GetMethodCodeItem();
+          if (code_item == nullptr) {
+            continue;
+          }
+          for (const DexInstructionPcPair& inst :
+                   CodeItemInstructionAccessor(*dex_file, code_item)) {
+            if (IsMethodInvoke(inst.Inst()) && is_deobfuscated[inst->VRegB()]) {
+              if (data.hot_methods.insert(it.GetMemberIndex()).second) {
+                ++caller_count;
+              }
+              break;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  size_t reachable_count = 0;
+  if (!entry_points.empty()) {
+    EntryPointReachability reachability(dex_files, &profile_data);
+    for (const TypeReference& class_ref : entry_points) {
+      reachability.AddEntryPoint(class_ref);
+    }
+    reachability.Run(options.entry_point_depth);
+    reachable_count = reachability.GetStartupMethodCount();
+  }
+
+  for (const auto& entry : profile_data) {
+    const DexFile* dex_file = entry.first;
+    const DexProfileData& data = entry.second;
+    out_profile->AddMethodsForDex(
+        Hotness::kFlagHot, dex_file, data.hot_methods.begin(), data.hot_methods.end());
+    out_profile->AddMethodsForDex(
+        Hotness::kFlagStartup, dex_file, data.startup_methods.begin(), data.startup_methods.end());
+    out_profile->AddClassesForDex(dex_file, data.classes.begin(), data.classes.end());
+  }
+  if (verbose) {
+    LOG(INFO) << "Deobfuscated methods " << deobfuscated_methods.size()
+              << " hot callers " << caller_count
+              << " startup classes " << startup_class_count
+              << " startup methods reachable from entry points " << reachable_count;
+  }
+}
+
+}  // namespace art
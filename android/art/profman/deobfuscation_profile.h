@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_PROFMAN_DEOBFUSCATION_PROFILE_H_
+#define ART_PROFMAN_DEOBFUSCATION_PROFILE_H_
+
+#include <memory>
+#include <vector>
+
+#include "dex/dex_file.h"
+#include "dex/method_reference.h"
+#include "dex/type_reference.h"
+
+namespace art {
+
+class ProfileCompilationInfo;
+
+struct DeobfuscationProfileOptions {
+ public:
+  // Whether the methods which invoke a deobfuscated method are marked hot as well.
+  bool include_callers = true;
+  // How many calls away from the methods of an entry point class a method is still
+  // marked startup.
+  uint32_t entry_point_depth = 3u;
+};
+
+// Generate a profile for the methods rewritten by a deobfuscator, so that a profile guided
+// compilation spends its time on the cleaned up code:
+//  - the deobfuscated methods are hot;
+//  - the methods invoking them are hot (if options.include_callers). Callers are matched on
+//    the class, name and signature of the invoked method, so calls through a super class or
+//    an interface are not found;
+//  - the classes which a deobfuscated class initializer stores static fields of are added
+//    to the classes of the profile, and the class initializer is also a startup method;
+//  - the methods statically reachable from the `entry_points` classes (e.g. the activities
+//    and the application class of the manifest) within options.entry_point_depth calls are
+//    startup methods and their classes are added to the profile. Class initializers are
+//    reached through the classes a method instantiates, accesses static fields of or
+//    invokes static methods of. Calls are resolved on the class named by the invoke and its
+//    super classes in `dex_files`, overriding methods are not followed.
+// The hot and startup methods and the classes of the profile drive the layout of code items
+// and string data by dexlayout.
+void GenerateDeobfuscationProfile(
+    const std::vector<std::unique_ptr<const DexFile>>& dex_files,
+    const std::vector<MethodReference>& deobfuscated_methods,
+    const std::vector<TypeReference>& entry_points,
+    const DeobfuscationProfileOptions& options,
+    bool verbose,
+    ProfileCompilationInfo* out_profile);
+
+}  // namespace art
+
+#endif  // ART_PROFMAN_DEOBFUSCATION_PROFILE_H_
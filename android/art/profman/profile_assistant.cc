@@ -16,6 +16,10 @@
 
 #include "profile_assistant.h"
 
+#include <algorithm>
+#include <memory>
+#include <thread>
+
 #include "base/os.h"
 #include "base/unix_file/fd_file.h"
 
@@ -28,11 +32,86 @@ static constexpr const uint32_t kMinNewMethodsPercentChangeForCompilation = 2;
 static constexpr const uint32_t kMinNewClassesForCompilation = 50;
 static constexpr const uint32_t kMinNewClassesPercentChangeForCompilation = 2;
 
+// Load the profiles in [begin, end) and merge them into `info` one after the other.
+static bool MergeProfileRange(const std::vector<int>& profile_fds,
+                              size_t begin,
+                              size_t end,
+                              const ProfileCompilationInfo::ProfileLoadFilterFn& filter_fn,
+                              ProfileCompilationInfo* info) {
+  for (size_t i = begin; i < end; i++) {
+    ProfileCompilationInfo cur_info;
+    if (!cur_info.Load(profile_fds[i], /*merge_classes*/ true, filter_fn)) {
+      LOG(WARNING) << "Could not load profile file at index " << i;
+      return false;
+    }
+    if (!info->MergeWith(cur_info)) {
+      LOG(WARNING) << "Could not merge profile file at index " << i;
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ProfileAssistant::MergeProfiles(const std::vector<int>& profile_fds,
+                                     const ProfileCompilationInfo::ProfileLoadFilterFn& filter_fn,
+                                     size_t num_jobs,
+                                     ProfileCompilationInfo* info) {
+  size_t num_ranges = std::min(num_jobs, profile_fds.size());
+  if (num_ranges <= 1u) {
+    return MergeProfileRange(profile_fds, 0u, profile_fds.size(), filter_fn, info);
+  }
+
+  // Merge contiguous ranges of profiles in parallel. The profiles are loaded one at a time
+  // so that memory use stays bounded by the merged profiles rather than the inputs.
+  std::vector<std::unique_ptr<ProfileCompilationInfo>> partial(num_ranges);
+  std::unique_ptr<bool[]> success(new bool[num_ranges]);
+  std::vector<std::thread> threads;
+  threads.reserve(num_ranges);
+  for (size_t r = 0; r != num_ranges; ++r) {
+    size_t begin = profile_fds.size() * r / num_ranges;
+    size_t end = profile_fds.size() * (r + 1) / num_ranges;
+    partial[r].reset(new ProfileCompilationInfo());
+    threads.emplace_back([&, r, begin, end]() {
+      success[r] = MergeProfileRange(profile_fds, begin, end, filter_fn, partial[r].get());
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  if (!std::all_of(success.get(), success.get() + num_ranges, [](bool b) { return b; })) {
+    return false;
+  }
+
+  // Reduce the partial results pairwise, always merging the right neighbour into the left
+  // one so that the order of the profiles is kept.
+  for (size_t stride = 1u; stride < num_ranges; stride *= 2u) {
+    threads.clear();
+    for (size_t r = 0; r + stride < num_ranges; r += 2u * stride) {
+      threads.emplace_back([&, r, stride]() {
+        success[r] = partial[r]->MergeWith(*partial[r + stride]);
+        partial[r + stride].reset();
+      });
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+    for (size_t r = 0; r + stride < num_ranges; r += 2u * stride) {
+      if (!success[r]) {
+        LOG(WARNING) << "Could not merge profile files at indexes "
+                     << (profile_fds.size() * r / num_ranges) << " and "
+                     << (profile_fds.size() * (r + stride) / num_ranges);
+        return false;
+      }
+    }
+  }
+  return info->MergeWith(*partial[0]);
+}
 
 ProfileAssistant::ProcessingResult ProfileAssistant::ProcessProfilesInternal(
         const std::vector<ScopedFlock>& profile_files,
         const ScopedFlock& reference_profile_file,
-        const ProfileCompilationInfo::ProfileLoadFilterFn& filter_fn) {
+        const ProfileCompilationInfo::ProfileLoadFilterFn& filter_fn,
+        size_t num_jobs) {
   DCHECK(!profile_files.empty());
 
   ProfileCompilationInfo info;
@@ -47,16 +126,13 @@ ProfileAssistant::ProcessingResult ProfileAssistant::ProcessProfilesInternal(
   uint32_t number_of_classes = info.GetNumberOfResolvedClasses();
 
   // Merge all current profiles.
-  for (size_t i = 0; i < profile_files.size(); i++) {
-    ProfileCompilationInfo cur_info;
-    if (!cur_info.Load(profile_files[i]->Fd(), /*merge_classes*/ true, filter_fn)) {
-      LOG(WARNING) << "Could not load profile file at index " << i;
-      return kErrorBadProfiles;
-    }
-    if (!info.MergeWith(cur_info)) {
-      LOG(WARNING) << "Could not merge profile file at index " << i;
-      return kErrorBadProfiles;
-    }
+  std::vector<int> profile_fds;
+  profile_fds.reserve(profile_files.size());
+  for (const ScopedFlock& profile_file : profile_files) {
+    profile_fds.push_back(profile_file->Fd());
+  }
+  if (!MergeProfiles(profile_fds, filter_fn, num_jobs, &info)) {
+    return kErrorBadProfiles;
   }
 
   uint32_t min_change_in_methods_for_compilation = std::max(
@@ -124,7 +200,8 @@ class ScopedFlockList {
 ProfileAssistant::ProcessingResult ProfileAssistant::ProcessProfiles(
         const std::vector<int>& profile_files_fd,
         int reference_profile_file_fd,
-        const ProfileCompilationInfo::ProfileLoadFilterFn& filter_fn) {
+        const ProfileCompilationInfo::ProfileLoadFilterFn& filter_fn,
+        size_t num_jobs) {
   DCHECK_GE(reference_profile_file_fd, 0);
 
   std::string error;
@@ -147,13 +224,15 @@ ProfileAssistant::ProcessingResult ProfileAssistant::ProcessProfiles(
 
   return ProcessProfilesInternal(profile_files.Get(),
                                  reference_profile_file,
-                                 filter_fn);
+                                 filter_fn,
+                                 num_jobs);
 }
 
 ProfileAssistant::ProcessingResult ProfileAssistant::ProcessProfiles(
         const std::vector<std::string>& profile_files,
         const std::string& reference_profile_file,
-        const ProfileCompilationInfo::ProfileLoadFilterFn& filter_fn) {
+        const ProfileCompilationInfo::ProfileLoadFilterFn& filter_fn,
+        size_t num_jobs) {
   std::string error;
 
   ScopedFlockList profile_files_list(profile_files.size());
@@ -171,7 +250,8 @@ ProfileAssistant::ProcessingResult ProfileAssistant::ProcessProfiles(
 
   return ProcessProfilesInternal(profile_files_list.Get(),
                                  locked_reference_profile_file,
-                                 filter_fn);
+                                 filter_fn,
+                                 num_jobs);
 }
 
 }  // namespace art
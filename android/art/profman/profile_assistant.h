@@ -51,23 +51,42 @@ class ProfileAssistant {
   // merge of the current profiles and the reference one is insignificant. In
   // this case no file will be updated.
   //
+  // With num_jobs > 1 the current profiles are loaded and merged on that many
+  // threads. The result is the same as with a single thread.
+  //
   static ProcessingResult ProcessProfiles(
       const std::vector<std::string>& profile_files,
       const std::string& reference_profile_file,
       const ProfileCompilationInfo::ProfileLoadFilterFn& filter_fn
-          = ProfileCompilationInfo::ProfileFilterFnAcceptAll);
+          = ProfileCompilationInfo::ProfileFilterFnAcceptAll,
+      size_t num_jobs = 1);
 
   static ProcessingResult ProcessProfiles(
       const std::vector<int>& profile_files_fd_,
       int reference_profile_file_fd,
       const ProfileCompilationInfo::ProfileLoadFilterFn& filter_fn
-          = ProfileCompilationInfo::ProfileFilterFnAcceptAll);
+          = ProfileCompilationInfo::ProfileFilterFnAcceptAll,
+      size_t num_jobs = 1);
+
+  // Load the profiles in `profile_fds` and merge them into `info`, in order, on
+  // `num_jobs` threads.
+  //
+  // Each thread merges a contiguous range of the profiles, loading them one at a
+  // time, and the partial results are then merged pairwise in a tree. Merging is
+  // associative and keeps the order in which dex files are first seen, so `info`
+  // ends up identical, and is saved byte for byte the same, as after merging the
+  // profiles one after the other.
+  static bool MergeProfiles(const std::vector<int>& profile_fds,
+                            const ProfileCompilationInfo::ProfileLoadFilterFn& filter_fn,
+                            size_t num_jobs,
+                            ProfileCompilationInfo* info);
 
  private:
   static ProcessingResult ProcessProfilesInternal(
       const std::vector<ScopedFlock>& profile_files,
       const ScopedFlock& reference_profile_file,
-      const ProfileCompilationInfo::ProfileLoadFilterFn& filter_fn);
+      const ProfileCompilationInfo::ProfileLoadFilterFn& filter_fn,
+      size_t num_jobs);
 
   DISALLOW_COPY_AND_ASSIGN(ProfileAssistant);
 };
@@ -15,6 +15,7 @@
  */
 
 #include <gtest/gtest.h>
+#include <sstream>
 
 #include "android-base/strings.h"
 #include "art_method-inl.h"
@@ -207,10 +208,13 @@ class ProfileAssistantTest : public CommonRuntimeTest {
   }
 
   // Runs test with given arguments.
-  int ProcessProfiles(const std::vector<int>& profiles_fd, int reference_profile_fd) {
+  int ProcessProfiles(const std::vector<int>& profiles_fd,
+                      int reference_profile_fd,
+                      const std::vector<std::string>& extra_args = std::vector<std::string>()) {
     std::string profman_cmd = GetProfmanCmd();
     std::vector<std::string> argv_str;
     argv_str.push_back(profman_cmd);
+    argv_str.insert(argv_str.end(), extra_args.begin(), extra_args.end());
     for (size_t k = 0; k < profiles_fd.size(); k++) {
       argv_str.push_back("--profile-file-fd=" + std::to_string(profiles_fd[k]));
     }
@@ -841,6 +845,110 @@ TEST_F(ProfileAssistantTest, TestBootImageProfile) {
       << output_file_contents;
 }
 
+TEST_F(ProfileAssistantTest, TestDeobfuscationProfile) {
+  const std::string core_dex = GetLibCoreDexFileNames()[0];
+  // A deobfuscated method with many callers.
+  const std::string kDeobfuscatedMethod = "Ljava/lang/Math;->max(II)I";
+  // A deobfuscated class initializer, which initializes its own class.
+  const std::string kDeobfuscatedInitializer = "Ljava/lang/Integer;-><clinit>()V";
+  // A method of the existing profile of the app.
+  const std::string kProfileMethod = "Ljava/util/HashMap;-><init>()V";
+
+  ScratchFile methods_file;
+  std::string methods = "# Deobfuscated methods\n" +
+      kDeobfuscatedMethod + "\n" +
+      kDeobfuscatedInitializer + "\n" +
+      "Ldoesnt/match/this/one;->foo()V\n";
+  ASSERT_TRUE(methods_file.GetFile()->WriteFully(methods.c_str(), methods.length()));
+  ASSERT_EQ(0, methods_file.GetFile()->Flush());
+  ScratchFile app_profile;
+  EXPECT_TRUE(CreateProfile("P" + kProfileMethod, app_profile.GetFilename(), core_dex));
+
+  ScratchFile out_profile;
+  std::vector<std::string> args;
+  args.push_back(GetProfmanCmd());
+  args.push_back("--create-profile-from-deobfuscated=" + methods_file.GetFilename());
+  args.push_back("--profile-file=" + app_profile.GetFilename());
+  args.push_back("--reference-profile-file=" + out_profile.GetFilename());
+  args.push_back("--apk=" + core_dex);
+  args.push_back("--dex-location=" + core_dex);
+  std::string error;
+  EXPECT_EQ(ExecAndReturnCode(args, &error), 0) << error;
+  ASSERT_EQ(0, out_profile.GetFile()->Flush());
+  ASSERT_TRUE(out_profile.GetFile()->ResetOffset());
+
+  std::string output_file_contents;
+  EXPECT_TRUE(DumpClassesAndMethods(out_profile.GetFilename(), &output_file_contents));
+  EXPECT_NE(output_file_contents.find("H" + kDeobfuscatedMethod), std::string::npos)
+      << output_file_contents;
+  EXPECT_NE(output_file_contents.find("HS" + kDeobfuscatedInitializer), std::string::npos)
+      << output_file_contents;
+  EXPECT_NE(output_file_contents.find("Ljava/lang/Integer;\n"), std::string::npos)
+      << output_file_contents;
+  EXPECT_NE(output_file_contents.find("P" + kProfileMethod), std::string::npos)
+      << output_file_contents;
+  // The callers of Math.max are hot too.
+  size_t hot_methods = 0;
+  std::istringstream output_stream(output_file_contents);
+  for (std::string line; std::getline(output_stream, line);) {
+    if (android::base::StartsWith(line, "H")) {
+      ++hot_methods;
+    }
+  }
+  EXPECT_GT(hot_methods, 2u) << output_file_contents;
+}
+
+TEST_F(ProfileAssistantTest, TestDeobfuscationProfileEntryPoints) {
+  const std::string core_dex = GetLibCoreDexFileNames()[0];
+  // ArrayList.toArray() invokes Arrays.copyOf.
+  const std::string kEntryPointMethod = "Ljava/util/ArrayList;->toArray()[Ljava/lang/Object;";
+  const std::string kReachableMethod =
+      "Ljava/util/Arrays;->copyOf([Ljava/lang/Object;I)[Ljava/lang/Object;";
+
+  ScratchFile methods_file;
+  std::string methods = "Ljava/lang/Math;->max(II)I\n";
+  ASSERT_TRUE(methods_file.GetFile()->WriteFully(methods.c_str(), methods.length()));
+  ASSERT_EQ(0, methods_file.GetFile()->Flush());
+  ScratchFile entry_points_file;
+  std::string entry_points = "# Manifest entry points\njava.util.ArrayList\nLdoesnt/Exist;\n";
+  ASSERT_TRUE(entry_points_file.GetFile()->WriteFully(entry_points.c_str(),
+                                                      entry_points.length()));
+  ASSERT_EQ(0, entry_points_file.GetFile()->Flush());
+
+  auto create_profile = [&](uint32_t depth, std::string* output_file_contents) {
+    ScratchFile out_profile;
+    std::vector<std::string> args;
+    args.push_back(GetProfmanCmd());
+    args.push_back("--create-profile-from-deobfuscated=" + methods_file.GetFilename());
+    args.push_back("--deobfuscated-skip-callers");
+    args.push_back("--deobfuscated-entry-points=" + entry_points_file.GetFilename());
+    args.push_back("--deobfuscated-entry-point-depth=" + std::to_string(depth));
+    args.push_back("--reference-profile-file=" + out_profile.GetFilename());
+    args.push_back("--apk=" + core_dex);
+    args.push_back("--dex-location=" + core_dex);
+    std::string error;
+    EXPECT_EQ(ExecAndReturnCode(args, &error), 0) << error;
+    ASSERT_EQ(0, out_profile.GetFile()->Flush());
+    EXPECT_TRUE(DumpClassesAndMethods(out_profile.GetFilename(), output_file_contents));
+  };
+
+  std::string output_file_contents;
+  create_profile(/* depth */ 0u, &output_file_contents);
+  EXPECT_NE(output_file_contents.find("S" + kEntryPointMethod), std::string::npos)
+      << output_file_contents;
+  EXPECT_NE(output_file_contents.find("Ljava/util/ArrayList;\n"), std::string::npos)
+      << output_file_contents;
+  EXPECT_EQ(output_file_contents.find(kReachableMethod), std::string::npos)
+      << output_file_contents;
+
+  create_profile(/* depth */ 1u, &output_file_contents);
+  EXPECT_NE(output_file_contents.find("S" + kReachableMethod), std::string::npos)
+      << output_file_contents;
+  // The class of the invoked static method is initialized at startup too.
+  EXPECT_NE(output_file_contents.find("Ljava/util/Arrays;\n"), std::string::npos)
+      << output_file_contents;
+}
+
 TEST_F(ProfileAssistantTest, TestProfileCreationOneNotMatched) {
   // Class names put here need to be in sorted order.
   std::vector<std::string> class_names = {
@@ -1028,6 +1136,43 @@ TEST_F(ProfileAssistantTest, MergeProfilesWithDifferentDexOrder) {
   CheckProfileInfo(profile1, info1);
 }
 
+TEST_F(ProfileAssistantTest, ParallelMergeIsIdenticalToSerialMerge) {
+  const size_t kNumberOfProfiles = 7;
+  std::vector<std::unique_ptr<ScratchFile>> profiles;
+  std::vector<int> profile_fds;
+  for (size_t i = 0; i < kNumberOfProfiles; i++) {
+    profiles.emplace_back(new ScratchFile());
+    profile_fds.push_back(GetFd(*profiles.back()));
+    // Share dex files between profiles and add them in different orders so that the
+    // profile indexes of the merged profile depend on the order of the merges.
+    std::string id = "p" + std::to_string(i % 3);
+    ProfileCompilationInfo info;
+    SetupProfile(id, i % 3 + 1, /* number_of_methods */ 50, /* number_of_classes */ i,
+        *profiles.back(), &info, /* start_method_index */ 20 * i,
+        /* reverse_dex_write_order */ (i % 2) == 0);
+  }
+
+  ScratchFile serial_profile;
+  ScratchFile parallel_profile;
+  ASSERT_EQ(ProfileAssistant::kCompile,
+            ProcessProfiles(profile_fds, GetFd(serial_profile)));
+  for (const std::unique_ptr<ScratchFile>& profile : profiles) {
+    ASSERT_TRUE(profile->GetFile()->ResetOffset());
+  }
+  ASSERT_EQ(ProfileAssistant::kCompile,
+            ProcessProfiles(profile_fds, GetFd(parallel_profile), {"--jobs=3"}));
+
+  // The output must be byte for byte the same.
+  int64_t length = serial_profile.GetFile()->GetLength();
+  ASSERT_GT(length, 0);
+  ASSERT_EQ(length, parallel_profile.GetFile()->GetLength());
+  std::unique_ptr<char[]> serial_buf(new char[length]);
+  std::unique_ptr<char[]> parallel_buf(new char[length]);
+  ASSERT_EQ(length, serial_profile.GetFile()->Read(serial_buf.get(), length, 0));
+  ASSERT_EQ(length, parallel_profile.GetFile()->Read(parallel_buf.get(), length, 0));
+  ASSERT_EQ(0, memcmp(serial_buf.get(), parallel_buf.get(), length));
+}
+
 TEST_F(ProfileAssistantTest, TestProfileCreateWithInvalidData) {
   // Create the profile content.
   std::vector<std::string> profile_methods = {
@@ -22,10 +22,13 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <set>
 #include <string>
+#include <thread>
 #include <unordered_set>
 #include <vector>
 
@@ -41,9 +44,11 @@
 #include "base/unix_file/fd_file.h"
 #include "base/utils.h"
 #include "boot_image_profile.h"
+#include "deobfuscation_profile.h"
 #include "dex/art_dex_file_loader.h"
 #include "dex/bytecode_utils.h"
 #include "dex/code_item_accessors-inl.h"
+#include "dex/descriptors_names.h"
 #include "dex/dex_file.h"
 #include "dex/dex_file_loader.h"
 #include "dex/dex_file_types.h"
@@ -156,6 +161,29 @@ NO_RETURN static void Usage(const char *fmt, ...) {
   UsageError("      the file passed with --profile-fd(file) to the profile passed with");
   UsageError("      --reference-profile-fd(file) and update at the same time the profile-key");
   UsageError("      of entries corresponding to the apks passed with --apk(-fd).");
+  UsageError("  --create-profile-from-deobfuscated=<filename>: creates a profile marking hot the");
+  UsageError("      methods listed in the file, one per line (e.g. LFoo;->bar(I)V), and the");
+  UsageError("      methods invoking them. The classes which their class initializers store");
+  UsageError("      static fields of are added as startup classes. The profiles passed with");
+  UsageError("      --profile-file(-fd) are merged into the result, which is written to the");
+  UsageError("      --reference-profile-file(-fd).");
+  UsageError("  --deobfuscated-skip-callers: do not mark the callers of the methods listed in");
+  UsageError("      --create-profile-from-deobfuscated hot.");
+  UsageError("  --deobfuscated-entry-points=<filename>: with --create-profile-from-deobfuscated,");
+  UsageError("      mark the methods reachable from the classes listed in the file, one per line");
+  UsageError("      (e.g. Lcom/example/MainActivity; or com.example.MainActivity), as startup");
+  UsageError("      methods and add their classes to the profile. Typically the application,");
+  UsageError("      activities, services, receivers and providers of the manifest.");
+  UsageError("  --deobfuscated-entry-point-depth=<number>: how many calls away from the methods");
+  UsageError("      of an entry point class a method is still marked startup. Default is 3.");
+  UsageError("  --compact-profile: write the profile created with --create-profile-from,");
+  UsageError("      --create-profile-from-deobfuscated or --generate-boot-image-profile in the");
+  UsageError("      compact format, which is larger but only the data of the dex files that are");
+  UsageError("      needed is read when loading it.");
+  UsageError("");
+  UsageError("  --jobs=<number>: number of threads used to load and merge the profiles passed");
+  UsageError("      with --profile-file(-fd). The output is the same as with a single thread.");
+  UsageError("      Defaults to 1.");
   UsageError("");
 
   exit(EXIT_FAILURE);
@@ -194,7 +222,9 @@ class ProfMan FINAL {
       test_profile_class_percentage_(kDefaultTestProfileClassPercentage),
       test_profile_seed_(NanoTime()),
       start_ns_(NanoTime()),
-      copy_and_update_profile_key_(false) {}
+      copy_and_update_profile_key_(false),
+      compact_profile_(false),
+      num_jobs_(1u) {}
 
   ~ProfMan() {
     LogCompletionTime();
@@ -246,6 +276,11 @@ class ProfMan FINAL {
                         "--boot-image-sampled-method-threshold",
                         &boot_image_options_.compiled_method_threshold,
                         Usage);
+      } else if (option.starts_with("--jobs=")) {
+        ParseUintOption(option, "--jobs", &num_jobs_, Usage);
+        if (num_jobs_ == 0u) {
+          Usage("--jobs must be at least 1");
+        }
       } else if (option.starts_with("--profile-file=")) {
         profile_files_.push_back(option.substr(strlen("--profile-file=")).ToString());
       } else if (option.starts_with("--profile-file-fd=")) {
@@ -281,6 +316,21 @@ class ProfMan FINAL {
         ParseUintOption(option, "--generate-test-profile-seed", &test_profile_seed_, Usage);
       } else if (option.starts_with("--copy-and-update-profile-key")) {
         copy_and_update_profile_key_ = true;
+      } else if (option.starts_with("--create-profile-from-deobfuscated=")) {
+        create_profile_from_deobfuscated_file_ =
+            option.substr(strlen("--create-profile-from-deobfuscated=")).ToString();
+      } else if (option == "--deobfuscated-skip-callers") {
+        deobfuscation_options_.include_callers = false;
+      } else if (option.starts_with("--deobfuscated-entry-points=")) {
+        deobfuscated_entry_points_file_ =
+            option.substr(strlen("--deobfuscated-entry-points=")).ToString();
+      } else if (option.starts_with("--deobfuscated-entry-point-depth=")) {
+        ParseUintOption(option,
+                        "--deobfuscated-entry-point-depth",
+                        &deobfuscation_options_.entry_point_depth,
+                        Usage);
+      } else if (option == "--compact-profile") {
+        compact_profile_ = true;
       } else {
         Usage("Unknown argument '%s'", option.data());
       }
@@ -357,12 +407,14 @@ class ProfMan FINAL {
       File file(reference_profile_file_fd_, false);
       result = ProfileAssistant::ProcessProfiles(profile_files_fd_,
                                                  reference_profile_file_fd_,
-                                                 filter_fn);
+                                                 filter_fn,
+                                                 num_jobs_);
       CloseAllFds(profile_files_fd_, "profile_files_fd_");
     } else {
       result = ProfileAssistant::ProcessProfiles(profile_files_,
                                                  reference_profile_file_,
-                                                 filter_fn);
+                                                 filter_fn,
+                                                 num_jobs_);
     }
     return result;
   }
@@ -486,6 +538,42 @@ class ProfMan FINAL {
     return info;
   }
 
+  // Load the profiles passed with --profile-file-fd and --profile-file, in that order,
+  // on num_jobs_ threads.
+  bool LoadProfiles(/*out*/ std::vector<std::unique_ptr<const ProfileCompilationInfo>>* profiles) {
+    size_t num_profiles = profile_files_fd_.size() + profile_files_.size();
+    profiles->resize(num_profiles);
+    auto load = [&](size_t i) {
+      (*profiles)[i] = (i < profile_files_fd_.size())
+          ? LoadProfile("", profile_files_fd_[i])
+          : LoadProfile(profile_files_[i - profile_files_fd_.size()], kInvalidFd);
+    };
+    size_t num_threads = std::min<size_t>(num_jobs_, num_profiles);
+    if (num_threads <= 1u) {
+      for (size_t i = 0; i != num_profiles; ++i) {
+        load(i);
+      }
+    } else {
+      std::vector<std::thread> threads;
+      threads.reserve(num_threads);
+      for (size_t t = 0; t != num_threads; ++t) {
+        threads.emplace_back([&, t]() {
+          for (size_t i = t; i < num_profiles; i += num_threads) {
+            load(i);
+          }
+        });
+      }
+      for (std::thread& thread : threads) {
+        thread.join();
+      }
+    }
+    return std::all_of(profiles->begin(),
+                       profiles->end(),
+                       [](const std::unique_ptr<const ProfileCompilationInfo>& profile) {
+                         return profile != nullptr;
+                       });
+  }
+
   int DumpOneProfile(const std::string& banner,
                      const std::string& filename,
                      int fd,
@@ -1066,7 +1154,7 @@ class ProfMan FINAL {
     }
 
     // Write the profile file.
-    CHECK(info.Save(fd));
+    CHECK(compact_profile_ ? info.SaveCompact(fd) : info.Save(fd));
     if (close(fd) < 0) {
       PLOG(WARNING) << "Failed to close descriptor";
     }
@@ -1093,23 +1181,8 @@ class ProfMan FINAL {
     }
     // Open the input profiles.
     std::vector<std::unique_ptr<const ProfileCompilationInfo>> profiles;
-    if (!profile_files_fd_.empty()) {
-      for (int profile_file_fd : profile_files_fd_) {
-        std::unique_ptr<const ProfileCompilationInfo> profile(LoadProfile("", profile_file_fd));
-        if (profile == nullptr) {
-          return -3;
-        }
-        profiles.emplace_back(std::move(profile));
-      }
-    }
-    if (!profile_files_.empty()) {
-      for (const std::string& profile_file : profile_files_) {
-        std::unique_ptr<const ProfileCompilationInfo> profile(LoadProfile(profile_file, kInvalidFd));
-        if (profile == nullptr) {
-          return -4;
-        }
-        profiles.emplace_back(std::move(profile));
-      }
+    if (!LoadProfiles(&profiles)) {
+      return -3;
     }
     ProfileCompilationInfo out_profile;
     GenerateBootImageProfile(dex_files,
@@ -1117,7 +1190,11 @@ class ProfMan FINAL {
                              boot_image_options_,
                              VLOG_IS_ON(profiler),
                              &out_profile);
-    out_profile.Save(reference_fd);
+    if (compact_profile_) {
+      out_profile.SaveCompact(reference_fd);
+    } else {
+      out_profile.Save(reference_fd);
+    }
     close(reference_fd);
     return 0;
   }
@@ -1126,6 +1203,112 @@ class ProfMan FINAL {
     return !create_profile_from_file_.empty();
   }
 
+  // Creates a profile from the list of methods rewritten by a deobfuscator.
+  // The expected input format is one method per line, as for --create-profile-from
+  // but without flags or inline caches:
+  //   # Methods without opaque predicates
+  //   Lcom/example/Foo;->bar(I)V
+  //   Lcom/example/Foo;-><clinit>()V
+  // Methods which cannot be found in the dex files are skipped. The optional entry points
+  // file lists one class per line, as a descriptor or a dotted class name:
+  //   Lcom/example/MainActivity;
+  //   com.example.App
+  int CreateDeobfuscationProfile() {
+    // Validate parameters for this command.
+    if (apk_files_.empty() && apks_fd_.empty()) {
+      Usage("APK files must be specified");
+    }
+    if (dex_locations_.empty()) {
+      Usage("DEX locations must be specified");
+    }
+    if (reference_profile_file_.empty() && !FdIsValid(reference_profile_file_fd_)) {
+      Usage("Reference profile must be specified with --reference-profile-file or "
+            "--reference-profile-file-fd");
+    }
+    std::unique_ptr<std::set<std::string>> lines(ReadCommentedInputFromFile<std::set<std::string>>(
+        create_profile_from_deobfuscated_file_.c_str(), nullptr));  // No post-processing.
+    if (lines == nullptr) {
+      return -1;
+    }
+    std::vector<std::unique_ptr<const DexFile>> dex_files;
+    OpenApkFilesFromLocations(&dex_files);
+
+    std::vector<MethodReference> methods;
+    for (const std::string& line : *lines) {
+      const size_t method_sep_index = line.find(kMethodSep, 0);
+      if (method_sep_index == std::string::npos) {
+        LOG(WARNING) << "Invalid method line: " << line;
+        continue;
+      }
+      TypeReference class_ref(/* dex_file */ nullptr, dex::TypeIndex());
+      if (!FindClass(dex_files, line.substr(0, method_sep_index), &class_ref)) {
+        LOG(WARNING) << "Could not find class: " << line.substr(0, method_sep_index);
+        continue;
+      }
+      uint32_t method_index =
+          FindMethodIndex(class_ref, line.substr(method_sep_index + kMethodSep.size()));
+      if (method_index != dex::kDexNoIndex) {
+        methods.push_back(MethodReference(class_ref.dex_file, method_index));
+      }
+    }
+
+    std::vector<TypeReference> entry_points;
+    if (!deobfuscated_entry_points_file_.empty()) {
+      std::unique_ptr<std::set<std::string>> classes(
+          ReadCommentedInputFromFile<std::set<std::string>>(
+              deobfuscated_entry_points_file_.c_str(), nullptr));  // No post-processing.
+      if (classes == nullptr) {
+        return -1;
+      }
+      for (const std::string& klass : *classes) {
+        const std::string descriptor =
+            android::base::EndsWith(klass, ";") ? klass : DotToDescriptor(klass.c_str());
+        TypeReference class_ref(/* dex_file */ nullptr, dex::TypeIndex());
+        if (descriptor == kInvalidClassDescriptor ||
+            !FindClass(dex_files, descriptor, &class_ref)) {
+          LOG(WARNING) << "Could not find entry point class: " << klass;
+          continue;
+        }
+        entry_points.push_back(class_ref);
+      }
+    }
+
+    ProfileCompilationInfo out_profile;
+    GenerateDeobfuscationProfile(dex_files,
+                                 methods,
+                                 entry_points,
+                                 deobfuscation_options_,
+                                 VLOG_IS_ON(profiler),
+                                 &out_profile);
+    // Keep the existing profile information of the app.
+    if (!ProfileAssistant::MergeProfiles(profile_files_fd_,
+                                         ProfileCompilationInfo::ProfileFilterFnAcceptAll,
+                                         num_jobs_,
+                                         &out_profile)) {
+      return -2;
+    }
+    for (const std::string& profile_file : profile_files_) {
+      std::unique_ptr<const ProfileCompilationInfo> profile(LoadProfile(profile_file, kInvalidFd));
+      if (profile == nullptr || !out_profile.MergeWith(*profile)) {
+        return -2;
+      }
+    }
+
+    int fd = OpenReferenceProfile();
+    if (!FdIsValid(fd)) {
+      return -1;
+    }
+    bool result = compact_profile_ ? out_profile.SaveCompact(fd) : out_profile.Save(fd);
+    if (close(fd) < 0) {
+      PLOG(WARNING) << "Failed to close descriptor";
+    }
+    return result ? 0 : -3;
+  }
+
+  bool ShouldCreateDeobfuscationProfile() const {
+    return !create_profile_from_deobfuscated_file_.empty();
+  }
+
   int GenerateTestProfile() {
     // Validate parameters for this command.
     if (test_profile_method_percerntage_ > 100) {
@@ -1259,12 +1442,17 @@ class ProfMan FINAL {
   BootImageOptions boot_image_options_;
   std::string test_profile_;
   std::string create_profile_from_file_;
+  std::string create_profile_from_deobfuscated_file_;
+  std::string deobfuscated_entry_points_file_;
+  DeobfuscationProfileOptions deobfuscation_options_;
   uint16_t test_profile_num_dex_;
   uint16_t test_profile_method_percerntage_;
   uint16_t test_profile_class_percentage_;
   uint32_t test_profile_seed_;
   uint64_t start_ns_;
   bool copy_and_update_profile_key_;
+  bool compact_profile_;
+  uint32_t num_jobs_;
 };
 
 // See ProfileAssistant::ProcessingResult for return codes.
@@ -1294,6 +1482,10 @@ static int profman(int argc, char** argv) {
     return profman.CreateBootProfile();
   }
 
+  if (profman.ShouldCreateDeobfuscationProfile()) {
+    return profman.CreateDeobfuscationProfile();
+  }
+
   if (profman.ShouldCopyAndUpdateProfileKey()) {
     return profman.CopyAndUpdateProfileKey();
   }
@@ -26,6 +26,7 @@
 #include <android-base/logging.h>
 
 #include "base/systrace.h"
+#include "base/utils.h"
 #include "mem_map.h"
 #include "mutex.h"
 #include "thread-current-inl.h"
@@ -189,9 +190,24 @@ void ArenaAllocatorMemoryTool::DoMakeInaccessible(void* ptr, size_t size) {
 Arena::Arena() : bytes_allocated_(0), memory_(nullptr), size_(0), next_(nullptr) {
 }
 
+// Ask for transparent huge pages for the whole pages in [begin, begin + size). This is only
+// a hint, so failures (e.g. THP disabled in the kernel) are ignored.
+static void AdviseHugePages(uint8_t* begin, size_t size) {
+#ifdef MADV_HUGEPAGE
+  uint8_t* aligned_begin = AlignUp(begin, kPageSize);
+  uint8_t* aligned_end = AlignDown(begin + size, kPageSize);
+  if (aligned_begin < aligned_end) {
+    madvise(aligned_begin, aligned_end - aligned_begin, MADV_HUGEPAGE);
+  }
+#else
+  UNUSED(begin, size);
+#endif
+}
+
 class MallocArena FINAL : public Arena {
  public:
-  explicit MallocArena(size_t size = arena_allocator::kArenaDefaultSize);
+  explicit MallocArena(size_t size = arena_allocator::kArenaDefaultSize,
+                       bool use_huge_pages = false);
   virtual ~MallocArena();
  private:
   static constexpr size_t RequiredOverallocation() {
@@ -203,7 +219,7 @@ class MallocArena FINAL : public Arena {
   uint8_t* unaligned_memory_;
 };
 
-MallocArena::MallocArena(size_t size) {
+MallocArena::MallocArena(size_t size, bool use_huge_pages) {
   // We need to guarantee kArenaAlignment aligned allocation for the new arena.
   // TODO: Use std::aligned_alloc() when it becomes available with C++17.
   constexpr size_t overallocation = RequiredOverallocation();
@@ -223,6 +239,9 @@ MallocArena::MallocArena(size_t size) {
   }
   DCHECK_ALIGNED(memory_, ArenaAllocator::kArenaAlignment);
   size_ = size;
+  if (use_huge_pages) {
+    AdviseHugePages(memory_, size_);
+  }
 }
 
 MallocArena::~MallocArena() {
@@ -238,7 +257,7 @@ MallocArena::~MallocArena() {
 
 class MemMapArena FINAL : public Arena {
  public:
-  MemMapArena(size_t size, bool low_4gb, const char* name);
+  MemMapArena(size_t size, bool low_4gb, const char* name, bool use_huge_pages);
   virtual ~MemMapArena();
   void Release() OVERRIDE;
 
@@ -246,10 +265,11 @@ class MemMapArena FINAL : public Arena {
   std::unique_ptr<MemMap> map_;
 };
 
-MemMapArena::MemMapArena(size_t size, bool low_4gb, const char* name) {
+MemMapArena::MemMapArena(size_t size, bool low_4gb, const char* name, bool use_huge_pages) {
   // Round up to a full page as that's the smallest unit of allocation for mmap()
-  // and we want to be able to use all memory that we actually allocate.
-  size = RoundUp(size, kPageSize);
+  // and we want to be able to use all memory that we actually allocate. Huge page
+  // backed arenas are rounded up to a full huge page for the same reason.
+  size = RoundUp(size, use_huge_pages ? ArenaPool::kHugePageArenaSize : kPageSize);
   std::string error_msg;
   map_.reset(MemMap::MapAnonymous(
       name, nullptr, size, PROT_READ | PROT_WRITE, low_4gb, false, &error_msg));
@@ -259,6 +279,9 @@ MemMapArena::MemMapArena(size_t size, bool low_4gb, const char* name) {
                 "Arena should not need stronger alignment than kPageSize.");
   DCHECK_ALIGNED(memory_, ArenaAllocator::kArenaAlignment);
   size_ = map_->Size();
+  if (use_huge_pages) {
+    AdviseHugePages(memory_, size_);
+  }
 }
 
 MemMapArena::~MemMapArena() {
@@ -279,12 +302,100 @@ void Arena::Reset() {
   }
 }
 
-ArenaPool::ArenaPool(bool use_malloc, bool low_4gb, const char* name)
+// A small stack of free arenas used by the threads that map to it. Its lock is only contended
+// by threads whose ids collide modulo ArenaPool::kNumThreadCaches. Its lock level is below the
+// pool's, so ReclaimMemory() can drain the caches while LockReclaimMemory() holds the pool lock.
+class ArenaPool::ThreadCache {
+ public:
+  static constexpr size_t kCapacity = 8u;
+
+  ThreadCache()
+      : lock_("Arena pool thread cache lock", kArenaPoolThreadCacheLock),
+        size_(0u),
+        low_water_mark_(0u) {}
+
+  Arena* Pop(Thread* self, size_t size) REQUIRES(!lock_) {
+    MutexLock lock(self, lock_);
+    if (size_ == 0u || UNLIKELY(arenas_[size_ - 1u]->Size() < size)) {
+      return nullptr;
+    }
+    --size_;
+    low_water_mark_ = std::min(low_water_mark_, size_);
+    return arenas_[size_];
+  }
+
+  // Keep as many arenas from the chain as fit, return the rest of the chain.
+  Arena* Push(Thread* self, Arena* first) REQUIRES(!lock_) {
+    MutexLock lock(self, lock_);
+    while (first != nullptr && size_ != kCapacity) {
+      arenas_[size_] = first;
+      ++size_;
+      first = first->next_;
+      arenas_[size_ - 1u]->next_ = nullptr;
+    }
+    return first;
+  }
+
+  // Remove arenas that were not used since the last call, return them as a chain.
+  Arena* Trim(Thread* self) REQUIRES(!lock_) {
+    MutexLock lock(self, lock_);
+    // The arenas at the bottom of the stack are the ones that were not touched.
+    size_t num_unused = low_water_mark_;
+    Arena* chain = nullptr;
+    for (size_t i = 0; i != num_unused; ++i) {
+      arenas_[i]->next_ = chain;
+      chain = arenas_[i];
+    }
+    std::copy(arenas_ + num_unused, arenas_ + size_, arenas_);
+    size_ -= num_unused;
+    low_water_mark_ = size_;
+    return chain;
+  }
+
+  // Remove all arenas, return them as a chain.
+  Arena* Drain(Thread* self) REQUIRES(!lock_) {
+    MutexLock lock(self, lock_);
+    Arena* chain = nullptr;
+    for (size_t i = 0; i != size_; ++i) {
+      arenas_[i]->next_ = chain;
+      chain = arenas_[i];
+    }
+    size_ = 0u;
+    low_water_mark_ = 0u;
+    return chain;
+  }
+
+  template <typename Visitor>
+  void VisitArenas(Thread* self, const Visitor& visitor) REQUIRES(!lock_) {
+    MutexLock lock(self, lock_);
+    for (size_t i = 0; i != size_; ++i) {
+      visitor(arenas_[i]);
+    }
+  }
+
+ private:
+  Mutex lock_;
+  Arena* arenas_[kCapacity] GUARDED_BY(lock_);
+  size_t size_ GUARDED_BY(lock_);
+  size_t low_water_mark_ GUARDED_BY(lock_);
+
+  DISALLOW_COPY_AND_ASSIGN(ThreadCache);
+};
+
+ArenaPool::ArenaPool(bool use_malloc,
+                     bool low_4gb,
+                     const char* name,
+                     bool use_thread_caches,
+                     bool use_huge_pages)
     : use_malloc_(use_malloc),
       lock_("Arena pool lock", kArenaPoolLock),
       free_arenas_(nullptr),
+      free_bytes_(0u),
+      free_bytes_low_water_mark_(0u),
       low_4gb_(low_4gb),
-      name_(name) {
+      name_(name),
+      use_huge_pages_(use_huge_pages),
+      thread_caches_(use_thread_caches ? new ThreadCache[kNumThreadCaches] : nullptr) {
   if (low_4gb) {
     CHECK(!use_malloc) << "low4gb must use map implementation";
   }
@@ -298,11 +409,24 @@ ArenaPool::~ArenaPool() {
 }
 
 void ArenaPool::ReclaimMemory() {
+  if (thread_caches_ != nullptr) {
+    Thread* self = Thread::Current();
+    for (size_t i = 0; i != kNumThreadCaches; ++i) {
+      Arena* arena = thread_caches_[i].Drain(self);
+      while (arena != nullptr) {
+        Arena* next = arena->next_;
+        delete arena;
+        arena = next;
+      }
+    }
+  }
   while (free_arenas_ != nullptr) {
     Arena* arena = free_arenas_;
     free_arenas_ = free_arenas_->next_;
     delete arena;
   }
+  free_bytes_ = 0u;
+  free_bytes_low_water_mark_ = 0u;
 }
 
 void ArenaPool::LockReclaimMemory() {
@@ -310,19 +434,37 @@ void ArenaPool::LockReclaimMemory() {
   ReclaimMemory();
 }
 
+ArenaPool::ThreadCache* ArenaPool::GetThreadCache() const {
+  DCHECK(thread_caches_ != nullptr);
+  Thread* self = Thread::Current();
+  pid_t tid = (self != nullptr) ? self->GetTid() : GetTid();
+  return &thread_caches_[static_cast<size_t>(tid) % kNumThreadCaches];
+}
+
+Arena* ArenaPool::NewArena(size_t size) {
+  bool use_huge_pages = use_huge_pages_ && size >= kHugePageArenaSize;
+  return use_malloc_
+      ? static_cast<Arena*>(new MallocArena(size, use_huge_pages))
+      : new MemMapArena(size, low_4gb_, name_, use_huge_pages);
+}
+
 Arena* ArenaPool::AllocArena(size_t size) {
   Thread* self = Thread::Current();
   Arena* ret = nullptr;
-  {
+  if (thread_caches_ != nullptr) {
+    ret = GetThreadCache()->Pop(self, size);
+  }
+  if (ret == nullptr) {
     MutexLock lock(self, lock_);
     if (free_arenas_ != nullptr && LIKELY(free_arenas_->Size() >= size)) {
       ret = free_arenas_;
       free_arenas_ = free_arenas_->next_;
+      free_bytes_ -= ret->Size();
+      free_bytes_low_water_mark_ = std::min(free_bytes_low_water_mark_, free_bytes_);
     }
   }
   if (ret == nullptr) {
-    ret = use_malloc_ ? static_cast<Arena*>(new MallocArena(size)) :
-        new MemMapArena(size, low_4gb_, name_);
+    ret = NewArena(size);
   }
   ret->Reset();
   return ret;
@@ -332,16 +474,75 @@ void ArenaPool::TrimMaps() {
   if (!use_malloc_) {
     ScopedTrace trace(__PRETTY_FUNCTION__);
     // Doesn't work for malloc.
-    MutexLock lock(Thread::Current(), lock_);
+    Thread* self = Thread::Current();
+    if (thread_caches_ != nullptr) {
+      for (size_t i = 0; i != kNumThreadCaches; ++i) {
+        thread_caches_[i].VisitArenas(self, [](Arena* arena) { arena->Release(); });
+      }
+    }
+    MutexLock lock(self, lock_);
     for (Arena* arena = free_arenas_; arena != nullptr; arena = arena->next_) {
       arena->Release();
     }
   }
 }
 
+void ArenaPool::TrimToHighWaterMark() {
+  ScopedTrace trace(__PRETTY_FUNCTION__);
+  Thread* self = Thread::Current();
+  Arena* unused = nullptr;
+  if (thread_caches_ != nullptr) {
+    for (size_t i = 0; i != kNumThreadCaches; ++i) {
+      Arena* chain = thread_caches_[i].Trim(self);
+      while (chain != nullptr) {
+        Arena* next = chain->next_;
+        chain->next_ = unused;
+        unused = chain;
+        chain = next;
+      }
+    }
+  }
+  {
+    MutexLock lock(self, lock_);
+    // Arenas are reused from the front of the list, so the arenas that were not needed
+    // during the last window are at the back. Keep the ones that were needed.
+    size_t bytes_to_keep = free_bytes_ - free_bytes_low_water_mark_;
+    Arena** link = &free_arenas_;
+    size_t kept_bytes = 0u;
+    while (*link != nullptr && kept_bytes < bytes_to_keep) {
+      kept_bytes += (*link)->Size();
+      link = &(*link)->next_;
+    }
+    Arena* arena = *link;
+    *link = nullptr;
+    while (arena != nullptr) {
+      Arena* next = arena->next_;
+      arena->next_ = unused;
+      unused = arena;
+      arena = next;
+    }
+    free_bytes_ = kept_bytes;
+    free_bytes_low_water_mark_ = kept_bytes;
+  }
+  // Delete outside the lock.
+  while (unused != nullptr) {
+    Arena* next = unused->next_;
+    delete unused;
+    unused = next;
+  }
+}
+
 size_t ArenaPool::GetBytesAllocated() const {
   size_t total = 0;
-  MutexLock lock(Thread::Current(), lock_);
+  Thread* self = Thread::Current();
+  if (thread_caches_ != nullptr) {
+    for (size_t i = 0; i != kNumThreadCaches; ++i) {
+      thread_caches_[i].VisitArenas(self, [&total](Arena* arena) {
+        total += arena->GetBytesAllocated();
+      });
+    }
+  }
+  MutexLock lock(self, lock_);
   for (Arena* arena = free_arenas_; arena != nullptr; arena = arena->next_) {
     total += arena->GetBytesAllocated();
   }
@@ -365,15 +566,21 @@ void ArenaPool::FreeArenaChain(Arena* first) {
     return;
   }
 
+  Thread* self = Thread::Current();
+  if (thread_caches_ != nullptr && first != nullptr) {
+    first = GetThreadCache()->Push(self, first);
+  }
   if (first != nullptr) {
     Arena* last = first;
+    size_t bytes = first->Size();
     while (last->next_ != nullptr) {
       last = last->next_;
+      bytes += last->Size();
     }
-    Thread* self = Thread::Current();
     MutexLock lock(self, lock_);
     last->next_ = free_arenas_;
     free_arenas_ = first;
+    free_bytes_ += bytes;
   }
 }
 
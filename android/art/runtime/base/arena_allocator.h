@@ -20,9 +20,12 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <memory>
+
 #include "base/bit_utils.h"
 #include "base/debug_stack.h"
 #include "base/dchecked_vector.h"
+#include "base/globals.h"
 #include "base/macros.h"
 #include "base/memory_tool.h"
 #include "mutex.h"
@@ -249,9 +252,16 @@ class Arena {
 
 class ArenaPool {
  public:
+  // Arenas at least this big are backed by transparent huge pages if `use_huge_pages`.
+  static constexpr size_t kHugePageArenaSize = 2 * MB;
+
+  // If `use_thread_caches` is true, freed arenas are first kept in small per-thread caches
+  // so that threads which repeatedly create and destroy allocators do not contend on `lock_`.
   explicit ArenaPool(bool use_malloc = true,
                      bool low_4gb = false,
-                     const char* name = "LinearAlloc");
+                     const char* name = "LinearAlloc",
+                     bool use_thread_caches = false,
+                     bool use_huge_pages = false);
   ~ArenaPool();
   Arena* AllocArena(size_t size) REQUIRES(!lock_);
   void FreeArenaChain(Arena* first) REQUIRES(!lock_);
@@ -261,13 +271,29 @@ class ArenaPool {
   // Trim the maps in arenas by madvising, used by JIT to reduce memory usage. This only works
   // use_malloc is false.
   void TrimMaps() REQUIRES(!lock_);
+  // Free the arenas that stayed unused since the previous call, i.e. the free arenas above
+  // the high-water mark of arenas in use, and start a new measurement window.
+  void TrimToHighWaterMark() REQUIRES(!lock_);
 
  private:
+  class ThreadCache;
+
+  Arena* NewArena(size_t size);
+  ThreadCache* GetThreadCache() const;
+
+  static constexpr size_t kNumThreadCaches = 16u;
+
   const bool use_malloc_;
   mutable Mutex lock_ DEFAULT_MUTEX_ACQUIRED_AFTER;
   Arena* free_arenas_ GUARDED_BY(lock_);
+  // Total size of `free_arenas_` and its low-water mark since the last TrimToHighWaterMark().
+  size_t free_bytes_ GUARDED_BY(lock_);
+  size_t free_bytes_low_water_mark_ GUARDED_BY(lock_);
   const bool low_4gb_;
   const char* name_;
+  const bool use_huge_pages_;
+  // Indexed by thread id modulo kNumThreadCaches; null if thread caches are not used.
+  std::unique_ptr<ThreadCache[]> thread_caches_;
   DISALLOW_COPY_AND_ASSIGN(ArenaPool);
 };
 
@@ -14,9 +14,13 @@
  * limitations under the License.
  */
 
+#include <memory>
+#include <vector>
+
 #include "base/arena_allocator-inl.h"
 #include "base/arena_bit_vector.h"
 #include "base/memory_tool.h"
+#include "common_runtime_test.h"
 #include "gtest/gtest.h"
 
 namespace art {
@@ -132,6 +136,93 @@ TEST_F(ArenaAllocatorTest, LargeAllocations) {
   }
 }
 
+TEST_F(ArenaAllocatorTest, ThreadCacheReuse) {
+  if (arena_allocator::kArenaAllocatorPreciseTracking) {
+    printf("WARNING: TEST DISABLED FOR precise arena tracking\n");
+    return;
+  }
+
+  ArenaPool pool(/* use_malloc */ true,
+                 /* low_4gb */ false,
+                 "ThreadCacheReuse",
+                 /* use_thread_caches */ true);
+  void* alloc1;
+  {
+    ArenaAllocator allocator(&pool);
+    alloc1 = allocator.Alloc(16);
+  }
+  {
+    ArenaAllocator allocator(&pool);
+    void* alloc2 = allocator.Alloc(16);
+    ASSERT_EQ(alloc1, alloc2);
+  }
+}
+
+// Runs with an attached thread so that lock levels are checked on debug builds.
+class ArenaPoolRuntimeTest : public CommonRuntimeTest {};
+
+TEST_F(ArenaPoolRuntimeTest, LockReclaimMemoryWithThreadCaches) {
+  if (arena_allocator::kArenaAllocatorPreciseTracking) {
+    printf("WARNING: TEST DISABLED FOR precise arena tracking\n");
+    return;
+  }
+
+  ArenaPool pool(/* use_malloc */ true,
+                 /* low_4gb */ false,
+                 "LockReclaimMemoryWithThreadCaches",
+                 /* use_thread_caches */ true);
+  {
+    ArenaAllocator allocator(&pool);
+    allocator.Alloc(16);
+  }
+  ASSERT_NE(0u, pool.GetBytesAllocated());
+  // Drains the thread caches while holding the pool lock.
+  pool.LockReclaimMemory();
+  ASSERT_EQ(0u, pool.GetBytesAllocated());
+}
+
+TEST_F(ArenaAllocatorTest, TrimToHighWaterMark) {
+  if (arena_allocator::kArenaAllocatorPreciseTracking) {
+    printf("WARNING: TEST DISABLED FOR precise arena tracking\n");
+    return;
+  }
+
+  static constexpr size_t kNumAllocators = 20u;
+  for (bool use_thread_caches : { false, true }) {
+    ArenaPool pool(/* use_malloc */ true,
+                   /* low_4gb */ false,
+                   "TrimToHighWaterMark",
+                   use_thread_caches);
+    {
+      std::vector<std::unique_ptr<ArenaAllocator>> allocators;
+      for (size_t i = 0; i != kNumAllocators; ++i) {
+        allocators.emplace_back(new ArenaAllocator(&pool));
+        allocators.back()->Alloc(16);
+      }
+    }
+    size_t all_bytes = pool.GetBytesAllocated();
+    ASSERT_NE(0u, all_bytes);
+    ASSERT_EQ(0u, all_bytes % kNumAllocators);
+
+    // All arenas were used in the first window.
+    pool.TrimToHighWaterMark();
+    ASSERT_EQ(all_bytes, pool.GetBytesAllocated());
+
+    // Only one arena is used in the second window.
+    {
+      ArenaAllocator allocator(&pool);
+      allocator.Alloc(16);
+    }
+    ASSERT_EQ(all_bytes, pool.GetBytesAllocated());
+    pool.TrimToHighWaterMark();
+    ASSERT_EQ(all_bytes / kNumAllocators, pool.GetBytesAllocated());
+
+    // Nothing is used in the third window.
+    pool.TrimToHighWaterMark();
+    ASSERT_EQ(0u, pool.GetBytesAllocated());
+  }
+}
+
 TEST_F(ArenaAllocatorTest, AllocAlignment) {
   ArenaPool pool;
   ArenaAllocator allocator(&pool);
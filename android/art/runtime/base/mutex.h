@@ -86,6 +86,8 @@ enum LockLevel {
   kJitDebugInterfaceLock,
   kAllocSpaceLock,
   kBumpPointerSpaceBlockLock,
+  kDexVerificationCacheLock,
+  kArenaPoolThreadCacheLock,
   kArenaPoolLock,
   kInternTableLock,
   kOatFileSecondaryLookupLock,
@@ -30,6 +30,8 @@
 #include "dex/dex_file.h"
 #include "dex/dex_file_verifier.h"
 #include "dex/standard_dex_file.h"
+#include "dex_extraction_cache.h"
+#include "dex_verification_cache.h"
 #include "zip_archive.h"
 
 namespace art {
@@ -82,6 +84,21 @@ using android::base::StringPrintf;
 
 static constexpr OatDexFile* kNoOatDexFile = nullptr;
 
+// Compute the verification cache key of the dex file in `map` loaded from `fd` into `storage`.
+// Returns null if the cache is not enabled or not needed.
+static const DexVerificationCache::Key* GetVerificationCacheKey(
+    bool verify,
+    int fd,
+    const std::string& location,
+    const MemMap& map,
+    /*out*/ DexVerificationCache::Key* storage) {
+  if (!verify || DexVerificationCache::Get() == nullptr || map.Size() < sizeof(DexFile::Header)) {
+    return nullptr;
+  }
+  const DexFile::Header* header = reinterpret_cast<const DexFile::Header*>(map.Begin());
+  return DexVerificationCache::ComputeKey(fd, location, *header, storage) ? storage : nullptr;
+}
+
 
 bool ArtDexFileLoader::GetMultiDexChecksums(const char* filename,
                                             std::vector<uint32_t>* checksums,
@@ -175,7 +192,8 @@ std::unique_ptr<const DexFile> ArtDexFileLoader::Open(const uint8_t* base,
                     verify_checksum,
                     error_msg,
                     /*container*/ nullptr,
-                    /*verify_result*/ nullptr);
+                    /*verify_result*/ nullptr,
+                    /*verification_key*/ nullptr);
 }
 
 std::unique_ptr<const DexFile> ArtDexFileLoader::Open(const std::string& location,
@@ -205,7 +223,8 @@ std::unique_ptr<const DexFile> ArtDexFileLoader::Open(const std::string& locatio
                                                  verify_checksum,
                                                  error_msg,
                                                  std::make_unique<MemMapContainer>(std::move(map)),
-                                                 /*verify_result*/ nullptr);
+                                                 /*verify_result*/ nullptr,
+                                                 /*verification_key*/ nullptr);
   // Opening CompactDex is only supported from vdex files.
   if (dex_file != nullptr && dex_file->IsCompactDexFile()) {
     *error_msg = StringPrintf("Opening CompactDex file '%s' is only supported from vdex files",
@@ -286,6 +305,8 @@ std::unique_ptr<const DexFile> ArtDexFileLoader::OpenFile(int fd,
   ScopedTrace trace(std::string("Open dex file ") + std::string(location));
   CHECK(!location.empty());
   std::unique_ptr<MemMap> map;
+  DexVerificationCache::Key verification_key_storage;
+  const DexVerificationCache::Key* verification_key = nullptr;
   {
     File delayed_close(fd, /* check_usage */ false);
     struct stat sbuf;
@@ -312,6 +333,8 @@ std::unique_ptr<const DexFile> ArtDexFileLoader::OpenFile(int fd,
       DCHECK(!error_msg->empty());
       return nullptr;
     }
+    verification_key =
+        GetVerificationCacheKey(verify, fd, location, *map, &verification_key_storage);
   }
 
   if (map->Size() < sizeof(DexFile::Header)) {
@@ -334,7 +357,8 @@ std::unique_ptr<const DexFile> ArtDexFileLoader::OpenFile(int fd,
                                                  verify_checksum,
                                                  error_msg,
                                                  std::make_unique<MemMapContainer>(std::move(map)),
-                                                 /*verify_result*/ nullptr);
+                                                 /*verify_result*/ nullptr,
+                                                 verification_key);
 
   // Opening CompactDex is only supported from vdex files.
   if (dex_file != nullptr && dex_file->IsCompactDexFile()) {
@@ -385,6 +409,16 @@ std::unique_ptr<const DexFile> ArtDexFileLoader::OpenOneDexFileFromZip(
     }
   }
 
+  DexExtractionCache* extraction_cache = DexExtractionCache::Get();
+  if (map == nullptr && extraction_cache != nullptr) {
+    // Map the inflated entry from the extraction cache, shared with other processes.
+    map.reset(extraction_cache->Map(zip_entry.get(), location, entry_name, error_msg));
+    if (map == nullptr) {
+      LOG(WARNING) << "Can't map dex file " << location << "!" << entry_name << " from the "
+                   << "extraction cache: " << *error_msg << ". Falling back to extraction.";
+    }
+  }
+
   if (map == nullptr) {
     // Default path for compressed ZIP entries,
     // and fallback for stored ZIP entries.
@@ -397,6 +431,9 @@ std::unique_ptr<const DexFile> ArtDexFileLoader::OpenOneDexFileFromZip(
     *error_code = ZipOpenErrorCode::kExtractToMemoryError;
     return nullptr;
   }
+  DexVerificationCache::Key verification_key_storage;
+  const DexVerificationCache::Key* verification_key = GetVerificationCacheKey(
+      verify, zip_archive.GetFd(), location, *map, &verification_key_storage);
   VerifyResult verify_result;
   std::unique_ptr<DexFile> dex_file = OpenCommon(map->Begin(),
                                                  map->Size(),
@@ -409,7 +446,8 @@ std::unique_ptr<const DexFile> ArtDexFileLoader::OpenOneDexFileFromZip(
                                                  verify_checksum,
                                                  error_msg,
                                                  std::make_unique<MemMapContainer>(std::move(map)),
-                                                 &verify_result);
+                                                 &verify_result,
+                                                 verification_key);
   if (dex_file != nullptr && dex_file->IsCompactDexFile()) {
     *error_msg = StringPrintf("Opening CompactDex file '%s' is only supported from vdex files",
                               location.c_str());
@@ -506,18 +544,29 @@ bool ArtDexFileLoader::OpenAllDexFilesFromZip(
   }
 }
 
-std::unique_ptr<DexFile> ArtDexFileLoader::OpenCommon(const uint8_t* base,
-                                                      size_t size,
-                                                      const uint8_t* data_base,
-                                                      size_t data_size,
-                                                      const std::string& location,
-                                                      uint32_t location_checksum,
-                                                      const OatDexFile* oat_dex_file,
-                                                      bool verify,
-                                                      bool verify_checksum,
-                                                      std::string* error_msg,
-                                                      std::unique_ptr<DexFileContainer> container,
-                                                      VerifyResult* verify_result) {
+std::unique_ptr<DexFile> ArtDexFileLoader::OpenCommon(
+    const uint8_t* base,
+    size_t size,
+    const uint8_t* data_base,
+    size_t data_size,
+    const std::string& location,
+    uint32_t location_checksum,
+    const OatDexFile* oat_dex_file,
+    bool verify,
+    bool verify_checksum,
+    std::string* error_msg,
+    std::unique_ptr<DexFileContainer> container,
+    VerifyResult* verify_result,
+    const DexVerificationCache::Key* verification_key) {
+  // Skip the verifier for dex files known to have passed it. The checksum is cheap compared to
+  // the structural checks, so it is still compared if requested.
+  DexVerificationCache* verification_cache =
+      (verify && verification_key != nullptr) ? DexVerificationCache::Get() : nullptr;
+  bool verified = false;
+  if (verification_cache != nullptr && verification_cache->IsVerified(*verification_key)) {
+    const DexFile::Header* header = reinterpret_cast<const DexFile::Header*>(base);
+    verified = !verify_checksum || header->checksum_ == DexFile::CalculateChecksum(base, size);
+  }
   std::unique_ptr<DexFile> dex_file = DexFileLoader::OpenCommon(base,
                                                                 size,
                                                                 data_base,
@@ -525,11 +574,14 @@ std::unique_ptr<DexFile> ArtDexFileLoader::OpenCommon(const uint8_t* base,
                                                                 location,
                                                                 location_checksum,
                                                                 oat_dex_file,
-                                                                verify,
-                                                                verify_checksum,
+                                                                verify && !verified,
+                                                                verify_checksum && !verified,
                                                                 error_msg,
                                                                 std::move(container),
                                                                 verify_result);
+  if (dex_file != nullptr && verification_cache != nullptr && !verified) {
+    verification_cache->RecordVerified(*verification_key);
+  }
 
   // Check if this dex file is located in the framework directory.
   // If it is, set a flag on the dex file. This is used by hidden API
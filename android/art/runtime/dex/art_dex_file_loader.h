@@ -24,6 +24,7 @@
 
 #include "base/macros.h"
 #include "dex/dex_file_loader.h"
+#include "dex_verification_cache.h"
 
 namespace art {
 
@@ -121,6 +122,8 @@ class ArtDexFileLoader : public DexFileLoader {
                                                        std::string* error_msg,
                                                        ZipOpenErrorCode* error_code) const;
 
+  // Like DexFileLoader::OpenCommon, but skips the verifier if `verification_key` is known to
+  // the DexVerificationCache and records it there after a successful verification.
   static std::unique_ptr<DexFile> OpenCommon(const uint8_t* base,
                                              size_t size,
                                              const uint8_t* data_base,
@@ -132,7 +135,8 @@ class ArtDexFileLoader : public DexFileLoader {
                                              bool verify_checksum,
                                              std::string* error_msg,
                                              std::unique_ptr<DexFileContainer> container,
-                                             VerifyResult* verify_result);
+                                             VerifyResult* verify_result,
+                                             const DexVerificationCache::Key* verification_key);
 };
 
 }  // namespace art
@@ -15,6 +15,9 @@
  */
 
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
 
 #include <fstream>
 #include <memory>
@@ -31,9 +34,12 @@
 #include "dex/dex_file.h"
 #include "dex/dex_file-inl.h"
 #include "dex/dex_file_loader.h"
+#include "dex_extraction_cache.h"
+#include "dex_verification_cache.h"
 #include "mem_map.h"
 #include "scoped_thread_state_change-inl.h"
 #include "thread-current-inl.h"
+#include "ziparchive/zip_writer.h"
 
 namespace art {
 
@@ -45,6 +51,37 @@ static void Copy(const std::string& src, const std::string& dst) {
 
 class ArtDexFileLoaderTest : public CommonRuntimeTest {};
 
+class ArtDexFileLoaderVerificationCacheTest : public ArtDexFileLoaderTest {
+ protected:
+  void SetUp() OVERRIDE {
+    ArtDexFileLoaderTest::SetUp();
+    cache_dir_ = android_data_ + "/dex-verification-cache";
+    ASSERT_EQ(0, mkdir(cache_dir_.c_str(), 0700));
+  }
+
+  void TearDown() OVERRIDE {
+    DexVerificationCache::Disable();
+    ClearDirectory(cache_dir_.c_str());
+    rmdir(cache_dir_.c_str());
+    ArtDexFileLoaderTest::TearDown();
+  }
+
+  size_t OpenVerified(const std::string& location) {
+    ArtDexFileLoader loader;
+    std::vector<std::unique_ptr<const DexFile>> dex_files;
+    std::string error_msg;
+    EXPECT_TRUE(loader.Open(location.c_str(),
+                            location,
+                            /* verify */ true,
+                            /* verify_checksum */ true,
+                            &error_msg,
+                            &dex_files)) << error_msg;
+    return dex_files.size();
+  }
+
+  std::string cache_dir_;
+};
+
 // TODO: Port OpenTestDexFile(s) need to be ported to use non-ART utilities, and
 // the tests that depend upon them should be moved to dex_file_loader_test.cc
 
@@ -482,4 +519,149 @@ TEST_F(ArtDexFileLoaderTest, IsPlatformDexFile_SystemFrameworkDir_MultiDex) {
   ASSERT_EQ(0, remove(system_framework_multi_location_path.c_str()));
 }
 
+TEST_F(ArtDexFileLoaderVerificationCacheTest, SkipsVerificationOnReopen) {
+  std::string error_msg;
+  ASSERT_TRUE(DexVerificationCache::Enable(/* sidecar_directory */ "", &error_msg)) << error_msg;
+  DexVerificationCache* cache = DexVerificationCache::Get();
+  ASSERT_TRUE(cache != nullptr);
+
+  std::string location = android_data_ + "/multidex.jar";
+  Copy(GetTestDexFileName("MultiDex"), location);
+  size_t num_dex_files = OpenVerified(location);
+  ASSERT_GT(num_dex_files, 1u);
+  EXPECT_EQ(0u, cache->GetNumHits());
+
+  EXPECT_EQ(num_dex_files, OpenVerified(location));
+  EXPECT_EQ(num_dex_files, cache->GetNumHits());
+
+  // A different modification time invalidates the entries.
+  struct timeval times[2] = { { 1, 0 }, { 1, 0 } };
+  ASSERT_EQ(0, utimes(location.c_str(), times));
+  EXPECT_EQ(num_dex_files, OpenVerified(location));
+  EXPECT_EQ(num_dex_files, cache->GetNumHits());
+
+  ASSERT_EQ(0, remove(location.c_str()));
+}
+
+TEST_F(ArtDexFileLoaderVerificationCacheTest, Sidecar) {
+  std::string error_msg;
+  ASSERT_TRUE(DexVerificationCache::Enable(cache_dir_, &error_msg)) << error_msg;
+
+  std::string location = android_data_ + "/main.jar";
+  Copy(GetTestDexFileName("Main"), location);
+  ASSERT_EQ(1u, OpenVerified(location));
+  EXPECT_EQ(0u, DexVerificationCache::Get()->GetNumHits());
+
+  // A new cache with the same directory finds the entry written by the first one.
+  ASSERT_TRUE(DexVerificationCache::Enable(cache_dir_, &error_msg)) << error_msg;
+  ASSERT_EQ(1u, OpenVerified(location));
+  EXPECT_EQ(1u, DexVerificationCache::Get()->GetNumHits());
+
+  ASSERT_EQ(0, remove(location.c_str()));
+}
+
+TEST_F(ArtDexFileLoaderVerificationCacheTest, UntrustedSidecarDirectory) {
+  ASSERT_EQ(0, chmod(cache_dir_.c_str(), 0777));
+  std::string error_msg;
+  EXPECT_FALSE(DexVerificationCache::Enable(cache_dir_, &error_msg));
+  EXPECT_FALSE(error_msg.empty());
+  EXPECT_TRUE(DexVerificationCache::Get() == nullptr);
+}
+
+TEST_F(ArtDexFileLoaderTest, ExtractionCache) {
+  std::string cache_dir = android_data_ + "/dex-extraction-cache";
+  ASSERT_EQ(0, mkdir(cache_dir.c_str(), 0700));
+  std::string error_msg;
+  ASSERT_TRUE(DexExtractionCache::Enable(cache_dir, &error_msg)) << error_msg;
+  DexExtractionCache* cache = DexExtractionCache::Get();
+
+  std::string multidex_file = GetTestDexFileName("MultiDex");
+  ArtDexFileLoader loader;
+  std::vector<std::unique_ptr<const DexFile>> first;
+  ASSERT_TRUE(loader.Open(multidex_file.c_str(),
+                          multidex_file,
+                          /* verify */ true,
+                          /* verify_checksum */ true,
+                          &error_msg,
+                          &first)) << error_msg;
+  size_t num_extractions = cache->GetNumExtractions();
+  EXPECT_EQ(0u, cache->GetNumHits());
+
+  // The second open maps the entries extracted by the first one.
+  std::vector<std::unique_ptr<const DexFile>> second;
+  ASSERT_TRUE(loader.Open(multidex_file.c_str(),
+                          multidex_file,
+                          /* verify */ true,
+                          /* verify_checksum */ true,
+                          &error_msg,
+                          &second)) << error_msg;
+  EXPECT_EQ(num_extractions, cache->GetNumExtractions());
+  EXPECT_EQ(num_extractions, cache->GetNumHits());
+  ASSERT_EQ(first.size(), second.size());
+  for (size_t i = 0; i != first.size(); ++i) {
+    EXPECT_TRUE(second[i]->IsReadOnly());
+    ASSERT_EQ(first[i]->Size(), second[i]->Size());
+    EXPECT_EQ(0, memcmp(first[i]->Begin(), second[i]->Begin(), first[i]->Size()));
+  }
+
+  DexExtractionCache::Disable();
+  ClearDirectory(cache_dir.c_str());
+  rmdir(cache_dir.c_str());
+}
+
+TEST_F(ArtDexFileLoaderTest, ExtractionCacheChecksSignature) {
+  std::string cache_dir = android_data_ + "/dex-extraction-cache";
+  ASSERT_EQ(0, mkdir(cache_dir.c_str(), 0700));
+  std::string error_msg;
+  ASSERT_TRUE(DexExtractionCache::Enable(cache_dir, &error_msg)) << error_msg;
+  DexExtractionCache* cache = DexExtractionCache::Get();
+
+  std::unique_ptr<const DexFile> dex(OpenTestDexFile("Nested"));
+  std::vector<uint8_t> data(dex->Begin(), dex->Begin() + dex->Size());
+  // Zip `data` compressed and open it through the cache.
+  auto open_zipped = [&]() {
+    ScratchFile zip;
+    FILE* file = fopen(zip.GetFile()->GetPath().c_str(), "wb");
+    ZipWriter writer(file);
+    writer.StartEntry("classes.dex", ZipWriter::kCompress);
+    writer.WriteBytes(data.data(), data.size());
+    writer.FinishEntry();
+    writer.Finish();
+    fflush(file);
+    fclose(file);
+    ArtDexFileLoader loader;
+    std::vector<std::unique_ptr<const DexFile>> dex_files;
+    ASSERT_TRUE(loader.Open(zip.GetFilename().c_str(),
+                            zip.GetFilename(),
+                            /* verify */ true,
+                            /* verify_checksum */ true,
+                            &error_msg,
+                            &dex_files)) << error_msg;
+    ASSERT_EQ(1u, dex_files.size());
+    ASSERT_EQ(data.size(), dex_files[0]->Size());
+    EXPECT_EQ(0, memcmp(data.data(), dex_files[0]->Begin(), data.size()));
+  };
+
+  // A dex file whose contents do not match its signature is not added to the cache, or any
+  // other archive with the same header could map it.
+  DexFile::Header* header = reinterpret_cast<DexFile::Header*>(data.data());
+  header->signature_[0] ^= 0xffu;
+  header->checksum_ = DexFile::CalculateChecksum(data.data(), data.size());
+  open_zipped();
+  EXPECT_EQ(0u, cache->GetNumExtractions());
+  EXPECT_EQ(0u, cache->GetNumHits());
+
+  header->signature_[0] ^= 0xffu;
+  header->checksum_ = DexFile::CalculateChecksum(data.data(), data.size());
+  open_zipped();
+  EXPECT_EQ(1u, cache->GetNumExtractions());
+  open_zipped();
+  EXPECT_EQ(1u, cache->GetNumExtractions());
+  EXPECT_EQ(1u, cache->GetNumHits());
+
+  DexExtractionCache::Disable();
+  ClearDirectory(cache_dir.c_str());
+  rmdir(cache_dir.c_str());
+}
+
 }  // namespace art
@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dex_extraction_cache.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <memory>
+
+#include <openssl/sha.h>
+
+#include "android-base/stringprintf.h"
+
+#include "base/os.h"
+#include "base/unix_file/fd_file.h"
+#include "base/utils.h"
+#include "dex/dex_file.h"
+#include "mem_map.h"
+#include "zip_archive.h"
+
+namespace art {
+
+using android::base::StringPrintf;
+
+// The magic, checksum and SHA-1 signature of the dex header. The signature is a digest of the
+// rest of the file.
+static constexpr size_t kHeaderPrefixSize =
+    offsetof(DexFile::Header, signature_) + DexFile::kSha1DigestSize;
+
+Atomic<DexExtractionCache*> DexExtractionCache::instance_(nullptr);
+
+static std::string SignatureToString(const uint8_t* signature) {
+  std::string result;
+  for (size_t i = 0; i != DexFile::kSha1DigestSize; ++i) {
+    result += StringPrintf("%02x", signature[i]);
+  }
+  return result;
+}
+
+// Whether `st` belongs to the current user and cannot be modified by anyone else.
+static bool IsTrusted(const struct stat& st) {
+  return st.st_uid == geteuid() && (st.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+
+bool DexExtractionCache::Enable(const std::string& directory, std::string* error_msg) {
+  struct stat st;
+  if (stat(directory.c_str(), &st) != 0) {
+    *error_msg = StringPrintf("Failed to stat dex extraction cache directory '%s': %s",
+                              directory.c_str(),
+                              strerror(errno));
+    return false;
+  }
+  if (!S_ISDIR(st.st_mode) || !IsTrusted(st)) {
+    *error_msg = StringPrintf("Dex extraction cache directory '%s' is not a directory "
+                                  "owned and only writable by the current user",
+                              directory.c_str());
+    return false;
+  }
+  delete instance_.ExchangeSequentiallyConsistent(new DexExtractionCache(directory));
+  return true;
+}
+
+void DexExtractionCache::Disable() {
+  delete instance_.ExchangeSequentiallyConsistent(nullptr);
+}
+
+DexExtractionCache::DexExtractionCache(const std::string& directory)
+    : directory_(directory),
+      num_hits_(0u),
+      num_extractions_(0u) {}
+
+MemMap* DexExtractionCache::MapCachedFile(const std::string& path,
+                                          size_t length,
+                                          const uint8_t* header,
+                                          const std::string& name,
+                                          std::string* error_msg) const {
+  std::unique_ptr<File> file(OS::OpenFileForReading(path.c_str()));
+  if (file == nullptr) {
+    *error_msg = StringPrintf("Failed to open '%s': %s", path.c_str(), strerror(errno));
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(file->Fd(), &st) != 0 ||
+      !S_ISREG(st.st_mode) ||
+      !IsTrusted(st) ||
+      static_cast<uint64_t>(st.st_size) != length) {
+    *error_msg = StringPrintf("Dex extraction cache entry '%s' is not valid", path.c_str());
+    return nullptr;
+  }
+  // Map privately, like ZipEntry::MapDirectlyFromFile(), so that the dex file loader can make
+  // the mapping read-only itself. Pages not written to stay shared with the page cache.
+  std::unique_ptr<MemMap> map(MemMap::MapFile(length,
+                                              PROT_READ | PROT_WRITE,
+                                              MAP_PRIVATE,
+                                              file->Fd(),
+                                              /* start */ 0,
+                                              /* low_4gb */ false,
+                                              name.c_str(),
+                                              error_msg));
+  if (map == nullptr) {
+    return nullptr;
+  }
+  if (memcmp(map->Begin(), header, kHeaderPrefixSize) != 0) {
+    *error_msg = StringPrintf("Dex extraction cache entry '%s' has a different header",
+                              path.c_str());
+    return nullptr;
+  }
+  return map.release();
+}
+
+MemMap* DexExtractionCache::Map(ZipEntry* zip_entry,
+                                const std::string& zip_location,
+                                const char* entry_name,
+                                std::string* error_msg) {
+  size_t length = zip_entry->GetUncompressedLength();
+  if (length < sizeof(DexFile::Header)) {
+    *error_msg = StringPrintf("'%s' is too short to be a dex file", entry_name);
+    return nullptr;
+  }
+  uint8_t header[kHeaderPrefixSize];
+  if (!zip_entry->ExtractPrefix(header, sizeof(header), error_msg)) {
+    return nullptr;
+  }
+  const uint8_t* signature = header + offsetof(DexFile::Header, signature_);
+  std::string path = StringPrintf("%s/%s-%zu.dex",
+                                  directory_.c_str(),
+                                  SignatureToString(signature).c_str(),
+                                  length);
+  std::string name = StringPrintf("%s extracted to %s from %s",
+                                  entry_name,
+                                  path.c_str(),
+                                  zip_location.c_str());
+  if (OS::FileExists(path.c_str())) {
+    MemMap* map = MapCachedFile(path, length, header, name, error_msg);
+    if (map != nullptr) {
+      num_hits_.FetchAndAddRelaxed(1u);
+      return map;
+    }
+    LOG(WARNING) << "Replacing dex extraction cache entry: " << *error_msg;
+  }
+
+  // Extract to a temporary file and rename it so that other processes never map a partial
+  // entry. Concurrent extractions of the same entry produce identical files.
+  std::string temp_path = StringPrintf("%s.%d.tmp", path.c_str(), static_cast<int>(GetTid()));
+  int fd = open(temp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    *error_msg = StringPrintf("Failed to create '%s': %s", temp_path.c_str(), strerror(errno));
+    return nullptr;
+  }
+  File file(fd, temp_path, /* check_usage */ true);
+  if (!zip_entry->ExtractToFile(file, error_msg)) {
+    file.Erase(/* unlink */ true);
+    return nullptr;
+  }
+  if (file.FlushCloseOrErase() != 0) {
+    *error_msg = StringPrintf("Failed to write '%s'", temp_path.c_str());
+    unlink(temp_path.c_str());
+    return nullptr;
+  }
+  std::unique_ptr<MemMap> map(MapCachedFile(temp_path, length, header, name, error_msg));
+  if (map == nullptr) {
+    unlink(temp_path.c_str());
+    return nullptr;
+  }
+  // The name of the entry must be a digest of its contents, or another archive could make
+  // this one map a different dex file with the same header.
+  uint8_t digest[SHA_DIGEST_LENGTH];
+  SHA1(map->Begin() + kHeaderPrefixSize, length - kHeaderPrefixSize, digest);
+  if (memcmp(digest, signature, sizeof(digest)) != 0) {
+    *error_msg = StringPrintf("'%s' in '%s' does not match its SHA-1 signature",
+                              entry_name,
+                              zip_location.c_str());
+    unlink(temp_path.c_str());
+    return nullptr;
+  }
+  if (rename(temp_path.c_str(), path.c_str()) != 0) {
+    *error_msg = StringPrintf("Failed to rename '%s' to '%s': %s",
+                              temp_path.c_str(),
+                              path.c_str(),
+                              strerror(errno));
+    unlink(temp_path.c_str());
+    return nullptr;
+  }
+  num_extractions_.FetchAndAddRelaxed(1u);
+  return map.release();
+}
+
+}  // namespace art
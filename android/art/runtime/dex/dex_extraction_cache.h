@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_RUNTIME_DEX_DEX_EXTRACTION_CACHE_H_
+#define ART_RUNTIME_DEX_DEX_EXTRACTION_CACHE_H_
+
+#include <string>
+
+#include "base/atomic.h"
+#include "base/macros.h"
+
+namespace art {
+
+class MemMap;
+class ZipEntry;
+
+// A directory of dex files inflated from compressed zip entries, shared between processes.
+//
+// Entries are named after the SHA-1 signature in the dex header and the uncompressed length,
+// so the same dex file in different archives is only extracted once. An entry is only added
+// once the SHA-1 of the extracted contents matches the signature, so finding a dex file
+// again only takes inflating its header and comparing it with the cached one. Opening a
+// cached entry maps the file instead of inflating the zip entry, and processes mapping the
+// same entry share its pages in the page cache. The directory and its files must be owned by
+// the current user and not writable by anyone else; other entries are ignored and replaced.
+// Nothing is ever evicted, the owner of the directory is responsible for cleaning it up.
+class DexExtractionCache {
+ public:
+  // Enable the process-wide cache in `directory`. Returns false and sets `error_msg` if the
+  // directory cannot be trusted.
+  static bool Enable(const std::string& directory, std::string* error_msg);
+
+  // Disable the process-wide cache. Must not be called while dex files are being opened.
+  static void Disable();
+
+  // Return the process-wide cache or null if it is not enabled.
+  static DexExtractionCache* Get() {
+    return instance_.LoadAcquire();
+  }
+
+  // Map the uncompressed contents of `zip_entry` from the cache, extracting it there first
+  // if needed. The mapping is private and writable like the one of
+  // ZipEntry::MapDirectlyFromFile(). Returns null and sets `error_msg` on failure.
+  MemMap* Map(ZipEntry* zip_entry,
+              const std::string& zip_location,
+              const char* entry_name,
+              std::string* error_msg);
+
+  size_t GetNumHits() const {
+    return num_hits_.LoadRelaxed();
+  }
+
+  size_t GetNumExtractions() const {
+    return num_extractions_.LoadRelaxed();
+  }
+
+ private:
+  explicit DexExtractionCache(const std::string& directory);
+
+  // Map the cache file at `path` if it is trusted, `length` bytes long and starts with the
+  // dex header prefix `header`.
+  MemMap* MapCachedFile(const std::string& path,
+                        size_t length,
+                        const uint8_t* header,
+                        const std::string& name,
+                        std::string* error_msg) const;
+
+  static Atomic<DexExtractionCache*> instance_;
+
+  const std::string directory_;
+
+  Atomic<size_t> num_hits_;
+  Atomic<size_t> num_extractions_;
+
+  DISALLOW_COPY_AND_ASSIGN(DexExtractionCache);
+};
+
+}  // namespace art
+
+#endif  // ART_RUNTIME_DEX_DEX_EXTRACTION_CACHE_H_
@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dex_verification_cache.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cinttypes>
+#include <cstring>
+#include <memory>
+
+#include "android-base/stringprintf.h"
+
+#include "base/casts.h"
+#include "base/os.h"
+#include "base/unix_file/fd_file.h"
+#include "base/utils.h"
+#include "thread-current-inl.h"
+
+namespace art {
+
+using android::base::StringPrintf;
+
+static constexpr uint8_t kSidecarMagic[] = { 'd', 'v', 'c', '\n' };
+static constexpr uint32_t kSidecarVersion = 1u;
+static constexpr size_t kMaxLocationLength = 4096u;
+
+Atomic<DexVerificationCache*> DexVerificationCache::instance_(nullptr);
+
+// Whether `st` belongs to the current user and cannot be modified by anyone else.
+static bool IsTrusted(const struct stat& st) {
+  return st.st_uid == geteuid() && (st.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+
+bool DexVerificationCache::Enable(const std::string& sidecar_directory, std::string* error_msg) {
+  if (!sidecar_directory.empty()) {
+    struct stat st;
+    if (stat(sidecar_directory.c_str(), &st) != 0) {
+      *error_msg = StringPrintf("Failed to stat dex verification cache directory '%s': %s",
+                                sidecar_directory.c_str(),
+                                strerror(errno));
+      return false;
+    }
+    if (!S_ISDIR(st.st_mode) || !IsTrusted(st)) {
+      *error_msg = StringPrintf("Dex verification cache directory '%s' is not a directory "
+                                    "owned and only writable by the current user",
+                                sidecar_directory.c_str());
+      return false;
+    }
+  }
+  DexVerificationCache* cache = new DexVerificationCache(sidecar_directory);
+  delete instance_.ExchangeSequentiallyConsistent(cache);
+  return true;
+}
+
+void DexVerificationCache::Disable() {
+  delete instance_.ExchangeSequentiallyConsistent(nullptr);
+}
+
+DexVerificationCache::DexVerificationCache(const std::string& sidecar_directory)
+    : sidecar_directory_(sidecar_directory),
+      lock_("dex verification cache lock", kDexVerificationCacheLock),
+      num_hits_(0u) {}
+
+bool DexVerificationCache::ComputeKey(int fd,
+                                      const std::string& location,
+                                      const DexFile::Header& header,
+                                      /*out*/ Key* key) {
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    return false;
+  }
+  key->location = location;
+  key->file_size = static_cast<uint64_t>(st.st_size);
+#ifdef __APPLE__
+  const struct timespec& mtime = st.st_mtimespec;
+#else
+  const struct timespec& mtime = st.st_mtim;
+#endif
+  key->mtime_ns = static_cast<int64_t>(mtime.tv_sec) * 1000000000 + mtime.tv_nsec;
+  memcpy(key->signature, header.signature_, sizeof(key->signature));
+  return true;
+}
+
+bool DexVerificationCache::IsSameFile(const Key& lhs, const Key& rhs) {
+  return lhs.location == rhs.location &&
+         lhs.file_size == rhs.file_size &&
+         lhs.mtime_ns == rhs.mtime_ns &&
+         memcmp(lhs.signature, rhs.signature, sizeof(lhs.signature)) == 0;
+}
+
+bool DexVerificationCache::IsVerified(const Key& key) {
+  {
+    MutexLock mu(Thread::Current(), lock_);
+    auto it = entries_.find(key.location);
+    if (it != entries_.end() && IsSameFile(it->second, key)) {
+      num_hits_.FetchAndAddRelaxed(1u);
+      return true;
+    }
+  }
+  Key sidecar_key;
+  if (sidecar_directory_.empty() ||
+      !ReadSidecar(key.location, &sidecar_key) ||
+      !IsSameFile(sidecar_key, key)) {
+    return false;
+  }
+  {
+    MutexLock mu(Thread::Current(), lock_);
+    entries_.Overwrite(key.location, key);
+  }
+  num_hits_.FetchAndAddRelaxed(1u);
+  return true;
+}
+
+void DexVerificationCache::RecordVerified(const Key& key) {
+  {
+    MutexLock mu(Thread::Current(), lock_);
+    entries_.Overwrite(key.location, key);
+  }
+  if (!sidecar_directory_.empty()) {
+    WriteSidecar(key);
+  }
+}
+
+std::string DexVerificationCache::GetSidecarPath(const std::string& location) const {
+  // FNV-1a of the location. Collisions only cost a miss since the location is stored too.
+  uint64_t hash = UINT64_C(14695981039346656037);
+  for (char c : location) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * UINT64_C(1099511628211);
+  }
+  return StringPrintf("%s/%016" PRIx64 ".dvc", sidecar_directory_.c_str(), hash);
+}
+
+bool DexVerificationCache::ReadSidecar(const std::string& location, /*out*/ Key* key) const {
+  std::string path = GetSidecarPath(location);
+  std::unique_ptr<File> file(OS::OpenFileForReading(path.c_str()));
+  if (file == nullptr) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(file->Fd(), &st) != 0 || !S_ISREG(st.st_mode) || !IsTrusted(st)) {
+    return false;
+  }
+  uint8_t magic[sizeof(kSidecarMagic)];
+  uint32_t version;
+  uint32_t location_length;
+  if (!file->ReadFully(magic, sizeof(magic)) ||
+      memcmp(magic, kSidecarMagic, sizeof(magic)) != 0 ||
+      !file->ReadFully(&version, sizeof(version)) ||
+      version != kSidecarVersion ||
+      !file->ReadFully(&key->file_size, sizeof(key->file_size)) ||
+      !file->ReadFully(&key->mtime_ns, sizeof(key->mtime_ns)) ||
+      !file->ReadFully(key->signature, sizeof(key->signature)) ||
+      !file->ReadFully(&location_length, sizeof(location_length)) ||
+      location_length != location.size()) {
+    return false;
+  }
+  key->location.resize(location_length);
+  return file->ReadFully(&key->location[0], location_length) && key->location == location;
+}
+
+void DexVerificationCache::WriteSidecar(const Key& key) const {
+  if (key.location.size() > kMaxLocationLength) {
+    return;
+  }
+  // Write to a temporary file and rename it so that readers never see a partial entry.
+  std::string path = GetSidecarPath(key.location);
+  std::string temp_path = StringPrintf("%s.%d.tmp", path.c_str(), static_cast<int>(GetTid()));
+  int fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    PLOG(WARNING) << "Failed to create dex verification cache entry " << temp_path;
+    return;
+  }
+  File file(fd, temp_path, /* check_usage */ true);
+  uint32_t location_length = dchecked_integral_cast<uint32_t>(key.location.size());
+  bool success = file.WriteFully(kSidecarMagic, sizeof(kSidecarMagic)) &&
+                 file.WriteFully(&kSidecarVersion, sizeof(kSidecarVersion)) &&
+                 file.WriteFully(&key.file_size, sizeof(key.file_size)) &&
+                 file.WriteFully(&key.mtime_ns, sizeof(key.mtime_ns)) &&
+                 file.WriteFully(key.signature, sizeof(key.signature)) &&
+                 file.WriteFully(&location_length, sizeof(location_length)) &&
+                 file.WriteFully(key.location.data(), location_length);
+  if (!success) {
+    file.Erase(/* unlink */ true);
+    LOG(WARNING) << "Failed to write dex verification cache entry " << temp_path;
+    return;
+  }
+  if (file.FlushCloseOrErase() != 0) {
+    LOG(WARNING) << "Failed to write dex verification cache entry " << temp_path;
+    unlink(temp_path.c_str());
+    return;
+  }
+  if (rename(temp_path.c_str(), path.c_str()) != 0) {
+    PLOG(WARNING) << "Failed to rename dex verification cache entry " << temp_path;
+    unlink(temp_path.c_str());
+  }
+}
+
+}  // namespace art
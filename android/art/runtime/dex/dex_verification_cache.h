@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_RUNTIME_DEX_DEX_VERIFICATION_CACHE_H_
+#define ART_RUNTIME_DEX_DEX_VERIFICATION_CACHE_H_
+
+#include <cstdint>
+#include <string>
+
+#include "base/atomic.h"
+#include "base/macros.h"
+#include "base/mutex.h"
+#include "base/safe_map.h"
+#include "dex/dex_file.h"
+
+namespace art {
+
+// Records which dex files passed structural verification (DexFileVerifier) so that
+// ArtDexFileLoader can skip the verifier when the same file is opened again.
+//
+// A dex file is identified by its location, the size and modification time of the file it
+// was loaded from (the zip archive for dex files inside one) and the SHA-1 signature in its
+// header. The cache does not look at the dex contents, so it is only as trustworthy as the
+// file system: it must only be enabled for files that cannot be rewritten with the same
+// size, modification time and signature by someone less trusted than the process.
+//
+// Entries are kept in memory and, if a sidecar directory is given, also written to one small
+// file per location there so that they survive the process. The sidecar directory and its
+// files must be owned by the current user and not writable by anyone else; other entries
+// are ignored.
+class DexVerificationCache {
+ public:
+  struct Key {
+    std::string location;
+    uint64_t file_size;
+    int64_t mtime_ns;
+    uint8_t signature[DexFile::kSha1DigestSize];
+  };
+
+  // Enable the process-wide cache. An empty `sidecar_directory` keeps the entries in memory
+  // only. Returns false and sets `error_msg` if the directory cannot be trusted.
+  static bool Enable(const std::string& sidecar_directory, std::string* error_msg);
+
+  // Disable the process-wide cache and drop its in-memory entries. Must not be called while
+  // dex files are being opened.
+  static void Disable();
+
+  // Return the process-wide cache or null if it is not enabled.
+  static DexVerificationCache* Get() {
+    return instance_.LoadAcquire();
+  }
+
+  // Compute the key of the dex file with `header` at `location`, loaded from `fd`.
+  static bool ComputeKey(int fd,
+                         const std::string& location,
+                         const DexFile::Header& header,
+                         /*out*/ Key* key);
+
+  // Return whether the dex file with `key` is known to have passed verification.
+  bool IsVerified(const Key& key) REQUIRES(!lock_);
+
+  // Record that the dex file with `key` passed verification.
+  void RecordVerified(const Key& key) REQUIRES(!lock_);
+
+  size_t GetNumHits() const {
+    return num_hits_.LoadRelaxed();
+  }
+
+ private:
+  explicit DexVerificationCache(const std::string& sidecar_directory);
+
+  static bool IsSameFile(const Key& lhs, const Key& rhs);
+
+  std::string GetSidecarPath(const std::string& location) const;
+  bool ReadSidecar(const std::string& location, /*out*/ Key* key) const;
+  void WriteSidecar(const Key& key) const;
+
+  static Atomic<DexVerificationCache*> instance_;
+
+  const std::string sidecar_directory_;
+
+  Mutex lock_;
+  // Verified dex files by location. Only the latest key of each location is kept.
+  SafeMap<std::string, Key> entries_ GUARDED_BY(lock_);
+
+  Atomic<size_t> num_hits_;
+
+  DISALLOW_COPY_AND_ASSIGN(DexVerificationCache);
+};
+
+}  // namespace art
+
+#endif  // ART_RUNTIME_DEX_DEX_VERIFICATION_CACHE_H_
@@ -17,12 +17,14 @@
 #include "profile_compilation_info.h"
 
 #include <sys/file.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <unistd.h>
 #include <zlib.h>
 
+#include <algorithm>
 #include <cerrno>
 #include <climits>
 #include <cstdlib>
@@ -56,6 +58,11 @@ const uint8_t ProfileCompilationInfo::kProfileMagic[] = { 'p', 'r', 'o', '\0' };
 // profile_compilation_info object. All the profile line headers are now placed together
 // before corresponding method_encodings and class_ids.
 const uint8_t ProfileCompilationInfo::kProfileVersion[] = { '0', '1', '0', '\0' };
+// Compact profile version: uncompressed and indexed per dex file so that the profile can be
+// mapped and only the data of the dex files which pass the load filter is read. Only the
+// inline caches are compressed, per dex file, and they are decoded when first needed.
+// See SaveCompact().
+const uint8_t ProfileCompilationInfo::kProfileVersionCompact[] = { '0', '1', '1', '\0' };
 
 // The name of the profile entry in the dex metadata file.
 // DO NOT CHANGE THIS! (it's similar to classes.dex in the apk files).
@@ -86,14 +93,16 @@ ProfileCompilationInfo::ProfileCompilationInfo(ArenaPool* custom_arena_pool)
     : default_arena_pool_(),
       allocator_(custom_arena_pool),
       info_(allocator_.Adapter(kArenaAllocProfile)),
-      profile_key_map_(std::less<const std::string>(), allocator_.Adapter(kArenaAllocProfile)) {
+      profile_key_map_(std::less<const std::string>(), allocator_.Adapter(kArenaAllocProfile)),
+      has_pending_inline_caches_(false) {
 }
 
 ProfileCompilationInfo::ProfileCompilationInfo()
     : default_arena_pool_(/*use_malloc*/true, /*low_4gb*/false, "ProfileCompilationInfo"),
       allocator_(&default_arena_pool_),
       info_(allocator_.Adapter(kArenaAllocProfile)),
-      profile_key_map_(std::less<const std::string>(), allocator_.Adapter(kArenaAllocProfile)) {
+      profile_key_map_(std::less<const std::string>(), allocator_.Adapter(kArenaAllocProfile)),
+      has_pending_inline_caches_(false) {
 }
 
 ProfileCompilationInfo::~ProfileCompilationInfo() {
@@ -347,6 +356,7 @@ bool ProfileCompilationInfo::Save(int fd) {
   uint64_t start = NanoTime();
   ScopedTrace trace(__PRETTY_FUNCTION__);
   DCHECK_GE(fd, 0);
+  DecodePendingInlineCaches();
 
   // Use a vector wrapper to avoid keeping track of offsets when we add elements.
   std::vector<uint8_t> buffer;
@@ -471,6 +481,101 @@ bool ProfileCompilationInfo::Save(int fd) {
   return true;
 }
 
+static constexpr size_t kCompactHeaderSize =
+    sizeof(ProfileCompilationInfo::kProfileMagic) +
+    sizeof(ProfileCompilationInfo::kProfileVersionCompact) +
+    sizeof(uint8_t);  // number_of_dex_files
+
+static constexpr size_t kCompactIndexEntrySize =
+    2 * sizeof(uint16_t) +  // dex_location.size + class_set.size
+    6 * sizeof(uint32_t);   // checksum + num_method_ids + number_of_hot_methods +
+                            // inline_caches compressed and uncompressed sizes + data_offset
+
+/**
+ * Compact serialization format:
+ * [profile_header, index_entry1, index_entry2..., dex_data1, dex_data2...]
+ * profile_header:
+ *   magic,version,number_of_dex_files
+ * index_entry:
+ *   dex_location_size,number_of_classes,dex_location_checksum,num_method_ids,
+ *   number_of_hot_methods,inline_caches_compressed_size,inline_caches_size,dex_data_offset
+ * dex_data (at dex_data_offset from the start of the file):
+ *   dex_location,class_id1,class_id2...,hot_method_id1,hot_method_id2...,
+ *   startup/post startup bitmap,zipped[inline_cache_block]
+ * The class and method ids are sorted uint16_t values and the bitmap is stored as in
+ * memory, so all of them are read directly from the mapped file without decoding. The
+ * bitmap is still copied, as it is merged into the bitmap of the loaded dex data.
+ * The inline_cache_block lists the hot methods which have inline caches:
+ *    method_id,number_of_inline_caches,inline_cache1,inline_cache2...
+ * with the inline caches encoded as for Save(). It is absent (zero sizes) if no method
+ * has inline caches.
+ **/
+bool ProfileCompilationInfo::SaveCompact(int fd) {
+  ScopedTrace trace(__PRETTY_FUNCTION__);
+  DCHECK_GE(fd, 0);
+  DecodePendingInlineCaches();
+
+  std::vector<uint8_t> header;
+  header.insert(header.end(), kProfileMagic, kProfileMagic + sizeof(kProfileMagic));
+  header.insert(header.end(),
+                kProfileVersionCompact,
+                kProfileVersionCompact + sizeof(kProfileVersionCompact));
+  DCHECK_LE(info_.size(), std::numeric_limits<uint8_t>::max());
+  AddUintToBuffer(&header, static_cast<uint8_t>(info_.size()));
+
+  std::vector<uint8_t> data;
+  uint32_t data_offset =
+      static_cast<uint32_t>(kCompactHeaderSize + info_.size() * kCompactIndexEntrySize);
+  for (const DexFileData* dex_data_ptr : info_) {
+    const DexFileData& dex_data = *dex_data_ptr;
+    if (dex_data.profile_key.size() >= kMaxDexFileKeyLength) {
+      LOG(WARNING) << "DexFileKey exceeds allocated limit";
+      return false;
+    }
+
+    std::vector<uint8_t> inline_caches;
+    for (const auto& method_it : dex_data.method_map) {
+      if (!method_it.second.empty()) {
+        AddUintToBuffer(&inline_caches, method_it.first);
+        AddInlineCacheToBuffer(&inline_caches, method_it.second);
+      }
+    }
+    uint32_t compressed_size = 0;
+    std::unique_ptr<uint8_t[]> compressed_inline_caches;
+    if (!inline_caches.empty()) {
+      compressed_inline_caches = DeflateBuffer(inline_caches.data(),
+                                               inline_caches.size(),
+                                               &compressed_size);
+    }
+
+    DCHECK_LE(dex_data.profile_key.size(), std::numeric_limits<uint16_t>::max());
+    DCHECK_LE(dex_data.class_set.size(), std::numeric_limits<uint16_t>::max());
+    AddUintToBuffer(&header, static_cast<uint16_t>(dex_data.profile_key.size()));
+    AddUintToBuffer(&header, static_cast<uint16_t>(dex_data.class_set.size()));
+    AddUintToBuffer(&header, dex_data.checksum);  // uint32_t
+    AddUintToBuffer(&header, dex_data.num_method_ids);  // uint32_t
+    AddUintToBuffer(&header, static_cast<uint32_t>(dex_data.method_map.size()));
+    AddUintToBuffer(&header, compressed_size);  // uint32_t
+    AddUintToBuffer(&header, static_cast<uint32_t>(inline_caches.size()));
+    AddUintToBuffer(&header, static_cast<uint32_t>(data_offset + data.size()));
+
+    AddStringToBuffer(&data, dex_data.profile_key);
+    for (const dex::TypeIndex& class_id : dex_data.class_set) {
+      AddUintToBuffer(&data, class_id.index_);
+    }
+    for (const auto& method_it : dex_data.method_map) {
+      AddUintToBuffer(&data, method_it.first);
+    }
+    data.insert(data.end(), dex_data.bitmap_storage.begin(), dex_data.bitmap_storage.end());
+    data.insert(data.end(),
+                compressed_inline_caches.get(),
+                compressed_inline_caches.get() + compressed_size);
+  }
+  DCHECK_EQ(header.size(), data_offset);
+  return WriteBuffer(fd, header.data(), header.size()) &&
+         WriteBuffer(fd, data.data(), data.size());
+}
+
 void ProfileCompilationInfo::AddInlineCacheToBuffer(std::vector<uint8_t>* buffer,
                                                     const InlineCacheMap& inline_cache_map) {
   // Add inline cache map size.
@@ -1074,6 +1179,7 @@ bool ProfileCompilationInfo::Load(
 }
 
 bool ProfileCompilationInfo::VerifyProfileData(const std::vector<const DexFile*>& dex_files) {
+  DecodePendingInlineCaches();
   std::unordered_map<std::string, const DexFile*> key_to_dex_file;
   for (const DexFile* dex_file : dex_files) {
     key_to_dex_file.emplace(GetProfileDexFileKey(dex_file->GetLocation()), dex_file);
@@ -1243,6 +1349,46 @@ bool ProfileCompilationInfo::ProfileSource::HasConsumedAllData() const {
       : (testEOF(fd_) == 0);
 }
 
+bool ProfileCompilationInfo::ProfileSource::IsCompact() const {
+  uint8_t magic_and_version[sizeof(kProfileMagic) + sizeof(kProfileVersionCompact)];
+  if (IsMemMap()) {
+    if (mem_map_ == nullptr || mem_map_cur_ != 0 || mem_map_->Size() < sizeof(magic_and_version)) {
+      return false;
+    }
+    memcpy(magic_and_version, mem_map_->Begin(), sizeof(magic_and_version));
+  } else {
+    // Read without moving the file offset so that the regular loading is not affected.
+    ssize_t bytes_read =
+        TEMP_FAILURE_RETRY(pread(fd_, magic_and_version, sizeof(magic_and_version), 0));
+    if (bytes_read != static_cast<ssize_t>(sizeof(magic_and_version))) {
+      return false;
+    }
+  }
+  return memcmp(magic_and_version, kProfileMagic, sizeof(kProfileMagic)) == 0 &&
+         memcmp(magic_and_version + sizeof(kProfileMagic),
+                kProfileVersionCompact,
+                sizeof(kProfileVersionCompact)) == 0;
+}
+
+std::unique_ptr<MemMap> ProfileCompilationInfo::ProfileSource::MapContent(std::string* error) {
+  if (IsMemMap()) {
+    return std::move(mem_map_);
+  }
+  struct stat stat_buffer;
+  if (fstat(fd_, &stat_buffer) != 0) {
+    *error += std::string("Profile IO error for MapContent") + strerror(errno);
+    return nullptr;
+  }
+  return std::unique_ptr<MemMap>(MemMap::MapFile(static_cast<size_t>(stat_buffer.st_size),
+                                                 PROT_READ,
+                                                 MAP_PRIVATE,
+                                                 fd_,
+                                                 /* start */ 0,
+                                                 /* low_4gb */ false,
+                                                 "profile",
+                                                 error));
+}
+
 bool ProfileCompilationInfo::ProfileSource::HasEmptyContent() const {
   if (IsMemMap()) {
     return mem_map_ == nullptr || mem_map_->Size() == 0;
@@ -1277,6 +1423,10 @@ ProfileCompilationInfo::ProfileLoadStatus ProfileCompilationInfo::LoadInternal(
     return kProfileLoadSuccess;
   }
 
+  if (source->IsCompact()) {
+    return LoadCompactInternal(*source, error, merge_classes, filter_fn);
+  }
+
   // Read profile header: magic + version + number_of_dex_files.
   uint8_t number_of_dex_files;
   uint32_t uncompressed_data_size;
@@ -1377,6 +1527,209 @@ ProfileCompilationInfo::ProfileLoadStatus ProfileCompilationInfo::LoadInternal(
   }
 }
 
+// Reads an uint value previously written with AddUintToBuffer and advances `ptr`.
+template <typename T>
+static T ReadCompactUint(const uint8_t** ptr) {
+  static_assert(std::is_unsigned<T>::value, "Type is not unsigned");
+  T value = 0;
+  for (size_t i = 0; i < sizeof(T); i++) {
+    value |= static_cast<T>((*ptr)[i]) << (i * kBitsPerByte);
+  }
+  *ptr += sizeof(T);
+  return value;
+}
+
+ProfileCompilationInfo::ProfileLoadStatus ProfileCompilationInfo::LoadCompactInternal(
+    ProfileSource& source,
+    std::string* error,
+    bool merge_classes,
+    const ProfileLoadFilterFn& filter_fn) {
+  std::shared_ptr<MemMap> map(source.MapContent(error));
+  if (map == nullptr) {
+    return kProfileLoadIOError;
+  }
+  const uint8_t* begin = map->Begin();
+  const size_t size = map->Size();
+  if (size < kCompactHeaderSize) {
+    *error += "Profile EOF reached prematurely for ReadProfileHeader";
+    return kProfileLoadBadData;
+  }
+  const uint8_t number_of_dex_files = begin[kCompactHeaderSize - sizeof(uint8_t)];
+  if (size < kCompactHeaderSize + number_of_dex_files * kCompactIndexEntrySize) {
+    *error += "Profile EOF reached prematurely for ReadProfileIndex";
+    return kProfileLoadBadData;
+  }
+
+  // The parts of the index entries which are not in the line header.
+  struct IndexEntry {
+    uint32_t number_of_hot_methods;
+    uint32_t inline_caches_compressed_size;
+    uint32_t inline_caches_size;
+    uint32_t data_offset;
+  };
+  std::vector<ProfileLineHeader> profile_line_headers(number_of_dex_files);
+  std::vector<IndexEntry> index_entries(number_of_dex_files);
+  uint64_t data_end = kCompactHeaderSize + number_of_dex_files * kCompactIndexEntrySize;
+  const uint8_t* ptr = begin + kCompactHeaderSize;
+  for (uint8_t k = 0; k < number_of_dex_files; k++) {
+    ProfileLineHeader& line_header = profile_line_headers[k];
+    IndexEntry& entry = index_entries[k];
+    uint16_t dex_location_size = ReadCompactUint<uint16_t>(&ptr);
+    line_header.class_set_size = ReadCompactUint<uint16_t>(&ptr);
+    line_header.method_region_size_bytes = 0u;  // Not used by the compact format.
+    line_header.checksum = ReadCompactUint<uint32_t>(&ptr);
+    line_header.num_method_ids = ReadCompactUint<uint32_t>(&ptr);
+    entry.number_of_hot_methods = ReadCompactUint<uint32_t>(&ptr);
+    entry.inline_caches_compressed_size = ReadCompactUint<uint32_t>(&ptr);
+    entry.inline_caches_size = ReadCompactUint<uint32_t>(&ptr);
+    entry.data_offset = ReadCompactUint<uint32_t>(&ptr);
+
+    if (dex_location_size == 0 || dex_location_size > kMaxDexFileKeyLength) {
+      *error = "DexFileKey has an invalid size: " +
+          std::to_string(static_cast<uint32_t>(dex_location_size));
+      return kProfileLoadBadData;
+    }
+    // Only check that the data of the dex file is within the profile here. It is read
+    // below, and only if the dex file passes the filter.
+    uint64_t entry_end = static_cast<uint64_t>(entry.data_offset) +
+        dex_location_size +
+        line_header.class_set_size * sizeof(uint16_t) +
+        static_cast<uint64_t>(entry.number_of_hot_methods) * sizeof(uint16_t) +
+        DexFileData::ComputeBitmapStorage(line_header.num_method_ids) +
+        entry.inline_caches_compressed_size;
+    if (entry_end > size) {
+      *error += "Profile EOF reached prematurely for ReadProfileLine";
+      return kProfileLoadBadData;
+    }
+    data_end = std::max(data_end, entry_end);
+    line_header.dex_location.assign(
+        reinterpret_cast<const char*>(begin + entry.data_offset), dex_location_size);
+  }
+  if (data_end != size) {
+    *error = "Unexpected content in the profile file";
+    return kProfileLoadBadData;
+  }
+
+  SafeMap<uint8_t, uint8_t> dex_profile_index_remap;
+  if (!RemapProfileIndex(profile_line_headers, filter_fn, &dex_profile_index_remap)) {
+    return kProfileLoadBadData;
+  }
+
+  for (uint8_t k = 0; k < number_of_dex_files; k++) {
+    const ProfileLineHeader& line_header = profile_line_headers[k];
+    const IndexEntry& entry = index_entries[k];
+    if (!filter_fn(line_header.dex_location, line_header.checksum)) {
+      continue;
+    }
+    DexFileData* data = GetOrAddDexFileData(line_header.dex_location,
+                                            line_header.checksum,
+                                            line_header.num_method_ids);
+    if (data == nullptr) {
+      *error = "Error when reading profile file line header: checksum mismatch for "
+          + line_header.dex_location;
+      return kProfileLoadBadData;
+    }
+
+    ptr = begin + entry.data_offset + line_header.dex_location.size();
+    if (merge_classes) {
+      for (uint16_t i = 0; i < line_header.class_set_size; i++) {
+        data->class_set.insert(dex::TypeIndex(ReadCompactUint<uint16_t>(&ptr)));
+      }
+    } else {
+      ptr += line_header.class_set_size * sizeof(uint16_t);
+    }
+    for (uint32_t i = 0; i < entry.number_of_hot_methods; i++) {
+      if (data->FindOrAddMethod(ReadCompactUint<uint16_t>(&ptr)) == nullptr) {
+        *error = "Invalid method index for " + line_header.dex_location;
+        return kProfileLoadBadData;
+      }
+    }
+    for (uint8_t& byte : data->bitmap_storage) {
+      byte |= *ptr++;
+    }
+
+    if ((entry.inline_caches_compressed_size != 0u) != (entry.inline_caches_size != 0u) ||
+        !CheckInflatedSize(ptr, entry.inline_caches_compressed_size, entry.inline_caches_size)) {
+      *error = "Error reading the inline caches of " + line_header.dex_location;
+      return kProfileLoadBadData;
+    }
+    if (entry.inline_caches_compressed_size != 0u) {
+      if (data->pending_inline_caches != nullptr) {
+        // The dex file was already loaded from another compact profile. Decode its
+        // inline caches now since they use a different profile index remapping.
+        std::lock_guard<std::mutex> mu(inline_cache_lock_);
+        if (!DecodeInlineCaches(data, error)) {
+          return kProfileLoadBadData;
+        }
+      }
+      data->pending_inline_caches.reset(new PendingInlineCaches {
+          map,
+          ptr,
+          entry.inline_caches_compressed_size,
+          entry.inline_caches_size,
+          number_of_dex_files,
+          dex_profile_index_remap });
+      has_pending_inline_caches_.StoreRelease(true);
+    }
+  }
+  return kProfileLoadSuccess;
+}
+
+bool ProfileCompilationInfo::DecodeInlineCaches(DexFileData* data, /*out*/std::string* error) {
+  std::unique_ptr<PendingInlineCaches> pending = std::move(data->pending_inline_caches);
+  if (pending == nullptr) {
+    return true;
+  }
+  SafeBuffer buffer(pending->uncompressed_size);
+  int ret = InflateBuffer(pending->data,
+                          pending->compressed_size,
+                          pending->uncompressed_size,
+                          buffer.Get());
+  if (ret != Z_STREAM_END) {
+    *error = "Error reading the inline caches of " + data->profile_key;
+    return false;
+  }
+  while (buffer.CountUnreadBytes() > 0) {
+    uint16_t method_index;
+    READ_UINT(uint16_t, buffer, method_index, error);
+    InlineCacheMap* inline_cache = data->FindOrAddMethod(method_index);
+    if (inline_cache == nullptr) {
+      *error = "Invalid method index for " + data->profile_key;
+      return false;
+    }
+    if (!ReadInlineCache(buffer,
+                         pending->number_of_dex_files,
+                         pending->dex_profile_index_remap,
+                         inline_cache,
+                         error)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void ProfileCompilationInfo::DecodePendingInlineCaches(const DexFileData* data) const {
+  if (!has_pending_inline_caches_.LoadAcquire()) {
+    return;
+  }
+  std::lock_guard<std::mutex> mu(inline_cache_lock_);
+  // Decoding only materializes inline caches which are already part of the profile.
+  ProfileCompilationInfo* self = const_cast<ProfileCompilationInfo*>(this);
+  for (DexFileData* dex_data : info_) {
+    if (data != nullptr && dex_data != data) {
+      continue;
+    }
+    std::string error;
+    if (!self->DecodeInlineCaches(dex_data, &error)) {
+      // The profile is still usable, only without (some of) these inline caches.
+      LOG(WARNING) << "Error when reading profile: " << error;
+    }
+  }
+  if (data == nullptr) {
+    has_pending_inline_caches_.StoreRelease(false);
+  }
+}
+
 bool ProfileCompilationInfo::RemapProfileIndex(
     const std::vector<ProfileLineHeader>& profile_line_headers,
     const ProfileLoadFilterFn& filter_fn,
@@ -1470,8 +1823,37 @@ int ProfileCompilationInfo::InflateBuffer(const uint8_t* in_buffer,
   return ret;
 }
 
+bool ProfileCompilationInfo::CheckInflatedSize(const uint8_t* in_buffer,
+                                               uint32_t in_size,
+                                               uint32_t out_size) {
+  if (in_size == 0u) {
+    return out_size == 0u;
+  }
+  z_stream strm;
+  strm.zalloc = Z_NULL;
+  strm.zfree = Z_NULL;
+  strm.opaque = Z_NULL;
+  strm.avail_in = in_size;
+  strm.next_in = const_cast<uint8_t*>(in_buffer);
+  if (inflateInit(&strm) != Z_OK) {
+    return false;
+  }
+  // Inflate into a small scratch buffer, only the total size is checked.
+  uint8_t scratch[4 * KB];
+  int ret;
+  do {
+    strm.avail_out = sizeof(scratch);
+    strm.next_out = scratch;
+    ret = inflate(&strm, Z_NO_FLUSH);
+  } while (ret == Z_OK && strm.total_out <= out_size);
+  bool valid = (ret == Z_STREAM_END) && strm.avail_in == 0u && strm.total_out == out_size;
+  inflateEnd(&strm);
+  return valid;
+}
+
 bool ProfileCompilationInfo::MergeWith(const ProfileCompilationInfo& other,
                                        bool merge_classes) {
+  other.DecodePendingInlineCaches();
   // First verify that all checksums match. This will avoid adding garbage to
   // the current profile info.
   // Note that the number of elements should be very small, so this should not
@@ -1591,10 +1973,15 @@ std::unique_ptr<ProfileCompilationInfo::OfflineProfileMethodInfo> ProfileCompila
     const std::string& dex_location,
     uint32_t dex_checksum,
     uint16_t dex_method_index) const {
-  MethodHotness hotness(GetMethodHotness(dex_location, dex_checksum, dex_method_index));
+  const DexFileData* data = FindDexData(GetProfileDexFileKey(dex_location), dex_checksum);
+  if (data == nullptr) {
+    return nullptr;
+  }
+  MethodHotness hotness(data->GetHotnessInfo(dex_method_index));
   if (!hotness.IsHot()) {
     return nullptr;
   }
+  DecodePendingInlineCaches(data);
   const InlineCacheMap* inline_caches = hotness.GetInlineCacheMap();
   DCHECK(inline_caches != nullptr);
   std::unique_ptr<OfflineProfileMethodInfo> pmi(new OfflineProfileMethodInfo(inline_caches));
@@ -1659,6 +2046,7 @@ std::string ProfileCompilationInfo::DumpInfo(const std::vector<const DexFile*>*
   if (info_.empty()) {
     return "ProfileInfo: empty";
   }
+  DecodePendingInlineCaches();
 
   os << "ProfileInfo:";
 
@@ -1772,6 +2160,8 @@ bool ProfileCompilationInfo::Equals(const ProfileCompilationInfo& other) {
   if (info_.size() != other.info_.size()) {
     return false;
   }
+  DecodePendingInlineCaches();
+  other.DecodePendingInlineCaches();
   for (size_t i = 0; i < info_.size(); i++) {
     const DexFileData& dex_data = *info_[i];
     const DexFileData& other_dex_data = *other.info_[i];
@@ -2111,6 +2501,7 @@ void ProfileCompilationInfo::ClearData() {
   }
   info_.clear();
   profile_key_map_.clear();
+  has_pending_inline_caches_.StoreRelease(false);
 }
 
 }  // namespace art
@@ -17,6 +17,8 @@
 #ifndef ART_RUNTIME_JIT_PROFILE_COMPILATION_INFO_H_
 #define ART_RUNTIME_JIT_PROFILE_COMPILATION_INFO_H_
 
+#include <memory>
+#include <mutex>
 #include <set>
 #include <vector>
 
@@ -71,6 +73,7 @@ class ProfileCompilationInfo {
  public:
   static const uint8_t kProfileMagic[];
   static const uint8_t kProfileVersion[];
+  static const uint8_t kProfileVersionCompact[];
 
   static const char* kDexMetadataProfileEntry;
 
@@ -346,6 +349,12 @@ class ProfileCompilationInfo {
   // Save the profile data to the given file descriptor.
   bool Save(int fd);
 
+  // Save the profile data to the given file descriptor in the compact format
+  // (kProfileVersionCompact). The compact format is larger on disk but it is loaded
+  // without inflating the whole profile: dex files rejected by the load filter are
+  // never read and inline caches are only decoded when they are first needed.
+  bool SaveCompact(int fd);
+
   // Save the current profile into the given file. The file will be cleared before saving.
   bool Save(const std::string& filename, uint64_t* bytes_written);
 
@@ -457,6 +466,18 @@ class ProfileCompilationInfo {
   const uint32_t kProfileSizeWarningThresholdInBytes = 500000U;
   const uint32_t kProfileSizeErrorThresholdInBytes = 1000000U;
 
+  // The deflated inline caches of a dex file loaded from a compact profile. They are
+  // decoded into the method map the first time they are needed.
+  struct PendingInlineCaches {
+    // The mapped profile, which holds `data`.
+    std::shared_ptr<MemMap> map;
+    const uint8_t* data;
+    uint32_t compressed_size;
+    uint32_t uncompressed_size;
+    uint8_t number_of_dex_files;
+    SafeMap<uint8_t, uint8_t> dex_profile_index_remap;
+  };
+
   // Internal representation of the profile information belonging to a dex file.
   // Note that we could do without profile_key (the key used to encode the dex
   // file in the profile) and profile_index (the index of the dex file in the
@@ -529,6 +550,8 @@ class ProfileCompilationInfo {
     uint32_t num_method_ids;
     ArenaVector<uint8_t> bitmap_storage;
     BitMemoryRegion method_bitmap;
+    // Inline caches not decoded yet, or null. See DecodeInlineCaches.
+    std::unique_ptr<PendingInlineCaches> pending_inline_caches;
 
    private:
     enum BitmapIndex {
@@ -607,6 +630,10 @@ class ProfileCompilationInfo {
                     uint32_t out_size,
                     /*out*/uint8_t* out_buffer);
 
+  // Check that the input buffer (in_buffer) of size in_size inflates to exactly out_size
+  // bytes, without keeping the inflated data.
+  static bool CheckInflatedSize(const uint8_t* in_buffer, uint32_t in_size, uint32_t out_size);
+
   // Parsing functionality.
 
   // The information present in the header of each profile line.
@@ -654,6 +681,15 @@ class ProfileCompilationInfo {
                            const std::string& debug_stage,
                            std::string* error);
 
+    /** Return true if the source is a profile in the compact format. */
+    bool IsCompact() const;
+
+    /**
+     * Map the whole content of this source. The source cannot be read
+     * afterwards. Returns null on error.
+     */
+    std::unique_ptr<MemMap> MapContent(std::string* error);
+
     /** Return true if the source has 0 data. */
     bool HasEmptyContent() const;
     /** Return true if all the information from this source has been read. */
@@ -720,6 +756,24 @@ class ProfileCompilationInfo {
       bool merge_classes = true,
       const ProfileLoadFilterFn& filter_fn = ProfileFilterFnAcceptAll);
 
+  // Load a profile in the compact format. Only the section index and the data of the
+  // dex files accepted by filter_fn are read; inline caches are left pending. Their
+  // compressed blocks are checked to inflate to the recorded size, so that a corrupt
+  // block fails the load.
+  ProfileLoadStatus LoadCompactInternal(ProfileSource& source,
+                                        std::string* error,
+                                        bool merge_classes,
+                                        const ProfileLoadFilterFn& filter_fn);
+
+  // Decode the pending inline caches of `data` into its method map.
+  // The caller must hold inline_cache_lock_.
+  bool DecodeInlineCaches(DexFileData* data, /*out*/std::string* error);
+
+  // Decode the pending inline caches of the dex data, or of all the dex files if `data`
+  // is null. Decoding does not change the observable profile, so this is const and can
+  // be called concurrently.
+  void DecodePendingInlineCaches(const DexFileData* data = nullptr) const;
+
   // Read the profile header from the given fd and store the number of profile
   // lines into number_of_dex_files.
   ProfileLoadStatus ReadProfileHeader(ProfileSource& source,
@@ -807,6 +861,12 @@ class ProfileCompilationInfo {
   // This is used to speed up searches since it avoids iterating
   // over the info_ vector when searching by profile key.
   ArenaSafeMap<const std::string, uint8_t> profile_key_map_;
+
+  // Whether any dex data may have pending inline caches. Only set while loading.
+  mutable Atomic<bool> has_pending_inline_caches_;
+  // Serializes the decoding of pending inline caches. Like MemMap, this uses a std::mutex
+  // since the profile may be queried from threads which are not attached to the runtime.
+  mutable std::mutex inline_cache_lock_;
 };
 
 }  // namespace art
@@ -1368,4 +1368,121 @@ TEST_F(ProfileCompilationInfoTest, ClearDataAndSave) {
   ASSERT_TRUE(loaded_info.Equals(info));
 }
 
+TEST_F(ProfileCompilationInfoTest, SaveCompact) {
+  ScratchFile profile;
+
+  ProfileCompilationInfo saved_info;
+  ProfileCompilationInfo::OfflineProfileMethodInfo pmi = GetOfflineProfileMethodInfo();
+  for (uint16_t method_idx = 0; method_idx < 10; method_idx++) {
+    ASSERT_TRUE(AddMethod("dex_location1", /* checksum */ 1, method_idx, pmi, &saved_info));
+    ASSERT_TRUE(AddMethod("dex_location4", /* checksum */ 4, method_idx, pmi, &saved_info));
+    // Hot methods without inline caches.
+    ASSERT_TRUE(AddMethod("dex_location2", /* checksum */ 2, method_idx, &saved_info));
+    ASSERT_TRUE(AddClass("dex_location2", /* checksum */ 2, dex::TypeIndex(method_idx),
+                         &saved_info));
+  }
+  ASSERT_TRUE(saved_info.AddMethodIndex(Hotness::kFlagStartup,
+                                        "dex_location3",
+                                        /* checksum */ 3,
+                                        /* method_idx */ 7,
+                                        kMaxMethodIds));
+
+  ASSERT_TRUE(saved_info.SaveCompact(GetFd(profile)));
+  ASSERT_EQ(0, profile.GetFile()->Flush());
+
+  // Check that we get back what we saved.
+  ProfileCompilationInfo loaded_info;
+  ASSERT_TRUE(profile.GetFile()->ResetOffset());
+  ASSERT_TRUE(loaded_info.Load(GetFd(profile)));
+
+  // The hotness and the classes are available before the inline caches are decoded.
+  ASSERT_EQ(saved_info.GetNumberOfMethods(), loaded_info.GetNumberOfMethods());
+  ASSERT_EQ(saved_info.GetNumberOfResolvedClasses(), loaded_info.GetNumberOfResolvedClasses());
+  ASSERT_TRUE(loaded_info.GetMethodHotness("dex_location3", /* checksum */ 3, 7).IsStartup());
+  ASSERT_FALSE(loaded_info.GetMethodHotness("dex_location3", /* checksum */ 3, 7).IsHot());
+
+  std::unique_ptr<ProfileCompilationInfo::OfflineProfileMethodInfo> loaded_pmi1 =
+      loaded_info.GetMethod("dex_location1", /* checksum */ 1, /* method_idx */ 3);
+  ASSERT_TRUE(loaded_pmi1 != nullptr);
+  ASSERT_TRUE(*loaded_pmi1 == pmi);
+  ASSERT_TRUE(loaded_info.Equals(saved_info));
+
+  // Saving in the regular format gives back the same profile.
+  ScratchFile regular_profile;
+  ASSERT_TRUE(loaded_info.Save(GetFd(regular_profile)));
+  ASSERT_EQ(0, regular_profile.GetFile()->Flush());
+  ProfileCompilationInfo regular_info;
+  ASSERT_TRUE(regular_profile.GetFile()->ResetOffset());
+  ASSERT_TRUE(regular_info.Load(GetFd(regular_profile)));
+  ASSERT_TRUE(regular_info.Equals(saved_info));
+}
+
+TEST_F(ProfileCompilationInfoTest, CompactCorruptInlineCaches) {
+  ScratchFile profile;
+
+  ProfileCompilationInfo saved_info;
+  ProfileCompilationInfo::OfflineProfileMethodInfo pmi = GetOfflineProfileMethodInfo();
+  for (uint16_t method_idx = 0; method_idx < 10; method_idx++) {
+    ASSERT_TRUE(AddMethod("dex_location1", /* checksum */ 1, method_idx, pmi, &saved_info));
+  }
+  ASSERT_TRUE(saved_info.SaveCompact(GetFd(profile)));
+  ASSERT_EQ(0, profile.GetFile()->Flush());
+
+  // The compressed inline caches are at the end of the profile. Corrupt the checksum
+  // of the compressed stream.
+  int64_t length = profile.GetFile()->GetLength();
+  ASSERT_GT(length, 0);
+  uint8_t last_byte;
+  ASSERT_TRUE(profile.GetFile()->PreadFully(&last_byte, sizeof(last_byte), length - 1));
+  last_byte ^= 0xff;
+  ASSERT_TRUE(profile.GetFile()->PwriteFully(&last_byte, sizeof(last_byte), length - 1));
+  ASSERT_EQ(0, profile.GetFile()->Flush());
+
+  // The load fails even though the inline caches are only decoded when first needed.
+  ProfileCompilationInfo loaded_info;
+  ASSERT_TRUE(profile.GetFile()->ResetOffset());
+  ASSERT_FALSE(loaded_info.Load(GetFd(profile)));
+}
+
+TEST_F(ProfileCompilationInfoTest, CompactFilteredLoading) {
+  ScratchFile profile;
+
+  ProfileCompilationInfo saved_info;
+  ProfileCompilationInfo::OfflineProfileMethodInfo pmi = GetOfflineProfileMethodInfo();
+  for (uint16_t method_idx = 0; method_idx < 10; method_idx++) {
+    ASSERT_TRUE(AddMethod("dex_location1", /* checksum */ 1, method_idx, pmi, &saved_info));
+    ASSERT_TRUE(AddMethod("dex_location2", /* checksum */ 2, method_idx, pmi, &saved_info));
+  }
+  ASSERT_TRUE(saved_info.SaveCompact(GetFd(profile)));
+  ASSERT_EQ(0, profile.GetFile()->Flush());
+
+  // Load the same profile in both formats with the same filter and compare.
+  ScratchFile regular_profile;
+  ASSERT_TRUE(saved_info.Save(GetFd(regular_profile)));
+  ASSERT_EQ(0, regular_profile.GetFile()->Flush());
+
+  ProfileCompilationInfo::ProfileLoadFilterFn filter_fn =
+      [](const std::string& dex_location, uint32_t checksum) -> bool {
+          return dex_location == "dex_location1" && checksum == 1;
+        };
+  ProfileCompilationInfo loaded_info;
+  ASSERT_TRUE(profile.GetFile()->ResetOffset());
+  ASSERT_TRUE(loaded_info.Load(GetFd(profile), true, filter_fn));
+  ProfileCompilationInfo expected_info;
+  ASSERT_TRUE(regular_profile.GetFile()->ResetOffset());
+  ASSERT_TRUE(expected_info.Load(GetFd(regular_profile), true, filter_fn));
+
+  for (uint16_t method_idx = 0; method_idx < 10; method_idx++) {
+    ASSERT_TRUE(nullptr == loaded_info.GetMethod("dex_location2", /* checksum */ 2, method_idx));
+    std::unique_ptr<ProfileCompilationInfo::OfflineProfileMethodInfo> loaded_pmi =
+        loaded_info.GetMethod("dex_location1", /* checksum */ 1, method_idx);
+    std::unique_ptr<ProfileCompilationInfo::OfflineProfileMethodInfo> expected_pmi =
+        expected_info.GetMethod("dex_location1", /* checksum */ 1, method_idx);
+    ASSERT_TRUE(loaded_pmi != nullptr);
+    ASSERT_TRUE(expected_pmi != nullptr);
+    ASSERT_TRUE(*loaded_pmi == *expected_pmi);
+  }
+  ASSERT_TRUE(loaded_info.Equals(expected_info));
+}
+
 }  // namespace art
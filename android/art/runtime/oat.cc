@@ -195,6 +195,11 @@ void OatHeader::UpdateChecksum(const void* data, size_t length) {
   }
 }
 
+void OatHeader::CombineChecksum(uint32_t checksum, size_t length) {
+  DCHECK(IsValid());
+  adler32_checksum_ = adler32_combine(adler32_checksum_, checksum, static_cast<z_off_t>(length));
+}
+
 InstructionSet OatHeader::GetInstructionSet() const {
   CHECK(IsValid());
   return instruction_set_;
@@ -62,6 +62,9 @@ class PACKED(4) OatHeader {
   uint32_t GetChecksum() const;
   void UpdateChecksumWithHeaderData();
   void UpdateChecksum(const void* data, size_t length);
+  // Update the checksum with `length` bytes whose own adler32 checksum, computed independently
+  // of the preceding data (e.g. on another thread), is `checksum`.
+  void CombineChecksum(uint32_t checksum, size_t length);
   uint32_t GetDexFileCount() const {
     DCHECK(IsValid());
     return dex_file_count_;
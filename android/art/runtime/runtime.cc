@@ -1345,8 +1345,14 @@ bool Runtime::Init(RuntimeArgumentMap&& runtime_options_in) {
 
   // Use MemMap arena pool for jit, malloc otherwise. Malloc arenas are faster to allocate but
   // can't be trimmed as easily.
+  // The compiler creates and destroys allocators for every method on every worker thread,
+  // so give it per-thread arena caches and huge pages for the big arenas of large methods.
   const bool use_malloc = IsAotCompiler();
-  arena_pool_.reset(new ArenaPool(use_malloc, /* low_4gb */ false));
+  arena_pool_.reset(new ArenaPool(use_malloc,
+                                  /* low_4gb */ false,
+                                  "LinearAlloc",
+                                  /* use_thread_caches */ IsAotCompiler(),
+                                  /* use_huge_pages */ IsAotCompiler()));
   jit_arena_pool_.reset(
       new ArenaPool(/* use_malloc */ false, /* low_4gb */ false, "CompilerMetadata"));
 
@@ -121,6 +121,12 @@ class VerifierDeps {
     return GetDexFileDeps(dex_file)->unverified_classes_;
   }
 
+  // Forget that the class `type_idx` of `dex_file` could not be verified, so that it can be
+  // verified again and its new status recorded.
+  void ClearUnverifiedClass(const DexFile& dex_file, dex::TypeIndex type_idx) {
+    GetDexFileDeps(dex_file)->unverified_classes_.erase(type_idx);
+  }
+
   bool OutputOnly() const {
     return output_only_;
   }
@@ -18,10 +18,13 @@
 
 #include <fcntl.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/mman.h>  // For the PROT_* and MAP_* constants.
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+
+#include <algorithm>
 #include <vector>
 
 #include "android-base/stringprintf.h"
@@ -97,6 +100,45 @@ MemMap* ZipEntry::ExtractToMemMap(const char* zip_filename, const char* entry_fi
   return map.release();
 }
 
+namespace {
+
+struct PrefixBuffer {
+  uint8_t* data;
+  size_t size;
+  size_t filled;
+};
+
+bool AppendToPrefix(const uint8_t* buf, size_t buf_size, void* cookie) {
+  PrefixBuffer* prefix = reinterpret_cast<PrefixBuffer*>(cookie);
+  size_t count = std::min(buf_size, prefix->size - prefix->filled);
+  memcpy(prefix->data + prefix->filled, buf, count);
+  prefix->filled += count;
+  // Stop inflating once the prefix is complete.
+  return prefix->filled != prefix->size;
+}
+
+}  // namespace
+
+bool ZipEntry::ExtractPrefix(uint8_t* buffer, size_t size, std::string* error_msg) {
+  if (size > GetUncompressedLength()) {
+    *error_msg = StringPrintf("Zip entry '%s' is shorter than %zu bytes",
+                              entry_name_.c_str(),
+                              size);
+    return false;
+  }
+  PrefixBuffer prefix = { buffer, size, 0u };
+  if (size == 0u) {
+    return true;
+  }
+  const int32_t error = ProcessZipEntryContents(handle_, zip_entry_, AppendToPrefix, &prefix);
+  // Stopping early is reported as an error, so only check the buffer.
+  if (prefix.filled != size) {
+    *error_msg = std::string(ErrorCodeString(error));
+    return false;
+  }
+  return true;
+}
+
 MemMap* ZipEntry::MapDirectlyFromFile(const char* zip_filename, std::string* error_msg) {
   const int zip_fd = GetFileDescriptor(handle_);
   const char* entry_filename = entry_name_.c_str();
@@ -251,6 +293,10 @@ ZipArchive* ZipArchive::OpenFromFd(int fd, const char* filename, std::string* er
   return new ZipArchive(handle);
 }
 
+int ZipArchive::GetFd() const {
+  return GetFileDescriptor(handle_);
+}
+
 ZipEntry* ZipArchive::Find(const char* name, std::string* error_msg) const {
   DCHECK(name != nullptr);
 
@@ -59,6 +59,10 @@ class ZipEntry {
                                const char* entry_filename,
                                std::string* error_msg);
 
+  // Extract the first `size` bytes of this entry to `buffer`, inflating no more of a
+  // compressed entry than needed. Returns false on failure and sets error_msg.
+  bool ExtractPrefix(uint8_t* buffer, size_t size, std::string* error_msg);
+
   uint32_t GetUncompressedLength();
   uint32_t GetCrc32();
 
@@ -88,6 +92,9 @@ class ZipArchive {
 
   ZipEntry* Find(const char* name, std::string* error_msg) const;
 
+  // Return the file descriptor of the archive.
+  int GetFd() const;
+
   ~ZipArchive();
 
  private:
@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Same as DexDiffA, except for the changed, removed and added methods. The string and
+// method referenced by added() sort before those referenced by unchanged(), so the
+// indices in the code of unchanged() differ from DexDiffA.
+class DexDiff {
+    static int unchanged(int i) {
+        return i + Integer.parseInt("42");
+    }
+
+    static String changed() {
+        return "after" + unchanged(1);
+    }
+
+    static void added() {
+        System.out.println(" " + Boolean.valueOf(true));
+    }
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+class OpaquePredicates {
+    private static int sOpaque = 1;
+    private static int sOnePath = 2;
+    private static int sInHandler = 3;
+    static int sink;
+
+    static int opaque() {
+        if ((sOpaque * (sOpaque + 1)) % 2 == 0) {
+            return 1;
+        }
+        return 0;
+    }
+
+    // The condition reads sOnePath on one path, but the parameter on the other one.
+    static int parameterOnOnePath(int p, boolean flag) {
+        int x = p;
+        if (flag) {
+            x = sOnePath;
+        }
+        if (x > 0) {
+            return 1;
+        }
+        return 0;
+    }
+
+    // The condition is only reachable through the exception handler.
+    static int inHandler(Object o) {
+        try {
+            sink = o.hashCode();
+        } catch (NullPointerException e) {
+            if (sInHandler == 42) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+}
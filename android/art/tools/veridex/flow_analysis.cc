@@ -21,6 +21,7 @@
 #include "dex/dex_instruction-inl.h"
 #include "dex/dex_file-inl.h"
 #include "dex/dex_file_exception_helpers.h"
+#include "dex/modifiers.h"
 #include "resolver.h"
 #include "veridex.h"
 
@@ -39,13 +40,26 @@ bool VeriFlowAnalysis::IsBranchTarget(uint32_t dex_pc) {
 }
 
 bool VeriFlowAnalysis::MergeRegisterValues(uint32_t dex_pc) {
-  // TODO: Do the merging. Right now, just return that we should continue
-  // the iteration if the instruction has not been visited.
-  if (!instruction_infos_[dex_pc].has_been_visited) {
-    dex_registers_[dex_pc]->assign(current_registers_.begin(), current_registers_.end());
+  std::vector<RegisterValue>& registers = *dex_registers_[dex_pc].get();
+  if (!instruction_infos_[dex_pc].has_register_values) {
+    registers.assign(current_registers_.begin(), current_registers_.end());
+    instruction_infos_[dex_pc].has_register_values = true;
     return true;
   }
-  return false;
+  // Values only lose their source and type, and gain inputs, so this reaches a fixpoint.
+  bool changed = false;
+  for (size_t i = 0; i != registers.size(); ++i) {
+    changed |= registers[i].Merge(current_registers_[i]);
+  }
+  return changed;
+}
+
+void VeriFlowAnalysis::MergeIntoCatchHandlers(uint32_t dex_pc, std::vector<uint32_t>* work_list) {
+  for (CatchHandlerIterator it(code_item_accessor_, dex_pc); it.HasNext(); it.Next()) {
+    if (MergeRegisterValues(it.GetHandlerAddress())) {
+      work_list->push_back(it.GetHandlerAddress());
+    }
+  }
 }
 
 void VeriFlowAnalysis::SetVisited(uint32_t dex_pc) {
@@ -56,15 +70,8 @@ void VeriFlowAnalysis::FindBranches() {
   SetAsBranchTarget(0);
 
   if (code_item_accessor_.TriesSize() != 0) {
-    // TODO: We need to mark the range of dex pcs as flowing in the handlers.
-    /*
-    for (const DexFile::TryItem& try_item : code_item_accessor_.TryItems()) {
-      uint32_t dex_pc_start = try_item.start_addr_;
-      uint32_t dex_pc_end = dex_pc_start + try_item.insn_count_;
-    }
-    */
-
-    // Create branch targets for exception handlers.
+    // Create branch targets for exception handlers. The instructions that can throw in
+    // the try ranges flow into them, see MergeIntoCatchHandlers.
     const uint8_t* handlers_ptr = code_item_accessor_.GetCatchHandlerData();
     uint32_t handlers_size = DecodeUnsignedLeb128(&handlers_ptr);
     for (uint32_t idx = 0; idx < handlers_size; ++idx) {
@@ -117,6 +124,16 @@ void VeriFlowAnalysis::UpdateRegister(uint32_t dex_register, int32_t value, cons
       RegisterValue(RegisterSource::kConstant, value, DexFileReference(nullptr, 0), cls);
 }
 
+void VeriFlowAnalysis::UpdateRegisterFromInputs(uint32_t dex_register,
+                                                const VeriClass* cls,
+                                                std::initializer_list<uint32_t> inputs) {
+  RegisterValue value(RegisterSource::kNone, DexFileReference(nullptr, 0), cls);
+  for (uint32_t input : inputs) {
+    value.AddInput(GetRegister(input));
+  }
+  current_registers_[dex_register] = value;
+}
+
 const RegisterValue& VeriFlowAnalysis::GetRegister(uint32_t dex_register) const {
   return current_registers_[dex_register];
 }
@@ -194,6 +211,10 @@ void VeriFlowAnalysis::AnalyzeCode() {
     while (true) {
       const uint16_t* insns = code_item_accessor_.Insns() + dex_pc;
       const Instruction& inst = *Instruction::At(insns);
+      if (inst.IsThrow() && code_item_accessor_.TriesSize() != 0) {
+        // The handlers see the register values from before the throwing instruction.
+        MergeIntoCatchHandlers(dex_pc, &work_list);
+      }
       ProcessDexInstruction(inst);
       SetVisited(dex_pc);
 
@@ -338,8 +359,8 @@ void VeriFlowAnalysis::ProcessDexInstruction(const Instruction& instruction) {
 
     // If operations will be handled when looking at the control flow.
     #define IF_XX(cond) \
-    case Instruction::IF_##cond: break; \
-    case Instruction::IF_##cond##Z: break
+    case Instruction::IF_##cond: AnalyzeConditionalBranch(instruction); break; \
+    case Instruction::IF_##cond##Z: AnalyzeConditionalBranch(instruction); break
 
     IF_XX(EQ);
     IF_XX(NE);
@@ -371,7 +392,7 @@ void VeriFlowAnalysis::ProcessDexInstruction(const Instruction& instruction) {
     case Instruction::NEG_DOUBLE:
     case Instruction::NOT_INT:
     case Instruction::NOT_LONG: {
-      UpdateRegister(instruction.VRegA(), VeriClass::integer_);
+      UpdateRegisterFromInputs(instruction.VRegA(), VeriClass::integer_, { instruction.VRegB() });
       break;
     }
 
@@ -390,7 +411,7 @@ void VeriFlowAnalysis::ProcessDexInstruction(const Instruction& instruction) {
     case Instruction::INT_TO_BYTE:
     case Instruction::INT_TO_SHORT:
     case Instruction::INT_TO_CHAR: {
-      UpdateRegister(instruction.VRegA(), VeriClass::integer_);
+      UpdateRegisterFromInputs(instruction.VRegA(), VeriClass::integer_, { instruction.VRegB() });
       break;
     }
 
@@ -426,7 +447,9 @@ void VeriFlowAnalysis::ProcessDexInstruction(const Instruction& instruction) {
     case Instruction::OR_LONG:
     case Instruction::XOR_INT:
     case Instruction::XOR_LONG: {
-      UpdateRegister(instruction.VRegA(), VeriClass::integer_);
+      UpdateRegisterFromInputs(instruction.VRegA(),
+                               VeriClass::integer_,
+                               { instruction.VRegB(), instruction.VRegC() });
       break;
     }
 
@@ -462,7 +485,9 @@ void VeriFlowAnalysis::ProcessDexInstruction(const Instruction& instruction) {
     case Instruction::OR_LONG_2ADDR:
     case Instruction::XOR_INT_2ADDR:
     case Instruction::XOR_LONG_2ADDR: {
-      UpdateRegister(instruction.VRegA(), VeriClass::integer_);
+      UpdateRegisterFromInputs(instruction.VRegA(),
+                               VeriClass::integer_,
+                               { instruction.VRegA(), instruction.VRegB() });
       break;
     }
 
@@ -474,7 +499,7 @@ void VeriFlowAnalysis::ProcessDexInstruction(const Instruction& instruction) {
     case Instruction::MUL_INT_LIT16:
     case Instruction::DIV_INT_LIT16:
     case Instruction::REM_INT_LIT16: {
-      UpdateRegister(instruction.VRegA(), VeriClass::integer_);
+      UpdateRegisterFromInputs(instruction.VRegA(), VeriClass::integer_, { instruction.VRegB() });
       break;
     }
 
@@ -489,7 +514,7 @@ void VeriFlowAnalysis::ProcessDexInstruction(const Instruction& instruction) {
     case Instruction::SHL_INT_LIT8:
     case Instruction::SHR_INT_LIT8: {
     case Instruction::USHR_INT_LIT8: {
-      UpdateRegister(instruction.VRegA(), VeriClass::integer_);
+      UpdateRegisterFromInputs(instruction.VRegA(), VeriClass::integer_, { instruction.VRegB() });
       break;
     }
 
@@ -530,7 +555,9 @@ void VeriFlowAnalysis::ProcessDexInstruction(const Instruction& instruction) {
     case Instruction::CMPG_DOUBLE:
     case Instruction::CMPL_FLOAT:
     case Instruction::CMPL_DOUBLE:
-      UpdateRegister(instruction.VRegA(), VeriClass::integer_);
+      UpdateRegisterFromInputs(instruction.VRegA(),
+                               VeriClass::integer_,
+                               { instruction.VRegB(), instruction.VRegC() });
       break;
     }
 
@@ -544,7 +571,9 @@ void VeriFlowAnalysis::ProcessDexInstruction(const Instruction& instruction) {
     case Instruction::IGET_BYTE:
     case Instruction::IGET_CHAR:
     case Instruction::IGET_SHORT: {
-      UpdateRegister(instruction.VRegA_22c(), GetFieldType(instruction.VRegC_22c()));
+      RegisterValue value = GetFieldType(instruction.VRegC_22c());
+      value.AddInput(GetRegister(instruction.VRegB_22c()));
+      UpdateRegister(instruction.VRegA_22c(), value);
       break;
     }
 
@@ -571,7 +600,9 @@ void VeriFlowAnalysis::ProcessDexInstruction(const Instruction& instruction) {
       if (VeriClass::sdkInt_ != nullptr && resolver_->GetField(field_index) == VeriClass::sdkInt_) {
         UpdateRegister(dest_reg, gTargetSdkVersion, VeriClass::integer_);
       } else {
-        UpdateRegister(dest_reg, GetFieldType(instruction.VRegC_22c()));
+        RegisterValue value = GetFieldType(field_index);
+        value.AddStaticFieldInput(field_index);
+        UpdateRegister(dest_reg, value);
       }
       break;
     }
@@ -589,7 +620,10 @@ void VeriFlowAnalysis::ProcessDexInstruction(const Instruction& instruction) {
 
 #define ARRAY_XX(kind, anticipated_type)                                          \
     case Instruction::AGET##kind: {                                               \
-      UpdateRegister(instruction.VRegA_23x(), anticipated_type);                  \
+      UpdateRegisterFromInputs(instruction.VRegA_23x(),                           \
+                               anticipated_type,                                  \
+                               { instruction.VRegB_23x(),                         \
+                                 instruction.VRegC_23x() });                      \
       break;                                                                      \
     }                                                                             \
     case Instruction::APUT##kind: {                                               \
@@ -614,7 +648,8 @@ void VeriFlowAnalysis::ProcessDexInstruction(const Instruction& instruction) {
     }
 
     case Instruction::ARRAY_LENGTH: {
-      UpdateRegister(instruction.VRegA_12x(), VeriClass::integer_);
+      UpdateRegisterFromInputs(
+          instruction.VRegA_12x(), VeriClass::integer_, { instruction.VRegB_12x() });
       break;
     }
 
@@ -666,6 +701,7 @@ void VeriFlowAnalysis::Run() {
       DexFileReference(&resolver_->GetDexFile(), method_id_),
       nullptr);
   }
+  instruction_infos_[0].has_register_values = true;
   AnalyzeCode();
 }
 
@@ -694,14 +730,14 @@ RegisterValue FlowAnalysisCollector::AnalyzeInvoke(const Instruction& instructio
     // second parameter for the field name.
     RegisterValue cls = GetRegister(GetParameterAt(instruction, is_range, args, 0));
     RegisterValue name = GetRegister(GetParameterAt(instruction, is_range, args, 1));
-    uses_.push_back(ReflectAccessInfo(cls, name, /* is_method */ false));
+    uses_[GetDexPc(instruction)] = { ReflectAccessInfo(cls, name, /* is_method */ false) };
     return GetReturnType(id);
   } else if (IsGetMethod(method)) {
     // Class.getMethod or Class.getDeclaredMethod. Fetch the first parameter for the class, and the
     // second parameter for the field name.
     RegisterValue cls = GetRegister(GetParameterAt(instruction, is_range, args, 0));
     RegisterValue name = GetRegister(GetParameterAt(instruction, is_range, args, 1));
-    uses_.push_back(ReflectAccessInfo(cls, name, /* is_method */ true));
+    uses_[GetDexPc(instruction)] = { ReflectAccessInfo(cls, name, /* is_method */ true) };
     return GetReturnType(id);
   } else if (method == VeriClass::getClass_) {
     // Get the type of the first parameter.
@@ -729,6 +765,19 @@ RegisterValue FlowAnalysisCollector::AnalyzeInvoke(const Instruction& instructio
   }
 }
 
+static std::vector<ReflectAccessInfo> FlattenUses(
+    const std::map<uint32_t, std::vector<ReflectAccessInfo>>& uses) {
+  std::vector<ReflectAccessInfo> result;
+  for (const auto& entry : uses) {
+    result.insert(result.end(), entry.second.begin(), entry.second.end());
+  }
+  return result;
+}
+
+std::vector<ReflectAccessInfo> FlowAnalysisCollector::GetUses() const {
+  return FlattenUses(uses_);
+}
+
 void FlowAnalysisCollector::AnalyzeFieldSet(const Instruction& instruction ATTRIBUTE_UNUSED) {
   // There are no fields that escape reflection uses.
 }
@@ -746,6 +795,8 @@ RegisterValue FlowAnalysisSubstitutor::AnalyzeInvoke(const Instruction& instruct
   if (!is_range) {
     instruction.GetVarArgs(args);
   }
+  std::vector<ReflectAccessInfo>& uses = uses_[GetDexPc(instruction)];
+  uses.clear();
   for (const ReflectAccessInfo& info : accesses_.at(method)) {
     if (info.cls.IsParameter() || info.name.IsParameter()) {
       RegisterValue cls = info.cls.IsParameter()
@@ -754,14 +805,93 @@ RegisterValue FlowAnalysisSubstitutor::AnalyzeInvoke(const Instruction& instruct
       RegisterValue name = info.name.IsParameter()
           ? GetRegister(GetParameterAt(instruction, is_range, args, info.name.GetParameterIndex()))
           : info.name;
-      uses_.push_back(ReflectAccessInfo(cls, name, info.is_method));
+      uses.push_back(ReflectAccessInfo(cls, name, info.is_method));
     }
   }
   return GetReturnType(id);
 }
 
+std::vector<ReflectAccessInfo> FlowAnalysisSubstitutor::GetUses() const {
+  return FlattenUses(uses_);
+}
+
 void FlowAnalysisSubstitutor::AnalyzeFieldSet(const Instruction& instruction ATTRIBUTE_UNUSED) {
   // TODO: analyze field sets.
 }
 
+RegisterValue OpaquePredicateCollector::AnalyzeInvoke(const Instruction& instruction,
+                                                      bool is_range) {
+  uint32_t id = is_range ? instruction.VRegB_3rc() : instruction.VRegB_35c();
+  return GetReturnType(id);
+}
+
+void OpaquePredicateCollector::AnalyzeFieldSet(const Instruction& instruction) {
+  switch (instruction.Opcode()) {
+    case Instruction::SPUT:
+    case Instruction::SPUT_WIDE:
+    case Instruction::SPUT_OBJECT:
+    case Instruction::SPUT_BOOLEAN:
+    case Instruction::SPUT_BYTE:
+    case Instruction::SPUT_CHAR:
+    case Instruction::SPUT_SHORT: {
+      const RegisterValue& value = GetRegister(instruction.VRegA_21c());
+      if (IsOpaque(value)) {
+        field_set_uses_[GetDexPc(instruction)] =
+            std::make_pair(instruction.VRegB_21c(), value.GetStaticFieldInputs()[0]);
+      } else {
+        // A later visit can find that a parameter or invoke flows in on another path.
+        field_set_uses_.erase(GetDexPc(instruction));
+      }
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+void OpaquePredicateCollector::AnalyzeConditionalBranch(const Instruction& instruction) {
+  RegisterValue condition = GetRegister(instruction.VRegA());
+  if (condition.GetType() != VeriClass::integer_) {
+    return;
+  }
+  if (Instruction::FormatOf(instruction.Opcode()) == Instruction::k22t) {
+    // if-<cond> vA, vB. if-<cond>z only has vA.
+    condition.AddInput(GetRegister(instruction.VRegB()));
+  }
+  if (IsOpaque(condition)) {
+    if_uses_[GetDexPc(instruction)] = condition.GetStaticFieldInputs();
+  } else {
+    if_uses_.erase(GetDexPc(instruction));
+  }
+}
+
+bool OpaquePredicateCollector::IsOpaque(const RegisterValue& value) {
+  if (value.DependsOnParameterOrInvoke()) {
+    return false;
+  }
+  for (uint32_t field_index : value.GetStaticFieldInputs()) {
+    if (IsOpaqueField(field_index)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool OpaquePredicateCollector::IsOpaqueField(uint32_t field_index) {
+  const DexFile& dex_file = resolver_->GetDexFile();
+  const DexFile::FieldId& field_id = dex_file.GetFieldId(field_index);
+  // Like HOpaqueIdentification, only consider the fields of the class of the method.
+  if (field_id.class_idx_ != dex_file.GetMethodId(GetMethodIndex()).class_idx_ ||
+      resolver_->GetVeriClass(field_id.type_idx_) != VeriClass::integer_) {
+    return false;
+  }
+  VeriField field = resolver_->GetField(field_index);
+  if (field == nullptr) {
+    return false;
+  }
+  // A VeriField points to the encoded_field: the field index delta, then the access flags.
+  DecodeUnsignedLeb128(&field);
+  return DecodeUnsignedLeb128(&field) == (kAccPrivate | kAccStatic);
+}
+
 }  // namespace art
@@ -24,6 +24,12 @@
 #include "resolver.h"
 #include "veridex.h"
 
+#include <algorithm>
+#include <initializer_list>
+#include <map>
+#include <utility>
+#include <vector>
+
 namespace art {
 
 /**
@@ -73,6 +79,61 @@ class RegisterValue {
   bool IsString() const { return source_ == RegisterSource::kString; }
   bool IsConstant() const { return source_ == RegisterSource::kConstant; }
 
+  // Static fields whose values flowed into this value, in the order they were first read.
+  const std::vector<uint32_t>& GetStaticFieldInputs() const { return static_field_inputs_; }
+
+  // Whether a parameter or the result of an invoke flowed into this value.
+  bool DependsOnParameterOrInvoke() const {
+    return IsParameter() || source_ == RegisterSource::kMethod || depends_on_parameter_or_invoke_;
+  }
+
+  // Record that the static field `field_index` was read to compute this value.
+  void AddStaticFieldInput(uint32_t field_index) {
+    if (std::find(static_field_inputs_.begin(), static_field_inputs_.end(), field_index) ==
+            static_field_inputs_.end()) {
+      static_field_inputs_.push_back(field_index);
+    }
+  }
+
+  // Record that `input` was used to compute this value.
+  void AddInput(const RegisterValue& input) {
+    depends_on_parameter_or_invoke_ |= input.DependsOnParameterOrInvoke();
+    for (uint32_t field_index : input.static_field_inputs_) {
+      AddStaticFieldInput(field_index);
+    }
+  }
+
+  // Merge `other`, the value of the same register on another path to the same instruction.
+  // The result only keeps the source and type both paths agree on, but everything that
+  // flowed into either of them. Returns whether this value changed.
+  bool Merge(const RegisterValue& other) {
+    bool changed = false;
+    if (source_ != RegisterSource::kNone &&
+        (source_ != other.source_ || value_ != other.value_ || !(reference_ == other.reference_))) {
+      depends_on_parameter_or_invoke_ = DependsOnParameterOrInvoke();
+      source_ = RegisterSource::kNone;
+      value_ = 0;
+      reference_ = DexFileReference(nullptr, 0);
+      changed = true;
+    }
+    if (type_ != nullptr && type_ != other.type_) {
+      type_ = nullptr;
+      changed = true;
+    }
+    if (!DependsOnParameterOrInvoke() && other.DependsOnParameterOrInvoke()) {
+      depends_on_parameter_or_invoke_ = true;
+      changed = true;
+    }
+    for (uint32_t field_index : other.static_field_inputs_) {
+      if (std::find(static_field_inputs_.begin(), static_field_inputs_.end(), field_index) ==
+              static_field_inputs_.end()) {
+        static_field_inputs_.push_back(field_index);
+        changed = true;
+      }
+    }
+    return changed;
+  }
+
   std::string ToString() const {
     switch (source_) {
       case RegisterSource::kString: {
@@ -100,10 +161,14 @@ class RegisterValue {
   uint32_t value_;
   DexFileReference reference_;
   const VeriClass* type_;
+  std::vector<uint32_t> static_field_inputs_;
+  bool depends_on_parameter_or_invoke_ = false;
 };
 
 struct InstructionInfo {
   bool has_been_visited;
+  // Whether a path reached this branch target, and its register values are set.
+  bool has_register_values;
 };
 
 class VeriFlowAnalysis {
@@ -119,6 +184,8 @@ class VeriFlowAnalysis {
 
   virtual RegisterValue AnalyzeInvoke(const Instruction& instruction, bool is_range) = 0;
   virtual void AnalyzeFieldSet(const Instruction& instruction) = 0;
+  // Called on if-* instructions, before the branch is taken.
+  virtual void AnalyzeConditionalBranch(const Instruction& instruction ATTRIBUTE_UNUSED) {}
   virtual ~VeriFlowAnalysis() {}
 
  private:
@@ -139,11 +206,19 @@ class VeriFlowAnalysis {
   // to be visited again.
   bool MergeRegisterValues(uint32_t dex_pc);
 
+  // Merge `current_registers` into the handlers catching exceptions thrown at the given pc,
+  // and add the handlers that need to be visited again to `work_list`.
+  void MergeIntoCatchHandlers(uint32_t dex_pc, std::vector<uint32_t>* work_list);
+
   void UpdateRegister(
       uint32_t dex_register, RegisterSource kind, VeriClass* cls, uint32_t source_id);
   void UpdateRegister(uint32_t dex_register, const RegisterValue& value);
   void UpdateRegister(uint32_t dex_register, const VeriClass* cls);
   void UpdateRegister(uint32_t dex_register, int32_t value, const VeriClass* cls);
+  // Set `dex_register` to a value of type `cls` computed from the values of `inputs`.
+  void UpdateRegisterFromInputs(uint32_t dex_register,
+                                const VeriClass* cls,
+                                std::initializer_list<uint32_t> inputs);
   void ProcessDexInstruction(const Instruction& inst);
   void SetVisited(uint32_t dex_pc);
   RegisterValue GetFieldType(uint32_t field_index);
@@ -153,6 +228,10 @@ class VeriFlowAnalysis {
  protected:
   const RegisterValue& GetRegister(uint32_t dex_register) const;
   RegisterValue GetReturnType(uint32_t method_index);
+  uint32_t GetDexPc(const Instruction& instruction) const {
+    return instruction.GetDexPc(code_item_accessor_.Insns());
+  }
+  uint32_t GetMethodIndex() const { return method_id_; }
 
   VeridexResolver* resolver_;
 
@@ -192,16 +271,16 @@ class FlowAnalysisCollector : public VeriFlowAnalysis {
   FlowAnalysisCollector(VeridexResolver* resolver, const ClassDataItemIterator& it)
       : VeriFlowAnalysis(resolver, it) {}
 
-  const std::vector<ReflectAccessInfo>& GetUses() const {
-    return uses_;
-  }
+  std::vector<ReflectAccessInfo> GetUses() const;
 
   RegisterValue AnalyzeInvoke(const Instruction& instruction, bool is_range) OVERRIDE;
   void AnalyzeFieldSet(const Instruction& instruction) OVERRIDE;
 
  private:
-  // List of reflection uses found, concrete and abstract.
-  std::vector<ReflectAccessInfo> uses_;
+  // List of reflection uses found, concrete and abstract, keyed by the dex pc of the invoke.
+  // Instructions are visited again until the register values reach a fixpoint, and the
+  // last visit wins.
+  std::map<uint32_t, std::vector<ReflectAccessInfo>> uses_;
 };
 
 // Substitutes reflection uses by new ones.
@@ -212,20 +291,55 @@ class FlowAnalysisSubstitutor : public VeriFlowAnalysis {
                           const std::map<MethodReference, std::vector<ReflectAccessInfo>>& accesses)
       : VeriFlowAnalysis(resolver, it), accesses_(accesses) {}
 
-  const std::vector<ReflectAccessInfo>& GetUses() const {
-    return uses_;
-  }
+  std::vector<ReflectAccessInfo> GetUses() const;
 
   RegisterValue AnalyzeInvoke(const Instruction& instruction, bool is_range) OVERRIDE;
   void AnalyzeFieldSet(const Instruction& instruction) OVERRIDE;
 
  private:
-  // List of reflection uses found, concrete and abstract.
-  std::vector<ReflectAccessInfo> uses_;
+  // List of reflection uses found, concrete and abstract, keyed by the dex pc of the invoke.
+  // Instructions are visited again until the register values reach a fixpoint, and the
+  // last visit wins.
+  std::map<uint32_t, std::vector<ReflectAccessInfo>> uses_;
   // The abstract uses we are trying to subsititute.
   const std::map<MethodReference, std::vector<ReflectAccessInfo>>& accesses_;
 };
 
+// Collects the static fields used by opaque predicates: conditions and static field stores
+// computed only from constants and private static int fields, without any parameter or
+// invoke result. Reports the same fields as the HOpaqueIdentification pass of the optimizing
+// compiler, without needing a runtime.
+class OpaquePredicateCollector : public VeriFlowAnalysis {
+ public:
+  OpaquePredicateCollector(VeridexResolver* resolver, const ClassDataItemIterator& it)
+      : VeriFlowAnalysis(resolver, it) {}
+
+  // The static fields read by each opaque if-*, keyed by dex pc.
+  const std::map<uint32_t, std::vector<uint32_t>>& GetIfUses() const {
+    return if_uses_;
+  }
+
+  // The stored field and the first static field read by each opaque sput, keyed by dex pc.
+  const std::map<uint32_t, std::pair<uint32_t, uint32_t>>& GetFieldSetUses() const {
+    return field_set_uses_;
+  }
+
+  RegisterValue AnalyzeInvoke(const Instruction& instruction, bool is_range) OVERRIDE;
+  void AnalyzeFieldSet(const Instruction& instruction) OVERRIDE;
+  void AnalyzeConditionalBranch(const Instruction& instruction) OVERRIDE;
+
+ private:
+  // Whether `value` is computed from at least one private static int field and nothing
+  // but constants and static fields.
+  bool IsOpaque(const RegisterValue& value);
+
+  // Whether `field_index` is a private static int field.
+  bool IsOpaqueField(uint32_t field_index);
+
+  std::map<uint32_t, std::vector<uint32_t>> if_uses_;
+  std::map<uint32_t, std::pair<uint32_t, uint32_t>> field_set_uses_;
+};
+
 }  // namespace art
 
 #endif  // ART_TOOLS_VERIDEX_FLOW_ANALYSIS_H_
@@ -16,6 +16,7 @@
 
 #include "hidden_api_finder.h"
 
+#include "base/parallel_for.h"
 #include "dex/code_item_accessors-inl.h"
 #include "dex/dex_instruction-inl.h"
 #include "dex/dex_file.h"
@@ -50,7 +51,7 @@ void HiddenApiFinder::CheckField(uint32_t field_id,
   }
 }
 
-void HiddenApiFinder::CollectAccesses(VeridexResolver* resolver) {
+void HiddenApiFinder::CollectTypeAccesses(VeridexResolver* resolver) {
   const DexFile& dex_file = resolver->GetDexFile();
   // Look at all types referenced in this dex file. Any of these
   // types can lead to being used through reflection.
@@ -60,10 +61,14 @@ void HiddenApiFinder::CollectAccesses(VeridexResolver* resolver) {
       classes_.insert(name);
     }
   }
+}
+
+void HiddenApiFinder::CollectAccesses(const ClassDefRange& range) {
+  VeridexResolver* resolver = range.resolver;
+  const DexFile& dex_file = resolver->GetDexFile();
   // Note: we collect strings constants only referenced in code items as the string table
   // contains other kind of strings (eg types).
-  size_t class_def_count = dex_file.NumClassDefs();
-  for (size_t class_def_index = 0; class_def_index < class_def_count; ++class_def_index) {
+  for (uint32_t class_def_index = range.begin; class_def_index < range.end; ++class_def_index) {
     const DexFile::ClassDef& class_def = dex_file.GetClassDef(class_def_index);
     const uint8_t* class_data = dex_file.GetClassData(class_def);
     if (class_data == nullptr) {
@@ -185,9 +190,38 @@ void HiddenApiFinder::CollectAccesses(VeridexResolver* resolver) {
   }
 }
 
-void HiddenApiFinder::Run(const std::vector<std::unique_ptr<VeridexResolver>>& resolvers) {
+static void AppendLocations(const std::map<std::string, std::vector<MethodReference>>& from,
+                            std::map<std::string, std::vector<MethodReference>>* to) {
+  for (const std::pair<std::string, std::vector<MethodReference>>& pair : from) {
+    std::vector<MethodReference>& refs = (*to)[pair.first];
+    refs.insert(refs.end(), pair.second.begin(), pair.second.end());
+  }
+}
+
+void HiddenApiFinder::Merge(const HiddenApiFinder& other) {
+  classes_.insert(other.classes_.begin(), other.classes_.end());
+  strings_.insert(other.strings_.begin(), other.strings_.end());
+  AppendLocations(other.reflection_locations_, &reflection_locations_);
+  AppendLocations(other.method_locations_, &method_locations_);
+  AppendLocations(other.field_locations_, &field_locations_);
+}
+
+void HiddenApiFinder::Run(const std::vector<std::unique_ptr<VeridexResolver>>& resolvers,
+                          size_t num_threads) {
   for (const std::unique_ptr<VeridexResolver>& resolver : resolvers) {
-    CollectAccesses(resolver.get());
+    CollectTypeAccesses(resolver.get());
+  }
+  // Look at the code of each range of class defs separately, and merge the accesses
+  // in class def order so that the locations are reported in the same order whatever
+  // the number of threads.
+  std::vector<ClassDefRange> ranges = SplitClassDefs(resolvers);
+  std::vector<std::unique_ptr<HiddenApiFinder>> range_finders(ranges.size());
+  ParallelFor(ranges.size(), num_threads, [&](size_t i) {
+    range_finders[i].reset(new HiddenApiFinder(hidden_api_));
+    range_finders[i]->CollectAccesses(ranges[i]);
+  });
+  for (const std::unique_ptr<HiddenApiFinder>& range_finder : range_finders) {
+    Merge(*range_finder);
   }
 }
 
@@ -21,14 +21,17 @@
 
 #include <iostream>
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
+#include <vector>
 
 namespace art {
 
 class HiddenApi;
 struct HiddenApiStats;
 class VeridexResolver;
+struct ClassDefRange;
 
 /**
  * Reports potential uses of hidden APIs from static linking and reflection.
@@ -38,13 +41,18 @@ class HiddenApiFinder {
   explicit HiddenApiFinder(const HiddenApi& hidden_api) : hidden_api_(hidden_api) {}
 
   // Iterate over the dex files associated with the passed resolvers to report
-  // hidden API uses.
-  void Run(const std::vector<std::unique_ptr<VeridexResolver>>& app_resolvers);
+  // hidden API uses, on `num_threads` threads. The resolvers must have resolved
+  // their types and members.
+  void Run(const std::vector<std::unique_ptr<VeridexResolver>>& app_resolvers,
+           size_t num_threads);
 
   void Dump(std::ostream& os, HiddenApiStats* stats, bool dump_reflection);
 
  private:
-  void CollectAccesses(VeridexResolver* resolver);
+  void CollectTypeAccesses(VeridexResolver* resolver);
+  void CollectAccesses(const ClassDefRange& range);
+  // Append the accesses found by `other`, which looked at code after the code we looked at.
+  void Merge(const HiddenApiFinder& other);
   void CheckMethod(uint32_t method_idx, VeridexResolver* resolver, MethodReference ref);
   void CheckField(uint32_t field_idx, VeridexResolver* resolver, MethodReference ref);
 
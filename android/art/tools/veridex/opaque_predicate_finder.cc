@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "opaque_predicate_finder.h"
+
+#include "base/parallel_for.h"
+#include "dex/dex_file-inl.h"
+#include "flow_analysis.h"
+#include "resolver.h"
+
+#include <string>
+
+namespace art {
+
+void OpaquePredicateFinder::Run(const std::vector<std::unique_ptr<VeridexResolver>>& resolvers,
+                                size_t num_threads) {
+  std::vector<ClassDefRange> ranges = SplitClassDefs(resolvers);
+  std::vector<Tallies> range_tallies(ranges.size());
+  ParallelFor(ranges.size(), num_threads, [&](size_t i) {
+    CollectPredicates(ranges[i], &range_tallies[i]);
+  });
+  // Add up the tallies of the ranges of each dex file.
+  size_t range_index = 0;
+  for (const std::unique_ptr<VeridexResolver>& resolver : resolvers) {
+    tallies_.emplace_back(&resolver->GetDexFile(), Tallies());
+    Tallies* tallies = &tallies_.back().second;
+    for (; range_index != ranges.size() && ranges[range_index].resolver == resolver.get();
+         ++range_index) {
+      for (const auto& entry : range_tallies[range_index].if_counts) {
+        tallies->if_counts[entry.first] += entry.second;
+      }
+      for (const auto& entry : range_tallies[range_index].sget_counts) {
+        tallies->sget_counts[entry.first] += entry.second;
+      }
+    }
+  }
+}
+
+void OpaquePredicateFinder::CollectPredicates(const ClassDefRange& range, Tallies* tallies) {
+  VeridexResolver* resolver = range.resolver;
+  const DexFile& dex_file = resolver->GetDexFile();
+  for (uint32_t class_def_index = range.begin; class_def_index < range.end; ++class_def_index) {
+    const uint8_t* class_data = dex_file.GetClassData(dex_file.GetClassDef(class_def_index));
+    if (class_data == nullptr) {
+      // Empty class.
+      continue;
+    }
+    ClassDataItemIterator it(dex_file, class_data);
+    it.SkipAllFields();
+    for (; it.HasNextMethod(); it.Next()) {
+      if (it.GetMethodCodeItem() == nullptr) {
+        continue;
+      }
+      OpaquePredicateCollector collector(resolver, it);
+      collector.Run();
+      for (const auto& entry : collector.GetIfUses()) {
+        for (uint32_t field_index : entry.second) {
+          ++tallies->if_counts[field_index];
+        }
+      }
+      for (const auto& entry : collector.GetFieldSetUses()) {
+        ++tallies->sget_counts[entry.second];
+      }
+    }
+  }
+}
+
+static std::string EscapeJson(const std::string& str) {
+  std::string result;
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      result += '\\';
+    }
+    result += c;
+  }
+  return result;
+}
+
+void OpaquePredicateFinder::Dump(std::ostream& os) {
+  os << "[" << std::endl;
+  for (size_t i = 0; i != tallies_.size(); ++i) {
+    const Tallies& tallies = tallies_[i].second;
+    os << "  {" << std::endl;
+    os << "    \"dex_file\" : \"" << EscapeJson(tallies_[i].first->GetLocation()) << "\","
+       << std::endl;
+    os << "    \"if\" : [";
+    const char* separator = "";
+    for (const auto& entry : tallies.if_counts) {
+      os << separator << std::endl
+         << "      {\"field\" : " << entry.first << ", \"count\" : " << entry.second << "}";
+      separator = ",";
+    }
+    os << std::endl << "    ]," << std::endl;
+    os << "    \"sget\" : [";
+    separator = "";
+    for (const auto& entry : tallies.sget_counts) {
+      os << separator << std::endl
+         << "      {\"fields\" : [" << entry.first.first << "," << entry.first.second << "]"
+         << ", \"count\" : " << entry.second << "}";
+      separator = ",";
+    }
+    os << std::endl << "    ]" << std::endl;
+    os << "  }" << (i + 1 != tallies_.size() ? "," : "") << std::endl;
+  }
+  os << "]" << std::endl;
+}
+
+}  // namespace art
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_TOOLS_VERIDEX_OPAQUE_PREDICATE_FINDER_H_
+#define ART_TOOLS_VERIDEX_OPAQUE_PREDICATE_FINDER_H_
+
+#include <iostream>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace art {
+
+class DexFile;
+class VeridexResolver;
+struct ClassDefRange;
+
+/**
+ * Reports the private static int fields used by opaque predicates, with the same
+ * field tallies as the HOpaqueIdentification compiler pass.
+ */
+class OpaquePredicateFinder {
+ public:
+  OpaquePredicateFinder() {}
+
+  // Iterate over the dex files associated with the passed resolvers to collect
+  // opaque predicates, on `num_threads` threads. The resolvers must have resolved
+  // their types and members.
+  void Run(const std::vector<std::unique_ptr<VeridexResolver>>& app_resolvers,
+           size_t num_threads);
+
+  // Dump the tallies of each dex file as JSON.
+  void Dump(std::ostream& os);
+
+ private:
+  struct Tallies {
+    // Number of opaque if-* reading each field.
+    std::map<uint32_t, uint32_t> if_counts;
+    // Number of opaque sputs of each field, by the first field they read.
+    std::map<std::pair<uint32_t, uint32_t>, uint32_t> sget_counts;
+  };
+
+  static void CollectPredicates(const ClassDefRange& range, Tallies* tallies);
+
+  std::vector<std::pair<const DexFile*, Tallies>> tallies_;
+};
+
+}  // namespace art
+
+#endif  // ART_TOOLS_VERIDEX_OPAQUE_PREDICATE_FINDER_H_
@@ -16,6 +16,7 @@
 
 #include "precise_hidden_api_finder.h"
 
+#include "base/parallel_for.h"
 #include "dex/code_item_accessors-inl.h"
 #include "dex/dex_instruction-inl.h"
 #include "dex/dex_file.h"
@@ -31,11 +32,19 @@ namespace art {
 
 void PreciseHiddenApiFinder::RunInternal(
     const std::vector<std::unique_ptr<VeridexResolver>>& resolvers,
-    const std::function<void(VeridexResolver*, const ClassDataItemIterator&)>& action) {
-  for (const std::unique_ptr<VeridexResolver>& resolver : resolvers) {
+    size_t num_threads,
+    const std::function<std::vector<ReflectAccessInfo>(
+        VeridexResolver*, const ClassDataItemIterator&)>& action) {
+  std::vector<ClassDefRange> ranges = SplitClassDefs(resolvers);
+  std::vector<std::unique_ptr<PreciseHiddenApiFinder>> range_finders(ranges.size());
+  ParallelFor(ranges.size(), num_threads, [&](size_t i) {
+    PreciseHiddenApiFinder* range_finder = new PreciseHiddenApiFinder(hidden_api_);
+    range_finders[i].reset(range_finder);
+    VeridexResolver* resolver = ranges[i].resolver;
     const DexFile& dex_file = resolver->GetDexFile();
-    size_t class_def_count = dex_file.NumClassDefs();
-    for (size_t class_def_index = 0; class_def_index < class_def_count; ++class_def_index) {
+    for (uint32_t class_def_index = ranges[i].begin;
+         class_def_index < ranges[i].end;
+         ++class_def_index) {
       const DexFile::ClassDef& class_def = dex_file.GetClassDef(class_def_index);
       const uint8_t* class_data = dex_file.GetClassData(class_def);
       if (class_data == nullptr) {
@@ -49,12 +58,29 @@ void PreciseHiddenApiFinder::RunInternal(
         if (code_item == nullptr) {
           continue;
         }
-        action(resolver.get(), it);
+        range_finder->AddUsesAt(action(resolver, it),
+                                MethodReference(&dex_file, it.GetMemberIndex()));
       }
     }
+  });
+  for (const std::unique_ptr<PreciseHiddenApiFinder>& range_finder : range_finders) {
+    Merge(*range_finder);
+  }
+}
+
+static void AppendUses(const std::map<MethodReference, std::vector<ReflectAccessInfo>>& from,
+                       std::map<MethodReference, std::vector<ReflectAccessInfo>>* to) {
+  for (const auto& entry : from) {
+    std::vector<ReflectAccessInfo>& infos = (*to)[entry.first];
+    infos.insert(infos.end(), entry.second.begin(), entry.second.end());
   }
 }
 
+void PreciseHiddenApiFinder::Merge(const PreciseHiddenApiFinder& other) {
+  AppendUses(other.concrete_uses_, &concrete_uses_);
+  AppendUses(other.abstract_uses_, &abstract_uses_);
+}
+
 void PreciseHiddenApiFinder::AddUsesAt(const std::vector<ReflectAccessInfo>& accesses,
                                        MethodReference ref) {
   for (const ReflectAccessInfo& info : accesses) {
@@ -66,12 +92,15 @@ void PreciseHiddenApiFinder::AddUsesAt(const std::vector<ReflectAccessInfo>& acc
   }
 }
 
-void PreciseHiddenApiFinder::Run(const std::vector<std::unique_ptr<VeridexResolver>>& resolvers) {
+void PreciseHiddenApiFinder::Run(const std::vector<std::unique_ptr<VeridexResolver>>& resolvers,
+                                 size_t num_threads) {
   // Collect reflection uses.
-  RunInternal(resolvers, [this] (VeridexResolver* resolver, const ClassDataItemIterator& it) {
+  RunInternal(resolvers,
+              num_threads,
+              [] (VeridexResolver* resolver, const ClassDataItemIterator& it) {
     FlowAnalysisCollector collector(resolver, it);
     collector.Run();
-    AddUsesAt(collector.GetUses(), MethodReference(&resolver->GetDexFile(), it.GetMemberIndex()));
+    return collector.GetUses();
   });
 
   // For non-final reflection uses, do a limited fixed point calculation over the code to try
@@ -84,11 +113,11 @@ void PreciseHiddenApiFinder::Run(const std::vector<std::unique_ptr<VeridexResolv
     std::map<MethodReference, std::vector<ReflectAccessInfo>> current_uses
         = std::move(abstract_uses_);
     RunInternal(resolvers,
-                [this, current_uses] (VeridexResolver* resolver, const ClassDataItemIterator& it) {
+                num_threads,
+                [&current_uses] (VeridexResolver* resolver, const ClassDataItemIterator& it) {
       FlowAnalysisSubstitutor substitutor(resolver, it, current_uses);
       substitutor.Run();
-      AddUsesAt(substitutor.GetUses(),
-                MethodReference(&resolver->GetDexFile(), it.GetMemberIndex()));
+      return substitutor.GetUses();
     });
   }
 }
@@ -20,10 +20,13 @@
 #include "dex/method_reference.h"
 #include "flow_analysis.h"
 
+#include <functional>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
+#include <vector>
 
 namespace art {
 
@@ -39,20 +42,28 @@ class PreciseHiddenApiFinder {
   explicit PreciseHiddenApiFinder(const HiddenApi& hidden_api) : hidden_api_(hidden_api) {}
 
   // Iterate over the dex files associated with the passed resolvers to report
-  // hidden API uses.
-  void Run(const std::vector<std::unique_ptr<VeridexResolver>>& app_resolvers);
+  // hidden API uses, on `num_threads` threads. The resolvers must have resolved
+  // their types and members.
+  void Run(const std::vector<std::unique_ptr<VeridexResolver>>& app_resolvers,
+           size_t num_threads);
 
   void Dump(std::ostream& os, HiddenApiStats* stats);
 
  private:
-  // Run over all methods of all dex files, and call `action` on each.
+  // Run over all methods of all dex files on `num_threads` threads, call `action` on each,
+  // and add the uses it returns. Uses are added in method order whatever the number of threads.
   void RunInternal(
       const std::vector<std::unique_ptr<VeridexResolver>>& resolvers,
-      const std::function<void(VeridexResolver*, const ClassDataItemIterator&)>& action);
+      size_t num_threads,
+      const std::function<std::vector<ReflectAccessInfo>(
+          VeridexResolver*, const ClassDataItemIterator&)>& action);
 
   // Add uses found in method `ref`.
   void AddUsesAt(const std::vector<ReflectAccessInfo>& accesses, MethodReference ref);
 
+  // Append the uses found by `other`, which looked at methods after the ones we looked at.
+  void Merge(const PreciseHiddenApiFinder& other);
+
   const HiddenApi& hidden_api_;
 
   std::map<MethodReference, std::vector<ReflectAccessInfo>> concrete_uses_;
@@ -140,7 +140,11 @@ VeriMethod VeridexResolver::LookupMethodIn(const VeriClass& kls,
     return nullptr;
   }
   if (kls.IsArray()) {
-    // Array classes don't have methods, but inherit the ones in j.l.Object.
+    // Array classes don't have methods, but inherit the ones in j.l.Object. Without a boot
+    // classpath, as with --opaque-predicates, there is no j.l.Object to look into.
+    if (VeriClass::object_ == nullptr) {
+      return nullptr;
+    }
     return LookupMethodIn(*VeriClass::object_, method_name, method_signature);
   }
   // Get the resolver where `kls` is from.
@@ -290,7 +294,9 @@ VeriMethod VeridexResolver::GetMethod(uint32_t method_index) {
     method_info = LookupMethodIn(*kls,
                                  dex_file_.GetMethodName(method_id),
                                  dex_file_.GetMethodSignature(method_id));
-    method_infos_[method_index] = method_info;
+    if (method_info != nullptr) {
+      method_infos_[method_index] = method_info;
+    }
   }
   return method_info;
 }
@@ -308,7 +314,9 @@ VeriField VeridexResolver::GetField(uint32_t field_index) {
     field_info = LookupFieldIn(*kls,
                                dex_file_.GetFieldName(field_id),
                                dex_file_.GetFieldTypeDescriptor(field_id));
-    field_infos_[field_index] = field_info;
+    if (field_info != nullptr) {
+      field_infos_[field_index] = field_info;
+    }
   }
   return field_info;
 }
@@ -333,4 +341,35 @@ void VeridexResolver::ResolveAll() {
   }
 }
 
+void VeridexResolver::ResolveTypes() {
+  for (uint32_t i = 0; i < dex_file_.NumTypeIds(); ++i) {
+    GetVeriClass(dex::TypeIndex(i));
+  }
+}
+
+void VeridexResolver::ResolveMembers() {
+  for (uint32_t i = 0; i < dex_file_.NumMethodIds(); ++i) {
+    GetMethod(i);
+  }
+  for (uint32_t i = 0; i < dex_file_.NumFieldIds(); ++i) {
+    GetField(i);
+  }
+}
+
+std::vector<ClassDefRange> SplitClassDefs(
+    const std::vector<std::unique_ptr<VeridexResolver>>& resolvers) {
+  // Small enough to balance the work between threads, large enough to amortize merging the
+  // results of each range.
+  static constexpr uint32_t kClassDefsPerRange = 64;
+  std::vector<ClassDefRange> ranges;
+  for (const std::unique_ptr<VeridexResolver>& resolver : resolvers) {
+    uint32_t class_def_count = resolver->GetDexFile().NumClassDefs();
+    for (uint32_t begin = 0; begin < class_def_count; begin += kClassDefsPerRange) {
+      ranges.push_back(ClassDefRange {
+          resolver.get(), begin, std::min(begin + kClassDefsPerRange, class_def_count) });
+    }
+  }
+  return ranges;
+}
+
 }  // namespace art
@@ -20,6 +20,9 @@
 #include "dex/dex_file.h"
 #include "veridex.h"
 
+#include <memory>
+#include <vector>
+
 namespace art {
 
 class HiddenApi;
@@ -74,6 +77,15 @@ class VeridexResolver {
   // Resolve all type_id/method_id/field_id.
   void ResolveAll();
 
+  // Resolve all type_id. This updates the type map shared by all resolvers, so it must
+  // not run concurrently with other resolvers.
+  void ResolveTypes();
+
+  // Resolve all method_id/field_id. Once all resolvers have resolved their types, this only
+  // writes to this resolver, so resolvers can resolve their members concurrently. Afterwards,
+  // lookups in this resolver do not modify it and can be done from multiple threads.
+  void ResolveMembers();
+
   // The dex file this resolver is associated to.
   const DexFile& GetDexFile() const {
     return dex_file_;
@@ -95,6 +107,21 @@ class VeridexResolver {
   std::vector<VeriField> field_infos_;
 };
 
+/**
+ * A range of class defs of one dex file, the unit of work of analyses running on
+ * multiple threads.
+ */
+struct ClassDefRange {
+  VeridexResolver* resolver;
+  uint32_t begin;
+  uint32_t end;
+};
+
+// Split the class defs of the dex files of `resolvers` into ranges, in dex file and
+// class def order.
+std::vector<ClassDefRange> SplitClassDefs(
+    const std::vector<std::unique_ptr<VeridexResolver>>& resolvers);
+
 }  // namespace art
 
 #endif  // ART_TOOLS_VERIDEX_RESOLVER_H_
@@ -18,15 +18,20 @@
 
 #include <android-base/file.h>
 
+#include "base/parallel_for.h"
 #include "dex/dex_file.h"
 #include "dex/dex_file_loader.h"
+#include "dex/dex_file_verifier.h"
 #include "hidden_api.h"
 #include "hidden_api_finder.h"
+#include "opaque_predicate_finder.h"
 #include "precise_hidden_api_finder.h"
 #include "resolver.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <sstream>
+#include <thread>
 
 namespace art {
 
@@ -72,6 +77,8 @@ struct VeridexOptions {
   const char* light_greylist = nullptr;
   const char* dark_greylist = nullptr;
   bool precise = true;
+  bool opaque_predicates = false;
+  size_t num_threads = std::max(1u, std::thread::hardware_concurrency());
   int target_sdk_version = 28; /* P */
 };
 
@@ -95,6 +102,8 @@ static void ParseArgs(VeridexOptions* options, int argc, char** argv) {
   static const char* kLightGreylistOption = "--light-greylist=";
   static const char* kImprecise = "--imprecise";
   static const char* kTargetSdkVersion = "--target-sdk-version=";
+  static const char* kOpaquePredicates = "--opaque-predicates";
+  static const char* kJobs = "--jobs=";
 
   for (int i = 0; i < argc; ++i) {
     if (StartsWith(argv[i], kDexFileOption)) {
@@ -111,6 +120,10 @@ static void ParseArgs(VeridexOptions* options, int argc, char** argv) {
       options->precise = false;
     } else if (StartsWith(argv[i], kTargetSdkVersion)) {
       options->target_sdk_version = atoi(Substr(argv[i], strlen(kTargetSdkVersion)));
+    } else if (strcmp(argv[i], kOpaquePredicates) == 0) {
+      options->opaque_predicates = true;
+    } else if (StartsWith(argv[i], kJobs)) {
+      options->num_threads = std::max(1, atoi(Substr(argv[i], strlen(kJobs))));
     }
   }
 }
@@ -131,6 +144,12 @@ class Veridex {
     VeridexOptions options;
     ParseArgs(&options, argc, argv);
     gTargetSdkVersion = options.target_sdk_version;
+    DexFileVerifier::SetDefaultNumThreads(options.num_threads);
+
+    if (options.opaque_predicates) {
+      // Opaque predicates only involve fields of the app, so the boot classpath is not needed.
+      return RunOpaquePredicates(options);
+    }
 
     std::vector<std::string> boot_content;
     std::vector<std::string> app_content;
@@ -164,16 +183,7 @@ class Veridex {
 
     // Cache of types we've seen, for quick class name lookups.
     TypeMap type_map;
-    // Add internally defined primitives.
-    type_map["Z"] = VeriClass::boolean_;
-    type_map["B"] = VeriClass::byte_;
-    type_map["S"] = VeriClass::short_;
-    type_map["C"] = VeriClass::char_;
-    type_map["I"] = VeriClass::integer_;
-    type_map["F"] = VeriClass::float_;
-    type_map["D"] = VeriClass::double_;
-    type_map["J"] = VeriClass::long_;
-    type_map["V"] = VeriClass::void_;
+    AddPrimitiveTypes(type_map);
 
     // Cache of resolvers, to easily query address in memory to VeridexResolver.
     DexResolverMap resolver_map;
@@ -214,18 +224,19 @@ class Veridex {
 
     std::vector<std::unique_ptr<VeridexResolver>> app_resolvers;
     Resolve(app_dex_files, resolver_map, type_map, &app_resolvers);
+    ResolveIds(boot_resolvers, app_resolvers, options.num_threads);
 
     // Find and log uses of hidden APIs.
     HiddenApi hidden_api(options.blacklist, options.dark_greylist, options.light_greylist);
     HiddenApiStats stats;
 
     HiddenApiFinder api_finder(hidden_api);
-    api_finder.Run(app_resolvers);
+    api_finder.Run(app_resolvers, options.num_threads);
     api_finder.Dump(std::cout, &stats, !options.precise);
 
     if (options.precise) {
       PreciseHiddenApiFinder precise_api_finder(hidden_api);
-      precise_api_finder.Run(app_resolvers);
+      precise_api_finder.Run(app_resolvers, options.num_threads);
       precise_api_finder.Dump(std::cout, &stats);
     }
 
@@ -240,6 +251,46 @@ class Veridex {
   }
 
  private:
+  static int RunOpaquePredicates(const VeridexOptions& options) {
+    std::vector<std::string> app_content;
+    std::vector<std::unique_ptr<const DexFile>> app_dex_files;
+    std::string error_msg;
+    std::vector<std::string> app_files = Split(options.dex_file, ':');
+    app_content.resize(app_files.size());
+    uint32_t i = 0;
+    for (const std::string& str : app_files) {
+      if (!Load(str, app_content[i++], &app_dex_files, &error_msg)) {
+        LOG(ERROR) << error_msg;
+        return 1;
+      }
+    }
+
+    TypeMap type_map;
+    AddPrimitiveTypes(type_map);
+    DexResolverMap resolver_map;
+    std::vector<std::unique_ptr<VeridexResolver>> app_resolvers;
+    Resolve(app_dex_files, resolver_map, type_map, &app_resolvers);
+    ResolveIds({}, app_resolvers, options.num_threads);
+
+    OpaquePredicateFinder finder;
+    finder.Run(app_resolvers, options.num_threads);
+    finder.Dump(std::cout);
+    return 0;
+  }
+
+  // Add internally defined primitives.
+  static void AddPrimitiveTypes(TypeMap& type_map) {
+    type_map["Z"] = VeriClass::boolean_;
+    type_map["B"] = VeriClass::byte_;
+    type_map["S"] = VeriClass::short_;
+    type_map["C"] = VeriClass::char_;
+    type_map["I"] = VeriClass::integer_;
+    type_map["F"] = VeriClass::float_;
+    type_map["D"] = VeriClass::double_;
+    type_map["J"] = VeriClass::long_;
+    type_map["V"] = VeriClass::void_;
+  }
+
   static void DumpSummaryStats(std::ostream& os, const HiddenApiStats& stats) {
     static const char* kPrefix = "       ";
     os << stats.count << " hidden API(s) used: "
@@ -299,6 +350,24 @@ class Veridex {
       resolver->Run();
     }
   }
+
+  // Resolve the ids of the app dex files up front, so that the analyses only read the
+  // resolvers and can run on multiple threads.
+  static void ResolveIds(const std::vector<std::unique_ptr<VeridexResolver>>& boot_resolvers,
+                         const std::vector<std::unique_ptr<VeridexResolver>>& app_resolvers,
+                         size_t num_threads) {
+    // Resolving types can add array classes to the shared type map, so do it on one thread.
+    // Boot classpath types are looked up when resolving the members of app classes.
+    for (const std::unique_ptr<VeridexResolver>& resolver : boot_resolvers) {
+      resolver->ResolveTypes();
+    }
+    for (const std::unique_ptr<VeridexResolver>& resolver : app_resolvers) {
+      resolver->ResolveTypes();
+    }
+    ParallelFor(app_resolvers.size(), num_threads, [&](size_t i) {
+      app_resolvers[i]->ResolveMembers();
+    });
+  }
 };
 
 }  // namespace art
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "android-base/file.h"
+#include "android-base/stringprintf.h"
+
+#include "common_runtime_test.h"
+#include "dex/dex_file-inl.h"
+
+namespace art {
+
+class VeridexTest : public CommonRuntimeTest {
+ protected:
+  // Run veridex with `args` and return what it printed on stdout.
+  std::string RunVeridex(const std::vector<std::string>& args) {
+    std::string file_path = GetTestAndroidRoot() + "/bin/veridex";
+    EXPECT_TRUE(OS::FileExists(file_path.c_str())) << file_path << " should be a valid file path";
+    std::vector<std::string> exec_argv = { file_path };
+    exec_argv.insert(exec_argv.end(), args.begin(), args.end());
+
+    ScratchFile output;
+    pid_t pid = fork();
+    if (pid == 0) {
+      dup2(output.GetFd(), STDOUT_FILENO);
+      std::vector<char*> argv;
+      for (const std::string& arg : exec_argv) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+      }
+      argv.push_back(nullptr);
+      execv(argv[0], &argv[0]);
+      // _exit to avoid atexit handlers in child.
+      _exit(1);
+    }
+    EXPECT_NE(-1, pid) << strerror(errno);
+    int status = 0;
+    EXPECT_EQ(pid, TEMP_FAILURE_RETRY(waitpid(pid, &status, 0)));
+    EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0) << status;
+
+    std::string content;
+    EXPECT_TRUE(android::base::ReadFileToString(output.GetFilename(), &content));
+    return content;
+  }
+
+  static uint32_t GetFieldIndex(const DexFile& dex_file, const char* cls, const char* name) {
+    const DexFile::TypeId* type_id = dex_file.FindTypeId(cls);
+    const DexFile::StringId* name_id = dex_file.FindStringId(name);
+    const DexFile::TypeId* int_type_id = dex_file.FindTypeId("I");
+    CHECK(type_id != nullptr && name_id != nullptr && int_type_id != nullptr);
+    const DexFile::FieldId* field_id = dex_file.FindFieldId(*type_id, *name_id, *int_type_id);
+    CHECK(field_id != nullptr) << name;
+    return dex_file.GetIndexForFieldId(*field_id);
+  }
+
+  static std::string IfEntry(uint32_t field_index, size_t count) {
+    return android::base::StringPrintf("{\"field\" : %u, \"count\" : %zu}", field_index, count);
+  }
+};
+
+TEST_F(VeridexTest, OpaquePredicates) {
+  std::unique_ptr<const DexFile> dex_file = OpenTestDexFile("OpaquePredicates");
+  std::string output = RunVeridex(
+      {"--dex-file=" + GetTestDexFileName("OpaquePredicates"), "--opaque-predicates"});
+
+  // The test dex file has an enum, whose methods call methods of arrays, which must not
+  // need the boot classpath.
+  ASSERT_NE(std::string::npos, output.find("\"dex_file\" : ")) << output;
+
+  const char* kClass = "LOpaquePredicates;";
+  EXPECT_NE(std::string::npos,
+            output.find(IfEntry(GetFieldIndex(*dex_file, kClass, "sOpaque"), 1u))) << output;
+  // Conditions in exception handlers are analyzed too.
+  EXPECT_NE(std::string::npos,
+            output.find(IfEntry(GetFieldIndex(*dex_file, kClass, "sInHandler"), 1u))) << output;
+  // A parameter flows into the condition on the other path, whichever is visited first.
+  std::string one_path = android::base::StringPrintf(
+      "{\"field\" : %u,", GetFieldIndex(*dex_file, kClass, "sOnePath"));
+  EXPECT_EQ(std::string::npos, output.find(one_path)) << output;
+}
+
+}  // namespace art